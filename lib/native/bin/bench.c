@@ -0,0 +1,1171 @@
+/**
+ * @file bench.c
+ * @brief A wrk-style HTTP load generator for measuring the native server.
+ *
+ * Usage:
+ *
+ *     bin/bench [options] http://host:port/path
+ *     bin/bench [options] --scenario router|static
+ *
+ * Each load thread runs its own event loop over an even share of the
+ * connections. A connection keeps `-p` requests in flight, drawn at random
+ * from the request mix, and records the latency of every response from the
+ * moment its request was queued. Latencies go into log-linear histograms
+ * that are merged once the run is over.
+ *
+ * A scenario starts the server itself in a child process on a free port,
+ * runs the load against it with a request mix of its own, and stops it:
+ * `router` serves the routes of `router_setup_test_routes`, and `static`
+ * serves a generated directory with `static_server_run`.
+ */
+#define _GNU_SOURCE
+#include "../lib/core/scan.h"
+#include "../lib/modules/event_loop.h"
+#include "../lib/modules/http.h"
+#include "../lib/modules/server.h"
+#include "../lib/webs_api.h"
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // SIGPIPE is ignored instead.
+#endif
+
+#define MAX_MIX 32
+#define MAX_HEADERS 16
+#define MAX_PIPELINE 64
+#define MAX_EVENTS 256
+#define TICK_MS 50
+#define IN_BUFFER (16 * 1024)
+#define MAX_HEAD (64 * 1024)
+
+// Latency histogram: exact below 2^SUB_BITS microseconds, then 2^SUB_BITS
+// buckets per power of two, which keeps every bucket within ~1.6%.
+#define SUB_BITS 6
+#define SUB_COUNT (1 << SUB_BITS)
+#define HISTOGRAM_BUCKETS ((64 - SUB_BITS) * SUB_COUNT)
+
+typedef struct {
+  char method[16];
+  char path[1024];
+  char *body;
+  int weight;
+  char *raw; // The request as sent.
+  size_t raw_len;
+} MixEntry;
+
+typedef struct {
+  const char *url;
+  char host[256];
+  char port[16];
+  char path[1024];
+  int connections;
+  int threads;
+  double duration;
+  int depth;
+  int timeout_ms;
+  MixEntry mix[MAX_MIX];
+  int mix_count;
+  int total_weight;
+  const char *headers[MAX_HEADERS];
+  int header_count;
+  const char *scenario;
+  const char *server_options;
+  struct addrinfo *address;
+} BenchConfig;
+
+typedef struct {
+  uint64_t buckets[HISTOGRAM_BUCKETS];
+  uint64_t count;
+  uint64_t max;
+  double sum;
+  double sum_squares;
+} Histogram;
+
+typedef struct {
+  Histogram latency;
+  uint64_t requests;
+  uint64_t bytes;
+  uint64_t status[6]; // Indexed by the first digit of the status code.
+  uint64_t connect_errors;
+  uint64_t read_errors;
+  uint64_t write_errors;
+  uint64_t timeouts;
+  uint64_t parse_errors;
+} BenchStats;
+
+typedef enum {
+  PARSE_HEAD,
+  PARSE_BODY,
+  PARSE_UNTIL_CLOSE,
+  PARSE_CHUNK_SIZE,
+  PARSE_CHUNK_DATA,
+  PARSE_TRAILERS,
+} ParseState;
+
+struct LoadThread;
+
+/**
+ * @struct Client
+ * @brief One connection to the server and the requests in flight on it.
+ */
+typedef struct {
+  struct LoadThread *thread;
+  int fd;
+  bool connecting;
+
+  char *out; // Requests queued but not yet written.
+  size_t out_len;
+  size_t out_sent;
+  size_t out_capacity;
+
+  char *in; // Received bytes not yet parsed, from `in_pos`.
+  size_t in_pos;
+  size_t in_len;
+  size_t in_capacity;
+
+  ParseState state;
+  uint64_t remaining; // Body or chunk bytes still to skip.
+  int status;
+  bool close_after; // The server asked to close after this response.
+
+  uint64_t sent_at[MAX_PIPELINE]; // Ring of queue times, oldest first.
+  int oldest;
+  int in_flight;
+} Client;
+
+typedef struct LoadThread {
+  const BenchConfig *config;
+  pthread_t thread;
+  EventLoop *loop;
+  Client *clients;
+  int client_count;
+  uint64_t rng;
+  BenchStats stats;
+} LoadThread;
+
+static atomic_bool stop_requested;
+
+static uint64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+// --- Histogram ---
+
+static int histogram_bucket(uint64_t value) {
+  if (value < SUB_COUNT)
+    return (int)value;
+  int msb = 63 - __builtin_clzll(value);
+  int shift = msb - SUB_BITS;
+  return (shift + 1) * SUB_COUNT + (int)((value >> shift) - SUB_COUNT);
+}
+
+/**
+ * @brief Returns the largest value that falls into `bucket`.
+ */
+static uint64_t histogram_bucket_max(int bucket) {
+  if (bucket < SUB_COUNT)
+    return (uint64_t)bucket;
+  int shift = bucket / SUB_COUNT - 1;
+  uint64_t base = (uint64_t)(bucket % SUB_COUNT + SUB_COUNT) << shift;
+  return base + ((uint64_t)1 << shift) - 1;
+}
+
+static void histogram_record(Histogram *h, uint64_t value) {
+  h->buckets[histogram_bucket(value)]++;
+  h->count++;
+  if (value > h->max)
+    h->max = value;
+  h->sum += (double)value;
+  h->sum_squares += (double)value * (double)value;
+}
+
+static void histogram_merge(Histogram *into, const Histogram *from) {
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+    into->buckets[i] += from->buckets[i];
+  into->count += from->count;
+  if (from->max > into->max)
+    into->max = from->max;
+  into->sum += from->sum;
+  into->sum_squares += from->sum_squares;
+}
+
+static uint64_t histogram_percentile(const Histogram *h, double percentile) {
+  if (h->count == 0)
+    return 0;
+  uint64_t rank = (uint64_t)ceil(percentile / 100.0 * (double)h->count);
+  if (rank == 0)
+    rank = 1;
+  uint64_t seen = 0;
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    seen += h->buckets[i];
+    if (seen >= rank) {
+      uint64_t value = histogram_bucket_max(i);
+      return value < h->max ? value : h->max;
+    }
+  }
+  return h->max;
+}
+
+// --- Request mix ---
+
+static bool method_has_body(const char *method) {
+  return strcmp(method, "POST") == 0 || strcmp(method, "PUT") == 0 ||
+         strcmp(method, "PATCH") == 0;
+}
+
+/**
+ * @brief Parses `METHOD PATH [WEIGHT] [BODY]` into the next mix entry.
+ */
+static bool mix_add(BenchConfig *config, const char *spec) {
+  if (config->mix_count == MAX_MIX) {
+    fprintf(stderr, "At most %d requests can be mixed.\n", MAX_MIX);
+    return false;
+  }
+  MixEntry *entry = &config->mix[config->mix_count];
+  memset(entry, 0, sizeof(*entry));
+  int consumed = 0;
+  if (sscanf(spec, "%15s %1023s%n", entry->method, entry->path, &consumed) <
+          2 ||
+      entry->path[0] != '/') {
+    fprintf(stderr, "Invalid request '%s'; expected METHOD /path.\n", spec);
+    return false;
+  }
+  const char *rest = spec + consumed;
+  char *end;
+  long weight = strtol(rest, &end, 10);
+  if (end != rest) {
+    if (weight <= 0) {
+      fprintf(stderr, "Invalid weight in request '%s'.\n", spec);
+      return false;
+    }
+    rest = end;
+  } else {
+    weight = 1;
+  }
+  while (*rest == ' ')
+    rest++;
+  if (*rest)
+    entry->body = strdup(rest);
+  entry->weight = (int)weight;
+  config->total_weight += entry->weight;
+  config->mix_count++;
+  return true;
+}
+
+static void mix_render(BenchConfig *config) {
+  char host[300];
+  bool default_port = strcmp(config->port, "80") == 0;
+  snprintf(host, sizeof(host), "%s%s%s", config->host, default_port ? "" : ":",
+           default_port ? "" : config->port);
+  for (int i = 0; i < config->mix_count; i++) {
+    MixEntry *entry = &config->mix[i];
+    size_t body_len = entry->body ? strlen(entry->body) : 0;
+    FILE *stream = open_memstream(&entry->raw, &entry->raw_len);
+    fprintf(stream, "%s %s HTTP/1.1\r\nHost: %s\r\n", entry->method,
+            entry->path, host);
+    for (int h = 0; h < config->header_count; h++)
+      fprintf(stream, "%s\r\n", config->headers[h]);
+    if (entry->body || method_has_body(entry->method))
+      fprintf(stream, "Content-Length: %zu\r\n", body_len);
+    fputs("\r\n", stream);
+    if (body_len)
+      fwrite(entry->body, 1, body_len, stream);
+    fclose(stream);
+  }
+}
+
+static const MixEntry *mix_pick(LoadThread *thread) {
+  const BenchConfig *config = thread->config;
+  if (config->mix_count == 1)
+    return &config->mix[0];
+  // xorshift64
+  uint64_t x = thread->rng;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  thread->rng = x;
+  int pick = (int)(x % (uint64_t)config->total_weight);
+  for (int i = 0; i < config->mix_count; i++) {
+    pick -= config->mix[i].weight;
+    if (pick < 0)
+      return &config->mix[i];
+  }
+  return &config->mix[config->mix_count - 1];
+}
+
+// --- Connections ---
+
+static bool reserve(char **buffer, size_t *capacity, size_t needed) {
+  if (needed <= *capacity)
+    return true;
+  size_t new_capacity = *capacity ? *capacity : IN_BUFFER;
+  while (new_capacity < needed)
+    new_capacity *= 2;
+  char *grown = realloc(*buffer, new_capacity);
+  if (!grown)
+    return false;
+  *buffer = grown;
+  *capacity = new_capacity;
+  return true;
+}
+
+static void client_close(Client *client) {
+  if (client->fd >= 0) {
+    event_loop_remove(client->thread->loop, client->fd);
+    close(client->fd);
+  }
+  client->fd = -1;
+  client->connecting = false;
+  client->out_len = client->out_sent = 0;
+  client->in_pos = client->in_len = 0;
+  client->state = PARSE_HEAD;
+  client->in_flight = 0;
+  client->oldest = 0;
+}
+
+static bool client_connect(Client *client) {
+  const struct addrinfo *address = client->thread->config->address;
+  int fd = socket(address->ai_family, SOCK_STREAM, 0);
+  if (fd < 0)
+    return false;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (connect(fd, address->ai_addr, address->ai_addrlen) < 0 &&
+      errno != EINPROGRESS) {
+    close(fd);
+    return false;
+  }
+  if (event_loop_add(client->thread->loop, fd,
+                     EVENT_READABLE | EVENT_WRITABLE, client) != OK) {
+    close(fd);
+    return false;
+  }
+  client->fd = fd;
+  client->connecting = true;
+  return true;
+}
+
+/**
+ * @brief Tops the pipeline up to its depth. Requests are only queued here;
+ * `client_flush` writes them.
+ */
+static void client_fill(Client *client) {
+  LoadThread *thread = client->thread;
+  int depth = thread->config->depth;
+  while (client->in_flight < depth && !atomic_load(&stop_requested)) {
+    const MixEntry *entry = mix_pick(thread);
+    if (!reserve(&client->out, &client->out_capacity,
+                 client->out_len + entry->raw_len))
+      return;
+    memcpy(client->out + client->out_len, entry->raw, entry->raw_len);
+    client->out_len += entry->raw_len;
+    client->sent_at[(client->oldest + client->in_flight) % MAX_PIPELINE] =
+        now_us();
+    client->in_flight++;
+  }
+}
+
+static bool client_flush(Client *client) {
+  while (client->out_sent < client->out_len) {
+    ssize_t n = send(client->fd, client->out + client->out_sent,
+                     client->out_len - client->out_sent, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return true;
+      if (errno == EINTR)
+        continue;
+      client->thread->stats.write_errors++;
+      return false;
+    }
+    client->out_sent += (size_t)n;
+  }
+  client->out_len = client->out_sent = 0;
+  return true;
+}
+
+static void client_complete(Client *client) {
+  LoadThread *thread = client->thread;
+  if (client->in_flight > 0) {
+    histogram_record(&thread->stats.latency,
+                     now_us() - client->sent_at[client->oldest]);
+    client->oldest = (client->oldest + 1) % MAX_PIPELINE;
+    client->in_flight--;
+  }
+  thread->stats.requests++;
+  int status_class = client->status / 100;
+  if (status_class >= 1 && status_class <= 5)
+    thread->stats.status[status_class]++;
+  client->state = PARSE_HEAD;
+}
+
+static bool header_is(const char *line, size_t len, const char *name) {
+  size_t name_len = strlen(name);
+  return len > name_len && line[name_len] == ':' &&
+         strncasecmp(line, name, name_len) == 0;
+}
+
+static const char *header_value(const char *line, size_t len, size_t *out) {
+  const char *value = (const char *)memchr(line, ':', len) + 1;
+  const char *end = line + len;
+  while (value < end && (*value == ' ' || *value == '\t'))
+    value++;
+  *out = (size_t)(end - value);
+  return value;
+}
+
+/**
+ * @brief Reads a response head, deciding how its body is framed.
+ * @return The head's length, 0 if it is incomplete, or -1 if it is invalid.
+ */
+static long parse_head(Client *client, const char *p, size_t len) {
+  const char *end = scan_head_end(p, len);
+  if (!end)
+    return len > MAX_HEAD ? -1 : 0;
+  if (len < 12 || strncmp(p, "HTTP/1.", 7) != 0)
+    return -1;
+  client->status = atoi(p + 9);
+  client->close_after = strncmp(p, "HTTP/1.0", 8) == 0;
+  bool chunked = false;
+  bool has_length = false;
+  uint64_t length = 0;
+  const char *line = (const char *)memchr(p, '\n', (size_t)(end + 2 - p)) + 1;
+  while (line < end) {
+    const char *eol = memchr(line, '\n', (size_t)(end + 2 - line));
+    size_t line_len = (size_t)(eol - line);
+    if (line_len && line[line_len - 1] == '\r')
+      line_len--;
+    size_t value_len;
+    if (header_is(line, line_len, "content-length")) {
+      has_length = true;
+      length = strtoull(header_value(line, line_len, &value_len), NULL, 10);
+    } else if (header_is(line, line_len, "transfer-encoding")) {
+      const char *value = header_value(line, line_len, &value_len);
+      chunked = value_len >= 7 && strncasecmp(value, "chunked", 7) == 0;
+    } else if (header_is(line, line_len, "connection")) {
+      const char *value = header_value(line, line_len, &value_len);
+      if (value_len >= 5 && strncasecmp(value, "close", 5) == 0)
+        client->close_after = true;
+      else if (value_len >= 10 && strncasecmp(value, "keep-alive", 10) == 0)
+        client->close_after = false;
+    }
+    line = eol + 1;
+  }
+
+  if (client->status == 204 || client->status == 304 ||
+      client->status / 100 == 1) {
+    client->state = PARSE_BODY;
+    client->remaining = 0;
+  } else if (chunked) {
+    client->state = PARSE_CHUNK_SIZE;
+  } else if (has_length) {
+    client->state = PARSE_BODY;
+    client->remaining = length;
+  } else {
+    client->state = PARSE_UNTIL_CLOSE;
+    client->close_after = true;
+  }
+  return (long)(end + 4 - p);
+}
+
+/**
+ * @brief Consumes as many whole responses from the input as it holds.
+ * @return false if the connection has to be closed.
+ */
+static bool client_parse(Client *client) {
+  for (;;) {
+    const char *p = client->in + client->in_pos;
+    size_t len = client->in_len - client->in_pos;
+    switch (client->state) {
+    case PARSE_HEAD: {
+      if (len == 0)
+        return true;
+      long head = parse_head(client, p, len);
+      if (head < 0) {
+        client->thread->stats.parse_errors++;
+        return false;
+      }
+      if (head == 0)
+        return true;
+      client->in_pos += (size_t)head;
+      break;
+    }
+    case PARSE_BODY: {
+      size_t skip = client->remaining < len ? (size_t)client->remaining : len;
+      client->in_pos += skip;
+      client->remaining -= skip;
+      if (client->remaining > 0)
+        return true;
+      client_complete(client);
+      if (client->close_after)
+        return false;
+      break;
+    }
+    case PARSE_UNTIL_CLOSE:
+      client->in_pos += len;
+      return true;
+    case PARSE_CHUNK_SIZE:
+    case PARSE_TRAILERS: {
+      const char *eol = memchr(p, '\n', len);
+      if (!eol)
+        return true;
+      client->in_pos += (size_t)(eol + 1 - p);
+      if (client->state == PARSE_TRAILERS) {
+        if (eol == p || (eol == p + 1 && *p == '\r')) {
+          client_complete(client);
+          if (client->close_after)
+            return false;
+        }
+        break;
+      }
+      char *digits_end;
+      uint64_t size = strtoull(p, &digits_end, 16);
+      if (digits_end == p) {
+        client->thread->stats.parse_errors++;
+        return false;
+      }
+      if (size == 0) {
+        client->state = PARSE_TRAILERS;
+      } else {
+        client->state = PARSE_CHUNK_DATA;
+        client->remaining = size + 2; // The data and its CRLF.
+      }
+      break;
+    }
+    case PARSE_CHUNK_DATA: {
+      size_t skip = client->remaining < len ? (size_t)client->remaining : len;
+      client->in_pos += skip;
+      client->remaining -= skip;
+      if (client->remaining > 0)
+        return true;
+      client->state = PARSE_CHUNK_SIZE;
+      break;
+    }
+    }
+  }
+}
+
+/**
+ * @brief Reads until the socket would block.
+ * @return false if the connection has to be closed.
+ */
+static bool client_read(Client *client) {
+  LoadThread *thread = client->thread;
+  for (;;) {
+    if (client->in_pos == client->in_len) {
+      client->in_pos = client->in_len = 0;
+    } else if (client->in_len == client->in_capacity && client->in_pos > 0) {
+      memmove(client->in, client->in + client->in_pos,
+              client->in_len - client->in_pos);
+      client->in_len -= client->in_pos;
+      client->in_pos = 0;
+    }
+    if (!reserve(&client->in, &client->in_capacity, client->in_len + 4096)) {
+      thread->stats.read_errors++;
+      return false;
+    }
+    ssize_t n = recv(client->fd, client->in + client->in_len,
+                     client->in_capacity - client->in_len, 0);
+    if (n > 0) {
+      thread->stats.bytes += (uint64_t)n;
+      client->in_len += (size_t)n;
+      if (!client_parse(client))
+        return false;
+      continue;
+    }
+    if (n == 0) {
+      // A body delimited by the end of the connection is now complete.
+      if (client->state == PARSE_UNTIL_CLOSE)
+        client_complete(client);
+      else if (client->in_flight > 0)
+        thread->stats.read_errors++;
+      return false;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return true;
+    if (errno == EINTR)
+      continue;
+    thread->stats.read_errors++;
+    return false;
+  }
+}
+
+static void client_reconnect(Client *client) {
+  client_close(client);
+  if (atomic_load(&stop_requested))
+    return;
+  if (!client_connect(client))
+    client->thread->stats.connect_errors++;
+}
+
+static void client_event(Client *client, int events) {
+  if (client->connecting) {
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+    getsockopt(client->fd, SOL_SOCKET, SO_ERROR, &error, &error_len);
+    if (error) {
+      client->thread->stats.connect_errors++;
+      client_close(client); // Retried on the next tick.
+      return;
+    }
+    if (!(events & EVENT_WRITABLE))
+      return;
+    client->connecting = false;
+    client_fill(client);
+  }
+  if ((events & EVENT_READABLE) && !client_read(client)) {
+    client_reconnect(client);
+    return;
+  }
+  client_fill(client);
+  if (!client_flush(client))
+    client_reconnect(client);
+}
+
+/**
+ * @brief Reconnects clients that failed to connect and drops requests that
+ * have waited longer than the timeout.
+ */
+static void load_thread_tick(LoadThread *thread) {
+  uint64_t now = now_us();
+  uint64_t timeout = (uint64_t)thread->config->timeout_ms * 1000u;
+  for (int i = 0; i < thread->client_count; i++) {
+    Client *client = &thread->clients[i];
+    if (client->fd < 0) {
+      if (!client_connect(client))
+        thread->stats.connect_errors++;
+    } else if (client->in_flight > 0 &&
+               now - client->sent_at[client->oldest] > timeout) {
+      thread->stats.timeouts += (uint64_t)client->in_flight;
+      client_reconnect(client);
+    }
+  }
+}
+
+static void *load_thread_run(void *arg) {
+  LoadThread *thread = arg;
+  LoopEvent events[MAX_EVENTS];
+  for (int i = 0; i < thread->client_count; i++) {
+    Client *client = &thread->clients[i];
+    client->thread = thread;
+    client->fd = -1;
+    if (!client_connect(client))
+      thread->stats.connect_errors++;
+  }
+  uint64_t next_tick = now_us() + TICK_MS * 1000u;
+  while (!atomic_load(&stop_requested)) {
+    int count = event_loop_wait(thread->loop, events, MAX_EVENTS, TICK_MS);
+    if (count < 0)
+      break;
+    for (int i = 0; i < count; i++)
+      client_event(events[i].data, events[i].events);
+    if (now_us() >= next_tick) {
+      load_thread_tick(thread);
+      next_tick = now_us() + TICK_MS * 1000u;
+    }
+  }
+  for (int i = 0; i < thread->client_count; i++) {
+    client_close(&thread->clients[i]);
+    free(thread->clients[i].in);
+    free(thread->clients[i].out);
+  }
+  return NULL;
+}
+
+// --- Reporting ---
+
+static void format_us(char *out, size_t size, double us) {
+  if (us < 1000.0)
+    snprintf(out, size, "%.0fus", us);
+  else if (us < 1000000.0)
+    snprintf(out, size, "%.2fms", us / 1000.0);
+  else
+    snprintf(out, size, "%.2fs", us / 1000000.0);
+}
+
+static void format_bytes(char *out, size_t size, double bytes) {
+  static const char *units[] = {"B", "KB", "MB", "GB", "TB"};
+  int unit = 0;
+  while (bytes >= 1024.0 && unit < 4) {
+    bytes /= 1024.0;
+    unit++;
+  }
+  snprintf(out, size, "%.2f%s", bytes, units[unit]);
+}
+
+static void report(const BenchConfig *config, const BenchStats *stats,
+                   double elapsed) {
+  const Histogram *h = &stats->latency;
+  double mean = h->count ? h->sum / (double)h->count : 0.0;
+  double variance =
+      h->count ? h->sum_squares / (double)h->count - mean * mean : 0.0;
+  char avg[32], stdev[32], max[32];
+  format_us(avg, sizeof(avg), mean);
+  format_us(stdev, sizeof(stdev), variance > 0 ? sqrt(variance) : 0.0);
+  format_us(max, sizeof(max), (double)h->max);
+  printf("  Latency   %10s %10s %10s  (avg, stdev, max)\n", avg, stdev, max);
+
+  static const double percentiles[] = {50, 75, 90, 99, 99.9, 99.99};
+  printf("  Latency distribution\n");
+  for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+    char value[32];
+    format_us(value, sizeof(value),
+              (double)histogram_percentile(h, percentiles[i]));
+    printf("  %7g%% %10s\n", percentiles[i], value);
+  }
+
+  char read[32], rate[32];
+  format_bytes(read, sizeof(read), (double)stats->bytes);
+  format_bytes(rate, sizeof(rate), (double)stats->bytes / elapsed);
+  printf("  %llu requests in %.2fs, %s read\n",
+         (unsigned long long)stats->requests, elapsed, read);
+  printf("  Responses: 1xx %llu, 2xx %llu, 3xx %llu, 4xx %llu, 5xx %llu\n",
+         (unsigned long long)stats->status[1],
+         (unsigned long long)stats->status[2],
+         (unsigned long long)stats->status[3],
+         (unsigned long long)stats->status[4],
+         (unsigned long long)stats->status[5]);
+  if (stats->connect_errors || stats->read_errors || stats->write_errors ||
+      stats->timeouts || stats->parse_errors)
+    printf("  Errors: connect %llu, read %llu, write %llu, timeout %llu, "
+           "parse %llu\n",
+           (unsigned long long)stats->connect_errors,
+           (unsigned long long)stats->read_errors,
+           (unsigned long long)stats->write_errors,
+           (unsigned long long)stats->timeouts,
+           (unsigned long long)stats->parse_errors);
+  printf("Requests/sec: %12.2f\n", (double)stats->requests / elapsed);
+  printf("Transfer/sec: %12s\n", rate);
+  (void)config;
+}
+
+// --- Load ---
+
+static int run_load(BenchConfig *config) {
+  LoadThread *threads = calloc((size_t)config->threads, sizeof(LoadThread));
+  Client *clients = calloc((size_t)config->connections, sizeof(Client));
+  if (!threads || !clients) {
+    free(threads);
+    free(clients);
+    fprintf(stderr, "Out of memory.\n");
+    return 1;
+  }
+
+  printf("Running %.0fs test @ %s\n", config->duration, config->url);
+  printf("  %d threads and %d connections, pipeline depth %d\n",
+         config->threads, config->connections, config->depth);
+
+  atomic_store(&stop_requested, false);
+  int assigned = 0;
+  int started = 0;
+  for (int t = 0; t < config->threads; t++) {
+    LoadThread *thread = &threads[t];
+    int share = config->connections / config->threads +
+                (t < config->connections % config->threads ? 1 : 0);
+    thread->config = config;
+    thread->clients = clients + assigned;
+    thread->client_count = share;
+    thread->rng = 0x9e3779b97f4a7c15ull * (uint64_t)(t + 1);
+    assigned += share;
+    thread->loop = event_loop();
+    if (!thread->loop ||
+        pthread_create(&thread->thread, NULL, load_thread_run, thread) != 0) {
+      fprintf(stderr, "Failed to start load thread %d.\n", t);
+      event_loop_free(thread->loop);
+      thread->loop = NULL;
+      break;
+    }
+    started++;
+  }
+
+  uint64_t start = now_us();
+  struct timespec duration = {
+      .tv_sec = (time_t)config->duration,
+      .tv_nsec = (long)((config->duration - (double)(time_t)config->duration) *
+                        1e9)};
+  while (started == config->threads &&
+         nanosleep(&duration, &duration) < 0 && errno == EINTR)
+    ;
+  atomic_store(&stop_requested, true);
+
+  BenchStats total = {0};
+  for (int t = 0; t < started; t++) {
+    LoadThread *thread = &threads[t];
+    pthread_join(thread->thread, NULL);
+    event_loop_free(thread->loop);
+    const BenchStats *stats = &thread->stats;
+    histogram_merge(&total.latency, &stats->latency);
+    total.requests += stats->requests;
+    total.bytes += stats->bytes;
+    for (int i = 0; i < 6; i++)
+      total.status[i] += stats->status[i];
+    total.connect_errors += stats->connect_errors;
+    total.read_errors += stats->read_errors;
+    total.write_errors += stats->write_errors;
+    total.timeouts += stats->timeouts;
+    total.parse_errors += stats->parse_errors;
+  }
+  double elapsed = (double)(now_us() - start) / 1e6;
+  free(threads);
+  free(clients);
+  if (started != config->threads)
+    return 1;
+
+  report(config, &total, elapsed);
+  return total.requests > 0 ? 0 : 1;
+}
+
+// --- Scenarios ---
+
+typedef struct {
+  const char *name;
+  const char *description;
+  const char *mix[8];
+  int (*serve)(int port, const char *dir, const char *options);
+  bool (*prepare)(const char *dir);
+} Scenario;
+
+static Server *scenario_server;
+static Router *scenario_router;
+
+static void scenario_stop(int signal_number) {
+  (void)signal_number;
+  if (scenario_server)
+    scenario_server->stop(scenario_server);
+}
+
+static void scenario_router_handler(int client_fd, const char *raw_request) {
+  HttpRequest request;
+  char *error = NULL;
+  if (http_request_parse(raw_request, W->server->requestLength(), &request,
+                         &error) != OK) {
+    W->freeString(error);
+    W->server->writeResponse(client_fd, "HTTP/1.1 400 Bad Request\r\n"
+                                        "Content-Length: 0\r\n\r\n");
+    return;
+  }
+  W->router->handleHttp(scenario_router, client_fd, &request);
+}
+
+static int serve_router(int port, const char *dir, const char *options) {
+  // The test routes open ./api_test.db.
+  if (chdir(dir) != 0)
+    return 1;
+  scenario_server = W->server->start("127.0.0.1", port);
+  if (!scenario_server)
+    return 1;
+  if (options) {
+    char *error = NULL;
+    if (W->server->configure(scenario_server, options, &error) != OK) {
+      fprintf(stderr, "Invalid server options: %s\n", error);
+      W->freeString(error);
+      return 1;
+    }
+  }
+  scenario_router = W->router->create();
+  router_setup_test_routes(scenario_router);
+  signal(SIGTERM, scenario_stop);
+  int result = scenario_server->listen(scenario_server,
+                                       scenario_router_handler);
+  W->server->destroy(scenario_server);
+  W->router->free(scenario_router);
+  return result;
+}
+
+static bool write_file(const char *dir, const char *name, size_t size) {
+  char path[1024];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  FILE *file = fopen(path, "w");
+  if (!file)
+    return false;
+  for (size_t i = 0; i < size; i++)
+    fputc("abcdefghijklmnopqrstuvwxyz\n"[i % 27], file);
+  return fclose(file) == 0;
+}
+
+static bool prepare_static(const char *dir) {
+  return write_file(dir, "index.html", 2 * 1024) &&
+         write_file(dir, "app.js", 64 * 1024) &&
+         write_file(dir, "video.mp4", 1024 * 1024);
+}
+
+static int serve_static(int port, const char *dir, const char *options) {
+  (void)options;
+  return static_server_run("127.0.0.1", port, dir);
+}
+
+static const Scenario scenarios[] = {
+    {"router", "router_setup_test_routes behind the server",
+     {"GET / 4", "GET /posts/2024/05 3", "GET /users/42 2",
+      "POST /data 1 {\"hello\":\"world\"}", "GET /missing 1"},
+     serve_router,
+     NULL},
+    {"static", "static_server_run over a generated directory",
+     {"GET /index.html 6", "GET /app.js 3", "GET /video.mp4 1",
+      "GET /missing.css 1"},
+     serve_static,
+     prepare_static},
+};
+
+static const Scenario *scenario_find(const char *name) {
+  for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+    if (strcmp(scenarios[i].name, name) == 0)
+      return &scenarios[i];
+  return NULL;
+}
+
+static int reserve_port(void) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in address = {.sin_family = AF_INET,
+                                .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+  socklen_t len = sizeof(address);
+  int port = -1;
+  if (fd >= 0 && bind(fd, (struct sockaddr *)&address, sizeof(address)) == 0 &&
+      getsockname(fd, (struct sockaddr *)&address, &len) == 0)
+    port = ntohs(address.sin_port);
+  if (fd >= 0)
+    close(fd);
+  return port;
+}
+
+static bool wait_for_port(int port, pid_t child) {
+  struct sockaddr_in address = {.sin_family = AF_INET,
+                                .sin_port = htons((uint16_t)port),
+                                .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+  for (int attempt = 0; attempt < 500; attempt++) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int rc = connect(fd, (struct sockaddr *)&address, sizeof(address));
+    close(fd);
+    if (rc == 0)
+      return true;
+    if (waitpid(child, NULL, WNOHANG) == child)
+      return false;
+    usleep(10000);
+  }
+  return false;
+}
+
+static void remove_dir(const char *dir) {
+  DIR *handle = opendir(dir);
+  if (handle) {
+    struct dirent *entry;
+    while ((entry = readdir(handle))) {
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        continue;
+      char path[1024];
+      snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+      unlink(path);
+    }
+    closedir(handle);
+  }
+  rmdir(dir);
+}
+
+static int run_scenario(BenchConfig *config, const Scenario *scenario) {
+  char dir[] = "/tmp/webs-bench-XXXXXX";
+  if (!mkdtemp(dir)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  int result = 1;
+  int port = reserve_port();
+  if (port < 0 || (scenario->prepare && !scenario->prepare(dir))) {
+    fprintf(stderr, "Failed to prepare scenario '%s'.\n", scenario->name);
+    remove_dir(dir);
+    return 1;
+  }
+
+  fflush(stdout);
+  pid_t child = fork();
+  if (child == 0) {
+    // Keep the server's request log out of the report.
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) {
+      dup2(null_fd, STDOUT_FILENO);
+      close(null_fd);
+    }
+    _exit(scenario->serve(port, dir, config->server_options));
+  }
+  if (child < 0) {
+    perror("fork");
+    remove_dir(dir);
+    return 1;
+  }
+
+  char url[64];
+  snprintf(url, sizeof(url), "http://127.0.0.1:%d/", port);
+  config->url = url;
+  snprintf(config->host, sizeof(config->host), "127.0.0.1");
+  snprintf(config->port, sizeof(config->port), "%d", port);
+  if (config->mix_count == 0)
+    for (int i = 0; i < 8 && scenario->mix[i]; i++)
+      mix_add(config, scenario->mix[i]);
+
+  if (!wait_for_port(port, child)) {
+    fprintf(stderr, "The %s server did not start.\n", scenario->name);
+  } else if (getaddrinfo(config->host, config->port,
+                         &(struct addrinfo){.ai_socktype = SOCK_STREAM},
+                         &config->address) == 0) {
+    printf("Scenario '%s': %s\n", scenario->name, scenario->description);
+    mix_render(config);
+    result = run_load(config);
+    freeaddrinfo(config->address);
+  }
+
+  kill(child, SIGTERM);
+  waitpid(child, NULL, 0);
+  remove_dir(dir);
+  return result;
+}
+
+// --- Command line ---
+
+static void usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options] <http://host:port/path>\n"
+          "       %s [options] --scenario <router|static>\n"
+          "\n"
+          "  -c <n>        Connections to keep open (default 64)\n"
+          "  -t <n>        Load threads (default 4)\n"
+          "  -d <seconds>  Test duration (default 10)\n"
+          "  -p <n>        Requests in flight per connection (default 1)\n"
+          "  -r <request>  Add 'METHOD /path [WEIGHT] [BODY]' to the mix;\n"
+          "                repeat to mix requests by weight\n"
+          "  -H <header>   Add a 'Name: value' header to every request\n"
+          "  --timeout <ms>         Per-request timeout (default 2000)\n"
+          "  --scenario <name>      Start a server and load it\n"
+          "  --server-options <json> Options for the router scenario's "
+          "server\n",
+          program, program);
+}
+
+static bool parse_url(BenchConfig *config, const char *url) {
+  if (strncmp(url, "http://", 7) != 0) {
+    fprintf(stderr, "Only http:// URLs are supported.\n");
+    return false;
+  }
+  const char *host = url + 7;
+  const char *path = strchr(host, '/');
+  size_t authority_len = path ? (size_t)(path - host) : strlen(host);
+  const char *colon = memchr(host, ':', authority_len);
+  size_t host_len = colon ? (size_t)(colon - host) : authority_len;
+  if (host_len == 0 || host_len >= sizeof(config->host))
+    return false;
+  memcpy(config->host, host, host_len);
+  config->host[host_len] = '\0';
+  if (colon)
+    snprintf(config->port, sizeof(config->port), "%.*s",
+             (int)(authority_len - host_len - 1), colon + 1);
+  else
+    snprintf(config->port, sizeof(config->port), "80");
+  snprintf(config->path, sizeof(config->path), "%s", path ? path : "/");
+  config->url = url;
+  return true;
+}
+
+int main(int argc, char **argv) {
+  BenchConfig config = {.connections = 64,
+                        .threads = 4,
+                        .duration = 10,
+                        .depth = 1,
+                        .timeout_ms = 2000};
+  const char *url = NULL;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+    bool takes_value = true;
+    if (strcmp(arg, "-c") == 0 && value)
+      config.connections = atoi(value);
+    else if (strcmp(arg, "-t") == 0 && value)
+      config.threads = atoi(value);
+    else if (strcmp(arg, "-d") == 0 && value)
+      config.duration = atof(value);
+    else if (strcmp(arg, "-p") == 0 && value)
+      config.depth = atoi(value);
+    else if (strcmp(arg, "-r") == 0 && value) {
+      if (!mix_add(&config, value))
+        return 1;
+    } else if (strcmp(arg, "-H") == 0 && value) {
+      if (config.header_count == MAX_HEADERS || !strchr(value, ':')) {
+        fprintf(stderr, "Invalid header '%s'.\n", value);
+        return 1;
+      }
+      config.headers[config.header_count++] = value;
+    } else if (strcmp(arg, "--timeout") == 0 && value)
+      config.timeout_ms = atoi(value);
+    else if (strcmp(arg, "--scenario") == 0 && value)
+      config.scenario = value;
+    else if (strcmp(arg, "--server-options") == 0 && value)
+      config.server_options = value;
+    else if (arg[0] != '-' && !url) {
+      url = arg;
+      takes_value = false;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+    if (takes_value)
+      i++;
+  }
+
+  if (config.connections <= 0 || config.threads <= 0 ||
+      config.duration <= 0 || config.depth <= 0 ||
+      config.depth > MAX_PIPELINE || config.timeout_ms <= 0 ||
+      (!url == !config.scenario)) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (config.threads > config.connections)
+    config.threads = config.connections;
+  signal(SIGPIPE, SIG_IGN);
+
+  if (config.scenario) {
+    const Scenario *scenario = scenario_find(config.scenario);
+    if (!scenario) {
+      fprintf(stderr, "Unknown scenario '%s'.\n", config.scenario);
+      return 1;
+    }
+    return run_scenario(&config, scenario);
+  }
+
+  if (!parse_url(&config, url)) {
+    fprintf(stderr, "Invalid URL '%s'.\n", url);
+    return 1;
+  }
+  if (config.mix_count == 0) {
+    char spec[1100];
+    snprintf(spec, sizeof(spec), "GET %s", config.path);
+    mix_add(&config, spec);
+  }
+  struct addrinfo hints = {.ai_socktype = SOCK_STREAM};
+  int rc = getaddrinfo(config.host, config.port, &hints, &config.address);
+  if (rc != 0) {
+    fprintf(stderr, "Cannot resolve %s: %s\n", config.host, gai_strerror(rc));
+    return 1;
+  }
+  mix_render(&config);
+  int result = run_load(&config);
+  freeaddrinfo(config.address);
+  return result;
+}
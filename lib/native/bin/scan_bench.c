@@ -0,0 +1,245 @@
+/**
+ * @file scan_bench.c
+ * @brief Times the vectorised scans in `scan.h` against the byte-at-a-time
+ * parsing they replaced.
+ *
+ * Build with `make bench` and run `bin/scan_bench [iterations]`. Each scan is
+ * timed once per kernel the CPU supports, and the request and cookie parsers
+ * are timed against copies of their previous `strtok_r`-based versions.
+ */
+#define _GNU_SOURCE
+#include "../lib/core/scan.h"
+#include "../lib/modules/cookie.h"
+#include "../lib/modules/http.h"
+#include "../lib/webs_api.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_ITERATIONS 200000
+
+// Defeats dead-code elimination of results the benchmark throws away.
+static volatile size_t sink;
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void report(const char *name, const char *kernel, double elapsed_ns,
+                   long iterations, size_t bytes) {
+  double per_op = elapsed_ns / (double)iterations;
+  double mb_per_s = (double)bytes * (double)iterations / (elapsed_ns / 1e9) /
+                    (1024.0 * 1024.0);
+  printf("%-22s %-8s %10.1f ns/op %10.1f MB/s\n", name, kernel, per_op,
+         mb_per_s);
+}
+
+/**
+ * @brief The request parser as it was before spans: copy the head, split it
+ * with `strtok_r`, and lowercase every header name into an object.
+ */
+static Value *legacy_parse_request(const char *raw_request) {
+  const char *body_start = strstr(raw_request, "\r\n\r\n");
+  size_t headers_len =
+      body_start ? (size_t)(body_start - raw_request) : strlen(raw_request);
+  char *headers_part = strndup(raw_request, headers_len);
+  Value *request = W->object();
+  Value *headers = W->object();
+  W->objectSet(request, "headers", headers);
+
+  char *saveptr = NULL;
+  char *line = strtok_r(headers_part, "\r\n", &saveptr);
+  char *path = line ? strchr(line, ' ') : NULL;
+  char *version = path ? strchr(path + 1, ' ') : NULL;
+  if (!version) {
+    W->freeValue(request);
+    free(headers_part);
+    return NULL;
+  }
+  *path++ = '\0';
+  *version++ = '\0';
+  char *query = strchr(path, '?');
+  if (query)
+    *query++ = '\0';
+  W->objectSet(request, "query", W->string(query ? query : ""));
+  W->objectSet(request, "method", W->string(line));
+  W->objectSet(request, "version", W->string(version));
+  W->objectSet(request, "path", W->string(path));
+
+  while ((line = strtok_r(NULL, "\r\n", &saveptr))) {
+    char *colon = strchr(line, ':');
+    if (!colon)
+      continue;
+    *colon = '\0';
+    char *value = colon + 1;
+    while (*value && isspace((unsigned char)*value))
+      value++;
+    char *value_end = value + strlen(value) - 1;
+    while (value_end > value && isspace((unsigned char)*value_end))
+      *value_end-- = '\0';
+    char *key = strdup(line);
+    for (int i = 0; key[i]; i++)
+      key[i] = (char)tolower((unsigned char)key[i]);
+    W->objectSet(headers, key, W->string(value));
+    free(key);
+  }
+  W->objectSet(request, "body", W->string(""));
+  free(headers_part);
+  return request;
+}
+
+/**
+ * @brief `cookie_parse` as it was before it used `scan_either`.
+ */
+static Value *legacy_cookie_parse(const char *cookie_header) {
+  Value *cookies = W->object();
+  char *header_copy = strdup(cookie_header);
+  char *state;
+  char *pair = strtok_r(header_copy, ";", &state);
+  while (pair) {
+    while (*pair == ' ')
+      pair++;
+    char *equals = strchr(pair, '=');
+    if (equals) {
+      *equals = '\0';
+      W->objectSet(cookies, pair, W->string(equals + 1));
+    }
+    pair = strtok_r(NULL, ";", &state);
+  }
+  free(header_copy);
+  return cookies;
+}
+
+static char *build_request(const char *cookie) {
+  char *request = NULL;
+  asprintf(&request,
+           "GET /assets/app.3f9c2a.js?v=12&lang=en HTTP/1.1\r\n"
+           "Host: www.example.com\r\n"
+           "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 14_5) "
+           "AppleWebKit/605.1.15 (KHTML, like Gecko) Version/17.5 "
+           "Safari/605.1.15\r\n"
+           "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+           "image/avif,image/webp,*/*;q=0.8\r\n"
+           "Accept-Language: en-GB,en;q=0.9\r\n"
+           "Accept-Encoding: gzip, deflate, br\r\n"
+           "Referer: https://www.example.com/dashboard/settings\r\n"
+           "Connection: keep-alive\r\n"
+           "Cache-Control: max-age=0\r\n"
+           "If-None-Match: \"5f2b-18c3a1e2b40\"\r\n"
+           "Sec-Fetch-Dest: script\r\n"
+           "Sec-Fetch-Mode: no-cors\r\n"
+           "Sec-Fetch-Site: same-origin\r\n"
+           "Cookie: %s\r\n"
+           "\r\n",
+           cookie);
+  return request;
+}
+
+static char *build_cookie(int count) {
+  size_t capacity = (size_t)count * 64 + 1;
+  char *cookie = malloc(capacity);
+  size_t len = 0;
+  for (int i = 0; i < count; i++)
+    len += (size_t)snprintf(cookie + len, capacity - len,
+                            "%spref_%02d=%08x%08x%08x", i ? "; " : "", i,
+                            i * 2654435761u, i * 40503u, i * 2246822519u);
+  return cookie;
+}
+
+static void bench_kernels(const char *request, long iterations) {
+  size_t len = strlen(request);
+  const char *end = request + len;
+  double start = now_ns();
+  for (long i = 0; i < iterations; i++)
+    sink += (size_t)memmem(request, len, "\r\n\r\n", 4);
+  report("head end (memmem)", "libc", now_ns() - start, iterations, len);
+
+  static const ScanKernel all[] = {SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2};
+  ScanKernel initial = scan_kernel();
+  for (size_t k = 0; k < sizeof(all) / sizeof(all[0]); k++) {
+    if (!scan_set_kernel(all[k]))
+      continue;
+    const char *name = scan_kernel_name(all[k]);
+
+    start = now_ns();
+    for (long i = 0; i < iterations; i++)
+      sink += (size_t)scan_head_end(request, len);
+    report("head end", name, now_ns() - start, iterations, len);
+
+    start = now_ns();
+    for (long i = 0; i < iterations; i++) {
+      for (const char *p = request; p < end;) {
+        ScanLine line = scan_line(p, end);
+        sink += (size_t)line.colon;
+        p = line.eol + 1;
+      }
+    }
+    report("lines", name, now_ns() - start, iterations, len);
+
+    HttpRequest parsed;
+    char *error = NULL;
+    start = now_ns();
+    for (long i = 0; i < iterations; i++) {
+      http_request_parse(request, len, &parsed, &error);
+      sink += parsed.header_count;
+    }
+    report("request spans", name, now_ns() - start, iterations, len);
+  }
+  scan_set_kernel(initial);
+}
+
+static void bench_parsers(const char *request, const char *cookie,
+                          long iterations) {
+  size_t len = strlen(request);
+  const char *kernel = scan_kernel_name(scan_kernel());
+  double start = now_ns();
+  for (long i = 0; i < iterations; i++)
+    W->freeValue(legacy_parse_request(request));
+  report("request Value (old)", "strtok", now_ns() - start, iterations, len);
+
+  start = now_ns();
+  for (long i = 0; i < iterations; i++) {
+    HttpRequest parsed;
+    char *error = NULL;
+    http_request_parse(request, len, &parsed, &error);
+    W->freeValue(http_request_value(&parsed));
+  }
+  report("request Value", kernel, now_ns() - start, iterations, len);
+
+  size_t cookie_len = strlen(cookie);
+  start = now_ns();
+  for (long i = 0; i < iterations; i++)
+    W->freeValue(legacy_cookie_parse(cookie));
+  report("cookies (old)", "strtok", now_ns() - start, iterations, cookie_len);
+
+  start = now_ns();
+  for (long i = 0; i < iterations; i++)
+    W->freeValue(cookie_parse(cookie));
+  report("cookies", kernel, now_ns() - start, iterations, cookie_len);
+}
+
+int main(int argc, char **argv) {
+  long iterations = argc > 1 ? atol(argv[1]) : DEFAULT_ITERATIONS;
+  if (iterations <= 0) {
+    fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  static const int cookie_counts[] = {2, 24};
+  for (size_t i = 0; i < sizeof(cookie_counts) / sizeof(cookie_counts[0]);
+       i++) {
+    char *cookie = build_cookie(cookie_counts[i]);
+    char *request = build_request(cookie);
+    printf("\n%zu-byte request, %d cookies\n", strlen(request),
+           cookie_counts[i]);
+    bench_kernels(request, iterations);
+    bench_parsers(request, cookie, iterations / 4 ? iterations / 4 : 1);
+    free(request);
+    free(cookie);
+  }
+  return (int)(sink & 0);
+}
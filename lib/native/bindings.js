@@ -36,6 +36,20 @@ export const symbols = {
   },
   webs_object_keys: { args: [FFIType.ptr], returns: FFIType.ptr },
   webs_regex_parse: { args: [FFIType.ptr, FFIType.ptr], returns: FFIType.ptr },
+  webs_scan_set_kernel: { args: [FFIType.int], returns: FFIType.bool },
+  webs_scan_kernel: { args: [], returns: FFIType.int },
+  webs_scan_line: {
+    args: [FFIType.ptr, FFIType.u64, FFIType.ptr],
+    returns: FFIType.void,
+  },
+  webs_scan_head_end: {
+    args: [FFIType.ptr, FFIType.u64],
+    returns: FFIType.i64,
+  },
+  webs_scan_either: {
+    args: [FFIType.ptr, FFIType.u64, FFIType.int, FFIType.int],
+    returns: FFIType.i64,
+  },
   webs_ref: { args: [FFIType.ptr], returns: FFIType.ptr },
   webs_ref_get_value: {
     args: [FFIType.ptr, FFIType.ptr],
@@ -138,6 +152,7 @@ export const symbols = {
     args: [FFIType.ptr, FFIType.ptr],
     returns: FFIType.void,
   },
+  webs_auth_sweep_sessions: { args: [FFIType.ptr], returns: FFIType.bool },
   webs_cookie_parse: { args: [FFIType.ptr], returns: FFIType.ptr },
   webs_cookie_serialize: {
     args: [FFIType.ptr, FFIType.ptr, FFIType.ptr],
@@ -147,6 +162,14 @@ export const symbols = {
   webs_db_close: { args: [FFIType.ptr], returns: FFIType.ptr },
   webs_db_exec: { args: [FFIType.ptr, FFIType.ptr], returns: FFIType.ptr },
   webs_db_query: { args: [FFIType.ptr, FFIType.ptr], returns: FFIType.ptr },
+  webs_test_db_write_async: {
+    args: [FFIType.ptr, FFIType.ptr, FFIType.ptr],
+    returns: FFIType.ptr,
+  },
+  webs_test_db_pool: {
+    args: [FFIType.ptr, FFIType.ptr, FFIType.int, FFIType.bool],
+    returns: FFIType.ptr,
+  },
   webs_free_string: { args: [FFIType.ptr], returns: FFIType.void },
   webs_free_value: { args: [FFIType.ptr], returns: FFIType.void },
   webs_read_file: { args: [FFIType.ptr], returns: FFIType.ptr },
@@ -169,10 +192,15 @@ export const symbols = {
   webs_asset_walk: { args: [FFIType.ptr], returns: FFIType.ptr },
   webs_fetch: { args: [FFIType.ptr, FFIType.ptr], returns: FFIType.ptr },
   webs_server: { args: [FFIType.ptr, FFIType.int], returns: FFIType.ptr },
+  webs_server_configure: {
+    args: [FFIType.ptr, FFIType.ptr],
+    returns: FFIType.ptr,
+  },
   webs_server_listen: {
     args: [FFIType.ptr, FFIType.ptr],
     returns: FFIType.int,
   },
+  webs_server_stats: { args: [FFIType.ptr], returns: FFIType.ptr },
   webs_server_stop: { args: [FFIType.ptr], returns: FFIType.void },
   webs_server_destroy: { args: [FFIType.ptr], returns: FFIType.void },
   webs_server_write_response: {
@@ -192,10 +220,19 @@ export const symbols = {
     args: [FFIType.ptr, FFIType.int, FFIType.ptr],
     returns: FFIType.int,
   },
+  webs_test_server_handler: { args: [], returns: FFIType.ptr },
   webs_router_create: { args: [], returns: FFIType.ptr },
   webs_router_free: { args: [FFIType.ptr], returns: FFIType.void },
   webs_test_run_router_logic: {
     args: [FFIType.ptr, FFIType.ptr],
     returns: FFIType.ptr,
   },
+  webs_test_run_router_raw: {
+    args: [FFIType.ptr, FFIType.ptr],
+    returns: FFIType.ptr,
+  },
+  webs_test_run_router_concurrent: {
+    args: [FFIType.ptr, FFIType.ptr, FFIType.int],
+    returns: FFIType.ptr,
+  },
 };
@@ -0,0 +1,153 @@
+/**
+ * @file arena.c
+ * @brief Implements the per-request bump allocator.
+ */
+#include "arena.h"
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN alignof(max_align_t)
+
+/**
+ * @struct Chunk
+ * @brief A block of memory allocations are bumped out of.
+ */
+typedef struct Chunk {
+  struct Chunk *next; // The chunk allocated before this one.
+  size_t size;        // Usable bytes in `data`.
+  size_t used;        // Bytes handed out from `data`.
+  max_align_t data[];
+} Chunk;
+
+struct Arena {
+  Chunk *head;  // The chunk allocations come from; newest first.
+  Chunk *first; // The oldest chunk, kept across resets.
+  size_t chunk_size;
+  size_t used;
+  void *last; // The most recent allocation, which can grow in place.
+};
+
+static _Thread_local Arena *current_arena = NULL;
+
+static size_t align_up(size_t size) {
+  return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+static char *chunk_data(Chunk *chunk) { return (char *)chunk->data; }
+
+Arena *arena(size_t chunk_size) {
+  Arena *arena = calloc(1, sizeof(Arena));
+  if (!arena)
+    return NULL;
+  arena->chunk_size = align_up(chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK);
+  return arena;
+}
+
+void arena_free(Arena *arena) {
+  if (!arena)
+    return;
+  Chunk *chunk = arena->head;
+  while (chunk) {
+    Chunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  if (current_arena == arena)
+    current_arena = NULL;
+  free(arena);
+}
+
+void arena_reset(Arena *arena) {
+  if (!arena)
+    return;
+  Chunk *chunk = arena->head;
+  while (chunk && chunk != arena->first) {
+    Chunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  // A first chunk sized for one large allocation is not worth keeping.
+  if (chunk && chunk->size != arena->chunk_size) {
+    free(chunk);
+    chunk = NULL;
+  }
+  if (chunk)
+    chunk->used = 0;
+  arena->head = chunk;
+  arena->first = chunk;
+  arena->used = 0;
+  arena->last = NULL;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+  size_t rounded = align_up(size ? size : 1);
+  if (rounded < size)
+    return NULL;
+  Chunk *chunk = arena->head;
+  if (!chunk || chunk->size - chunk->used < rounded) {
+    size_t chunk_size = rounded > arena->chunk_size ? rounded
+                                                    : arena->chunk_size;
+    if (chunk_size > SIZE_MAX - sizeof(Chunk))
+      return NULL;
+    chunk = malloc(sizeof(Chunk) + chunk_size);
+    if (!chunk)
+      return NULL;
+    chunk->size = chunk_size;
+    chunk->used = 0;
+    chunk->next = arena->head;
+    arena->head = chunk;
+    if (!arena->first)
+      arena->first = chunk;
+  }
+  void *pointer = chunk_data(chunk) + chunk->used;
+  chunk->used += rounded;
+  arena->used += rounded;
+  arena->last = pointer;
+  return pointer;
+}
+
+void *arena_grow(Arena *arena, void *pointer, size_t old_size,
+                 size_t new_size) {
+  if (!pointer)
+    return arena_alloc(arena, new_size);
+  if (new_size <= old_size)
+    return pointer;
+  if (pointer == arena->last) {
+    Chunk *chunk = arena->head;
+    size_t offset = (size_t)((char *)pointer - chunk_data(chunk));
+    size_t rounded = align_up(new_size);
+    if (rounded >= new_size && rounded <= chunk->size - offset) {
+      arena->used += rounded - (chunk->used - offset);
+      chunk->used = offset + rounded;
+      return pointer;
+    }
+  }
+  void *grown = arena_alloc(arena, new_size);
+  if (grown)
+    memcpy(grown, pointer, old_size);
+  return grown;
+}
+
+bool arena_owns(const Arena *arena, const void *pointer) {
+  const char *p = pointer;
+  for (Chunk *chunk = arena->head; chunk; chunk = chunk->next) {
+    const char *data = (const char *)chunk->data;
+    if (p >= data && p < data + chunk->used)
+      return true;
+  }
+  return false;
+}
+
+size_t arena_used(const Arena *arena) { return arena ? arena->used : 0; }
+
+Arena *arena_enter(Arena *arena) {
+  Arena *previous = current_arena;
+  current_arena = arena;
+  return previous;
+}
+
+void arena_leave(Arena *previous) { current_arena = previous; }
+
+Arena *arena_current(void) { return current_arena; }
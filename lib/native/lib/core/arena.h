@@ -0,0 +1,97 @@
+/**
+ * @file arena.h
+ * @brief Defines a bump allocator for memory that lives as long as one
+ * request.
+ *
+ * An arena hands out memory from large chunks by bumping a pointer, and
+ * releases all of it at once with `arena_reset`, which keeps the first chunk
+ * for the next request. Individual allocations are never freed.
+ *
+ * A thread can make an arena current with `arena_enter`. While one is
+ * current, the core allocator in `memory.h` draws from it, so every `Value`
+ * built on that thread (strings, arrays, objects and their maps) belongs to
+ * the arena, and `value_free` on such a value releases nothing. Values that
+ * must outlive the request have to be built, or cloned, with no arena
+ * current. A heap array or object changed while one is current keeps its
+ * entries and keys on the heap, but the values put into it must not be
+ * built inside the arena either.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief The chunk size used when `arena` is passed 0.
+ */
+#define ARENA_DEFAULT_CHUNK (16 * 1024)
+
+typedef struct Arena Arena;
+
+/**
+ * @brief Creates an empty arena. No memory is reserved until the first
+ * allocation.
+ * @param chunk_size The size of each chunk, or 0 for `ARENA_DEFAULT_CHUNK`.
+ * Larger allocations get a chunk of their own.
+ * @return A new `Arena`, or NULL on allocation failure.
+ */
+Arena *arena(size_t chunk_size);
+
+/**
+ * @brief Frees the arena and everything allocated from it.
+ */
+void arena_free(Arena *arena);
+
+/**
+ * @brief Releases everything allocated from the arena. The first chunk is
+ * kept for reuse; any others go back to the system.
+ */
+void arena_reset(Arena *arena);
+
+/**
+ * @brief Allocates `size` bytes, aligned for any type.
+ * @return The memory, or NULL on allocation failure.
+ */
+void *arena_alloc(Arena *arena, size_t size);
+
+/**
+ * @brief Resizes an allocation, in place if it is the arena's most recent
+ * one and there is room, by copying otherwise.
+ * @param pointer The allocation, or NULL to allocate afresh.
+ * @param old_size Its current size.
+ * @param new_size The size wanted.
+ * @return The resized memory, or NULL on allocation failure.
+ */
+void *arena_grow(Arena *arena, void *pointer, size_t old_size,
+                 size_t new_size);
+
+/**
+ * @brief Reports whether `pointer` lies in memory handed out by the arena.
+ */
+bool arena_owns(const Arena *arena, const void *pointer);
+
+/**
+ * @brief Returns the number of bytes handed out since the last reset.
+ */
+size_t arena_used(const Arena *arena);
+
+/**
+ * @brief Makes `arena` the calling thread's current arena.
+ * @param arena The arena, or NULL to allocate from the heap again.
+ * @return The previously current arena, to be passed to `arena_leave`.
+ */
+Arena *arena_enter(Arena *arena);
+
+/**
+ * @brief Restores the arena that was current before `arena_enter`.
+ */
+void arena_leave(Arena *previous);
+
+/**
+ * @brief Returns the calling thread's current arena, or NULL.
+ */
+Arena *arena_current(void);
+
+#endif // ARENA_H
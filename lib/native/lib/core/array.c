@@ -3,6 +3,7 @@
  * @brief Implements the Array type, a dynamic array for `Value` pointers.
  */
 #include "array.h"
+#include "memory.h"
 #include "../webs_api.h"
 #include <stdlib.h>
 
@@ -17,7 +18,8 @@ static Status array_push_method(Array *self, Value *element) {
   if (self->count >= self->capacity) {
     size_t new_capacity = self->capacity == 0 ? 8 : self->capacity * 2;
     Value **new_elements =
-        realloc(self->elements, sizeof(Value *) * new_capacity);
+        GROW_ARRAY_FOR(self, Value *, self->elements, self->capacity,
+                       new_capacity);
     if (!new_elements) {
       return ERROR_MEMORY;
     }
@@ -33,13 +35,13 @@ static Status array_push_method(Array *self, Value *element) {
  * @brief Creates a new `Value` of type `VALUE_ARRAY`.
  */
 Value *array_value(void) {
-  Value *val = malloc(sizeof(Value));
+  Value *val = ALLOCATE(Value, 1);
   if (!val)
     return NULL;
   val->type = VALUE_ARRAY;
   val->as.array = array();
   if (!val->as.array) {
-    free(val);
+    FREE(Value, val);
     return NULL;
   }
   return val;
@@ -49,7 +51,7 @@ Value *array_value(void) {
  * @brief Creates a new heap-allocated `Array` struct.
  */
 Array *array(void) {
-  Array *array = malloc(sizeof(Array));
+  Array *array = ALLOCATE(Array, 1);
   if (!array)
     return NULL;
 
@@ -69,8 +71,8 @@ void array_free(Array *array) {
   for (size_t i = 0; i < array->count; i++) {
     W->freeValue(array->elements[i]);
   }
-  free(array->elements);
-  free(array);
+  FREE_ARRAY(Value *, array->elements, array->capacity);
+  FREE(Array, array);
 }
 
 /**
@@ -1,8 +1,9 @@
 #include "boolean.h"
+#include "memory.h"
 #include <stdlib.h>
 
 Value *boolean(bool b) {
-  Value *val = malloc(sizeof(Value));
+  Value *val = ALLOCATE(Value, 1);
   if (!val)
     return NULL;
   val->type = VALUE_BOOL;
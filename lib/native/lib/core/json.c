@@ -280,10 +280,17 @@ Value *json_decode(const char *json_string, Status *status) {
 
 static void encode_value(const Value *value, StringBuilder *sb);
 
-static void encode_string(const char *str, StringBuilder *sb) {
+void json_encode_string(const char *str, StringBuilder *sb) {
   W->stringBuilder->appendChar(sb, '"');
+  // Runs of characters that need no escaping are copied in one append.
+  const char *run = str;
   for (const char *p = str; *p; p++) {
-    switch (*p) {
+    unsigned char c = (unsigned char)*p;
+    if (c >= 32 && c != '"' && c != '\\')
+      continue;
+    W->stringBuilder->appendBytes(sb, run, (size_t)(p - run));
+    run = p + 1;
+    switch (c) {
     case '"':
       W->stringBuilder->appendStr(sb, "\\\"");
       break;
@@ -305,17 +312,15 @@ static void encode_string(const char *str, StringBuilder *sb) {
     case '\t':
       W->stringBuilder->appendStr(sb, "\\t");
       break;
-    default:
-      if ((unsigned char)*p < 32) {
-        char hex_buf[7];
-        sprintf(hex_buf, "\\u%04x", (unsigned char)*p);
-        W->stringBuilder->appendStr(sb, hex_buf);
-      } else {
-        W->stringBuilder->appendChar(sb, *p);
-      }
+    default: {
+      char hex_buf[7];
+      snprintf(hex_buf, sizeof(hex_buf), "\\u%04x", c);
+      W->stringBuilder->appendStr(sb, hex_buf);
       break;
     }
+    }
   }
+  W->stringBuilder->appendStr(sb, run);
   W->stringBuilder->appendChar(sb, '"');
 }
 
@@ -330,7 +335,7 @@ static void encode_object(const Value *value, StringBuilder *sb) {
       }
       Value *key_val = W->arrayGetRef(keys, i);
       const char *key_str = W->valueAsString(key_val);
-      encode_string(key_str, sb);
+      json_encode_string(key_str, sb);
       W->stringBuilder->appendChar(sb, ':');
       encode_value(W->objectGetRef(value, key_str), sb);
     }
@@ -367,7 +372,7 @@ static void encode_value(const Value *value, StringBuilder *sb) {
     break;
   }
   case VALUE_STRING:
-    encode_string(W->valueAsString(value), sb);
+    json_encode_string(W->valueAsString(value), sb);
     break;
   case VALUE_ARRAY:
     encode_array(value, sb);
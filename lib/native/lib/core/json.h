@@ -7,6 +7,7 @@
 #define JSON_H
 
 #include "error.h"
+#include "string_builder.h"
 #include "value.h"
 
 /**
@@ -27,6 +28,14 @@ Value *json_decode(const char *json_string, Status *status);
  */
 char *json_encode(const Value *value);
 
+/**
+ * @brief Appends a string to a `StringBuilder` as a quoted JSON string,
+ * escaping quotes, backslashes and control characters.
+ * @param str The null-terminated string to encode.
+ * @param sb The builder to append to.
+ */
+void json_encode_string(const char *str, StringBuilder *sb);
+
 /**
  * @brief Queries a `Value` structure using a dot-notation path.
  * @param root The root `Value` (must be an object or array) to query.
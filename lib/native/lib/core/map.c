@@ -3,6 +3,7 @@
  * @brief Implements a hash map for string keys and `Value` pointers.
  */
 #include "map.h"
+#include "memory.h"
 #include "../webs_api.h"
 #include "value.h"
 #include <stdio.h>
@@ -41,17 +42,14 @@ static size_t hash_key_len(const char *key, size_t len) {
  * @brief Creates a new hash map.
  */
 Map *map(size_t capacity) {
-  Map *table = malloc(sizeof(Map));
+  Map *table = ALLOCATE(Map, 1);
   if (!table)
     return NULL;
 
   table->capacity = capacity > 0 ? capacity : 16;
   table->count = 0;
-  table->entries = calloc(table->capacity, sizeof(MapEntry *));
-  if (!table->entries) {
-    free(table);
-    return NULL;
-  }
+  table->entries = ALLOCATE_FOR(table, MapEntry *, table->capacity);
+  memset(table->entries, 0, sizeof(MapEntry *) * table->capacity);
 
   table->set = map_set_method;
   table->get = map_get_method;
@@ -70,14 +68,14 @@ void map_free(Map *table) {
     MapEntry *entry = table->entries[i];
     while (entry) {
       MapEntry *next = entry->next;
-      free(entry->key);
+      FREE_ARRAY(char, entry->key, strlen(entry->key) + 1);
       W->freeValue(entry->value);
-      free(entry);
+      FREE(MapEntry, entry);
       entry = next;
     }
   }
-  free(table->entries);
-  free(table);
+  FREE_ARRAY(MapEntry *, table->entries, table->capacity);
+  FREE(Map, table);
 }
 
 /**
@@ -85,11 +83,8 @@ void map_free(Map *table) {
  */
 static Status map_resize(Map *table) {
   size_t new_capacity = table->capacity * 2;
-  MapEntry **new_entries = calloc(new_capacity, sizeof(MapEntry *));
-  if (!new_entries) {
-    W->log->error("Map: Failed to allocate memory for resize.");
-    return ERROR_MEMORY;
-  }
+  MapEntry **new_entries = ALLOCATE_FOR(table, MapEntry *, new_capacity);
+  memset(new_entries, 0, sizeof(MapEntry *) * new_capacity);
 
   for (size_t i = 0; i < table->capacity; i++) {
     MapEntry *entry = table->entries[i];
@@ -102,7 +97,7 @@ static Status map_resize(Map *table) {
     }
   }
 
-  free(table->entries);
+  FREE_ARRAY(MapEntry *, table->entries, table->capacity);
   table->entries = new_entries;
   table->capacity = new_capacity;
   return OK;
@@ -137,18 +132,12 @@ static Status map_set_method(Map *self, const char *key, Value *value) {
     entry = entry->next;
   }
 
-  MapEntry *new_entry = malloc(sizeof(MapEntry));
-  if (!new_entry) {
-    W->freeValue(value);
-    return ERROR_MEMORY;
-  }
-
-  new_entry->key = strdup(key);
-  if (!new_entry->key) {
-    free(new_entry);
-    W->freeValue(value);
-    return ERROR_MEMORY;
-  }
+  // The entry and its key belong to the map, wherever the caller's memory
+  // is coming from.
+  size_t key_length = strlen(key);
+  MapEntry *new_entry = ALLOCATE_FOR(self, MapEntry, 1);
+  new_entry->key = ALLOCATE_FOR(self, char, key_length + 1);
+  memcpy(new_entry->key, key, key_length + 1);
   new_entry->value = value;
 
   new_entry->next = self->entries[index];
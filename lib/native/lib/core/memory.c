@@ -1,10 +1,23 @@
 #include "memory.h"
+#include "arena.h"
 #include "console.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-void *reallocate(void *pointer, size_t oldSize, size_t newSize) {
-  (void)oldSize;
+static void *arena_reallocate(Arena *arena, void *pointer, size_t oldSize,
+                              size_t newSize) {
+  if (newSize == 0)
+    return NULL;
+  void *result = arena_grow(arena, pointer, oldSize, newSize);
+  if (result == NULL) {
+    console()->error(console(), "FATAL: Memory allocation failed (arena).");
+    exit(1);
+  }
+  return result;
+}
+
+static void *heap_reallocate(void *pointer, size_t newSize) {
   if (newSize == 0) {
     free(pointer);
     return NULL;
@@ -17,3 +30,25 @@ void *reallocate(void *pointer, size_t oldSize, size_t newSize) {
   }
   return result;
 }
+
+void *reallocate(void *pointer, size_t oldSize, size_t newSize) {
+  Arena *arena = arena_current();
+  if (arena && (!pointer || arena_owns(arena, pointer)))
+    return arena_reallocate(arena, pointer, oldSize, newSize);
+  return heap_reallocate(pointer, newSize);
+}
+
+void *reallocate_for(const void *owner, void *pointer, size_t oldSize,
+                     size_t newSize) {
+  Arena *arena = arena_current();
+  if (arena && arena_owns(arena, owner))
+    return arena_reallocate(arena, pointer, oldSize, newSize);
+  return heap_reallocate(pointer, newSize);
+}
+
+char *copy_chars(const char *chars, size_t length) {
+  char *copy = ALLOCATE(char, length + 1);
+  memcpy(copy, chars, length);
+  copy[length] = '\0';
+  return copy;
+}
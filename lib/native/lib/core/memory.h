@@ -5,13 +5,48 @@
 
 #define GROW_CAPACITY(capacity) ((capacity) < 8 ? 8 : (capacity) * 2)
 
+#define ALLOCATE(type, count)                                                  \
+  (type *)reallocate(NULL, 0, sizeof(type) * (count))
+
+#define ALLOCATE_FOR(owner, type, count)                                       \
+  (type *)reallocate_for(owner, NULL, 0, sizeof(type) * (count))
+
+#define FREE(type, pointer) reallocate(pointer, sizeof(type), 0)
+
 #define GROW_ARRAY(type, pointer, oldCount, newCount)                          \
   (type *)reallocate(pointer, sizeof(type) * (oldCount),                       \
                      sizeof(type) * (newCount))
 
+#define GROW_ARRAY_FOR(owner, type, pointer, oldCount, newCount)              \
+  (type *)reallocate_for(owner, pointer, sizeof(type) * (oldCount),           \
+                         sizeof(type) * (newCount))
+
 #define FREE_ARRAY(type, pointer, oldCount)                                    \
   reallocate(pointer, sizeof(type) * (oldCount), 0)
 
+/**
+ * @brief Allocates, resizes or frees memory for the core value types.
+ *
+ * While a thread has a current arena (see `arena.h`), new memory comes from
+ * it and freeing memory it owns does nothing. Heap memory stays on the heap
+ * when resized, so long-lived values keep growing there. Exits the process
+ * if the allocation fails.
+ */
 void *reallocate(void *pointer, size_t oldSize, size_t newSize);
 
+/**
+ * @brief Like `reallocate`, for memory held by `owner`, such as a
+ * container's entries or key copies. It comes from the current arena only
+ * if `owner` does, so a heap container changed during a request stays
+ * wholly on the heap and outlives the arena's reset.
+ */
+void *reallocate_for(const void *owner, void *pointer, size_t oldSize,
+                     size_t newSize);
+
+/**
+ * @brief Copies `length` bytes of `chars` into a new NUL-terminated string
+ * from `reallocate`. Release it with `FREE_ARRAY(char, ...)` or `FREE`.
+ */
+char *copy_chars(const char *chars, size_t length);
+
 #endif
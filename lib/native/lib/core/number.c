@@ -1,4 +1,5 @@
 #include "number.h"
+#include "memory.h"
 #include "null.h"
 #include <math.h>
 #include <stdlib.h>
@@ -7,7 +8,7 @@ Value *number(double n) {
   if (isnan(n) || isinf(n)) {
     return null();
   }
-  Value *val = malloc(sizeof(Value));
+  Value *val = ALLOCATE(Value, 1);
   if (!val)
     return NULL;
 
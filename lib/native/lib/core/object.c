@@ -3,6 +3,7 @@
  * @brief Implements the Object type, a key-value store.
  */
 #include "object.h"
+#include "memory.h"
 #include "../webs_api.h"
 #include <stdlib.h>
 
@@ -13,13 +14,13 @@ static Value *object_get_method(const Object *self, const char *key);
  * @brief Creates a new `Value` of type `VALUE_OBJECT`.
  */
 Value *object_value(void) {
-  Value *val = malloc(sizeof(Value));
+  Value *val = ALLOCATE(Value, 1);
   if (!val)
     return NULL;
   val->type = VALUE_OBJECT;
   val->as.object = object();
   if (!val->as.object) {
-    free(val);
+    FREE(Value, val);
     return NULL;
   }
   return val;
@@ -29,12 +30,12 @@ Value *object_value(void) {
  * @brief Creates a new heap-allocated `Object` struct.
  */
 Object *object(void) {
-  Object *object = malloc(sizeof(Object));
+  Object *object = ALLOCATE(Object, 1);
   if (!object)
     return NULL;
   object->map = map(8);
   if (!object->map) {
-    free(object);
+    FREE(Object, object);
     return NULL;
   }
   object->set = object_set_method;
@@ -49,7 +50,7 @@ void object_free(Object *object) {
   if (!object)
     return;
   map_free(object->map);
-  free(object);
+  FREE(Object, object);
 }
 
 /**
@@ -1,8 +1,9 @@
 #include "pointer.h"
+#include "memory.h"
 #include <stdlib.h>
 
 Value *pointer(void *p) {
-  Value *val = malloc(sizeof(Value));
+  Value *val = ALLOCATE(Value, 1);
   if (!val)
     return NULL;
   val->type = VALUE_POINTER;
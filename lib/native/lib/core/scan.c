@@ -0,0 +1,248 @@
+#define _GNU_SOURCE
+#include "scan.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __x86_64__
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+typedef struct {
+  void (*line)(const char *p, const char *end, ScanLine *found);
+  const char *(*head_end)(const char *p, size_t len);
+  const char *(*either)(const char *p, const char *end, char a, char b);
+} ScanKernels;
+
+static bool is_invalid(unsigned char c) {
+  return (c < 0x20 && c != '\t') || c == 0x7f;
+}
+
+// --- Scalar kernels ---
+
+/**
+ * @brief Finishes a line scan byte by byte. `found` carries what earlier
+ * blocks already saw.
+ */
+static void scalar_line(const char *p, const char *end, ScanLine *found) {
+  for (; p < end; p++) {
+    unsigned char c = (unsigned char)*p;
+    if (c == '\n') {
+      found->eol = p;
+      return;
+    }
+    if (c == ':' && !found->colon)
+      found->colon = p;
+    if (!found->invalid && is_invalid(c))
+      found->invalid = p;
+  }
+  found->eol = end;
+}
+
+static const char *scalar_head_end(const char *p, size_t len) {
+  return memmem(p, len, "\r\n\r\n", 4);
+}
+
+static const char *scalar_either(const char *p, const char *end, char a,
+                                 char b) {
+  while (p < end && *p != a && *p != b)
+    p++;
+  return p;
+}
+
+#ifdef SCAN_X86
+
+// --- SSE2 kernels ---
+
+static void sse2_line(const char *p, const char *end, ScanLine *found) {
+  const __m128i lf = _mm_set1_epi8('\n');
+  const __m128i colon = _mm_set1_epi8(':');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i del = _mm_set1_epi8(0x7f);
+  const __m128i ctl = _mm_set1_epi8(0x1f);
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    // max(v, 0x1f) == 0x1f exactly when v <= 0x1f, compared unsigned.
+    __m128i low = _mm_cmpeq_epi8(_mm_max_epu8(v, ctl), ctl);
+    __m128i bad = _mm_or_si128(_mm_andnot_si128(_mm_cmpeq_epi8(v, tab), low),
+                               _mm_cmpeq_epi8(v, del));
+    unsigned lf_mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, lf));
+    unsigned before = lf_mask ? (lf_mask & -lf_mask) - 1 : 0xffffu;
+    unsigned colon_mask =
+        (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, colon)) & before;
+    unsigned bad_mask = (unsigned)_mm_movemask_epi8(bad) & before;
+    if (colon_mask && !found->colon)
+      found->colon = p + __builtin_ctz(colon_mask);
+    if (bad_mask && !found->invalid)
+      found->invalid = p + __builtin_ctz(bad_mask);
+    if (lf_mask) {
+      found->eol = p + __builtin_ctz(lf_mask);
+      return;
+    }
+    p += 16;
+  }
+  scalar_line(p, end, found);
+}
+
+/**
+ * @brief Compares the first and last bytes of the needle at 16 positions at
+ * once, and checks the middle two only for positions where both match.
+ */
+static const char *sse2_head_end(const char *p, size_t len) {
+  const char *end = p + len;
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i lf = _mm_set1_epi8('\n');
+  while (end - p >= 16 + 3) {
+    __m128i first = _mm_loadu_si128((const __m128i *)p);
+    __m128i last = _mm_loadu_si128((const __m128i *)(p + 3));
+    unsigned mask = (unsigned)_mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(first, cr), _mm_cmpeq_epi8(last, lf)));
+    while (mask) {
+      const char *candidate = p + __builtin_ctz(mask);
+      if (candidate[1] == '\n' && candidate[2] == '\r')
+        return candidate;
+      mask &= mask - 1;
+    }
+    p += 16;
+  }
+  return scalar_head_end(p, (size_t)(end - p));
+}
+
+static const char *sse2_either(const char *p, const char *end, char a, char b) {
+  const __m128i va = _mm_set1_epi8(a);
+  const __m128i vb = _mm_set1_epi8(b);
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    unsigned mask = (unsigned)_mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+    if (mask)
+      return p + __builtin_ctz(mask);
+    p += 16;
+  }
+  return scalar_either(p, end, a, b);
+}
+
+// --- AVX2 kernels ---
+//
+// There is no AVX2 line kernel. Header lines are mostly shorter than two
+// 32-byte blocks, and `bin/scan_bench` measures the SSE2 kernel ahead on
+// them, so the AVX2 set reuses it.
+
+__attribute__((target("avx2"))) static const char *
+avx2_head_end(const char *p, size_t len) {
+  const char *end = p + len;
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i lf = _mm256_set1_epi8('\n');
+  while (end - p >= 32 + 3) {
+    __m256i first = _mm256_loadu_si256((const __m256i *)p);
+    __m256i last = _mm256_loadu_si256((const __m256i *)(p + 3));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(
+        _mm256_cmpeq_epi8(first, cr), _mm256_cmpeq_epi8(last, lf)));
+    while (mask) {
+      const char *candidate = p + __builtin_ctz(mask);
+      if (candidate[1] == '\n' && candidate[2] == '\r')
+        return candidate;
+      mask &= mask - 1;
+    }
+    p += 32;
+  }
+  return sse2_head_end(p, (size_t)(end - p));
+}
+
+__attribute__((target("avx2"))) static const char *
+avx2_either(const char *p, const char *end, char a, char b) {
+  const __m256i va = _mm256_set1_epi8(a);
+  const __m256i vb = _mm256_set1_epi8(b);
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)));
+    if (mask)
+      return p + __builtin_ctz(mask);
+    p += 32;
+  }
+  return sse2_either(p, end, a, b);
+}
+
+#endif // SCAN_X86
+
+// --- Dispatch ---
+
+static const ScanKernels kernels[] = {
+    [SCAN_SCALAR] = {scalar_line, scalar_head_end, scalar_either},
+#ifdef SCAN_X86
+    [SCAN_SSE2] = {sse2_line, sse2_head_end, sse2_either},
+    [SCAN_AVX2] = {sse2_line, avx2_head_end, avx2_either},
+#else
+    [SCAN_SSE2] = {scalar_line, scalar_head_end, scalar_either},
+    [SCAN_AVX2] = {scalar_line, scalar_head_end, scalar_either},
+#endif
+};
+
+// The selected kernel, or -1 until the first scan picks one.
+static _Atomic int active_kernel = -1;
+
+static bool kernel_supported(ScanKernel kernel) {
+  switch (kernel) {
+  case SCAN_SCALAR:
+    return true;
+#ifdef SCAN_X86
+  case SCAN_SSE2:
+    return __builtin_cpu_supports("sse2");
+  case SCAN_AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+ScanKernel scan_kernel(void) {
+  int kernel = atomic_load_explicit(&active_kernel, memory_order_relaxed);
+  if (kernel >= 0)
+    return (ScanKernel)kernel;
+  ScanKernel best = SCAN_SCALAR;
+  if (kernel_supported(SCAN_AVX2))
+    best = SCAN_AVX2;
+  else if (kernel_supported(SCAN_SSE2))
+    best = SCAN_SSE2;
+  // Racing threads all pick the same kernel.
+  atomic_store_explicit(&active_kernel, (int)best, memory_order_relaxed);
+  return best;
+}
+
+bool scan_set_kernel(ScanKernel kernel) {
+  if (!kernel_supported(kernel))
+    return false;
+  atomic_store_explicit(&active_kernel, (int)kernel, memory_order_relaxed);
+  return true;
+}
+
+const char *scan_kernel_name(ScanKernel kernel) {
+  switch (kernel) {
+  case SCAN_SSE2:
+    return "sse2";
+  case SCAN_AVX2:
+    return "avx2";
+  default:
+    return "scalar";
+  }
+}
+
+ScanLine scan_line(const char *p, const char *end) {
+  ScanLine found = {NULL, NULL, NULL};
+  kernels[scan_kernel()].line(p, end, &found);
+  // A CR is only allowed as the first half of the line's CRLF.
+  if (found.invalid && found.invalid == found.eol - 1 && *found.invalid == '\r')
+    found.invalid = NULL;
+  return found;
+}
+
+const char *scan_head_end(const char *p, size_t len) {
+  return kernels[scan_kernel()].head_end(p, len);
+}
+
+const char *scan_either(const char *p, const char *end, char a, char b) {
+  return kernels[scan_kernel()].either(p, end, a, b);
+}
@@ -0,0 +1,72 @@
+/**
+ * @file scan.h
+ * @brief Provides vectorised byte scanning for HTTP and cookie parsing.
+ *
+ * Each scan has a scalar kernel and, on x86, SSE2 and AVX2 kernels that look
+ * at 16 or 32 bytes per step. The fastest kernel the CPU supports is picked
+ * on first use; `scan_set_kernel` overrides the choice, which is mainly
+ * useful for benchmarks and tests. Every kernel returns the same results.
+ */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @enum ScanKernel
+ * @brief The instruction sets the scans can be run with.
+ */
+typedef enum { SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2 } ScanKernel;
+
+/**
+ * @struct ScanLine
+ * @brief What `scan_line` found in one line.
+ */
+typedef struct {
+  const char *eol;     ///< The line's LF, or the end of input if none.
+  const char *colon;   ///< The first `:` before `eol`, or NULL.
+  const char *invalid; ///< The first control character before `eol`, or NULL.
+} ScanLine;
+
+/**
+ * @brief Scans one line of an HTTP head in a single pass.
+ *
+ * Control characters are bytes below 0x20 other than HTAB, and DEL. A CR
+ * directly before the LF ends the line and is not reported as invalid.
+ * @param p The start of the line.
+ * @param end The end of the input.
+ */
+ScanLine scan_line(const char *p, const char *end);
+
+/**
+ * @brief Finds the blank line ending an HTTP head.
+ * @return The first byte of the first `\r\n\r\n` in `[p, p + len)`, or NULL.
+ */
+const char *scan_head_end(const char *p, size_t len);
+
+/**
+ * @brief Finds the first occurrence of either of two bytes.
+ * @return The first `a` or `b` in `[p, end)`, or `end` if there is neither.
+ */
+const char *scan_either(const char *p, const char *end, char a, char b);
+
+/**
+ * @brief Returns the kernel the scans currently use.
+ */
+ScanKernel scan_kernel(void);
+
+/**
+ * @brief Makes the scans use `kernel`.
+ * @return false, leaving the choice unchanged, if the CPU lacks the
+ * instructions `kernel` needs.
+ */
+bool scan_set_kernel(ScanKernel kernel);
+
+/**
+ * @brief Returns the name of a kernel: "scalar", "sse2" or "avx2".
+ */
+const char *scan_kernel_name(ScanKernel kernel);
+
+#endif // SCAN_H
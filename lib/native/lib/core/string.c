@@ -1,4 +1,5 @@
 #include "string.h"
+#include "memory.h"
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -6,38 +7,47 @@
 
 Value *string_value(const char *s) {
   const char *input = s ? s : "";
-  Value *val = malloc(sizeof(Value));
+  Value *val = ALLOCATE(Value, 1);
   if (!val)
     return NULL;
   val->type = VALUE_STRING;
   val->as.string = string(input);
   if (!val->as.string) {
-    free(val);
+    FREE(Value, val);
     return NULL;
   }
   return val;
 }
 
+Value *string_value_length(const char *s, size_t length) {
+  Value *val = ALLOCATE(Value, 1);
+  String *string = ALLOCATE(String, 1);
+  char *chars = ALLOCATE(char, length + 1);
+  if (length > 0)
+    memcpy(chars, s, length);
+  chars[length] = '\0';
+  string->chars = chars;
+  string->length = length;
+  val->type = VALUE_STRING;
+  val->as.string = string;
+  return val;
+}
+
 String *string(const char *s) {
   const char *input = s ? s : "";
-  String *string = malloc(sizeof(String));
+  String *string = ALLOCATE(String, 1);
   if (!string)
     return NULL;
   string->length = strlen(input);
-  string->chars = malloc(string->length + 1);
-  if (!string->chars) {
-    free(string);
-    return NULL;
-  }
-  memcpy(string->chars, input, string->length + 1);
+  string->chars = copy_chars(input, string->length);
   return string;
 }
 
 void string_free(String *string) {
   if (!string)
     return;
-  free(string->chars);
-  free(string);
+  FREE_ARRAY(char, string->chars, string->length + 1);
+  FREE(String, string);
 }
 
 char *string_trim_start(const char *str) {
@@ -25,6 +25,15 @@ typedef struct String {
  */
 Value *string_value(const char *s);
 
+/**
+ * @brief Creates a new `Value` of type `VALUE_STRING` from a byte range.
+ * @param s The bytes to copy, which may contain NUL bytes.
+ * @param length The number of bytes to copy.
+ * @return A new string `Value`, or NULL on allocation failure.
+ * @note The caller is responsible for freeing the returned Value.
+ */
+Value *string_value_length(const char *s, size_t length);
+
 /**
  * @brief Creates a new heap-allocated `String` struct.
  * @param s The null-terminated C string to copy.
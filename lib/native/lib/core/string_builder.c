@@ -8,12 +8,19 @@
 #include <stdlib.h>
 #include <string.h>
 
+static char *sb_resize(StringBuilder *sb, size_t old_capacity,
+                       size_t new_capacity) {
+  if (sb->arena)
+    return arena_grow(sb->arena, sb->buffer, old_capacity, new_capacity);
+  return realloc(sb->buffer, new_capacity);
+}
+
 static bool sb_ensure_capacity(StringBuilder *sb, size_t additional) {
   if (!sb)
     return false;
   if (!sb->buffer) {
     sb->capacity = additional > 256 ? additional + 1 : 256;
-    sb->buffer = malloc(sb->capacity);
+    sb->buffer = sb_resize(sb, 0, sb->capacity);
     if (!sb->buffer)
       return false;
     sb->buffer[0] = '\0';
@@ -25,7 +32,7 @@ static bool sb_ensure_capacity(StringBuilder *sb, size_t additional) {
     while (new_capacity <= sb->length + additional) {
       new_capacity = new_capacity == 0 ? 256 : new_capacity * 2;
     }
-    char *new_buffer = realloc(sb->buffer, new_capacity);
+    char *new_buffer = sb_resize(sb, sb->capacity, new_capacity);
     if (!new_buffer)
       return false;
     sb->buffer = new_buffer;
@@ -34,11 +41,15 @@ static bool sb_ensure_capacity(StringBuilder *sb, size_t additional) {
   return true;
 }
 
-void sb_init(StringBuilder *sb) {
+void sb_init(StringBuilder *sb) { sb_init_arena(sb, NULL); }
+
+void sb_init_arena(StringBuilder *sb, Arena *arena) {
   if (!sb)
     return;
+  sb->arena = arena;
+  sb->buffer = NULL;
   sb->capacity = 1024;
-  sb->buffer = malloc(sb->capacity);
+  sb->buffer = sb_resize(sb, 0, sb->capacity);
   if (sb->buffer) {
     sb->buffer[0] = '\0';
   }
@@ -56,6 +67,16 @@ void sb_append_str(StringBuilder *sb, const char *str) {
   sb->buffer[sb->length] = '\0';
 }
 
+void sb_append_bytes(StringBuilder *sb, const char *data, size_t len) {
+  if (!sb || !data || len == 0)
+    return;
+  if (!sb_ensure_capacity(sb, len))
+    return;
+  memcpy(sb->buffer + sb->length, data, len);
+  sb->length += len;
+  sb->buffer[sb->length] = '\0';
+}
+
 void sb_append_char(StringBuilder *sb, char c) {
   if (!sb)
     return;
@@ -95,7 +116,9 @@ void sb_append_html_escaped(StringBuilder *sb, const char *text) {
 char *sb_to_string(StringBuilder *sb) {
   if (!sb || !sb->buffer)
     return NULL;
-  char *result = realloc(sb->buffer, sb->length + 1);
+  // Arena memory is released with the arena, so there is nothing to trim.
+  char *result =
+      sb->arena ? sb->buffer : realloc(sb->buffer, sb->length + 1);
   if (result) {
     result[sb->length] = '\0';
   }
@@ -107,7 +130,8 @@ char *sb_to_string(StringBuilder *sb) {
 
 void sb_free(StringBuilder *sb) {
   if (sb && sb->buffer) {
-    free(sb->buffer);
+    if (!sb->arena)
+      free(sb->buffer);
     sb->buffer = NULL;
     sb->length = 0;
     sb->capacity = 0;
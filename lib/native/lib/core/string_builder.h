@@ -6,6 +6,7 @@
 #ifndef STRING_BUILDER_H
 #define STRING_BUILDER_H
 
+#include "arena.h"
 #include <stddef.h>
 
 /**
@@ -16,6 +17,7 @@ typedef struct {
   char *buffer;
   size_t length;
   size_t capacity;
+  Arena *arena; // Where the buffer lives, or NULL for the heap.
 } StringBuilder;
 
 /**
@@ -24,6 +26,16 @@ typedef struct {
  */
 void sb_init(StringBuilder *sb);
 
+/**
+ * @brief Initializes a StringBuilder whose buffer is allocated from `arena`.
+ *
+ * The string returned by `sb_to_string` then belongs to the arena and must
+ * not be passed to `free`; `sb_free` leaves the memory to the arena.
+ * @param sb Pointer to the StringBuilder to initialize.
+ * @param arena The arena to allocate from, or NULL for the heap.
+ */
+void sb_init_arena(StringBuilder *sb, Arena *arena);
+
 /**
  * @brief Appends a C string to the StringBuilder.
  * @param sb Pointer to the StringBuilder.
@@ -31,6 +43,14 @@ void sb_init(StringBuilder *sb);
  */
 void sb_append_str(StringBuilder *sb, const char *str);
 
+/**
+ * @brief Appends `len` bytes to the StringBuilder.
+ * @param sb Pointer to the StringBuilder.
+ * @param data The bytes to append; they need not be null-terminated.
+ * @param len The number of bytes to append.
+ */
+void sb_append_bytes(StringBuilder *sb, const char *data, size_t len);
+
 /**
  * @brief Appends a single character to the StringBuilder.
  * @param sb Pointer to the StringBuilder.
@@ -52,7 +72,8 @@ void sb_append_html_escaped(StringBuilder *sb, const char *text);
  * This function transfers ownership of the buffer to the caller. The
  * StringBuilder is reset and should not be used further unless re-initialized.
  * @param sb Pointer to the StringBuilder.
- * @return A new, null-terminated string that the caller must free.
+ * @return A new, null-terminated string that the caller must free, unless
+ * the builder was initialized with an arena.
  */
 char *sb_to_string(StringBuilder *sb);
 
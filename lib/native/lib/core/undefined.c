@@ -1,8 +1,9 @@
 #include "undefined.h"
+#include "memory.h"
 #include <stdlib.h>
 
 Value *undefined(void) {
-  Value *val = malloc(sizeof(Value));
+  Value *val = ALLOCATE(Value, 1);
   if (!val)
     return NULL;
   val->type = VALUE_UNDEFINED;
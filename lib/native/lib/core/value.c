@@ -51,11 +51,11 @@ void writeValueArray(ValueArray *array, Value *value) {
     int oldCapacity = array->capacity;
     int newCapacity = GROW_CAPACITY(oldCapacity);
     Value *new_values =
-        GROW_ARRAY(Value, array->values, oldCapacity, newCapacity);
+        GROW_ARRAY_FOR(array, Value, array->values, oldCapacity, newCapacity);
 
     if (!new_values) {
       W->log->error("MEMORY_ERROR: Could not grow ValueArray.");
-      free(value);
+      FREE(Value, value);
       return;
     }
     array->values = new_values;
@@ -63,7 +63,7 @@ void writeValueArray(ValueArray *array, Value *value) {
   }
   array->values[array->count] = *value;
   array->count++;
-  free(value);
+  FREE(Value, value);
 }
 
 void freeValueArray(ValueArray *array) {
@@ -100,7 +100,7 @@ void value_free(Value *value) {
   default:
     break;
   }
-  free(value);
+  FREE(Value, value);
 }
 
 /**
@@ -1,6 +1,7 @@
 #include "bundler.h"
 #include "../core/map.h"
 #include "../core/string_builder.h"
+#include "../modules/compress.h"
 #include "../modules/path.h"
 #include "../webs_api.h"
 #include "asset.h"
@@ -175,13 +176,20 @@ Status webs_bundle_from_entry(const char *entry_file, const char *output_dir,
   snprintf(css_output_path, sizeof(css_output_path), "%s/bundle.css",
            output_dir);
 
+  // Precompressed sidecars let the static server answer Accept-Encoding
+  // without compressing per request.
   char *js_bundle = sb_to_string(&js_bundle_sb);
   W->fs->writeFile(js_output_path, js_bundle, NULL);
+  status = compress_write_sidecars(js_output_path, js_bundle,
+                                   strlen(js_bundle), error);
   free(js_bundle);
 
   char *css_bundle = sb_to_string(&css_bundle_sb);
   if (strlen(css_bundle) > 0) {
     W->fs->writeFile(css_output_path, css_bundle, NULL);
+    if (status == OK)
+      status = compress_write_sidecars(css_output_path, css_bundle,
+                                       strlen(css_bundle), error);
   }
   free(css_bundle);
 
@@ -17,7 +17,8 @@
  *
  * This function builds a dependency graph, performs a topological sort, and
  * concatenates the assets into `bundle.js` and `bundle.css` in the output
- * directory.
+ * directory, each with a gzip sidecar (`bundle.js.gz`) and, when built with
+ * `WEBS_BROTLI=1`, a Brotli sidecar (`bundle.js.br`).
  *
  * @param entry_file The path to the main entry file of the project.
  * @param output_dir The path to the directory where bundles will be written.
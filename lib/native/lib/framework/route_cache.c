@@ -0,0 +1,369 @@
+/**
+ * @file route_cache.c
+ * @brief Implements the coalescing cache of route responses.
+ */
+#define _GNU_SOURCE
+#include "route_cache.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#define ROUTE_CACHE_BUCKETS 256
+
+struct RouteCache {
+  pthread_mutex_t lock;
+  pthread_cond_t filled; // Broadcast whenever a fill finishes.
+  RouteCacheEntry *buckets[ROUTE_CACHE_BUCKETS];
+  RouteCacheEntry *lru_head; // Most recently used; filled and pass entries.
+  RouteCacheEntry *lru_tail; // Next to be evicted.
+  size_t bytes;
+  size_t max_bytes;
+  int ttl_ms;
+  int stale_ms;
+  char **vary;
+  int vary_count;
+};
+
+static int64_t now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static size_t hash_key(const char *key, size_t len) {
+  size_t hash = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (size_t)(unsigned char)key[i];
+    hash *= 16777619;
+  }
+  return hash;
+}
+
+static void entry_free(RouteCacheEntry *entry) {
+  free(entry->key);
+  free(entry->data);
+  free(entry);
+}
+
+static void lru_unlink(RouteCache *cache, RouteCacheEntry *entry) {
+  if (!entry->data && !entry->pass)
+    return;
+  if (entry->lru_prev)
+    entry->lru_prev->lru_next = entry->lru_next;
+  else
+    cache->lru_head = entry->lru_next;
+  if (entry->lru_next)
+    entry->lru_next->lru_prev = entry->lru_prev;
+  else
+    cache->lru_tail = entry->lru_prev;
+  entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void lru_push_front(RouteCache *cache, RouteCacheEntry *entry) {
+  entry->lru_prev = NULL;
+  entry->lru_next = cache->lru_head;
+  if (cache->lru_head)
+    cache->lru_head->lru_prev = entry;
+  cache->lru_head = entry;
+  if (!cache->lru_tail)
+    cache->lru_tail = entry;
+}
+
+/**
+ * @brief Removes an entry from the table and LRU list. It is freed now if
+ * unreferenced, otherwise by the last `route_cache_release`.
+ */
+static void evict(RouteCache *cache, RouteCacheEntry *entry) {
+  RouteCacheEntry **slot =
+      &cache->buckets[hash_key(entry->key, entry->key_len) %
+                      ROUTE_CACHE_BUCKETS];
+  while (*slot && *slot != entry)
+    slot = &(*slot)->hash_next;
+  if (*slot)
+    *slot = entry->hash_next;
+  lru_unlink(cache, entry);
+  cache->bytes -= entry->size;
+  entry->evicted = true;
+  if (entry->refs == 0)
+    entry_free(entry);
+}
+
+static RouteCacheEntry *find(RouteCache *cache, const char *key,
+                             size_t key_len) {
+  for (RouteCacheEntry *entry =
+           cache->buckets[hash_key(key, key_len) % ROUTE_CACHE_BUCKETS];
+       entry; entry = entry->hash_next) {
+    if (entry->key_len == key_len && memcmp(entry->key, key, key_len) == 0)
+      return entry;
+  }
+  return NULL;
+}
+
+static RouteCacheEntry *insert(RouteCache *cache, const char *key,
+                               size_t key_len) {
+  RouteCacheEntry *entry = calloc(1, sizeof(RouteCacheEntry));
+  char *key_copy = malloc(key_len ? key_len : 1);
+  if (!entry || !key_copy) {
+    free(entry);
+    free(key_copy);
+    return NULL;
+  }
+  memcpy(key_copy, key, key_len);
+  entry->key = key_copy;
+  entry->key_len = key_len;
+  size_t bucket = hash_key(key, key_len) % ROUTE_CACHE_BUCKETS;
+  entry->hash_next = cache->buckets[bucket];
+  cache->buckets[bucket] = entry;
+  return entry;
+}
+
+/**
+ * @brief Finds `needle` in a span without regard to case.
+ */
+static bool span_contains(const char *text, size_t len, const char *needle) {
+  size_t needle_len = strlen(needle);
+  for (size_t i = 0; i + needle_len <= len; i++)
+    if (strncasecmp(text + i, needle, needle_len) == 0)
+      return true;
+  return false;
+}
+
+static bool header_is(const char *line, size_t len, const char *name) {
+  size_t name_len = strlen(name);
+  return len > name_len && line[name_len] == ':' &&
+         strncasecmp(line, name, name_len) == 0;
+}
+
+/**
+ * @brief Decides whether a raw response may be replayed to other clients:
+ * a complete 200 that sets no cookie and does not forbid shared caching.
+ */
+static bool storable(const char *data, size_t size) {
+  if (size < 13 || memcmp(data, "HTTP/1.", 7) != 0 ||
+      memcmp(data + 8, " 200", 4) != 0)
+    return false;
+  const char *end = memmem(data, size, "\r\n\r\n", 4);
+  if (!end)
+    return false;
+  size_t body = size - (size_t)(end + 4 - data);
+  bool chunked = false;
+  const char *line = memchr(data, '\n', size) + 1;
+  while (line < end + 2) {
+    const char *eol = memchr(line, '\r', (size_t)(end + 2 - line));
+    size_t len = (size_t)(eol - line);
+    if (header_is(line, len, "Set-Cookie"))
+      return false;
+    if (header_is(line, len, "Cache-Control") &&
+        (span_contains(line, len, "no-store") ||
+         span_contains(line, len, "private")))
+      return false;
+    if (header_is(line, len, "Connection") && span_contains(line, len, "close"))
+      return false;
+    if (header_is(line, len, "Content-Length") &&
+        strtoull(line + 15, NULL, 10) != body)
+      return false;
+    if (header_is(line, len, "Transfer-Encoding") &&
+        span_contains(line, len, "chunked"))
+      chunked = true;
+    line = eol + 2;
+  }
+  return !chunked ||
+         (body >= 5 && memcmp(data + size - 5, "0\r\n\r\n", 5) == 0);
+}
+
+RouteCache *route_cache(const RouteCacheOptions *options) {
+  RouteCache *cache = calloc(1, sizeof(RouteCache));
+  if (!cache)
+    return NULL;
+  pthread_mutex_init(&cache->lock, NULL);
+  pthread_cond_init(&cache->filled, NULL);
+  int vary_count = options->vary ? options->vary_count : 0;
+  if (vary_count > 0) {
+    cache->vary = calloc((size_t)vary_count, sizeof(char *));
+    if (!cache->vary) {
+      route_cache_free(cache);
+      return NULL;
+    }
+    for (int i = 0; i < vary_count; i++) {
+      cache->vary[i] = strdup(options->vary[i]);
+      if (!cache->vary[i]) {
+        cache->vary_count = i;
+        route_cache_free(cache);
+        return NULL;
+      }
+    }
+  }
+  cache->vary_count = vary_count;
+  cache->ttl_ms = options->ttl_ms > 0 ? options->ttl_ms : 0;
+  cache->stale_ms = options->stale_ms > 0 ? options->stale_ms : 0;
+  cache->max_bytes = options->max_bytes;
+  return cache;
+}
+
+void route_cache_free(RouteCache *cache) {
+  if (!cache)
+    return;
+  for (int i = 0; i < ROUTE_CACHE_BUCKETS; i++)
+    while (cache->buckets[i])
+      evict(cache, cache->buckets[i]);
+  for (int i = 0; i < cache->vary_count; i++)
+    free(cache->vary[i]);
+  free(cache->vary);
+  pthread_cond_destroy(&cache->filled);
+  pthread_mutex_destroy(&cache->lock);
+  free(cache);
+}
+
+const char *const *route_cache_vary(const RouteCache *cache, int *count) {
+  *count = cache->vary_count;
+  return (const char *const *)cache->vary;
+}
+
+/**
+ * @brief Waits for a fill to finish, up to `deadline`.
+ * @return False once the deadline has passed.
+ */
+static bool wait_for_fill(RouteCache *cache, const struct timespec *deadline) {
+  int result;
+  do
+    result = pthread_cond_timedwait(&cache->filled, &cache->lock, deadline);
+  while (result == EINTR);
+  return result == 0;
+}
+
+RouteCacheResult route_cache_lookup(RouteCache *cache, const char *key,
+                                    size_t key_len, RouteCacheEntry **entry) {
+  *entry = NULL;
+  // The condition variable waits against the realtime clock, which is the
+  // only one `pthread_cond_timedwait` accepts everywhere.
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += ROUTE_CACHE_WAIT_MS / 1000;
+  deadline.tv_nsec += (long)(ROUTE_CACHE_WAIT_MS % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+
+  RouteCacheResult result = ROUTE_CACHE_BYPASS;
+  pthread_mutex_lock(&cache->lock);
+  for (;;) {
+    RouteCacheEntry *found = find(cache, key, key_len);
+    int64_t now = now_ms();
+    if (!found) {
+      found = insert(cache, key, key_len);
+      if (found) {
+        found->filling = true;
+        found->refs++;
+        *entry = found;
+        result = ROUTE_CACHE_FILL;
+      }
+      break;
+    }
+    if (found->pass && now < found->fresh_until) {
+      // The last response could not be cached, so there is nothing to wait
+      // for.
+      result = ROUTE_CACHE_BYPASS;
+      break;
+    }
+    if (found->data && now < found->stale_until &&
+        (now < found->fresh_until || found->filling)) {
+      lru_unlink(cache, found);
+      lru_push_front(cache, found);
+      found->refs++;
+      *entry = found;
+      result = ROUTE_CACHE_HIT;
+      break;
+    }
+    if (!found->filling) {
+      // Expired, or stale with nobody refreshing it yet.
+      found->filling = true;
+      found->refs++;
+      *entry = found;
+      result = ROUTE_CACHE_FILL;
+      break;
+    }
+    if (!wait_for_fill(cache, &deadline))
+      break;
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return result;
+}
+
+/**
+ * @brief Replaces `entry` with a new one holding `data`, or with a pass
+ * marker if `data` is NULL, and evicts the least recently used entries
+ * until the cache fits. Readers may still hold the old response, so it is
+ * never overwritten. A marker counts its key against `max_bytes`.
+ * @return False on allocation failure.
+ */
+static bool replace(RouteCache *cache, RouteCacheEntry *entry, char *data,
+                    size_t size, int64_t now) {
+  if (!entry->evicted)
+    evict(cache, entry);
+  RouteCacheEntry *fresh = insert(cache, entry->key, entry->key_len);
+  if (!fresh)
+    return false;
+  if (data) {
+    fresh->data = data;
+    fresh->size = size;
+    fresh->fresh_until = now + cache->ttl_ms;
+    fresh->stale_until = fresh->fresh_until + cache->stale_ms;
+  } else {
+    fresh->pass = true;
+    fresh->size = fresh->key_len;
+    fresh->fresh_until = fresh->stale_until = now + ROUTE_CACHE_PASS_MS;
+  }
+  cache->bytes += fresh->size;
+  while (cache->bytes > cache->max_bytes) {
+    RouteCacheEntry *victim = cache->lru_tail;
+    while (victim && victim->filling)
+      victim = victim->lru_prev;
+    if (!victim)
+      break;
+    evict(cache, victim);
+  }
+  lru_push_front(cache, fresh);
+  return true;
+}
+
+void route_cache_store(RouteCache *cache, RouteCacheEntry *entry, char *data,
+                       size_t size) {
+  bool pass = false;
+  if (data && (!storable(data, size) || size > cache->max_bytes)) {
+    free(data);
+    data = NULL;
+    pass = true;
+  }
+
+  pthread_mutex_lock(&cache->lock);
+  entry->filling = false;
+  int64_t now = now_ms();
+  if (data) {
+    if (!replace(cache, entry, data, size, now))
+      free(data);
+  } else if (pass) {
+    // Waiters wake to the marker and run the handler themselves.
+    replace(cache, entry, NULL, 0, now);
+  } else if (!entry->evicted && (!entry->data || now >= entry->stale_until)) {
+    evict(cache, entry);
+  }
+  pthread_cond_broadcast(&cache->filled);
+  bool free_now = --entry->refs == 0 && entry->evicted;
+  pthread_mutex_unlock(&cache->lock);
+  if (free_now)
+    entry_free(entry);
+}
+
+void route_cache_release(RouteCache *cache, RouteCacheEntry *entry) {
+  if (!entry)
+    return;
+  pthread_mutex_lock(&cache->lock);
+  bool free_now = --entry->refs == 0 && entry->evicted;
+  pthread_mutex_unlock(&cache->lock);
+  if (free_now)
+    entry_free(entry);
+}
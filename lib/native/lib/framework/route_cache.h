@@ -0,0 +1,131 @@
+/**
+ * @file route_cache.h
+ * @brief Defines a bounded, thread-safe cache of whole route responses.
+ *
+ * A route opted in with `router_cache_route` keeps the bytes its handler
+ * wrote, keyed by the request method, path, query and any configured `vary`
+ * headers, and replays them until they expire. Only complete 200 responses
+ * are kept, and never one that sets a cookie or carries `Cache-Control:
+ * no-store` or `private`.
+ *
+ * Concurrent misses on one key are coalesced: the first request runs the
+ * handler and the rest wait for its response instead of running it again.
+ * Once an entry is past its TTL but inside its stale window, it keeps being
+ * served while a single request refreshes it. A key whose response may not
+ * be cached is remembered for `ROUTE_CACHE_PASS_MS`, during which requests
+ * for it run the handler at once instead of queueing behind each other.
+ * Waiting blocks the calling thread, so coalescing pays off when handlers
+ * run on several workers or on `handlerThreads`.
+ */
+#ifndef ROUTE_CACHE_H
+#define ROUTE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief How long a request waits for another to fill its entry before
+ * running the handler itself.
+ */
+#define ROUTE_CACHE_WAIT_MS 5000
+
+/**
+ * @brief How long requests for a key bypass the cache after its response
+ * could not be cached.
+ */
+#define ROUTE_CACHE_PASS_MS 1000
+
+/**
+ * @struct RouteCacheOptions
+ * @brief How one route's responses are cached.
+ */
+typedef struct {
+  int ttl_ms;   ///< How long a response is served as fresh.
+  int stale_ms; ///< How long after that it is served while being refreshed.
+  size_t max_bytes; ///< The total size of responses the cache may hold.
+  const char *const *vary; ///< Request headers that are part of the key.
+  int vary_count;
+} RouteCacheOptions;
+
+/**
+ * @struct RouteCacheEntry
+ * @brief A cached response. Returned by `route_cache_lookup` with a
+ * reference held; `data` and `size` are immutable until it is released.
+ */
+typedef struct RouteCacheEntry {
+  char *key;
+  size_t key_len;
+  char *data; // The raw response, head and body; NULL until first filled.
+  size_t size;
+  int64_t fresh_until; // Monotonic milliseconds.
+  int64_t stale_until;
+
+  bool pass;    // The response may not be cached; bypass until fresh_until.
+  bool filling; // A request is running the handler for this key.
+  int refs;
+  bool evicted;
+  struct RouteCacheEntry *hash_next;
+  struct RouteCacheEntry *lru_prev;
+  struct RouteCacheEntry *lru_next;
+} RouteCacheEntry;
+
+typedef struct RouteCache RouteCache;
+
+/**
+ * @brief What the caller of `route_cache_lookup` must do next.
+ */
+typedef enum {
+  ROUTE_CACHE_HIT,   ///< Write the entry's data, then release it.
+  ROUTE_CACHE_FILL,  ///< Run the handler, then pass its output to
+                     ///< `route_cache_store`.
+  ROUTE_CACHE_BYPASS ///< Run the handler without caching its output.
+} RouteCacheResult;
+
+/**
+ * @brief Creates an empty cache.
+ * @param options The caching policy; `vary` is copied.
+ * @return A new `RouteCache`, or NULL on allocation failure.
+ */
+RouteCache *route_cache(const RouteCacheOptions *options);
+
+/**
+ * @brief Frees the cache. Every entry must have been released.
+ */
+void route_cache_free(RouteCache *cache);
+
+/**
+ * @brief Returns the request headers that are part of the key.
+ * @param[out] count Set to the number of headers.
+ */
+const char *const *route_cache_vary(const RouteCache *cache, int *count);
+
+/**
+ * @brief Finds the response cached under `key`, waiting if another request
+ * is filling it.
+ * @param cache The cache.
+ * @param key The key; may contain NUL bytes.
+ * @param key_len The length of `key`.
+ * @param[out] entry Set to a referenced entry on HIT and FILL.
+ */
+RouteCacheResult route_cache_lookup(RouteCache *cache, const char *key,
+                                    size_t key_len, RouteCacheEntry **entry);
+
+/**
+ * @brief Finishes a FILL with the handler's output and wakes any waiters.
+ *
+ * Takes ownership of `data`, which is freed if the response may not be
+ * cached; lookups of the key then bypass the cache for
+ * `ROUTE_CACHE_PASS_MS`. Pass NULL if the handler's output could not be
+ * captured; an entry still inside its stale window then keeps being served.
+ * Releases `entry`.
+ */
+void route_cache_store(RouteCache *cache, RouteCacheEntry *entry, char *data,
+                       size_t size);
+
+/**
+ * @brief Drops a reference returned by `route_cache_lookup`.
+ */
+void route_cache_release(RouteCache *cache, RouteCacheEntry *entry);
+
+#endif // ROUTE_CACHE_H
@@ -0,0 +1,281 @@
+/**
+ * @file route_tree.c
+ * @brief Implements the radix tree of compiled route patterns.
+ */
+#define _GNU_SOURCE
+#include "route_tree.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum { NODE_STATIC, NODE_PARAM, NODE_CATCH_ALL } RouteNodeKind;
+
+/**
+ * @struct RouteNode
+ * @brief One edge of the tree and the routes that end there.
+ *
+ * A static node matches its `text` exactly. Its static children start with
+ * distinct bytes, so at most one of them can match the next byte of a path.
+ */
+typedef struct RouteNode {
+  RouteNodeKind kind;
+  char *text; // Static: the path text. Param and catch-all: the name.
+  size_t len;
+  char stop;  // Param: the byte that ends the capture besides `/`, or 0.
+  int value;  // The route ending here, or -1.
+  struct RouteNode **children; // Static children first, then params, then
+  int child_count;             // the catch-all.
+  int static_count;
+} RouteNode;
+
+struct RouteTree {
+  RouteNode *root;
+};
+
+static RouteNode *route_node(RouteNodeKind kind, const char *text,
+                             size_t len) {
+  RouteNode *node = calloc(1, sizeof(RouteNode));
+  if (!node)
+    return NULL;
+  node->text = strndup(text, len);
+  if (!node->text) {
+    free(node);
+    return NULL;
+  }
+  node->kind = kind;
+  node->len = len;
+  node->value = -1;
+  return node;
+}
+
+static void route_node_free(RouteNode *node) {
+  if (!node)
+    return;
+  for (int i = 0; i < node->child_count; i++)
+    route_node_free(node->children[i]);
+  free(node->children);
+  free(node->text);
+  free(node);
+}
+
+/**
+ * @brief Adds `child` to `node`, keeping static children ahead of parameters
+ * and the catch-all last.
+ */
+static bool add_child(RouteNode *node, RouteNode *child) {
+  RouteNode **children = realloc(
+      node->children, sizeof(RouteNode *) * (size_t)(node->child_count + 1));
+  if (!children)
+    return false;
+  node->children = children;
+  int at = node->child_count;
+  if (child->kind == NODE_STATIC)
+    at = node->static_count++;
+  else if (child->kind == NODE_PARAM && node->child_count > 0 &&
+           node->children[node->child_count - 1]->kind == NODE_CATCH_ALL)
+    at = node->child_count - 1;
+  memmove(&children[at + 1], &children[at],
+          sizeof(RouteNode *) * (size_t)(node->child_count - at));
+  children[at] = child;
+  node->child_count++;
+  return true;
+}
+
+/**
+ * @brief Walks or extends the static edges below `node` along `text`,
+ * splitting an edge where `text` leaves it.
+ * @return The node at the end of `text`, or NULL on allocation failure.
+ */
+static RouteNode *insert_static(RouteNode *node, const char *text,
+                                size_t len) {
+  while (len > 0) {
+    RouteNode *child = NULL;
+    for (int i = 0; i < node->static_count; i++) {
+      if (node->children[i]->text[0] == text[0]) {
+        child = node->children[i];
+        break;
+      }
+    }
+    if (!child) {
+      RouteNode *leaf = route_node(NODE_STATIC, text, len);
+      if (!leaf || !add_child(node, leaf)) {
+        route_node_free(leaf);
+        return NULL;
+      }
+      return leaf;
+    }
+
+    size_t common = 0;
+    while (common < len && common < child->len &&
+           text[common] == child->text[common])
+      common++;
+    if (common < child->len) {
+      // Split the edge: `child` keeps its tail under a new shared prefix.
+      RouteNode *prefix = route_node(NODE_STATIC, child->text, common);
+      char *tail = strndup(child->text + common, child->len - common);
+      if (!prefix || !tail || !add_child(prefix, child)) {
+        route_node_free(prefix);
+        free(tail);
+        return NULL;
+      }
+      free(child->text);
+      child->text = tail;
+      child->len -= common;
+      for (int i = 0; i < node->static_count; i++)
+        if (node->children[i] == child)
+          node->children[i] = prefix;
+      child = prefix;
+    }
+    node = child;
+    text += common;
+    len -= common;
+  }
+  return node;
+}
+
+static RouteNode *insert_capture(RouteNode *node, RouteNodeKind kind,
+                                 const char *name, size_t len, char stop) {
+  for (int i = node->static_count; i < node->child_count; i++) {
+    RouteNode *child = node->children[i];
+    // A node has one catch-all, whatever it is called.
+    if (child->kind == kind &&
+        (kind == NODE_CATCH_ALL ||
+         (child->len == len && child->stop == stop &&
+          memcmp(child->text, name, len) == 0)))
+      return child;
+  }
+  RouteNode *child = route_node(kind, name, len);
+  if (!child)
+    return NULL;
+  child->stop = stop;
+  if (!add_child(node, child)) {
+    route_node_free(child);
+    return NULL;
+  }
+  return child;
+}
+
+RouteTree *route_tree(void) {
+  RouteTree *tree = calloc(1, sizeof(RouteTree));
+  if (!tree)
+    return NULL;
+  tree->root = route_node(NODE_STATIC, "", 0);
+  if (!tree->root) {
+    free(tree);
+    return NULL;
+  }
+  return tree;
+}
+
+void route_tree_free(RouteTree *tree) {
+  if (!tree)
+    return;
+  route_node_free(tree->root);
+  free(tree);
+}
+
+static Status fail(char **error, Status status, const char *message,
+                   const char *pattern) {
+  if (error)
+    asprintf(error, "%s: %s", message, pattern);
+  return status;
+}
+
+Status route_tree_insert(RouteTree *tree, const char *pattern, int value,
+                         char **error) {
+  if (!tree || !pattern || value < 0)
+    return fail(error, ERROR_INVALID_ARG, "Invalid route", pattern ? pattern
+                                                                    : "");
+  RouteNode *node = tree->root;
+  int params = 0;
+  const char *p = pattern;
+  while (*p) {
+    if (*p != '[') {
+      const char *open = strchr(p, '[');
+      size_t len = open ? (size_t)(open - p) : strlen(p);
+      node = insert_static(node, p, len);
+      p += len;
+    } else {
+      bool catch_all = strncmp(p + 1, "...", 3) == 0;
+      const char *name = p + (catch_all ? 4 : 1);
+      const char *close = strchr(name, ']');
+      if (!close || close == name || memchr(name, '/', close - name))
+        return fail(error, ERROR_PARSE, "Malformed route parameter", pattern);
+      if (catch_all && close[1] != '\0')
+        return fail(error, ERROR_PARSE, "Catch-all must end the route",
+                    pattern);
+      if (close[1] == '[')
+        return fail(error, ERROR_PARSE, "Adjacent route parameters", pattern);
+      if (++params > ROUTE_MAX_PARAMS)
+        return fail(error, ERROR_PARSE, "Too many route parameters", pattern);
+      node = insert_capture(node, catch_all ? NODE_CATCH_ALL : NODE_PARAM,
+                            name, (size_t)(close - name),
+                            close[1] == '/' ? '\0' : close[1]);
+      p = close + 1;
+    }
+    if (!node)
+      return fail(error, ERROR_MEMORY, "Out of memory compiling route",
+                  pattern);
+  }
+  if (node->value >= 0)
+    return fail(error, ERROR_INVALID_ARG, "Duplicate route", pattern);
+  node->value = value;
+  return OK;
+}
+
+typedef struct {
+  const char *end;
+  RouteParam *params;
+  int count;
+} Match;
+
+static int match_node(const RouteNode *node, const char *p, Match *match) {
+  if (p == match->end && node->value >= 0)
+    return node->value;
+
+  size_t left = (size_t)(match->end - p);
+  if (left > 0) {
+    // At most one static child starts with the next byte.
+    for (int i = 0; i < node->static_count; i++) {
+      const RouteNode *child = node->children[i];
+      if (child->text[0] != p[0])
+        continue;
+      if (left >= child->len && memcmp(p, child->text, child->len) == 0) {
+        int found = match_node(child, p + child->len, match);
+        if (found >= 0)
+          return found;
+      }
+      break;
+    }
+  }
+
+  for (int i = node->static_count; i < node->child_count; i++) {
+    const RouteNode *child = node->children[i];
+    int saved = match->count;
+    if (child->kind == NODE_CATCH_ALL) {
+      match->params[match->count++] = (RouteParam){
+          .name = child->text, .value = p, .len = left, .catch_all = true};
+      return child->value;
+    }
+    const char *q = p;
+    while (q < match->end && *q != '/' && *q != child->stop)
+      q++;
+    if (q == p)
+      continue;
+    match->params[match->count++] =
+        (RouteParam){.name = child->text, .value = p, .len = (size_t)(q - p)};
+    int found = match_node(child, q, match);
+    if (found >= 0)
+      return found;
+    match->count = saved;
+  }
+  return -1;
+}
+
+int route_tree_match(const RouteTree *tree, const char *path, size_t len,
+                     RouteParam *params, int *param_count) {
+  Match match = {.end = path + len, .params = params, .count = 0};
+  int value = tree ? match_node(tree->root, path, &match) : -1;
+  *param_count = value >= 0 ? match.count : 0;
+  return value;
+}
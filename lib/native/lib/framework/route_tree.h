@@ -0,0 +1,78 @@
+/**
+ * @file route_tree.h
+ * @brief Defines a radix tree of compiled route patterns.
+ *
+ * Patterns are compiled once, when a route is added, into a tree whose edges
+ * are path text shared between routes, `[param]` captures and `[...rest]`
+ * catch-alls. A lookup walks the request path once, trying static text
+ * before parameters and parameters before catch-alls at each node, and
+ * backtracks only when a branch dead-ends. It allocates nothing: parameters
+ * come back as spans of the path being matched.
+ *
+ * A parameter captures a non-empty run of the path up to the next `/`, or up
+ * to the character that follows it in the pattern (`[name].txt`). A
+ * catch-all must end its pattern and captures the rest of the path, which may
+ * be empty.
+ */
+#ifndef ROUTE_TREE_H
+#define ROUTE_TREE_H
+
+#include "../core/error.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief The most parameters one route pattern may capture.
+ */
+#define ROUTE_MAX_PARAMS 16
+
+/**
+ * @struct RouteParam
+ * @brief A parameter captured from a request path.
+ */
+typedef struct {
+  const char *name;  ///< The name from the pattern, NUL-terminated.
+  const char *value; ///< The raw, undecoded text in the matched path.
+  size_t len;        ///< The length of `value`.
+  bool catch_all;    ///< Captured by `[...name]`; may contain slashes.
+} RouteParam;
+
+typedef struct RouteTree RouteTree;
+
+/**
+ * @brief Creates an empty tree.
+ * @return A new `RouteTree`, or NULL on allocation failure.
+ */
+RouteTree *route_tree(void);
+
+/**
+ * @brief Frees the tree and its compiled patterns.
+ */
+void route_tree_free(RouteTree *tree);
+
+/**
+ * @brief Compiles `pattern` into the tree.
+ * @param tree The tree.
+ * @param pattern The route pattern, such as "/users/[id]".
+ * @param value The value a match on this pattern returns; must be >= 0.
+ * @param[out] error Set to a new error message on failure.
+ * @return OK, ERROR_PARSE for a malformed pattern, or ERROR_INVALID_ARG if
+ * an identical pattern is already in the tree.
+ */
+Status route_tree_insert(RouteTree *tree, const char *pattern, int value,
+                         char **error);
+
+/**
+ * @brief Finds the route matching a path.
+ * @param tree The tree.
+ * @param path The path to match, without its query string.
+ * @param len The length of `path`.
+ * @param[out] params Receives up to `ROUTE_MAX_PARAMS` parameters, pointing
+ * into `path`.
+ * @param[out] param_count Set to the number of parameters captured.
+ * @return The value the matching pattern was inserted with, or -1.
+ */
+int route_tree_match(const RouteTree *tree, const char *path, size_t len,
+                     RouteParam *params, int *param_count);
+
+#endif // ROUTE_TREE_H
@@ -1,14 +1,25 @@
+#define _GNU_SOURCE
 #include "router.h"
+#include "../modules/server.h"
 #include "../webs_api.h"
+#include <ctype.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 static void run_next_middleware_or_handler(RequestContext *ctx);
 static void test_handler_root(RequestContext *ctx);
 static void test_handler_user(RequestContext *ctx);
 static void test_handler_post(RequestContext *ctx);
 static void test_handler_posts_by_date(RequestContext *ctx);
+static void test_handler_redirect(RequestContext *ctx);
+static void test_handler_cached(RequestContext *ctx);
+static void test_handler_cached_cookie(RequestContext *ctx);
+static void test_handler_usernames(RequestContext *ctx);
+static void test_handler_users_json(RequestContext *ctx);
+static void test_handler_user_columns(RequestContext *ctx);
 static void test_handler_register(RequestContext *ctx);
 static void test_handler_login(RequestContext *ctx);
 static void test_handler_logout(RequestContext *ctx);
@@ -19,20 +30,20 @@ static void send_json_response(int client_fd, int status_code,
 static void send_json_response_with_headers(int client_fd, int status_code,
                                             const char *status_text,
                                             Value *headers, Value *payload);
+static void send_text_response(int client_fd, const char *body);
+
+static const struct {
+  const char *name;
+  HttpMethod method;
+} methods[] = {{"GET", HTTP_GET},       {"POST", HTTP_POST},
+               {"PUT", HTTP_PUT},       {"DELETE", HTTP_DELETE},
+               {"PATCH", HTTP_PATCH},   {"OPTIONS", HTTP_OPTIONS}};
 
 static HttpMethod method_from_string(const char *method_str) {
-  if (strcasecmp(method_str, "GET") == 0)
-    return HTTP_GET;
-  if (strcasecmp(method_str, "POST") == 0)
-    return HTTP_POST;
-  if (strcasecmp(method_str, "PUT") == 0)
-    return HTTP_PUT;
-  if (strcasecmp(method_str, "DELETE") == 0)
-    return HTTP_DELETE;
-  if (strcasecmp(method_str, "PATCH") == 0)
-    return HTTP_PATCH;
-  if (strcasecmp(method_str, "OPTIONS") == 0)
-    return HTTP_OPTIONS;
+  for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+    if (strcasecmp(method_str, methods[i].name) == 0)
+      return methods[i].method;
+  }
   return -1;
 }
 
@@ -59,7 +70,12 @@ void router_free(Router *router) {
   for (int i = 0; i < router->count; i++) {
     free(router->routes[i].path);
     free(router->routes[i].middleware);
+    route_cache_free(router->routes[i].cache);
   }
+  for (int i = 0; i < HTTP_METHOD_COUNT; i++)
+    route_tree_free(router->trees[i]);
+  auth_sweeper_free(router->session_sweeper);
+  W->db->poolFree(router->db_pool);
   free(router->routes);
   free(router);
 }
@@ -69,8 +85,17 @@ void router_add_route_with_middleware(Router *router, HttpMethod method,
                                       MiddlewareFunc *middleware,
                                       int middleware_count,
                                       RouteHandler handler) {
-  if (!router || !path || !handler)
+  if (!router || !path || !handler || (unsigned)method >= HTTP_METHOD_COUNT)
     return;
+  if (!router->trees[method])
+    router->trees[method] = route_tree();
+  char *error = NULL;
+  if (route_tree_insert(router->trees[method], path, router->count, &error) !=
+      OK) {
+    W->log->error("Route not added: %s", error ? error : path);
+    free(error);
+    return;
+  }
   if (router->count >= router->capacity) {
     router->capacity *= 2;
     router->routes = (RouteDefinition *)realloc(
@@ -80,6 +105,7 @@ void router_add_route_with_middleware(Router *router, HttpMethod method,
   router->routes[router->count].path = strdup(path);
   router->routes[router->count].handler = handler;
   router->routes[router->count].middleware_count = middleware_count;
+  router->routes[router->count].cache = NULL;
 
   if (middleware_count > 0 && middleware) {
     router->routes[router->count].middleware =
@@ -97,45 +123,325 @@ void router_add_route(Router *router, HttpMethod method, const char *path,
   router_add_route_with_middleware(router, method, path, NULL, 0, handler);
 }
 
+void router_use_db(Router *router, DbPool *pool) {
+  if (!router)
+    return;
+  if (router->db_pool != pool) {
+    auth_sweeper_free(router->session_sweeper);
+    router->session_sweeper = NULL;
+    W->db->poolFree(router->db_pool);
+  }
+  router->db_pool = pool;
+}
+
+Status router_sweep_sessions(Router *router, int interval_ms, char **error) {
+  if (!router || !router->db_pool) {
+    if (error)
+      *error = strdup("Sessions can only be swept from a router's pool");
+    return ERROR_INVALID_STATE;
+  }
+  auth_sweeper_free(router->session_sweeper);
+  router->session_sweeper = auth_sweeper(router->db_pool, interval_ms);
+  if (!router->session_sweeper) {
+    if (error)
+      *error = strdup("Could not start the session sweeper");
+    return ERROR;
+  }
+  return OK;
+}
+
+Status router_cache_route(Router *router, HttpMethod method, const char *path,
+                          const RouteCacheOptions *options, char **error) {
+  if (!router || !path || !options || method != HTTP_GET) {
+    if (error)
+      *error = strdup("Only GET routes can be cached");
+    return ERROR_INVALID_ARG;
+  }
+  for (int i = 0; i < router->count; i++) {
+    RouteDefinition *route = &router->routes[i];
+    if (route->method != method || strcmp(route->path, path) != 0)
+      continue;
+    RouteCache *cache = route_cache(options);
+    if (!cache) {
+      if (error)
+        *error = strdup("Failed to allocate route cache");
+      return ERROR_MEMORY;
+    }
+    route_cache_free(route->cache);
+    route->cache = cache;
+    return OK;
+  }
+  if (error)
+    asprintf(error, "No GET route: %s", path);
+  return ERROR_INVALID_ARG;
+}
+
+/**
+ * @brief Builds the cache key for a request: the method, the request target
+ * with its query, and each `vary` header, separated by NUL bytes.
+ * @return A new key the caller must free, or NULL on allocation failure.
+ */
+static char *cache_key(RequestContext *ctx, const RouteCache *cache,
+                       size_t *key_len) {
+  const char *method = methods[ctx->route->method].name;
+  const char *path = NULL, *query = NULL;
+  size_t path_len = 0, query_len = 0;
+  if (ctx->http) {
+    path = http_span_data(ctx->http, ctx->http->path);
+    path_len = ctx->http->path.len;
+    query = http_span_data(ctx->http, ctx->http->query);
+    query_len = ctx->http->query.len;
+  } else {
+    path = W->valueAsString(W->objectGetRef(ctx->request, "path"));
+    if (!path)
+      path = "";
+    path_len = strcspn(path, "?");
+    query = path[path_len] ? path + path_len + 1 : "";
+    query_len = strlen(query);
+  }
+
+  int vary_count = 0;
+  const char *const *vary = route_cache_vary(cache, &vary_count);
+  char *values[vary_count > 0 ? vary_count : 1];
+  size_t len = strlen(method) + 1 + path_len + 1 + query_len;
+  for (int i = 0; i < vary_count; i++) {
+    values[i] = router_header(ctx, vary[i]);
+    // An absent header keys differently from an empty one.
+    len += 1 + (values[i] ? strlen(values[i]) : 1);
+  }
+
+  char *key = malloc(len);
+  if (key) {
+    char *p = key;
+    size_t method_len = strlen(method) + 1;
+    memcpy(p, method, method_len);
+    p += method_len;
+    memcpy(p, path, path_len);
+    p += path_len;
+    *p++ = '?';
+    memcpy(p, query, query_len);
+    p += query_len;
+    for (int i = 0; i < vary_count; i++) {
+      *p++ = '\0';
+      if (values[i]) {
+        memcpy(p, values[i], strlen(values[i]));
+        p += strlen(values[i]);
+      } else {
+        *p++ = '\1';
+      }
+    }
+    *key_len = len;
+  }
+  for (int i = 0; i < vary_count; i++)
+    free(values[i]);
+  return key;
+}
+
+/**
+ * @brief Serves a request for a cached route, running the middleware and
+ * handler only to fill or refresh the cache.
+ */
+static void run_cached(RequestContext *ctx) {
+  RouteCache *cache = ctx->route->cache;
+  size_t key_len = 0;
+  char *key = cache_key(ctx, cache, &key_len);
+  RouteCacheEntry *entry = NULL;
+  RouteCacheResult result =
+      key ? route_cache_lookup(cache, key, key_len, &entry)
+          : ROUTE_CACHE_BYPASS;
+  free(key);
+
+  if (result == ROUTE_CACHE_HIT) {
+    W->server->write(ctx->client_fd, entry->data, entry->size);
+    route_cache_release(cache, entry);
+    return;
+  }
+  if (result == ROUTE_CACHE_BYPASS) {
+    run_next_middleware_or_handler(ctx);
+    return;
+  }
+
+  ServerCapture capture;
+  W->server->captureBegin(&capture, ctx->client_fd);
+  run_next_middleware_or_handler(ctx);
+  W->server->captureEnd(&capture);
+  if (capture.failed) {
+    free(capture.data);
+    route_cache_store(cache, entry, NULL, 0);
+    Response res;
+    W->response->init(&res, ctx->client_fd, 500, "Internal Server Error");
+    W->response->send(&res);
+    return;
+  }
+  W->server->write(ctx->client_fd, capture.data, capture.len);
+  route_cache_store(cache, entry, capture.data, capture.len);
+}
+
+static void dispatch(Router *router, int client_fd, HttpMethod method,
+                     const char *path, size_t path_len, Value *request,
+                     const HttpRequest *http) {
+  RouteParam params[ROUTE_MAX_PARAMS];
+  int param_count = 0;
+  int index = (unsigned)method < HTTP_METHOD_COUNT
+                  ? route_tree_match(router->trees[method], path, path_len,
+                                     params, &param_count)
+                  : -1;
+  if (index < 0) {
+    Response res;
+    W->response->init(&res, client_fd, 404, "Not Found");
+    W->response->body(&res, "Not Found", 9);
+    W->response->send(&res);
+    return;
+  }
+
+  RequestContext ctx = {.request = request,
+                        .http = http,
+                        .client_fd = client_fd,
+                        .db = NULL,
+                        .user = NULL,
+                        .route = &router->routes[index],
+                        .next_middleware_index = 0,
+                        .route_params = params,
+                        .param_count = param_count,
+                        .params_object = NULL,
+                        .db_pool = router->db_pool};
+  if (ctx.route->cache)
+    run_cached(&ctx);
+  else
+    run_next_middleware_or_handler(&ctx);
+  if (ctx.params_object)
+    W->freeValue(ctx.params_object);
+  if (ctx.db && ctx.db_pool)
+    W->db->release(ctx.db_pool, ctx.db);
+  else if (ctx.db)
+    W->db->close(ctx.db, NULL);
+  if (ctx.user)
+    W->freeValue(ctx.user);
+  if (ctx.owns_request)
+    W->freeValue(ctx.request);
+}
+
 void router_handle_request(Router *router, int client_fd, Value *request) {
   Value *method_val = W->objectGetRef(request, "method");
   Value *path_val = W->objectGetRef(request, "path");
   const char *method_str = W->valueAsString(method_val);
   const char *path_str = W->valueAsString(path_val);
-  HttpMethod request_method = method_from_string(method_str);
+  if (!path_str)
+    path_str = "";
+  Arena *previous = W->arena->enter(W->server->requestArena());
+  dispatch(router, client_fd, method_from_string(method_str), path_str,
+           strcspn(path_str, "?"), request, NULL);
+  W->arena->leave(previous);
+}
 
-  for (int i = 0; i < router->count; i++) {
-    RouteDefinition *route = &router->routes[i];
-    if (route->method == request_method) {
-      Value *params = NULL;
-      char *match_error = NULL;
-      Status match_status =
-          W->url->matchRoute(route->path, path_str, &params, &match_error);
-      if (match_error)
-        W->freeString(match_error);
-
-      if (match_status == OK && params != NULL) {
-        RequestContext ctx = {.request = request,
-                              .params = params,
-                              .client_fd = client_fd,
-                              .db = NULL,
-                              .user = NULL,
-                              .route = route,
-                              .next_middleware_index = 0};
-        run_next_middleware_or_handler(&ctx);
-        W->freeValue(params);
-        if (ctx.db)
-          W->db->close(ctx.db, NULL);
-        if (ctx.user)
-          W->freeValue(ctx.user);
-        return;
-      }
-      if (params)
-        W->freeValue(params);
+void router_handle_http(Router *router, int client_fd,
+                        const HttpRequest *request) {
+  HttpMethod method = -1;
+  for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+    if (http_span_equals(request, request->method, methods[i].name)) {
+      method = methods[i].method;
+      break;
+    }
+  }
+  // Values built while routing live until the response has been queued.
+  Arena *previous = W->arena->enter(W->server->requestArena());
+  dispatch(router, client_fd, method, http_span_data(request, request->path),
+           request->path.len, NULL, request);
+  W->arena->leave(previous);
+}
+
+Value *router_db(RequestContext *ctx, char **error) {
+  if (ctx->db)
+    return ctx->db;
+  if (!ctx->db_pool) {
+    if (error)
+      *error = strdup("No database pool configured");
+    return NULL;
+  }
+  W->db->acquire(ctx->db_pool, &ctx->db, error);
+  return ctx->db;
+}
+
+const RouteParam *router_param(const RequestContext *ctx, const char *name) {
+  for (int i = 0; i < ctx->param_count; i++)
+    if (strcmp(ctx->route_params[i].name, name) == 0)
+      return &ctx->route_params[i];
+  return NULL;
+}
+
+/**
+ * @brief Builds a string `Value` from a path span, decoding %XX escapes.
+ */
+static Value *decode_segment(const char *text, size_t len) {
+  char stack[256];
+  char *decoded = len < sizeof(stack) ? stack : malloc(len + 1);
+  if (!decoded)
+    return NULL;
+  size_t out = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (text[i] == '%' && i + 2 < len &&
+        isxdigit((unsigned char)text[i + 1]) &&
+        isxdigit((unsigned char)text[i + 2])) {
+      char hex[3] = {text[i + 1], text[i + 2], '\0'};
+      decoded[out++] = (char)strtol(hex, NULL, 16);
+      i += 2;
+    } else {
+      decoded[out++] = text[i];
+    }
+  }
+  decoded[out] = '\0';
+  Value *value = W->string(decoded);
+  if (decoded != stack)
+    free(decoded);
+  return value;
+}
+
+Value *router_params(RequestContext *ctx) {
+  if (ctx->params_object)
+    return ctx->params_object;
+  ctx->params_object = W->object();
+  for (int i = 0; i < ctx->param_count; i++) {
+    const RouteParam *param = &ctx->route_params[i];
+    if (!param->catch_all) {
+      W->objectSet(ctx->params_object, param->name,
+                   decode_segment(param->value, param->len));
+      continue;
+    }
+    Value *segments = W->array();
+    const char *p = param->value;
+    const char *end = param->value + param->len;
+    while (p < end) {
+      const char *slash = memchr(p, '/', (size_t)(end - p));
+      const char *segment_end = slash ? slash : end;
+      if (segment_end > p)
+        W->arrayPush(segments, decode_segment(p, (size_t)(segment_end - p)));
+      p = segment_end + 1;
     }
+    W->objectSet(ctx->params_object, param->name, segments);
+  }
+  return ctx->params_object;
+}
+
+Value *router_request(RequestContext *ctx) {
+  if (!ctx->request && ctx->http) {
+    ctx->request = W->http->requestValue(ctx->http);
+    ctx->owns_request = ctx->request != NULL;
+  }
+  return ctx->request;
+}
+
+char *router_header(RequestContext *ctx, const char *name) {
+  if (ctx->http) {
+    HttpSpan value;
+    if (!W->http->header(ctx->http, name, &value))
+      return NULL;
+    return strndup(http_span_data(ctx->http, value), value.len);
   }
-  const char *resp = "HTTP/1.1 404 Not Found\r\n\r\nNot Found";
-  W->server->writeResponse(client_fd, resp);
+  Value *headers = W->objectGetRef(ctx->request, "headers");
+  Value *header = headers ? W->objectGetRef(headers, name) : NULL;
+  if (!header || W->valueGetType(header) != VALUE_STRING)
+    return NULL;
+  return strdup(W->valueAsString(header));
 }
 
 static void run_next_middleware_or_handler(RequestContext *ctx) {
@@ -159,44 +465,34 @@ static void send_json_response_with_headers(int client_fd, int status_code,
                                             const char *status_text,
                                             Value *headers, Value *payload) {
   char *json_body = W->json->encode(payload);
-  StringBuilder sb;
-  W->stringBuilder->init(&sb);
-
-  char status_line[128];
-  snprintf(status_line, sizeof(status_line), "HTTP/1.1 %d %s\r\n", status_code,
-           status_text);
-  W->stringBuilder->appendStr(&sb, status_line);
-  W->stringBuilder->appendStr(&sb, "Content-Type: application/json\r\n");
-  char content_length_header[64];
-  snprintf(content_length_header, sizeof(content_length_header),
-           "Content-Length: %zu\r\n", strlen(json_body));
-  W->stringBuilder->appendStr(&sb, content_length_header);
+  Response res;
+  W->response->init(&res, client_fd, status_code, status_text);
+  W->response->header(&res, "Content-Type", "application/json");
 
   if (headers && W->valueGetType(headers) == VALUE_OBJECT) {
     Value *keys = W->objectKeys(headers);
     for (size_t i = 0; i < W->arrayCount(keys); i++) {
       const char *key = W->valueAsString(W->arrayGetRef(keys, i));
       const char *value = W->valueAsString(W->objectGetRef(headers, key));
-      W->stringBuilder->appendStr(&sb, key);
-      W->stringBuilder->appendStr(&sb, ": ");
-      W->stringBuilder->appendStr(&sb, value);
-      W->stringBuilder->appendStr(&sb, "\r\n");
+      W->response->header(&res, key, value);
     }
     W->freeValue(keys);
   }
-  W->stringBuilder->appendStr(&sb, "\r\n");
-  char *header_str = W->stringBuilder->toString(&sb);
-  W->server->writeResponse(client_fd, header_str);
-  W->server->writeResponse(client_fd, json_body);
-  W->freeString(header_str);
-  W->freeString(json_body);
+  W->response->bodyOwned(&res, json_body, strlen(json_body));
+  W->response->send(&res);
+}
+
+static void send_text_response(int client_fd, const char *body) {
+  Response res;
+  W->response->init(&res, client_fd, 200, "OK");
+  W->response->header(&res, "Content-Type", "text/plain; charset=utf-8");
+  W->response->body(&res, body, strlen(body));
+  W->response->send(&res);
 }
 
 static void test_db_middleware(RequestContext *ctx, NextFunc next) {
   char *db_error = NULL;
-  Status status = W->db->open("./api_test.db", &ctx->db, &db_error);
-
-  if (status != OK) {
+  if (!router_db(ctx, &db_error)) {
     Value *err = W->objectOf(
         "message", W->string(db_error ? db_error : "Could not open database"),
         NULL);
@@ -206,23 +502,12 @@ static void test_db_middleware(RequestContext *ctx, NextFunc next) {
       W->freeString(db_error);
     return;
   }
-  if (db_error)
-    W->freeString(db_error);
-
-  char *exec_error = NULL;
-  W->db->exec(ctx->db,
-              "CREATE TABLE IF NOT EXISTS users (username TEXT UNIQUE, "
-              "password TEXT); CREATE TABLE IF NOT EXISTS sessions "
-              "(session_id TEXT PRIMARY KEY, username TEXT, expires_at "
-              "INTEGER);",
-              &exec_error);
-  if (exec_error)
-    W->freeString(exec_error);
   next(ctx);
 }
 
 static void test_handler_register(RequestContext *ctx) {
-  const char *body = W->valueAsString(W->objectGetRef(ctx->request, "body"));
+  const char *body = W->valueAsString(
+      W->objectGetRef(router_request(ctx), "body"));
   Value *body_json = NULL;
   char *parse_error = NULL;
   Status status = W->json->parse(body, &body_json, &parse_error);
@@ -245,13 +530,14 @@ static void test_handler_register(RequestContext *ctx) {
   Value *password_val = W->objectGetRef(body_json, "password");
   const char *username = W->valueAsString(username_val);
   char *hashed_password = W->auth->hashPassword(W->valueAsString(password_val));
-  char sql[256];
-  snprintf(sql, sizeof(sql),
-           "INSERT INTO users (username, password) VALUES ('%s', '%s');",
-           username, hashed_password);
-
   char *exec_error = NULL;
-  status = W->db->exec(ctx->db, sql, &exec_error);
+  Value *params = W->arrayOf(
+      2, username ? W->string(username) : W->null(),
+      hashed_password ? W->string(hashed_password) : W->null());
+  status = W->db->write(ctx->db,
+                        "INSERT INTO users (username, password) VALUES (?, ?);",
+                        params, &exec_error);
+  W->freeValue(params);
 
   if (status != OK) {
     Value *err;
@@ -279,7 +565,8 @@ static void test_handler_register(RequestContext *ctx) {
 }
 
 static void test_handler_login(RequestContext *ctx) {
-  const char *body = W->valueAsString(W->objectGetRef(ctx->request, "body"));
+  const char *body = W->valueAsString(
+      W->objectGetRef(router_request(ctx), "body"));
   Value *body_json = NULL;
   char *parse_error = NULL;
   Status status = W->json->parse(body, &body_json, &parse_error);
@@ -298,49 +585,43 @@ static void test_handler_login(RequestContext *ctx) {
       W->valueAsString(W->objectGetRef(body_json, "username"));
   const char *password =
       W->valueAsString(W->objectGetRef(body_json, "password"));
-  char sql[256];
-  snprintf(sql, sizeof(sql), "SELECT password FROM users WHERE username = '%s'",
-           username);
-
-  Value *query_result = NULL;
+  DbStatement *stmt = NULL;
   char *query_error = NULL;
-  status = W->db->query(ctx->db, sql, &query_result, &query_error);
-
-  if (status == OK && query_result &&
-      W->valueGetType(query_result) == VALUE_ARRAY &&
-      W->arrayCount(query_result) == 1) {
-    Value *row = W->arrayGetRef(query_result, 0);
-    const char *hash = W->valueAsString(W->objectGetRef(row, "password"));
-    if (W->auth->verifyPassword(password, hash)) {
-      char *session_id = NULL;
-      char *session_error = NULL;
-      W->auth->createSession(ctx->db, username, &session_id, &session_error);
-      if (session_id) {
-        char *cookie_str = W->cookie->serialize("session_id", session_id, NULL);
-        Value *headers = W->objectOf("Set-Cookie", W->string(cookie_str), NULL);
-        Value *ok = W->objectOf("message", W->string("Login successful"), NULL);
-        send_json_response_with_headers(ctx->client_fd, 200, "OK", headers, ok);
-        W->freeValue(ok);
-        W->freeValue(headers);
-        W->freeString(cookie_str);
-        W->freeString(session_id);
-      } else {
-        Value *err =
-            W->objectOf("message",
-                        W->string(session_error ? session_error
-                                                : "Failed to create session"),
-                        NULL);
-        send_json_response(ctx->client_fd, 500, "Server Error", err);
-        W->freeValue(err);
-      }
-      if (session_error)
-        W->freeString(session_error);
+  status = W->db->prepare(ctx->db,
+                          "SELECT password FROM users WHERE username = ?;",
+                          &stmt, &query_error);
+  bool verified = false;
+  if (status == OK) {
+    W->db->bindText(stmt, 1, username);
+    verified = W->db->step(stmt, &query_error) == DB_ROW &&
+               W->auth->verifyPassword(password, W->db->columnText(stmt, 0));
+    W->db->finish(stmt);
+  }
+
+  if (verified) {
+    char *session_id = NULL;
+    char *session_error = NULL;
+    W->auth->createSession(ctx->db, username, &session_id, &session_error);
+    if (session_id) {
+      char *cookie_str = W->cookie->serialize("session_id", session_id, NULL);
+      Value *headers = W->objectOf("Set-Cookie", W->string(cookie_str), NULL);
+      Value *ok = W->objectOf("message", W->string("Login successful"), NULL);
+      send_json_response_with_headers(ctx->client_fd, 200, "OK", headers, ok);
+      W->freeValue(ok);
+      W->freeValue(headers);
+      W->freeString(cookie_str);
+      W->freeString(session_id);
     } else {
       Value *err =
-          W->objectOf("message", W->string("Invalid credentials"), NULL);
-      send_json_response(ctx->client_fd, 401, "Unauthorized", err);
+          W->objectOf("message",
+                      W->string(session_error ? session_error
+                                              : "Failed to create session"),
+                      NULL);
+      send_json_response(ctx->client_fd, 500, "Server Error", err);
       W->freeValue(err);
     }
+    if (session_error)
+      W->freeString(session_error);
   } else {
     Value *err = W->objectOf("message", W->string("Invalid credentials"), NULL);
     send_json_response(ctx->client_fd, 401, "Unauthorized", err);
@@ -348,24 +629,20 @@ static void test_handler_login(RequestContext *ctx) {
   }
   if (query_error)
     W->freeString(query_error);
-  if (query_result)
-    W->freeValue(query_result);
   W->freeValue(body_json);
 }
 
 static void test_handler_logout(RequestContext *ctx) {
-  Value *headers = W->objectGetRef(ctx->request, "headers");
-  if (headers) {
-    Value *cookie_header = W->objectGetRef(headers, "cookie");
-    if (cookie_header && W->valueGetType(cookie_header) == VALUE_STRING) {
-      Value *cookies = W->cookie->parse(W->valueAsString(cookie_header));
-      Value *session_id_val = W->objectGetRef(cookies, "session_id");
-      if (session_id_val && W->valueGetType(session_id_val) == VALUE_STRING) {
-        const char *session_id = W->valueAsString(session_id_val);
-        W->auth->deleteSession(ctx->db, session_id, NULL);
-      }
-      W->freeValue(cookies);
+  char *cookie_header = router_header(ctx, "cookie");
+  if (cookie_header) {
+    Value *cookies = W->cookie->parse(cookie_header);
+    Value *session_id_val = W->objectGetRef(cookies, "session_id");
+    if (session_id_val && W->valueGetType(session_id_val) == VALUE_STRING) {
+      const char *session_id = W->valueAsString(session_id_val);
+      W->auth->deleteSession(ctx->db, session_id, NULL);
     }
+    W->freeValue(cookies);
+    free(cookie_header);
   }
   char *cookie_str = "session_id=; HttpOnly; Path=/; Max-Age=0";
   Value *response_headers =
@@ -378,83 +655,229 @@ static void test_handler_logout(RequestContext *ctx) {
 }
 
 static void test_handler_root(RequestContext *ctx) {
-  const char *resp = "HTTP/1.1 200 OK\r\n\r\nRoot Handler Called";
-  W->server->writeResponse(ctx->client_fd, resp);
+  send_text_response(ctx->client_fd, "Root Handler Called");
 }
 
 static void test_auth_middleware(RequestContext *ctx, NextFunc next) {
-  Value *headers = W->objectGetRef(ctx->request, "headers");
-  if (headers) {
-    Value *cookie_header = W->objectGetRef(headers, "cookie");
-    if (cookie_header && W->valueGetType(cookie_header) == VALUE_STRING) {
-      Value *cookies = W->cookie->parse(W->valueAsString(cookie_header));
-      Value *session_id_val = W->objectGetRef(cookies, "session_id");
-      if (session_id_val && W->valueGetType(session_id_val) == VALUE_STRING) {
-        const char *session_id = W->valueAsString(session_id_val);
-        Value *user = NULL;
-        char *error = NULL;
-        W->auth->getUserFromSession(ctx->db, session_id, &user, &error);
-        if (user) {
-          ctx->user = user;
-        }
-        if (error)
-          W->freeString(error);
+  char *cookie_header = router_header(ctx, "cookie");
+  if (cookie_header) {
+    Value *cookies = W->cookie->parse(cookie_header);
+    Value *session_id_val = W->objectGetRef(cookies, "session_id");
+    if (session_id_val && W->valueGetType(session_id_val) == VALUE_STRING) {
+      const char *session_id = W->valueAsString(session_id_val);
+      Value *user = NULL;
+      char *error = NULL;
+      W->auth->getUserFromSession(ctx->db, session_id, &user, &error);
+      if (user) {
+        ctx->user = user;
       }
-      W->freeValue(cookies);
+      if (error)
+        W->freeString(error);
     }
+    W->freeValue(cookies);
+    free(cookie_header);
   }
   next(ctx);
 }
 
 static void test_handler_user(RequestContext *ctx) {
-  const char *id = W->valueAsString(W->objectGetRef(ctx->params, "id"));
+  const char *id = W->valueAsString(W->objectGetRef(router_params(ctx), "id"));
   char buffer[256];
   if (ctx->user) {
     const char *user_name =
         W->valueAsString(W->objectGetRef(ctx->user, "username"));
     snprintf(buffer, sizeof(buffer),
-             "HTTP/1.1 200 OK\r\n\r\nUser Handler Called for ID: %s "
-             "(Authenticated as %s)",
-             id, user_name);
+             "User Handler Called for ID: %s (Authenticated as %s)", id,
+             user_name);
   } else {
     snprintf(buffer, sizeof(buffer),
-             "HTTP/1.1 200 OK\r\n\r\nUser Handler Called for ID: %s "
-             "(Unauthenticated)",
-             id);
+             "User Handler Called for ID: %s (Unauthenticated)", id);
   }
-  W->server->writeResponse(ctx->client_fd, buffer);
+  send_text_response(ctx->client_fd, buffer);
 }
 
 static void test_handler_post(RequestContext *ctx) {
-  const char *body = W->valueAsString(W->objectGetRef(ctx->request, "body"));
+  const char *body = W->valueAsString(
+      W->objectGetRef(router_request(ctx), "body"));
   char buffer[1024];
-  snprintf(buffer, sizeof(buffer), "HTTP/1.1 200 OK\r\n\r\nPOST Handled: %s",
-           body);
-  W->server->writeResponse(ctx->client_fd, buffer);
+  snprintf(buffer, sizeof(buffer), "POST Handled: %s", body);
+  send_text_response(ctx->client_fd, buffer);
 }
 
 static void test_handler_posts_by_date(RequestContext *ctx) {
-  const char *year = W->valueAsString(W->objectGetRef(ctx->params, "year"));
-  const char *month = W->valueAsString(W->objectGetRef(ctx->params, "month"));
+  const RouteParam *year = router_param(ctx, "year");
+  const RouteParam *month = router_param(ctx, "month");
   char buffer[256];
-  snprintf(buffer, sizeof(buffer), "HTTP/1.1 200 OK\r\n\r\nPosts for %s/%s",
-           month, year);
-  W->server->writeResponse(ctx->client_fd, buffer);
+  snprintf(buffer, sizeof(buffer), "Posts for %.*s/%.*s", (int)month->len,
+           month->value, (int)year->len, year->value);
+  send_text_response(ctx->client_fd, buffer);
+}
+
+static void test_handler_redirect(RequestContext *ctx) {
+  const char *to = W->valueAsString(W->objectGetRef(router_params(ctx), "to"));
+  Response res;
+  W->response->init(&res, ctx->client_fd, 302, "Found");
+  W->response->header(&res, "Location", to);
+  W->response->send(&res);
+}
+
+static void test_handler_cached(RequestContext *ctx) {
+  static atomic_int calls;
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "Cached Handler Call %d",
+           atomic_fetch_add(&calls, 1) + 1);
+  send_text_response(ctx->client_fd, buffer);
+}
+
+/**
+ * @brief Sets a cookie, so its responses are never cached. The body reports
+ * the most calls seen running at once.
+ */
+static void test_handler_cached_cookie(RequestContext *ctx) {
+  static atomic_int running, peak;
+  int now = atomic_fetch_add(&running, 1) + 1;
+  int seen = atomic_load(&peak);
+  while (now > seen && !atomic_compare_exchange_weak(&peak, &seen, now))
+    ;
+  usleep(100000);
+  atomic_fetch_sub(&running, 1);
+
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "Peak %d", atomic_load(&peak));
+  Response res;
+  W->response->init(&res, ctx->client_fd, 200, "OK");
+  W->response->header(&res, "Content-Type", "text/plain; charset=utf-8");
+  W->response->header(&res, "Set-Cookie", "visited=1");
+  W->response->body(&res, buffer, strlen(buffer));
+  W->response->send(&res);
+}
+
+static void test_handler_usernames(RequestContext *ctx) {
+  DbStatement *stmt = NULL;
+  if (W->db->prepare(ctx->db, "SELECT username FROM users ORDER BY rowid;",
+                     &stmt, NULL) != OK) {
+    send_text_response(ctx->client_fd, "");
+    return;
+  }
+  DbCursor *cursor = W->db->cursor(stmt);
+  W->server->streamBegin(ctx->client_fd, 200, "text/plain; charset=utf-8");
+  const Value *row = NULL;
+  while (cursor && W->db->cursorNext(cursor, &row, NULL) == DB_ROW) {
+    const Value *name = W->objectGetRef(row, "username");
+    if (W->valueGetType(name) != VALUE_STRING)
+      continue;
+    W->server->streamWrite(ctx->client_fd, W->valueAsString(name),
+                         strlen(W->valueAsString(name)));
+    W->server->streamWrite(ctx->client_fd, "\n", 1);
+  }
+  W->server->streamEnd(ctx->client_fd);
+  W->db->cursorFree(cursor);
+}
+
+static void test_handler_users_json(RequestContext *ctx) {
+  DbStatement *stmt = NULL;
+  char *error = NULL;
+  StringBuilder sb;
+  W->stringBuilder->init(&sb);
+  Status status = W->db->prepare(
+      ctx->db, "SELECT rowid AS id, username FROM users ORDER BY rowid;",
+      &stmt, &error);
+  if (status == OK)
+    status = W->db->queryJson(stmt, &sb, &error);
+  W->db->finish(stmt);
+  if (status != OK) {
+    W->stringBuilder->free(&sb);
+    Value *err = W->objectOf(
+        "message", W->string(error ? error : "Query failed"), NULL);
+    send_json_response(ctx->client_fd, 500, "Server Error", err);
+    W->freeValue(err);
+    if (error)
+      W->freeString(error);
+    return;
+  }
+
+  size_t length = sb.length;
+  Response res;
+  W->response->init(&res, ctx->client_fd, 200, "OK");
+  W->response->header(&res, "Content-Type", "application/json");
+  W->response->bodyOwned(&res, W->stringBuilder->toString(&sb), length);
+  W->response->send(&res);
+}
+
+static void test_handler_user_columns(RequestContext *ctx) {
+  DbStatement *stmt = NULL;
+  DbResultSet *set = NULL;
+  char *error = NULL;
+  Status status = W->db->prepare(
+      ctx->db,
+      "SELECT rowid AS id, username, length(username) / 2.0 AS half FROM "
+      "users ORDER BY rowid;",
+      &stmt, &error);
+  if (status == OK)
+    status = W->db->resultSet(stmt, &set, &error);
+  W->db->finish(stmt);
+  StringBuilder sb;
+  W->stringBuilder->init(&sb);
+  if (status == OK)
+    status = W->db->resultJson(set, &sb);
+  W->db->resultFree(set);
+  if (status != OK) {
+    W->stringBuilder->free(&sb);
+    Value *err = W->objectOf(
+        "message", W->string(error ? error : "Query failed"), NULL);
+    send_json_response(ctx->client_fd, 500, "Server Error", err);
+    W->freeValue(err);
+    if (error)
+      W->freeString(error);
+    return;
+  }
+
+  size_t length = sb.length;
+  Response res;
+  W->response->init(&res, ctx->client_fd, 200, "OK");
+  W->response->header(&res, "Content-Type", "application/json");
+  W->response->bodyOwned(&res, W->stringBuilder->toString(&sb), length);
+  W->response->send(&res);
 }
 
 void router_setup_test_routes(Router *router) {
   MiddlewareFunc user_middleware[] = {test_db_middleware, test_auth_middleware};
   MiddlewareFunc db_middleware[] = {test_db_middleware};
+  DbPoolOptions db_options = {
+      .init_sql = "CREATE TABLE IF NOT EXISTS users (username TEXT UNIQUE, "
+                  "password TEXT); CREATE TABLE IF NOT EXISTS sessions "
+                  "(session_id TEXT PRIMARY KEY, username TEXT, expires_at "
+                  "INTEGER); CREATE INDEX IF NOT EXISTS sessions_expires_at "
+                  "ON sessions (expires_at);",
+      .single_writer = true};
+  W->router->useDb(router, W->db->pool("./api_test.db", &db_options));
+  W->router->sweepSessions(router, 0, NULL);
   W->router->addRoute(router, HTTP_GET, "/", test_handler_root);
   W->router->addRouteWithMiddleware(router, HTTP_GET, "/users/[id]",
                                     user_middleware, 2, test_handler_user);
   W->router->addRoute(router, HTTP_POST, "/data", test_handler_post);
   W->router->addRoute(router, HTTP_GET, "/posts/[year]/[month]",
                       test_handler_posts_by_date);
+  W->router->addRoute(router, HTTP_GET, "/redirect/[to]",
+                      test_handler_redirect);
   W->router->addRouteWithMiddleware(router, HTTP_POST, "/register",
                                     db_middleware, 1, test_handler_register);
   W->router->addRouteWithMiddleware(router, HTTP_POST, "/login", db_middleware,
                                     1, test_handler_login);
   W->router->addRouteWithMiddleware(router, HTTP_POST, "/logout", db_middleware,
                                     1, test_handler_logout);
+  W->router->addRouteWithMiddleware(router, HTTP_GET, "/usernames",
+                                    db_middleware, 1, test_handler_usernames);
+  W->router->addRouteWithMiddleware(router, HTTP_GET, "/users.json",
+                                    db_middleware, 1, test_handler_users_json);
+  W->router->addRouteWithMiddleware(router, HTTP_GET, "/users.columns",
+                                    db_middleware, 1,
+                                    test_handler_user_columns);
+  W->router->addRoute(router, HTTP_GET, "/cached", test_handler_cached);
+  RouteCacheOptions cache_options = {.ttl_ms = 60000, .max_bytes = 64 * 1024};
+  W->router->cacheRoute(router, HTTP_GET, "/cached", &cache_options, NULL);
+  W->router->addRoute(router, HTTP_GET, "/cached/cookie",
+                      test_handler_cached_cookie);
+  W->router->cacheRoute(router, HTTP_GET, "/cached/cookie", &cache_options,
+                        NULL);
 }
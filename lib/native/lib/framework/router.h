@@ -5,11 +5,29 @@
  * This module provides the necessary components to define routes, map them to
  * handler functions, and process incoming requests to dispatch them to the
  * appropriate handler.
+ *
+ * Route patterns are compiled into one radix tree per method when they are
+ * added (see `route_tree.h`), so finding a route costs one walk of the path.
+ * Static text wins over a `[param]`, and a parameter over a `[...catchAll]`,
+ * whatever order the routes were added in. A request that matches no route
+ * is answered with 404 without allocating.
+ *
+ * A GET route may also keep its responses in a cache (see `route_cache.h`
+ * and `router_cache_route`).
+ *
+ * A router with a pool can also delete expired sessions from it in the
+ * background (see `router_sweep_sessions`).
  */
 #ifndef ROUTER_H
 #define ROUTER_H
 
 #include "../core/value.h"
+#include "../modules/auth.h"
+#include "../modules/db.h"
+#include "../modules/http.h"
+#include "route_cache.h"
+#include "route_tree.h"
+#include <stdbool.h>
 
 // Enum for standard HTTP methods
 typedef enum {
@@ -21,6 +39,8 @@ typedef enum {
   HTTP_OPTIONS
 } HttpMethod;
 
+#define HTTP_METHOD_COUNT (HTTP_OPTIONS + 1)
+
 // Forward declaration for the context and function types
 struct RequestContext;
 typedef void (*NextFunc)(struct RequestContext *ctx);
@@ -37,6 +57,7 @@ typedef struct {
   MiddlewareFunc *middleware; // Array of middleware function pointers
   int middleware_count;       // Number of middleware functions
   RouteHandler handler;       // The final handler for the route
+  RouteCache *cache;          // Responses kept for replay, or NULL
 } RouteDefinition;
 
 /**
@@ -46,25 +67,34 @@ typedef struct {
   RouteDefinition *routes;
   int count;
   int capacity;
+  RouteTree *trees[HTTP_METHOD_COUNT]; // Indexes into `routes`, by method.
+  DbPool *db_pool; // Connections handed out by `router_db`, or NULL.
+  AuthSweeper *session_sweeper; // Expires `db_pool`'s sessions, or NULL.
 } Router;
 
 /**
  * @brief Holds all relevant information for a single request lifecycle.
  *
  * This context is passed to route handlers and middleware, carrying state
- * like the parsed request, URL parameters, and the client connection.
- * It can be extended by middleware (e.g., to add user or db info).
+ * like the parsed request and the client connection. URL parameters are
+ * read with `router_param` or `router_params`. It can be extended by
+ * middleware (e.g., to add user or db info).
  */
 typedef struct RequestContext {
-  Value *request; // The parsed request object from http.c
-  Value *params;  // URL parameters extracted from route matching
+  Value *request; // The parsed request object; see `router_request`
+  const HttpRequest *http; // The request's spans, when routed from raw bytes
   int client_fd;  // The client's socket file descriptor for writing responses
-  Value *db;      // Database connection handle
+  Value *db;      // Database connection handle; see `router_db`
   Value *user;    // Authenticated user object
 
   // --- Internal use for middleware execution ---
   const RouteDefinition *route; // The matched route
   int next_middleware_index;    // The index of the next middleware to run
+  bool owns_request;            // `request` was built from `http`
+  const RouteParam *route_params; // Spans of the routed path; see `router_param`
+  int param_count;
+  Value *params_object; // Built by `router_params` on first use, or NULL
+  DbPool *db_pool; // The router's pool; `db` is returned to it if set
 } RequestContext;
 
 // --- Function Declarations ---
@@ -74,6 +104,9 @@ void router_free(Router *router);
 
 /**
  * @brief Adds a route with an array of middleware functions.
+ *
+ * The pattern is compiled immediately. A malformed pattern, or one already
+ * added for the same method, is logged and the route is not added.
  * @param router The router instance.
  * @param method The HTTP method for this route.
  * @param path The path pattern (e.g., "/users/[id]").
@@ -93,12 +126,96 @@ void router_add_route_with_middleware(Router *router, HttpMethod method,
 void router_add_route(Router *router, HttpMethod method, const char *path,
                       RouteHandler handler);
 
+/**
+ * @brief Gives the router a pool of database connections for `router_db`.
+ * The router takes ownership of the pool and frees any it had before,
+ * stopping that pool's session sweeper.
+ */
+void router_use_db(Router *router, DbPool *pool);
+
+/**
+ * @brief Starts deleting expired sessions from the router's pool in the
+ * background, replacing any sweeper already running. It stops when the
+ * pool is replaced or the router is freed.
+ * @param router The router instance; it must have a pool.
+ * @param interval_ms The time between sweeps, or 0 for the default.
+ * @param[out] error Set to a new error message on failure.
+ * @return OK, ERROR_INVALID_STATE without a pool, or ERROR if the sweeper
+ * could not be started.
+ */
+Status router_sweep_sessions(Router *router, int interval_ms, char **error);
+
+/**
+ * @brief Caches the responses of a GET route that has already been added.
+ *
+ * A request served from the cache runs neither the route's middleware nor
+ * its handler, so only cache routes whose response depends on nothing but
+ * the path, the query and the `vary` headers.
+ * @param router The router instance.
+ * @param method The route's method; must be `HTTP_GET`.
+ * @param path The route's pattern, exactly as it was added.
+ * @param options The caching policy.
+ * @param[out] error Set to a new error message on failure.
+ * @return OK, ERROR_INVALID_ARG if there is no such GET route, or
+ * ERROR_MEMORY.
+ */
+Status router_cache_route(Router *router, HttpMethod method, const char *path,
+                          const RouteCacheOptions *options, char **error);
+
 /**
  * @brief Processes a parsed request, finds a matching route, and invokes its
  * handler.
  */
 void router_handle_request(Router *router, int client_fd, Value *request);
 
+/**
+ * @brief Routes a request parsed into spans by `http_request_parse`.
+ *
+ * No `Value` is built for the request unless a handler or middleware asks for
+ * one with `router_request`.
+ */
+void router_handle_http(Router *router, int client_fd,
+                        const HttpRequest *request);
+
+/**
+ * @brief Returns the request as an object `Value`, building it from the
+ * request's spans on first use. The value belongs to the context.
+ */
+Value *router_request(RequestContext *ctx);
+
+/**
+ * @brief Returns the request's database connection, checking one out of the
+ * router's pool on first use. It is returned to the pool when the request
+ * finishes, so it must not be closed.
+ * @param ctx The request context.
+ * @param[out] error Set to a new error message on failure.
+ * @return `ctx->db`, or NULL if the router has no pool or no connection
+ * could be opened.
+ */
+Value *router_db(RequestContext *ctx, char **error);
+
+/**
+ * @brief Looks up a route parameter without allocating.
+ * @return The parameter, whose value is a raw span of the request path that
+ * stays valid until the handler returns, or NULL if the route has none by
+ * that name.
+ */
+const RouteParam *router_param(const RequestContext *ctx, const char *name);
+
+/**
+ * @brief Returns the route parameters as an object `Value` of decoded
+ * strings, building it on first use. A catch-all becomes an array of its
+ * non-empty segments. The value belongs to the context.
+ */
+Value *router_params(RequestContext *ctx);
+
+/**
+ * @brief Returns a copy of a request header, looked up without regard to
+ * case and without building the request `Value`.
+ * @return A new string the caller must free, or NULL if the header is absent.
+ */
+char *router_header(RequestContext *ctx, const char *name);
+
 /**
  * @brief Sets up all the routes needed for the test suite.
  */
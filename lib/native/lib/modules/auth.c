@@ -1,6 +1,9 @@
 #include "auth.h"
 #include "../webs_api.h"
+#include <errno.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -55,17 +58,231 @@ bool auth_verify_password(const char *password, const char *hash) {
   return match;
 }
 
+/**
+ * @brief Makes a 32-digit hex token from the system's random source. IDs
+ * key the session cache as well as the table, so two logins in the same
+ * second must not share one.
+ */
 static char *generate_session_token() {
+  unsigned char bytes[16];
+  FILE *random = fopen("/dev/urandom", "rb");
+  bool filled =
+      random && fread(bytes, 1, sizeof(bytes), random) == sizeof(bytes);
+  if (random)
+    fclose(random);
+  if (!filled)
+    return NULL;
   char *token = malloc(33);
   if (!token)
     return NULL;
-  srand(time(NULL));
-  for (int i = 0; i < 32; i++) {
-    sprintf(token + i, "%x", rand() % 16);
+  for (int i = 0; i < 16; i++) {
+    sprintf(token + i * 2, "%02x", bytes[i]);
   }
   return token;
 }
 
+typedef struct SessionEntry {
+  char *file; // The database file, then the session ID, in one allocation.
+  char *session_id;
+  size_t hash;
+  Value *user; // Allocated outside any arena.
+  time_t expires_at;
+  struct SessionEntry *hash_next;
+  struct SessionEntry *lru_prev;
+  struct SessionEntry *lru_next;
+} SessionEntry;
+
+typedef struct {
+  pthread_mutex_t lock;
+  SessionEntry *buckets[AUTH_SESSION_CACHE_SHARD_CAPACITY];
+  SessionEntry *lru_head; // Most recently used.
+  SessionEntry *lru_tail;
+  int count;
+  // Bumped by every delete, so a lookup that raced one does not cache the
+  // row it read before the delete.
+  uint64_t generation;
+} SessionShard;
+
+static SessionShard session_shards[AUTH_SESSION_CACHE_SHARDS];
+static pthread_once_t session_shards_once = PTHREAD_ONCE_INIT;
+
+static void session_shards_init(void) {
+  for (int i = 0; i < AUTH_SESSION_CACHE_SHARDS; i++)
+    pthread_mutex_init(&session_shards[i].lock, NULL);
+}
+
+static size_t session_hash(const char *file, const char *session_id) {
+  size_t hash = 2166136261u;
+  for (const char *p = file; *p; p++)
+    hash = (hash ^ (unsigned char)*p) * 16777619;
+  hash *= 16777619;
+  for (const char *p = session_id; *p; p++)
+    hash = (hash ^ (unsigned char)*p) * 16777619;
+  return hash;
+}
+
+static SessionShard *session_shard(size_t hash) {
+  pthread_once(&session_shards_once, session_shards_init);
+  return &session_shards[(hash >> 16) % AUTH_SESSION_CACHE_SHARDS];
+}
+
+static SessionEntry **session_slot(SessionShard *shard, size_t hash,
+                                   const char *file, const char *session_id) {
+  SessionEntry **slot =
+      &shard->buckets[hash % AUTH_SESSION_CACHE_SHARD_CAPACITY];
+  while (*slot && ((*slot)->hash != hash ||
+                   strcmp((*slot)->session_id, session_id) != 0 ||
+                   strcmp((*slot)->file, file) != 0))
+    slot = &(*slot)->hash_next;
+  return slot;
+}
+
+static void session_lru_unlink(SessionShard *shard, SessionEntry *entry) {
+  if (entry->lru_prev)
+    entry->lru_prev->lru_next = entry->lru_next;
+  else
+    shard->lru_head = entry->lru_next;
+  if (entry->lru_next)
+    entry->lru_next->lru_prev = entry->lru_prev;
+  else
+    shard->lru_tail = entry->lru_prev;
+}
+
+static void session_lru_push_front(SessionShard *shard, SessionEntry *entry) {
+  entry->lru_prev = NULL;
+  entry->lru_next = shard->lru_head;
+  if (shard->lru_head)
+    shard->lru_head->lru_prev = entry;
+  shard->lru_head = entry;
+  if (!shard->lru_tail)
+    shard->lru_tail = entry;
+}
+
+/**
+ * @brief Unlinks the entry in `slot`. The caller frees it after dropping
+ * the shard's lock.
+ */
+static SessionEntry *session_unlink(SessionShard *shard, SessionEntry **slot) {
+  SessionEntry *entry = *slot;
+  *slot = entry->hash_next;
+  session_lru_unlink(shard, entry);
+  shard->count--;
+  return entry;
+}
+
+static void session_entry_free(SessionEntry *entry) {
+  if (!entry)
+    return;
+  Arena *previous = W->arena->enter(NULL);
+  W->freeValue(entry->user);
+  W->arena->leave(previous);
+  free(entry->file);
+  free(entry);
+}
+
+/**
+ * @brief Looks a session up in the cache.
+ * @param[out] generation Set to the shard's generation, to pass to
+ * `session_cache_put` after a miss.
+ * @return A copy of the cached user, or NULL.
+ */
+static Value *session_cache_get(const char *file, const char *session_id,
+                                uint64_t *generation) {
+  size_t hash = session_hash(file, session_id);
+  SessionShard *shard = session_shard(hash);
+  SessionEntry *expired = NULL;
+  Value *user = NULL;
+  pthread_mutex_lock(&shard->lock);
+  *generation = shard->generation;
+  SessionEntry **slot = session_slot(shard, hash, file, session_id);
+  if (*slot && (*slot)->expires_at <= time(NULL)) {
+    expired = session_unlink(shard, slot);
+  } else if (*slot) {
+    session_lru_unlink(shard, *slot);
+    session_lru_push_front(shard, *slot);
+    user = W->valueClone((*slot)->user);
+  }
+  pthread_mutex_unlock(&shard->lock);
+  session_entry_free(expired);
+  return user;
+}
+
+static void session_cache_put(const char *file, const char *session_id,
+                              const Value *user, time_t expires_at,
+                              uint64_t generation) {
+  size_t file_len = strlen(file);
+  size_t id_len = strlen(session_id);
+  SessionEntry *entry = calloc(1, sizeof(SessionEntry));
+  char *strings = malloc(file_len + id_len + 2);
+  Arena *previous = W->arena->enter(NULL);
+  Value *copy = W->valueClone(user);
+  W->arena->leave(previous);
+  if (!entry || !strings || !copy) {
+    free(entry);
+    free(strings);
+    previous = W->arena->enter(NULL);
+    W->freeValue(copy);
+    W->arena->leave(previous);
+    return;
+  }
+  memcpy(strings, file, file_len + 1);
+  memcpy(strings + file_len + 1, session_id, id_len + 1);
+  entry->file = strings;
+  entry->session_id = strings + file_len + 1;
+  entry->hash = session_hash(file, session_id);
+  entry->user = copy;
+  entry->expires_at = expires_at;
+
+  SessionShard *shard = session_shard(entry->hash);
+  SessionEntry *replaced = NULL;
+  SessionEntry *evicted = NULL;
+  pthread_mutex_lock(&shard->lock);
+  if (shard->generation != generation) {
+    pthread_mutex_unlock(&shard->lock);
+    session_entry_free(entry);
+    return;
+  }
+  SessionEntry **slot = session_slot(shard, entry->hash, file, session_id);
+  if (*slot)
+    replaced = session_unlink(shard, slot);
+  size_t bucket = entry->hash % AUTH_SESSION_CACHE_SHARD_CAPACITY;
+  entry->hash_next = shard->buckets[bucket];
+  shard->buckets[bucket] = entry;
+  session_lru_push_front(shard, entry);
+  if (++shard->count > AUTH_SESSION_CACHE_SHARD_CAPACITY) {
+    SessionEntry *victim = shard->lru_tail;
+    evicted = session_unlink(
+        shard, session_slot(shard, victim->hash, victim->file,
+                            victim->session_id));
+  }
+  pthread_mutex_unlock(&shard->lock);
+  session_entry_free(replaced);
+  session_entry_free(evicted);
+}
+
+static void session_cache_remove(const char *file, const char *session_id) {
+  size_t hash = session_hash(file, session_id);
+  SessionShard *shard = session_shard(hash);
+  SessionEntry *removed = NULL;
+  pthread_mutex_lock(&shard->lock);
+  shard->generation++;
+  SessionEntry **slot = session_slot(shard, hash, file, session_id);
+  if (*slot)
+    removed = session_unlink(shard, slot);
+  pthread_mutex_unlock(&shard->lock);
+  session_entry_free(removed);
+}
+
+/**
+ * @brief Returns the database file that names a handle's sessions in the
+ * cache, or NULL if they are not cached.
+ */
+static const char *session_cache_file(Value *db_handle_val,
+                                      const char *session_id) {
+  const char *file = W->db->filename(db_handle_val);
+  return file && *file && session_id ? file : NULL;
+}
+
 char *auth_create_session(Value *db_handle_val, const char *username) {
   char *session_id = generate_session_token();
   if (!session_id)
@@ -73,14 +290,14 @@ char *auth_create_session(Value *db_handle_val, const char *username) {
 
   long expires_at = time(NULL) + 3600;
 
-  char sql[512];
-  snprintf(sql, sizeof(sql),
-           "INSERT INTO sessions (session_id, username, expires_at) VALUES "
-           "('%s', '%s', %ld);",
-           session_id, username, expires_at);
-
   char *exec_error = NULL;
-  Status status = W->db->exec(db_handle_val, sql, &exec_error);
+  Value *params = W->arrayOf(3, W->string(session_id), W->string(username),
+                             W->number((double)expires_at));
+  Status status = W->db->write(db_handle_val,
+                               "INSERT INTO sessions (session_id, username, "
+                               "expires_at) VALUES (?, ?, ?);",
+                               params, &exec_error);
+  W->freeValue(params);
 
   if (status != OK) {
     W->log->error("Failed to create session: %s",
@@ -94,81 +311,210 @@ char *auth_create_session(Value *db_handle_val, const char *username) {
   return session_id;
 }
 
+static DbStatement *prepare(Value *db_handle_val, const char *sql) {
+  DbStatement *stmt = NULL;
+  char *error = NULL;
+  if (W->db->prepare(db_handle_val, sql, &stmt, &error) != OK) {
+    W->log->error("Session query failed: %s", error ? error : "Unknown error");
+    free(error);
+  }
+  return stmt;
+}
+
+/**
+ * @brief Steps a bound statement once and finishes it.
+ * @return The first row as an object `Value`, or NULL if there is none or
+ * the statement failed.
+ */
+static Value *first_row(DbStatement *stmt) {
+  char *error = NULL;
+  Value *row = NULL;
+  DbStep step = W->db->step(stmt, &error);
+  if (step == DB_ROW) {
+    row = W->db->row(stmt);
+  } else if (step == DB_ERROR) {
+    W->log->error("Session query failed: %s", error ? error : "Unknown error");
+    free(error);
+  }
+  W->db->finish(stmt);
+  return row;
+}
+
 Value *auth_get_user_from_session(Value *db_handle_val,
                                   const char *session_id) {
-  long now = time(NULL);
-  char sql[256];
-  snprintf(sql, sizeof(sql),
-           "SELECT username FROM sessions WHERE session_id = '%s' AND "
-           "expires_at > %ld;",
-           session_id, now);
-
-  Value *result = NULL;
-  char *query_error = NULL;
-  Status status = W->db->query(db_handle_val, sql, &result, &query_error);
+  const char *file = session_cache_file(db_handle_val, session_id);
+  uint64_t generation = 0;
+  if (file) {
+    Value *cached = session_cache_get(file, session_id, &generation);
+    if (cached)
+      return cached;
+  }
 
-  if (status != OK) {
-    W->log->error("Session query failed: %s",
-                  query_error ? query_error : "Unknown error");
-    if (query_error)
-      W->freeString(query_error);
-    if (result)
-      W->freeValue(result);
+  // Expired rows are skipped here and left for the sweeper.
+  time_t now = time(NULL);
+  DbStatement *stmt = prepare(db_handle_val,
+                              "SELECT username, expires_at FROM sessions "
+                              "WHERE session_id = ? AND expires_at > ?;");
+  if (!stmt)
     return NULL;
+  W->db->bindText(stmt, 1, session_id);
+  W->db->bindInt(stmt, 2, now);
+  Value *session = first_row(stmt);
+  if (!session)
+    return NULL;
+
+  stmt = prepare(db_handle_val,
+                 "SELECT username FROM users WHERE username = ?;");
+  Value *user = NULL;
+  if (stmt) {
+    W->db->bindText(stmt, 1,
+                    W->valueAsString(W->objectGetRef(session, "username")));
+    user = first_row(stmt);
   }
+  if (user && file) {
+    time_t expires_at =
+        (time_t)W->valueAsNumber(W->objectGetRef(session, "expires_at"));
+    time_t limit = now + AUTH_SESSION_CACHE_TTL_SECONDS;
+    session_cache_put(file, session_id, user,
+                      expires_at < limit ? expires_at : limit, generation);
+  }
+  W->freeValue(session);
+  return user;
+}
 
-  if (W->arrayCount(result) == 0) {
-    snprintf(sql, sizeof(sql), "DELETE FROM sessions WHERE session_id = '%s';",
-             session_id);
-    char *delete_error = NULL;
-    W->db->exec(db_handle_val, sql, &delete_error);
-    if (delete_error)
-      W->freeString(delete_error);
+void auth_delete_session(Value *db_handle_val, const char *session_id) {
+  if (!session_id)
+    return;
+  Value *params = W->arrayOf(1, W->string(session_id));
+  char *error = NULL;
+  if (W->db->write(db_handle_val, "DELETE FROM sessions WHERE session_id = ?;",
+                   params, &error) != OK) {
+    W->log->error("Failed to delete session: %s",
+                  error ? error : "Unknown DB error");
+    free(error);
   }
+  W->freeValue(params);
+  // After the row is gone, so a concurrent lookup cannot cache it again.
+  const char *file = session_cache_file(db_handle_val, session_id);
+  if (file)
+    session_cache_remove(file, session_id);
+}
 
-  if (W->valueGetType(result) != VALUE_ARRAY || W->arrayCount(result) != 1) {
-    W->freeValue(result);
-    return NULL;
+Status auth_sweep_sessions(Value *db_handle_val, char **error) {
+  Status status = OK;
+  for (;;) {
+    // The schema's index on expires_at makes both the check and the batch's
+    // subquery a range scan over the expired sessions alone.
+    DbStatement *stmt =
+        prepare(db_handle_val,
+                "SELECT 1 FROM sessions WHERE expires_at <= ? LIMIT 1;");
+    if (!stmt) {
+      status = ERROR_INVALID_ARG;
+      if (error)
+        *error = strdup("Cannot query sessions");
+      break;
+    }
+    time_t now = time(NULL);
+    W->db->bindInt(stmt, 1, now);
+    bool expired = W->db->step(stmt, NULL) == DB_ROW;
+    W->db->finish(stmt);
+    if (!expired)
+      break;
+
+    Value *params = W->arrayOf(2, W->number((double)now),
+                               W->number(AUTH_SWEEP_BATCH));
+    status = W->db->write(db_handle_val,
+                          "DELETE FROM sessions WHERE session_id IN (SELECT "
+                          "session_id FROM sessions WHERE expires_at <= ? "
+                          "ORDER BY expires_at LIMIT ?);",
+                          params, error);
+    W->freeValue(params);
+    if (status != OK)
+      break;
   }
+  return status;
+}
 
-  Value *row = W->arrayGetRef(result, 0);
-  Value *username_val = W->objectGetRef(row, "username");
-  char *username = strdup(W->valueAsString(username_val));
-  W->freeValue(result);
+struct AuthSweeper {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t stop; // Signalled to end the wait between sweeps.
+  bool stopping;
+  DbPool *pool;
+  int interval_ms;
+};
 
-  snprintf(sql, sizeof(sql), "SELECT username FROM users WHERE username = '%s'",
-           username);
+/**
+ * @brief Checks a connection out and sweeps on it.
+ */
+static void sweeper_run(AuthSweeper *sweeper) {
+  Value *db = NULL;
+  char *error = NULL;
+  Status status = W->db->acquire(sweeper->pool, &db, &error);
+  if (status == OK) {
+    status = auth_sweep_sessions(db, &error);
+    W->db->release(sweeper->pool, db);
+  }
+  if (status != OK)
+    W->log->error("Session sweep failed: %s",
+                  error ? error : "Unknown DB error");
+  free(error);
+}
 
-  Value *user_result = NULL;
-  char *user_query_error = NULL;
-  Status user_status =
-      W->db->query(db_handle_val, sql, &user_result, &user_query_error);
-  free(username);
+static void *sweeper_main(void *arg) {
+  AuthSweeper *sweeper = arg;
+  pthread_mutex_lock(&sweeper->lock);
+  while (!sweeper->stopping) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += sweeper->interval_ms / 1000;
+    deadline.tv_nsec += (long)(sweeper->interval_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+    int result = 0;
+    while (!sweeper->stopping && result != ETIMEDOUT)
+      result =
+          pthread_cond_timedwait(&sweeper->stop, &sweeper->lock, &deadline);
+    if (sweeper->stopping)
+      break;
+    pthread_mutex_unlock(&sweeper->lock);
+    sweeper_run(sweeper);
+    pthread_mutex_lock(&sweeper->lock);
+  }
+  pthread_mutex_unlock(&sweeper->lock);
+  return NULL;
+}
 
-  if (user_status != OK || !user_result ||
-      W->valueGetType(user_result) != VALUE_ARRAY ||
-      W->arrayCount(user_result) != 1) {
-    if (user_query_error)
-      W->freeString(user_query_error);
-    if (user_result)
-      W->freeValue(user_result);
+AuthSweeper *auth_sweeper(DbPool *pool, int interval_ms) {
+  if (!pool)
+    return NULL;
+  AuthSweeper *sweeper = calloc(1, sizeof(AuthSweeper));
+  if (!sweeper)
+    return NULL;
+  sweeper->pool = pool;
+  sweeper->interval_ms = interval_ms > 0 ? interval_ms : AUTH_SWEEP_INTERVAL_MS;
+  pthread_mutex_init(&sweeper->lock, NULL);
+  pthread_cond_init(&sweeper->stop, NULL);
+  if (pthread_create(&sweeper->thread, NULL, sweeper_main, sweeper) != 0) {
+    pthread_cond_destroy(&sweeper->stop);
+    pthread_mutex_destroy(&sweeper->lock);
+    free(sweeper);
     return NULL;
   }
-
-  Value *user_row = W->arrayGetRef(user_result, 0);
-  Value *final_user_obj = W->valueClone(user_row);
-  W->freeValue(user_result);
-  return final_user_obj;
+  return sweeper;
 }
 
-void auth_delete_session(Value *db_handle_val, const char *session_id) {
-  if (!session_id)
+void auth_sweeper_free(AuthSweeper *sweeper) {
+  if (!sweeper)
     return;
-  char sql[256];
-  snprintf(sql, sizeof(sql), "DELETE FROM sessions WHERE session_id = '%s';",
-           session_id);
-  char *error = NULL;
-  W->db->exec(db_handle_val, sql, &error);
-  if (error)
-    W->freeString(error);
+  pthread_mutex_lock(&sweeper->lock);
+  sweeper->stopping = true;
+  pthread_cond_signal(&sweeper->stop);
+  pthread_mutex_unlock(&sweeper->lock);
+  pthread_join(sweeper->thread, NULL);
+  pthread_cond_destroy(&sweeper->stop);
+  pthread_mutex_destroy(&sweeper->lock);
+  free(sweeper);
 }
@@ -2,14 +2,57 @@
  * @file auth.h
  * @brief Defines the authentication module for password hashing, verification,
  * and session management.
+ *
+ * Users found by `auth_get_user_from_session` are cached in memory, keyed
+ * by database file and session ID, so a request with a known session skips
+ * the database. An entry lives until its session expires, it is deleted
+ * with `auth_delete_session`, or `AUTH_SESSION_CACHE_TTL_SECONDS` pass,
+ * which bounds how long a change to the user row goes unseen. Sessions in
+ * in-memory databases are not cached.
+ *
+ * Looking a session up never writes: expired rows are left to an
+ * `AuthSweeper`, which deletes them in the background, oldest first,
+ * using an index on `sessions(expires_at)`.
  */
 
 #ifndef AUTH_H
 #define AUTH_H
 
 #include "../core/value.h"
+#include "db.h"
 #include <stdbool.h>
 
+/**
+ * @brief The session cache is split into this many independently locked
+ * shards.
+ */
+#define AUTH_SESSION_CACHE_SHARDS 16
+
+/**
+ * @brief The sessions each shard holds before evicting the least recently
+ * used.
+ */
+#define AUTH_SESSION_CACHE_SHARD_CAPACITY 1024
+
+/**
+ * @brief The longest a cached user is served without reading the database.
+ */
+#define AUTH_SESSION_CACHE_TTL_SECONDS 60
+
+/**
+ * @brief How often a sweeper deletes expired sessions when no interval is
+ * given.
+ */
+#define AUTH_SWEEP_INTERVAL_MS 60000
+
+/**
+ * @brief The most expired sessions deleted in one write, so a large sweep
+ * does not hold the writer up.
+ */
+#define AUTH_SWEEP_BATCH 500
+
+typedef struct AuthSweeper AuthSweeper;
+
 /**
  * @brief Hashes a plain-text password.
  * @param password The plain-text password.
@@ -49,4 +92,29 @@ Value *auth_get_user_from_session(Value *db_handle_val, const char *session_id);
  */
 void auth_delete_session(Value *db_handle_val, const char *session_id);
 
+/**
+ * @brief Deletes every expired session, `AUTH_SWEEP_BATCH` at a time. The
+ * schema should index `sessions(expires_at)`, e.g. in the pool's `init_sql`,
+ * or each batch scans the whole table.
+ * @param db_handle_val A `Value` containing the database handle.
+ * @param[out] error Set to a new error message on failure.
+ * @return OK, or the status of the write that failed.
+ */
+Status auth_sweep_sessions(Value *db_handle_val, char **error);
+
+/**
+ * @brief Starts a thread that sweeps a pool's expired sessions on an
+ * interval.
+ * @param pool The pool; it must outlive the sweeper.
+ * @param interval_ms The time between sweeps, or 0 for
+ * `AUTH_SWEEP_INTERVAL_MS`.
+ * @return A new sweeper, or NULL if the thread could not be started.
+ */
+AuthSweeper *auth_sweeper(DbPool *pool, int interval_ms);
+
+/**
+ * @brief Stops the sweeper, waiting for a sweep in progress, and frees it.
+ */
+void auth_sweeper_free(AuthSweeper *sweeper);
+
 #endif // AUTH_H
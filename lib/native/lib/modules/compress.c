@@ -0,0 +1,136 @@
+#define _GNU_SOURCE
+#include "compress.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#ifdef WEBS_HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+Status compress_gzip(const void *data, size_t len, char **out,
+                     size_t *out_len) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  // 15 window bits plus 16 selects the gzip wrapper.
+  if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9,
+                   Z_DEFAULT_STRATEGY) != Z_OK)
+    return ERROR_MEMORY;
+
+  uLong bound = deflateBound(&stream, (uLong)len);
+  char *buffer = malloc(bound);
+  if (!buffer) {
+    deflateEnd(&stream);
+    return ERROR_MEMORY;
+  }
+  stream.next_in = (Bytef *)data;
+  stream.avail_in = (uInt)len;
+  stream.next_out = (Bytef *)buffer;
+  stream.avail_out = (uInt)bound;
+  int result = deflate(&stream, Z_FINISH);
+  size_t written = stream.total_out;
+  deflateEnd(&stream);
+  if (result != Z_STREAM_END) {
+    free(buffer);
+    return ERROR_IO;
+  }
+  *out = buffer;
+  *out_len = written;
+  return OK;
+}
+
+Status compress_brotli(const void *data, size_t len, char **out,
+                       size_t *out_len) {
+#ifdef WEBS_HAVE_BROTLI
+  size_t bound = BrotliEncoderMaxCompressedSize(len);
+  if (bound == 0)
+    bound = len + 1024;
+  char *buffer = malloc(bound);
+  if (!buffer)
+    return ERROR_MEMORY;
+  size_t written = bound;
+  if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW,
+                             BROTLI_MODE_TEXT, len, data, &written,
+                             (uint8_t *)buffer)) {
+    free(buffer);
+    return ERROR_IO;
+  }
+  *out = buffer;
+  *out_len = written;
+  return OK;
+#else
+  (void)data;
+  (void)len;
+  (void)out;
+  (void)out_len;
+  return ERROR_INVALID_STATE;
+#endif
+}
+
+bool compress_has_brotli(void) {
+#ifdef WEBS_HAVE_BROTLI
+  return true;
+#else
+  return false;
+#endif
+}
+
+static void remove_sidecar(const char *path, const char *suffix) {
+  char sidecar[PATH_MAX];
+  snprintf(sidecar, sizeof(sidecar), "%s%s", path, suffix);
+  unlink(sidecar);
+}
+
+static Status write_sidecar(const char *path, const char *suffix,
+                            const char *data, size_t len, size_t original_len,
+                            char **error) {
+  if (len >= original_len) {
+    remove_sidecar(path, suffix);
+    return OK;
+  }
+  char sidecar[PATH_MAX];
+  snprintf(sidecar, sizeof(sidecar), "%s%s", path, suffix);
+  FILE *file = fopen(sidecar, "wb");
+  if (!file) {
+    asprintf(error, "Could not open '%s' for writing", sidecar);
+    return ERROR_IO;
+  }
+  size_t written = fwrite(data, 1, len, file);
+  if (fclose(file) != 0 || written != len) {
+    asprintf(error, "Could not write '%s'", sidecar);
+    return ERROR_IO;
+  }
+  return OK;
+}
+
+Status compress_write_sidecars(const char *path, const void *data, size_t len,
+                               char **error) {
+  char *compressed = NULL;
+  size_t compressed_len = 0;
+  Status status = compress_gzip(data, len, &compressed, &compressed_len);
+  if (status != OK) {
+    asprintf(error, "Could not gzip '%s'", path);
+    return status;
+  }
+  status = write_sidecar(path, ".gz", compressed, compressed_len, len, error);
+  free(compressed);
+  if (status != OK)
+    return status;
+  if (!compress_has_brotli()) {
+    // A `.br` left by a build with Brotli no longer matches the file.
+    remove_sidecar(path, ".br");
+    return OK;
+  }
+
+  status = compress_brotli(data, len, &compressed, &compressed_len);
+  if (status != OK) {
+    asprintf(error, "Could not compress '%s' with Brotli", path);
+    return status;
+  }
+  status = write_sidecar(path, ".br", compressed, compressed_len, len, error);
+  free(compressed);
+  return status;
+}
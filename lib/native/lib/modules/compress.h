@@ -0,0 +1,55 @@
+/**
+ * @file compress.h
+ * @brief Provides build-time compression of static assets.
+ *
+ * The bundler writes precompressed sidecars (`bundle.js.gz`, and
+ * `bundle.js.br` when built with `WEBS_BROTLI=1`) next to each output file so
+ * the static server can serve them without compressing per request.
+ */
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include "../core/error.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Compresses a buffer into the gzip format at the highest level.
+ * @param data The bytes to compress.
+ * @param len The number of bytes.
+ * @param[out] out Receives a new buffer that the caller must free.
+ * @param[out] out_len Receives the compressed size.
+ * @return OK on success, or an error Status on failure.
+ */
+Status compress_gzip(const void *data, size_t len, char **out,
+                     size_t *out_len);
+
+/**
+ * @brief Compresses a buffer with Brotli at the highest quality.
+ * @return OK on success, or `ERROR_INVALID_STATE` when the library was built
+ * without Brotli support.
+ */
+Status compress_brotli(const void *data, size_t len, char **out,
+                       size_t *out_len);
+
+/**
+ * @brief Returns true if the library was built with Brotli support.
+ */
+bool compress_has_brotli(void);
+
+/**
+ * @brief Writes `path.gz` (and `path.br` when available) holding compressed
+ * copies of `data`. Sidecars that would not be smaller than the original are
+ * removed instead, so the server falls back to the plain file, and so is
+ * `path.br` when this build has no Brotli.
+ * @param path The path of the uncompressed file.
+ * @param data The contents of that file.
+ * @param len The number of bytes.
+ * @param[out] error Set to a new error message on failure.
+ * @return OK on success, or an error Status on failure.
+ */
+Status compress_write_sidecars(const char *path, const void *data, size_t len,
+                               char **error);
+
+#endif // COMPRESS_H
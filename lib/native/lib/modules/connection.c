@@ -0,0 +1,697 @@
+#define _GNU_SOURCE
+#include "connection.h"
+#include "../core/scan.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#define CONNECTION_INITIAL_BUFFER 4096
+// Longest chunk-size or trailer line accepted in a chunked body.
+#define CHUNK_LINE_MAX 4096
+
+#ifdef MSG_NOSIGNAL
+#define CONNECTION_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define CONNECTION_SEND_FLAGS 0
+#endif
+
+Connection *connection(int fd) {
+  Connection *conn = calloc(1, sizeof(Connection));
+  if (!conn)
+    return NULL;
+  conn->fd = fd;
+  conn->file_fd = -1;
+  conn->state = CONN_READING;
+  conn->last_active_ms = connection_now_ms();
+  return conn;
+}
+
+static void connection_detach_file(Connection *conn) {
+  if (conn->file_map)
+    munmap(conn->file_map, conn->file_map_len);
+  if (conn->file_fd >= 0)
+    close(conn->file_fd);
+  conn->file_fd = -1;
+  conn->file_map = NULL;
+  conn->file_map_len = 0;
+  conn->file_map_pos = 0;
+  conn->file_remaining = 0;
+}
+
+void connection_free(Connection *conn) {
+  if (!conn)
+    return;
+  if (conn->fd >= 0)
+    close(conn->fd);
+  connection_detach_file(conn);
+  arena_free(conn->arena);
+  free(conn->in);
+  free(conn->out);
+  free(conn->sending);
+  free(conn);
+}
+
+static bool ensure_capacity(char **buffer, size_t *capacity, size_t needed) {
+  if (needed <= *capacity)
+    return true;
+  size_t new_capacity = *capacity ? *capacity : CONNECTION_INITIAL_BUFFER;
+  while (new_capacity < needed)
+    new_capacity *= 2;
+  char *grown = realloc(*buffer, new_capacity);
+  if (!grown)
+    return false;
+  *buffer = grown;
+  *capacity = new_capacity;
+  return true;
+}
+
+IoResult connection_fill(Connection *conn, size_t limit) {
+  while (conn->in_len < limit) {
+    // Keep one spare byte so the request can be NUL-terminated in place.
+    size_t want = conn->in_len + CONNECTION_INITIAL_BUFFER + 1;
+    if (want > limit + 1)
+      want = limit + 1;
+    if (!ensure_capacity(&conn->in, &conn->in_capacity, want))
+      return IO_ERROR;
+
+    size_t room = conn->in_capacity - conn->in_len - 1;
+    if (room > limit - conn->in_len)
+      room = limit - conn->in_len;
+    ssize_t n = read(conn->fd, conn->in + conn->in_len, room);
+    if (n > 0) {
+      conn->in_len += (size_t)n;
+      conn->last_active_ms = connection_now_ms();
+      continue;
+    }
+    if (n == 0)
+      return IO_EOF;
+    if (errno == EINTR)
+      continue;
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return IO_AGAIN;
+    return IO_ERROR;
+  }
+  return IO_DONE;
+}
+
+Status connection_receive(Connection *conn, const void *data, size_t len) {
+  if (!ensure_capacity(&conn->in, &conn->in_capacity, conn->in_len + len + 1))
+    return ERROR_MEMORY;
+  memcpy(conn->in + conn->in_len, data, len);
+  conn->in_len += len;
+  conn->last_active_ms = connection_now_ms();
+  return OK;
+}
+
+typedef struct {
+  size_t content_length;
+  bool has_content_length;
+  bool chunked;
+  bool expect_continue;
+  bool invalid;
+  bool http10;
+  bool connection_close;
+  bool connection_keep_alive;
+} RequestHead;
+
+enum {
+  CHUNK_SIZE,     // Expecting a chunk-size line.
+  CHUNK_DATA,     // Inside chunk data.
+  CHUNK_DATA_END, // Expecting the CRLF after chunk data.
+  CHUNK_TRAILER,  // Skipping trailer fields after the last chunk.
+};
+
+static bool header_is(const char *line, const char *line_end, const char *name,
+                      const char **out_value) {
+  size_t name_len = strlen(name);
+  if ((size_t)(line_end - line) <= name_len || line[name_len] != ':' ||
+      strncasecmp(line, name, name_len) != 0)
+    return false;
+  const char *p = line + name_len + 1;
+  while (p < line_end && (*p == ' ' || *p == '\t'))
+    p++;
+  *out_value = p;
+  return true;
+}
+
+static bool has_token(const char *value, const char *value_end,
+                      const char *token) {
+  size_t token_len = strlen(token);
+  const char *p = value;
+  while (p < value_end) {
+    while (p < value_end && (*p == ' ' || *p == '\t' || *p == ','))
+      p++;
+    const char *start = p;
+    while (p < value_end && *p != ',' && *p != ' ' && *p != '\t')
+      p++;
+    if ((size_t)(p - start) == token_len &&
+        strncasecmp(start, token, token_len) == 0)
+      return true;
+  }
+  return false;
+}
+
+static void parse_request_head(const char *head, size_t head_len,
+                               RequestHead *out) {
+  const char *end = head + head_len;
+  const char *line_end = memchr(head, '\r', head_len);
+  if (!line_end) {
+    out->invalid = true;
+    return;
+  }
+  out->http10 = line_end - head >= 8 && memcmp(line_end - 8, "HTTP/1.0", 8) == 0;
+
+  const char *line = line_end + 2;
+  while (line < end) {
+    const char *eol = memchr(line, '\r', (size_t)(end - line));
+    if (!eol || eol == line)
+      break;
+    const char *value;
+    if (header_is(line, eol, "content-length", &value)) {
+      if (value == eol || !isdigit((unsigned char)*value)) {
+        out->invalid = true;
+        return;
+      }
+      size_t length = 0;
+      while (value < eol && isdigit((unsigned char)*value)) {
+        size_t digit = (size_t)(*value++ - '0');
+        // Saturate; any limit rejects it as too large.
+        length = length > (SIZE_MAX - digit) / 10 ? SIZE_MAX
+                                                  : length * 10 + digit;
+      }
+      while (value < eol && (*value == ' ' || *value == '\t'))
+        value++;
+      // Conflicting lengths would let two parsers disagree on where the
+      // request ends.
+      if (value != eol ||
+          (out->has_content_length && out->content_length != length)) {
+        out->invalid = true;
+        return;
+      }
+      out->content_length = length;
+      out->has_content_length = true;
+    } else if (header_is(line, eol, "transfer-encoding", &value)) {
+      // Only plain chunked framing is decoded.
+      const char *value_end = eol;
+      while (value_end > value &&
+             (value_end[-1] == ' ' || value_end[-1] == '\t'))
+        value_end--;
+      if (value_end - value != 7 || strncasecmp(value, "chunked", 7) != 0 ||
+          out->chunked) {
+        out->invalid = true;
+        return;
+      }
+      out->chunked = true;
+    } else if (header_is(line, eol, "expect", &value)) {
+      out->expect_continue |= has_token(value, eol, "100-continue");
+    } else if (header_is(line, eol, "connection", &value)) {
+      out->connection_close |= has_token(value, eol, "close");
+      out->connection_keep_alive |= has_token(value, eol, "keep-alive");
+    }
+    line = eol + 2;
+  }
+  if (out->chunked && out->has_content_length)
+    out->invalid = true;
+}
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+/**
+ * @brief Decodes chunked input from `buf[*pos, end)`, moving chunk data down
+ * to `buf + *out`. The write position never passes the read position, so the
+ * body is decoded in place. Incomplete lines are left unread for the next
+ * call; the decoder's position is kept in `body`.
+ * @return `FRAME_COMPLETE` after the last chunk and its trailers,
+ * `FRAME_INCOMPLETE` when more input is needed, `FRAME_INVALID` on malformed
+ * framing, or `FRAME_TOO_LARGE` once the body would exceed `max_body`.
+ */
+static RequestFrame decode_chunks(BodyFraming *body, char *buf, size_t *pos,
+                                  size_t end, size_t *out, size_t max_body) {
+  while (*pos < end) {
+    if (body->chunk_state == CHUNK_DATA) {
+      size_t n = end - *pos;
+      if (n > body->chunk_remaining)
+        n = body->chunk_remaining;
+      if (*out != *pos)
+        memmove(buf + *out, buf + *pos, n);
+      *out += n;
+      *pos += n;
+      body->decoded += n;
+      body->chunk_remaining -= n;
+      if (body->chunk_remaining == 0)
+        body->chunk_state = CHUNK_DATA_END;
+      continue;
+    }
+
+    if (body->chunk_state == CHUNK_DATA_END) {
+      if (buf[*pos] == '\n') {
+        *pos += 1;
+      } else if (buf[*pos] == '\r') {
+        if (end - *pos < 2)
+          return FRAME_INCOMPLETE;
+        if (buf[*pos + 1] != '\n')
+          return FRAME_INVALID;
+        *pos += 2;
+      } else {
+        return FRAME_INVALID;
+      }
+      body->chunk_state = CHUNK_SIZE;
+      continue;
+    }
+
+    // Chunk-size and trailer lines are only parsed once complete.
+    const char *line = buf + *pos;
+    size_t available = end - *pos;
+    const char *lf = memchr(line, '\n', available);
+    if (!lf)
+      return available > CHUNK_LINE_MAX ? FRAME_INVALID : FRAME_INCOMPLETE;
+    size_t line_len = (size_t)(lf - line);
+    *pos += line_len + 1;
+    if (line_len > 0 && line[line_len - 1] == '\r')
+      line_len--;
+
+    if (body->chunk_state == CHUNK_TRAILER) {
+      if (line_len == 0)
+        return FRAME_COMPLETE;
+      continue;
+    }
+
+    size_t size = 0;
+    size_t i = 0;
+    for (; i < line_len && hex_value(line[i]) >= 0; i++) {
+      if (size > (SIZE_MAX >> 4))
+        return FRAME_TOO_LARGE;
+      size = size * 16 + (size_t)hex_value(line[i]);
+    }
+    // Chunk extensions after the size are ignored.
+    if (i == 0 ||
+        (i < line_len && line[i] != ';' && line[i] != ' ' && line[i] != '\t'))
+      return FRAME_INVALID;
+    if (size == 0) {
+      body->chunk_state = CHUNK_TRAILER;
+    } else if (size > max_body - body->decoded) {
+      return FRAME_TOO_LARGE;
+    } else {
+      body->chunk_remaining = size;
+      body->chunk_state = CHUNK_DATA;
+    }
+  }
+  return FRAME_INCOMPLETE;
+}
+
+/**
+ * @brief Replaces the `Transfer-Encoding` line of a dechunked request with a
+ * `Content-Length` line. The new line is at most one byte longer (a body
+ * limit below 2^31 has at most ten digits), and the chunk framing that was
+ * removed leaves at least three spare bytes, so the request still fits in
+ * the input it was framed from.
+ * @return The new size of the head.
+ */
+static size_t rewrite_chunked_head(char *buf, size_t head_len,
+                                   size_t body_len) {
+  const char *end = buf + head_len;
+  const char *line = memchr(buf, '\n', head_len);
+  const char *value;
+  while (line && ++line < end) {
+    const char *eol = memchr(line, '\r', (size_t)(end - line));
+    if (!eol || eol == line)
+      break;
+    if (header_is(line, eol, "transfer-encoding", &value)) {
+      char header[48];
+      int header_len = snprintf(header, sizeof(header),
+                                "Content-Length: %zu\r\n", body_len);
+      size_t start = (size_t)(line - buf);
+      size_t old_end = (size_t)(eol - buf) + 2;
+      memmove(buf + start + header_len, buf + old_end,
+              head_len + body_len - old_end);
+      memcpy(buf + start, header, (size_t)header_len);
+      return head_len - (old_end - start) + (size_t)header_len;
+    }
+    line = eol + 1;
+  }
+  return head_len;
+}
+
+static void fill_request(const BodyFraming *body, size_t body_length,
+                         FramedRequest *out_request) {
+  out_request->head_length = body->head_length;
+  out_request->body_length = body_length;
+  out_request->length = body->head_length + body_length;
+  out_request->frame_length = out_request->length;
+  out_request->keep_alive = body->keep_alive;
+  out_request->chunked = body->chunked;
+}
+
+RequestFrame connection_frame_request(Connection *conn,
+                                      const RequestLimits *limits,
+                                      FramedRequest *out_request) {
+  BodyFraming *body = &conn->body;
+  if (body->streaming)
+    return FRAME_INCOMPLETE;
+
+  if (!body->active) {
+    if (conn->in_len == 0)
+      return FRAME_INCOMPLETE;
+    size_t scan = conn->in_len < limits->max_head ? conn->in_len
+                                                  : limits->max_head;
+    const char *head_end = scan_head_end(conn->in, scan);
+    if (!head_end)
+      return conn->in_len >= limits->max_head ? FRAME_TOO_LARGE
+                                              : FRAME_INCOMPLETE;
+
+    size_t head_len = (size_t)(head_end - conn->in) + 4;
+    RequestHead head = {0};
+    parse_request_head(conn->in, head_len, &head);
+    if (head.invalid)
+      return FRAME_INVALID;
+
+    memset(body, 0, sizeof(*body));
+    body->active = true;
+    body->chunked = head.chunked;
+    body->keep_alive =
+        head.http10 ? head.connection_keep_alive : !head.connection_close;
+    body->head_length = head_len;
+    body->remaining = head.content_length;
+    body->raw = head_len;
+    body->chunk_state = CHUNK_SIZE;
+    body->expect_continue = head.expect_continue && !head.http10 &&
+                            (head.chunked || head.content_length > 0);
+    if (limits->report_head && (head.chunked || head.content_length > 0)) {
+      fill_request(body, head.content_length, out_request);
+      return FRAME_HEAD;
+    }
+  }
+
+  if (!body->chunked) {
+    if (body->remaining > limits->max_body)
+      return FRAME_TOO_LARGE;
+    if (conn->in_len < body->head_length + body->remaining)
+      return FRAME_INCOMPLETE;
+    fill_request(body, body->remaining, out_request);
+    memset(body, 0, sizeof(*body));
+    return FRAME_COMPLETE;
+  }
+
+  size_t pos = body->raw;
+  size_t out = body->head_length + body->decoded;
+  RequestFrame result = decode_chunks(body, conn->in, &pos, conn->in_len,
+                                      &out, limits->max_body);
+  if (result != FRAME_COMPLETE) {
+    // Close the gap left by the framing so only the undecoded tail follows
+    // the body, keeping the buffer within the head and body limits.
+    if (pos > out) {
+      memmove(conn->in + out, conn->in + pos, conn->in_len - pos);
+      conn->in_len -= pos - out;
+      pos = out;
+    }
+    body->raw = pos;
+    return result;
+  }
+
+  size_t decoded = body->decoded;
+  body->head_length =
+      rewrite_chunked_head(conn->in, body->head_length, decoded);
+  fill_request(body, decoded, out_request);
+  out_request->frame_length = pos;
+  memset(body, 0, sizeof(*body));
+  return FRAME_COMPLETE;
+}
+
+void connection_begin_stream(Connection *conn) {
+  connection_consume(conn, conn->body.head_length);
+  conn->body.streaming = true;
+  conn->body.raw = 0;
+}
+
+RequestFrame connection_stream_body(Connection *conn, const char **out_data,
+                                    size_t *out_len, size_t *out_consumed) {
+  BodyFraming *body = &conn->body;
+  *out_data = conn->in;
+  *out_len = 0;
+  *out_consumed = 0;
+
+  if (!body->chunked) {
+    size_t n = conn->in_len < body->remaining ? conn->in_len : body->remaining;
+    body->remaining -= n;
+    *out_len = *out_consumed = n;
+    if (body->remaining > 0)
+      return FRAME_INCOMPLETE;
+    memset(body, 0, sizeof(*body));
+    return FRAME_COMPLETE;
+  }
+
+  size_t pos = 0;
+  size_t out = 0;
+  RequestFrame result =
+      decode_chunks(body, conn->in, &pos, conn->in_len, &out, SIZE_MAX);
+  *out_len = out;
+  *out_consumed = pos;
+  if (result == FRAME_COMPLETE)
+    memset(body, 0, sizeof(*body));
+  return result;
+}
+
+void connection_consume(Connection *conn, size_t length) {
+  if (length >= conn->in_len) {
+    conn->in_len = 0;
+    return;
+  }
+  memmove(conn->in, conn->in + length, conn->in_len - length);
+  conn->in_len -= length;
+}
+
+Status connection_queue(Connection *conn, const void *data, size_t len) {
+  if (len == 0)
+    return OK;
+  if (!ensure_capacity(&conn->out, &conn->out_capacity, conn->out_len + len))
+    return ERROR_MEMORY;
+  memcpy(conn->out + conn->out_len, data, len);
+  conn->out_len += len;
+  return OK;
+}
+
+Status connection_sendv(Connection *conn, const struct iovec *iov, int count) {
+  size_t sent = 0;
+  if (!connection_has_pending_output(conn)) {
+    struct msghdr msg = {.msg_iov = (struct iovec *)iov,
+                         .msg_iovlen = (size_t)count};
+    ssize_t n;
+    do
+      n = sendmsg(conn->fd, &msg, CONNECTION_SEND_FLAGS);
+    while (n < 0 && errno == EINTR);
+    // A failed send leaves everything queued; the next flush reports it.
+    if (n > 0) {
+      sent = (size_t)n;
+      conn->last_active_ms = connection_now_ms();
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    if (sent >= iov[i].iov_len) {
+      sent -= iov[i].iov_len;
+      continue;
+    }
+    if (connection_queue(conn, (const char *)iov[i].iov_base + sent,
+                         iov[i].iov_len - sent) != OK)
+      return ERROR_MEMORY;
+    sent = 0;
+  }
+  return OK;
+}
+
+Status connection_insert_output(Connection *conn, size_t offset,
+                                const void *data, size_t len) {
+  if (offset < conn->out_sent || offset > conn->out_len)
+    return ERROR_INVALID_ARG;
+  if (!ensure_capacity(&conn->out, &conn->out_capacity, conn->out_len + len))
+    return ERROR_MEMORY;
+  memmove(conn->out + offset + len, conn->out + offset, conn->out_len - offset);
+  memcpy(conn->out + offset, data, len);
+  conn->out_len += len;
+  if (conn->file_fd >= 0 && offset <= conn->file_at)
+    conn->file_at += len;
+  return OK;
+}
+
+Status connection_attach_file(Connection *conn, int file_fd, off_t offset,
+                              size_t length) {
+  if (conn->file_fd >= 0)
+    return ERROR_INVALID_STATE;
+  if (length == 0) {
+    close(file_fd);
+    return OK;
+  }
+  conn->file_fd = file_fd;
+  conn->file_offset = offset;
+  conn->file_remaining = length;
+  conn->file_at = conn->out_len;
+  return OK;
+}
+
+bool connection_has_file(const Connection *conn) { return conn->file_fd >= 0; }
+
+/**
+ * @brief Maps the unsent part of the attached file so it can be written with
+ * `send`. The mapping starts on a page boundary, so the first bytes may be
+ * skipped.
+ */
+static bool map_file(Connection *conn) {
+  long page = sysconf(_SC_PAGESIZE);
+  off_t aligned = conn->file_offset - conn->file_offset % (page > 0 ? page : 4096);
+  size_t skip = (size_t)(conn->file_offset - aligned);
+  void *map = mmap(NULL, conn->file_remaining + skip, PROT_READ, MAP_PRIVATE,
+                   conn->file_fd, aligned);
+  if (map == MAP_FAILED)
+    return false;
+  conn->file_map = map;
+  conn->file_map_len = conn->file_remaining + skip;
+  conn->file_map_pos = skip;
+  return true;
+}
+
+static IoResult flush_file(Connection *conn) {
+  while (conn->file_remaining > 0) {
+    ssize_t n;
+    if (conn->file_map) {
+      n = send(conn->fd, (char *)conn->file_map + conn->file_map_pos,
+               conn->file_remaining, CONNECTION_SEND_FLAGS);
+      if (n > 0)
+        conn->file_map_pos += (size_t)n;
+    } else {
+#ifdef __linux__
+      n = sendfile(conn->fd, conn->file_fd, &conn->file_offset,
+                   conn->file_remaining);
+      if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+        if (!map_file(conn))
+          return IO_ERROR;
+        continue;
+      }
+#else
+      if (!map_file(conn))
+        return IO_ERROR;
+      continue;
+#endif
+    }
+    if (n > 0) {
+      conn->file_remaining -= (size_t)n;
+      conn->last_active_ms = connection_now_ms();
+      continue;
+    }
+    if (n == 0)
+      return IO_ERROR; // The file shrank while it was being sent.
+    if (errno == EINTR)
+      continue;
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return IO_AGAIN;
+    return IO_ERROR;
+  }
+  connection_detach_file(conn);
+  return IO_DONE;
+}
+
+IoResult connection_flush(Connection *conn) {
+  for (;;) {
+    if (conn->file_fd >= 0 && conn->out_sent == conn->file_at) {
+      IoResult file_result = flush_file(conn);
+      if (file_result != IO_DONE)
+        return file_result;
+      continue;
+    }
+    size_t limit = conn->file_fd >= 0 ? conn->file_at : conn->out_len;
+    if (conn->out_sent >= limit)
+      break;
+    // Headers in front of a file body are corked so they share the first
+    // segment with the file instead of leaving in a packet of their own.
+    int flags = CONNECTION_SEND_FLAGS;
+#ifdef MSG_MORE
+    if (conn->file_fd >= 0)
+      flags |= MSG_MORE;
+#endif
+    ssize_t n = send(conn->fd, conn->out + conn->out_sent,
+                     limit - conn->out_sent, flags);
+    if (n > 0) {
+      conn->out_sent += (size_t)n;
+      conn->last_active_ms = connection_now_ms();
+      continue;
+    }
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return IO_AGAIN;
+    return IO_ERROR;
+  }
+  conn->out_len = 0;
+  conn->out_sent = 0;
+  return IO_DONE;
+}
+
+size_t connection_begin_send(Connection *conn, const char **out_data) {
+  if (conn->sending_sent < conn->sending_len) {
+    *out_data = conn->sending + conn->sending_sent;
+    return conn->sending_len - conn->sending_sent;
+  }
+  if (conn->file_fd >= 0 || conn->out_sent >= conn->out_len)
+    return 0;
+
+  // Swap the buffers so new output is queued behind the lent bytes. The
+  // previous send's buffer is reused for it, so steady traffic allocates
+  // nothing.
+  char *lent = conn->out;
+  size_t lent_capacity = conn->out_capacity;
+  conn->sending_len = conn->out_len;
+  conn->sending_sent = conn->out_sent;
+  conn->out = conn->sending;
+  conn->out_capacity = conn->sending_capacity;
+  conn->out_len = 0;
+  conn->out_sent = 0;
+  conn->sending = lent;
+  conn->sending_capacity = lent_capacity;
+
+  *out_data = conn->sending + conn->sending_sent;
+  return conn->sending_len - conn->sending_sent;
+}
+
+void connection_end_send(Connection *conn, size_t sent) {
+  conn->sending_sent += sent;
+  if (sent > 0)
+    conn->last_active_ms = connection_now_ms();
+  if (conn->sending_sent >= conn->sending_len) {
+    conn->sending_len = 0;
+    conn->sending_sent = 0;
+  }
+}
+
+bool connection_has_pending_output(const Connection *conn) {
+  return conn->out_sent < conn->out_len || conn->file_fd >= 0 ||
+         conn->sending_sent < conn->sending_len;
+}
+
+size_t connection_pending_output(const Connection *conn) {
+  return conn->out_len - conn->out_sent + conn->file_remaining +
+         conn->sending_len - conn->sending_sent;
+}
+
+long long connection_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
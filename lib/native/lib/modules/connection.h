@@ -0,0 +1,338 @@
+/**
+ * @file connection.h
+ * @brief Defines the per-client connection state used by the HTTP server.
+ *
+ * A `Connection` owns a non-blocking socket together with an input buffer
+ * that accumulates partial reads until a full request is framed, and an
+ * output buffer that holds the pending response until the socket has
+ * accepted every byte.
+ *
+ * Request bodies are framed by `Content-Length` or `Transfer-Encoding:
+ * chunked`. Chunked bodies are decoded in place as they arrive, so a
+ * buffered request never holds more than its head, its decoded body and a
+ * partial chunk line. A body can instead be streamed out of the buffer piece
+ * by piece with `connection_stream_body`.
+ *
+ * The output may also carry one file-backed segment, which is sent straight
+ * from the page cache with `sendfile` (or from an `mmap` of the file where
+ * `sendfile` is unavailable) instead of being copied into the buffer.
+ *
+ * With a completion-based backend the socket is not read or written here:
+ * received bytes are appended with `connection_receive`, and queued output
+ * is lent to an asynchronous send with `connection_begin_send`.
+ */
+
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include "../core/arena.h"
+#include "../core/error.h"
+#include "timer_wheel.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/**
+ * @enum ConnectionState
+ * @brief The position of a connection in its read/write state machine.
+ */
+typedef enum {
+  CONN_READING,  ///< Accumulating bytes until a full request is available.
+  CONN_WRITING,  ///< Flushing a queued response to the socket.
+  CONN_HANDLING, ///< A request is running on the handler thread pool.
+  CONN_CLOSING,  ///< The connection is finished and should be released.
+} ConnectionState;
+
+/**
+ * @enum IoResult
+ * @brief The outcome of a non-blocking read or write pass.
+ */
+typedef enum {
+  IO_DONE,  ///< The operation ran to completion.
+  IO_AGAIN, ///< The socket would block; wait for the next readiness event.
+  IO_EOF,   ///< The peer closed its end of the connection.
+  IO_ERROR, ///< A socket error occurred.
+} IoResult;
+
+/**
+ * @enum RequestFrame
+ * @brief The result of looking for a complete request in the input buffer.
+ */
+typedef enum {
+  FRAME_INCOMPLETE, ///< More bytes are needed.
+  FRAME_COMPLETE,   ///< A complete request is at the head of the buffer.
+  FRAME_INVALID,    ///< The request head is malformed.
+  FRAME_TOO_LARGE,  ///< The request exceeds the configured size limit.
+  FRAME_HEAD,       ///< The head is complete and a body follows (see
+                    ///< `RequestLimits.report_head`).
+} RequestFrame;
+
+/**
+ * @struct RequestLimits
+ * @brief Size limits applied while framing requests.
+ */
+typedef struct {
+  size_t max_head; // Request line plus headers.
+  size_t max_body; // Decoded body.
+  // Return `FRAME_HEAD` once a head with a body is framed, so the caller can
+  // choose to stream the body instead of buffering it.
+  bool report_head;
+} RequestLimits;
+
+/**
+ * @struct FramedRequest
+ * @brief Describes a request found at the head of the input buffer.
+ *
+ * A chunked body is decoded in place and its head rewritten to carry a
+ * `Content-Length`, so the request handed to a handler is always
+ * Content-Length delimited. It can therefore be shorter than the input it
+ * was framed from.
+ */
+typedef struct {
+  size_t length;       // Size of the request head plus its body.
+  size_t head_length;  // Size of the head, including the blank line.
+  size_t body_length;  // Size of the (decoded) body.
+  size_t frame_length; // Input bytes to consume once the request is handled.
+  bool keep_alive;     // The client permits the connection to be reused.
+  bool chunked;        // The body arrives with chunked framing.
+} FramedRequest;
+
+/**
+ * @struct BodyFraming
+ * @brief Progress through the body of the request at the head of the input
+ * buffer. Reset once the request is framed.
+ */
+typedef struct {
+  bool active;      // A head has been framed and its body is pending.
+  bool streaming;   // The body is handed out by `connection_stream_body`.
+  bool chunked;     // The body uses chunked framing.
+  bool keep_alive;
+  bool expect_continue; // The client waits for `100 Continue` to send it.
+  size_t head_length;
+  size_t remaining; // Content-Length bytes not yet received or streamed.
+  size_t decoded;   // Chunked bytes decoded so far.
+  size_t raw;       // Input offset of the first undecoded chunked byte.
+  int chunk_state;
+  size_t chunk_remaining; // Data bytes left in the current chunk.
+} BodyFraming;
+
+/**
+ * @struct Connection
+ * @brief A single client connection and its buffered I/O state.
+ */
+typedef struct Connection {
+  int fd;
+  ConnectionState state;
+
+  char *in; // Received bytes; always has room for a trailing NUL.
+  size_t in_len;
+  size_t in_capacity;
+  BodyFraming body;
+  void *body_state; // Owned by the server's body stream callbacks.
+
+  char *out; // Response bytes queued by the handler.
+  size_t out_len;
+  size_t out_sent;
+  size_t out_capacity;
+
+  // File body sent after the first `file_at` bytes of `out`. `file_fd` is -1
+  // when no file is attached.
+  int file_fd;
+  off_t file_offset;
+  size_t file_remaining;
+  size_t file_at;
+  void *file_map; // Mapping used when sendfile is unavailable.
+  size_t file_map_len;
+  size_t file_map_pos;
+
+  // Output lent to an asynchronous send. It stays put while later output is
+  // queued in `out`, and is written before it.
+  char *sending;
+  size_t sending_len;
+  size_t sending_sent;
+  size_t sending_capacity;
+
+  // Operations on the server's io_uring that still refer to the connection.
+  // It is only freed once they have all completed.
+  int ring_ops;
+  bool recv_armed;
+  bool send_armed;
+  bool poll_armed;
+  bool ring_failed; // A send failed; the socket is unusable.
+  bool retired;     // Closed by the server, waiting for `ring_ops` to drain.
+
+  bool close_after_write; // Close once the pending output is flushed.
+  bool read_closed;       // The peer has shut down its sending side.
+  int requests_served;
+  long long last_active_ms;  // Monotonic time of the last socket activity.
+  long long head_started_ms; // When the pending request head began, or 0.
+  Timer timer;               // Deadline of the current phase.
+  Arena *arena; // Per-request allocations, reset after each response.
+
+  // Intrusive list of the connections owned by an event loop.
+  struct Connection *prev;
+  struct Connection *next;
+} Connection;
+
+/**
+ * @brief Creates the state for a newly accepted, non-blocking socket.
+ * @param fd The client socket. Ownership passes to the connection.
+ * @return A new `Connection`, or NULL on allocation failure.
+ */
+Connection *connection(int fd);
+
+/**
+ * @brief Closes the socket and frees all buffers.
+ * @param conn The connection to free.
+ */
+void connection_free(Connection *conn);
+
+/**
+ * @brief Reads from the socket until it would block or `limit` bytes are
+ * buffered.
+ * @param conn The connection to read into.
+ * @param limit The maximum number of bytes to hold in the input buffer.
+ * @return `IO_AGAIN` once the socket is drained, `IO_DONE` if the limit was
+ * reached first, `IO_EOF` if the peer closed, or `IO_ERROR`.
+ */
+IoResult connection_fill(Connection *conn, size_t limit);
+
+/**
+ * @brief Appends bytes received by an asynchronous read to the input buffer.
+ * @return OK on success, or `ERROR_MEMORY` if the buffer could not grow.
+ */
+Status connection_receive(Connection *conn, const void *data, size_t len);
+
+/**
+ * @brief Determines whether a complete request is at the head of the input
+ * buffer, using `Content-Length` or chunked framing to find the end of the
+ * body. Chunked data is decoded incrementally, so repeated calls as more
+ * input arrives do not rescan the body.
+ *
+ * Pipelined requests are framed one at a time: after the first request is
+ * consumed (by `frame_length` bytes), calling this again frames the next one
+ * from the same buffer.
+ * @param conn The connection to inspect.
+ * @param limits The size limits to enforce.
+ * @param[out] out_request Describes the request when complete, or its head
+ * when `FRAME_HEAD` is returned.
+ * @return A `RequestFrame` describing the state of the buffer.
+ */
+RequestFrame connection_frame_request(Connection *conn,
+                                      const RequestLimits *limits,
+                                      FramedRequest *out_request);
+
+/**
+ * @brief Switches the request whose head was just reported by `FRAME_HEAD`
+ * to streaming. The head is discarded from the buffer; the caller must have
+ * finished with it.
+ */
+void connection_begin_stream(Connection *conn);
+
+/**
+ * @brief Hands out the next piece of a streamed body.
+ *
+ * Decoded bytes are placed at the start of the input buffer and stay valid
+ * until `connection_consume(conn, *out_consumed)` is called, which must be
+ * done before the next call.
+ * @param conn The connection.
+ * @param[out] out_data The decoded bytes, possibly empty.
+ * @param[out] out_len The number of decoded bytes.
+ * @param[out] out_consumed The number of input bytes they were decoded from.
+ * @return `FRAME_COMPLETE` once the body has ended, `FRAME_INCOMPLETE` if
+ * more input is needed, or `FRAME_INVALID` on malformed chunked framing.
+ */
+RequestFrame connection_stream_body(Connection *conn, const char **out_data,
+                                    size_t *out_len, size_t *out_consumed);
+
+/**
+ * @brief Discards `length` bytes from the head of the input buffer.
+ */
+void connection_consume(Connection *conn, size_t length);
+
+/**
+ * @brief Appends bytes to the pending output of the connection.
+ * @return OK on success, or `ERROR_MEMORY` if the buffer could not grow.
+ */
+Status connection_queue(Connection *conn, const void *data, size_t len);
+
+/**
+ * @brief Sends segments straight to the socket with one `sendmsg` when
+ * nothing is pending ahead of them, and queues whatever it does not take.
+ * The segments may be reused once this returns.
+ * @return OK on success, or `ERROR_MEMORY` if the rest could not be queued.
+ */
+Status connection_sendv(Connection *conn, const struct iovec *iov, int count);
+
+/**
+ * @brief Inserts bytes into the pending output at `offset`, which must not
+ * precede bytes that were already written.
+ * @return OK on success, or an error Status on failure.
+ */
+Status connection_insert_output(Connection *conn, size_t offset,
+                                const void *data, size_t len);
+
+/**
+ * @brief Appends a range of a file to the pending output. The bytes are sent
+ * after everything queued so far and before anything queued later.
+ * @param conn The connection.
+ * @param file_fd An open file. Ownership passes to the connection, which
+ * closes it once the range is sent or the connection is freed.
+ * @param offset The first byte of the range.
+ * @param length The number of bytes to send.
+ * @return OK on success, or `ERROR_INVALID_STATE` if a file is already
+ * attached (the caller keeps ownership of `file_fd` in that case).
+ */
+Status connection_attach_file(Connection *conn, int file_fd, off_t offset,
+                              size_t length);
+
+/**
+ * @brief Returns true while a file body is attached and not fully sent.
+ */
+bool connection_has_file(const Connection *conn);
+
+/**
+ * @brief Writes as much pending output as the socket accepts.
+ * @return `IO_DONE` once everything is written, `IO_AGAIN` if the socket
+ * would block, or `IO_ERROR`.
+ */
+IoResult connection_flush(Connection *conn);
+
+/**
+ * @brief Lends the queued output to an asynchronous send. The bytes stay
+ * valid, and are not moved by later writes to the connection, until
+ * `connection_end_send` reports them written.
+ *
+ * Bytes left over from a short send are lent again before anything newer.
+ * Output in front of an attached file is not lent; it goes out with the file
+ * through `connection_flush`.
+ * @param conn The connection.
+ * @param[out] out_data The bytes to send.
+ * @return The number of bytes to send, or 0 if there are none to lend.
+ */
+size_t connection_begin_send(Connection *conn, const char **out_data);
+
+/**
+ * @brief Records that `sent` bytes lent by `connection_begin_send` were
+ * written.
+ */
+void connection_end_send(Connection *conn, size_t sent);
+
+/**
+ * @brief Returns true if queued output has not yet been written.
+ */
+bool connection_has_pending_output(const Connection *conn);
+
+/**
+ * @brief Returns the number of queued bytes not yet written, including any
+ * attached file body.
+ */
+size_t connection_pending_output(const Connection *conn);
+
+/**
+ * @brief Returns the current monotonic time in milliseconds.
+ */
+long long connection_now_ms(void);
+
+#endif // CONNECTION_H
@@ -1,4 +1,5 @@
 #include "cookie.h"
+#include "../core/scan.h"
 #include "../webs_api.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,23 +14,34 @@ Value *cookie_parse(const char *cookie_header) {
   if (!cookie_header)
     return cookies;
 
-  char *header_copy = strdup(cookie_header);
+  size_t len = strlen(cookie_header);
+  char *header_copy = malloc(len + 1);
   if (!header_copy)
     return cookies;
+  memcpy(header_copy, cookie_header, len + 1);
 
-  char *pair_state;
-  char *pair = strtok_r(header_copy, ";", &pair_state);
-  while (pair) {
-    while (*pair == ' ')
-      pair++;
-    char *equals = strchr(pair, '=');
-    if (equals) {
-      *equals = '\0';
-      char *key = pair;
-      char *value = equals + 1;
-      W->objectSet(cookies, key, W->string(value));
+  // Keys and values are cut out of the copy in place; the first separator
+  // of each pair decides whether it has a value at all.
+  char *p = header_copy;
+  char *end = header_copy + len;
+  while (p < end) {
+    while (p < end && *p == ' ')
+      p++;
+    char *separator = (char *)scan_either(p, end, ';', '=');
+    if (separator == end)
+      break;
+    if (*separator == ';') {
+      p = separator + 1;
+      continue;
     }
-    pair = strtok_r(NULL, ";", &pair_state);
+    char *value = separator + 1;
+    char *value_end = memchr(value, ';', (size_t)(end - value));
+    if (!value_end)
+      value_end = end;
+    *separator = '\0';
+    *value_end = '\0';
+    W->objectSet(cookies, p, W->string(value));
+    p = value_end + 1;
   }
   free(header_copy);
   return cookies;
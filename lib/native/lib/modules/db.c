@@ -1,14 +1,176 @@
+#define _GNU_SOURCE
 #include "db.h"
+#include "../core/arena.h"
 #include "../core/array.h"
 #include "../core/boolean.h"
+#include "../core/json.h"
+#include "../core/memory.h"
 #include "../core/null.h"
 #include "../core/number.h"
 #include "../core/object.h"
 #include "../core/pointer.h"
 #include "../core/string.h"
 #include "sqlite3.h"
+#include <ctype.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+/**
+ * @struct DbConnection
+ * @brief What a database handle points to: the connection and its cache of
+ * prepared statements, most recently used first.
+ */
+typedef struct {
+  sqlite3 *db;
+  DbPool *pool; // The pool it belongs to, or NULL if opened with `db_open`.
+  DbStatement *head;
+  DbStatement *tail;
+  int cached;
+} DbConnection;
+
+struct DbStatement {
+  sqlite3_stmt *stmt;
+  char *sql;
+  size_t hash;
+  bool in_use; // Handed out by `db_prepare` and not yet finished.
+  bool cached; // In `conn`'s cache; otherwise finalized when finished.
+  struct DbStatement *prev;
+  struct DbStatement *next;
+};
+
+/**
+ * @struct DbWrite
+ * @brief A write waiting for the writer thread. `db_write` waits on one on
+ * its own stack; `db_write_async` allocates one that owns copies of its SQL
+ * and parameters and is freed once its callback has run.
+ */
+typedef struct DbWrite {
+  char *sql;
+  Value *params; // An array, or NULL.
+  DbWriteCallback callback;
+  void *user_data;
+  bool owned;
+  Status status;
+  char *error;
+  bool done;
+  struct DbWrite *next;
+} DbWrite;
+
+/**
+ * @struct DbWriter
+ * @brief The thread that owns a pool's write connection and commits queued
+ * writes in batches.
+ */
+typedef struct {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t pending;   // Signalled when a write is queued or on stop.
+  pthread_cond_t completed; // Broadcast when a batch has finished.
+  DbWrite *head;
+  DbWrite *tail;
+  bool stopping;
+  Value *handle;
+} DbWriter;
+
+struct DbPool {
+  pthread_mutex_t lock;
+  pthread_cond_t available; // Signalled when a connection is returned.
+  char *filename;
+  char *init_sql;
+  int busy_timeout_ms;
+  bool initialized; // `init_sql` has run.
+  bool single_writer;
+  DbWriter *writer; // Started by the first `db_write`.
+  Value **idle;     // Handles ready to check out; room for `max`.
+  int idle_count;
+  int open_count; // Idle and checked out.
+  int max;
+};
+
+static DbConnection *connection_of(Value *db_handle_val) {
+  if (!db_handle_val || db_handle_val->type != VALUE_POINTER)
+    return NULL;
+  return (DbConnection *)db_handle_val->as.pointer;
+}
+
+static size_t hash_sql(const char *sql) {
+  size_t hash = 2166136261u;
+  for (const char *p = sql; *p; p++) {
+    hash ^= (size_t)(unsigned char)*p;
+    hash *= 16777619;
+  }
+  return hash;
+}
+
+static void statement_unlink(DbConnection *conn, DbStatement *statement) {
+  if (statement->prev)
+    statement->prev->next = statement->next;
+  else
+    conn->head = statement->next;
+  if (statement->next)
+    statement->next->prev = statement->prev;
+  else
+    conn->tail = statement->prev;
+  statement->prev = statement->next = NULL;
+}
+
+static void statement_push_front(DbConnection *conn, DbStatement *statement) {
+  statement->prev = NULL;
+  statement->next = conn->head;
+  if (conn->head)
+    conn->head->prev = statement;
+  conn->head = statement;
+  if (!conn->tail)
+    conn->tail = statement;
+}
+
+static void statement_free(DbStatement *statement) {
+  sqlite3_finalize(statement->stmt);
+  free(statement->sql);
+  free(statement);
+}
+
+/**
+ * @brief Wraps an open connection in a handle. Handles are allocated
+ * outside any arena: they may outlive the request that opened them.
+ */
+static Value *connection_handle(sqlite3 *db) {
+  DbConnection *conn = calloc(1, sizeof(DbConnection));
+  if (!conn)
+    return NULL;
+  conn->db = db;
+  Arena *previous = arena_enter(NULL);
+  Value *handle = pointer(conn);
+  arena_leave(previous);
+  if (!handle)
+    free(conn);
+  return handle;
+}
+
+/**
+ * @brief Finalizes the cached statements and closes the connection. A
+ * statement still in use keeps it open until it is finished.
+ */
+static int connection_close(DbConnection *conn) {
+  DbStatement *statement = conn->head;
+  while (statement) {
+    DbStatement *next = statement->next;
+    if (statement->in_use) {
+      statement->cached = false;
+      statement->prev = statement->next = NULL;
+    } else {
+      statement_free(statement);
+    }
+    statement = next;
+  }
+  conn->head = conn->tail = NULL;
+  conn->cached = 0;
+  return sqlite3_close_v2(conn->db);
+}
 
 Value *db_open(const char *filename) {
   sqlite3 *db;
@@ -18,31 +180,227 @@ Value *db_open(const char *filename) {
     sqlite3_close(db);
     return NULL;
   }
-  return pointer(db);
+  Value *handle = connection_handle(db);
+  if (!handle)
+    sqlite3_close(db);
+  return handle;
 }
 
 Value *db_close(Value *db_handle_val) {
-  if (!db_handle_val || db_handle_val->type != VALUE_POINTER ||
-      !db_handle_val->as.pointer) {
+  DbConnection *conn = connection_of(db_handle_val);
+  if (!conn) {
     return string_value("Invalid database handle");
   }
-  sqlite3 *db = (sqlite3 *)db_handle_val->as.pointer;
-  int rc = sqlite3_close(db);
+  int rc = connection_close(conn);
   if (rc != SQLITE_OK) {
-    return string_value(sqlite3_errmsg(db));
+    return string_value(sqlite3_errmsg(conn->db));
   }
+  free(conn);
   db_handle_val->as.pointer = NULL;
   return boolean(true);
 }
 
+const char *db_filename(Value *db_handle_val) {
+  DbConnection *conn = connection_of(db_handle_val);
+  return conn ? sqlite3_db_filename(conn->db, "main") : NULL;
+}
+
+Status db_prepare(Value *db_handle_val, const char *sql,
+                  DbStatement **out_statement, char **error) {
+  *out_statement = NULL;
+  DbConnection *conn = connection_of(db_handle_val);
+  if (!conn || !sql) {
+    if (error)
+      *error = strdup("Invalid database handle");
+    return ERROR_INVALID_ARG;
+  }
+
+  size_t hash = hash_sql(sql);
+  for (DbStatement *statement = conn->head; statement;
+       statement = statement->next) {
+    if (statement->hash != hash || statement->in_use ||
+        strcmp(statement->sql, sql) != 0)
+      continue;
+    statement_unlink(conn, statement);
+    statement_push_front(conn, statement);
+    statement->in_use = true;
+    *out_statement = statement;
+    return OK;
+  }
+
+  DbStatement *statement = calloc(1, sizeof(DbStatement));
+  if (!statement || !(statement->sql = strdup(sql))) {
+    free(statement);
+    if (error)
+      *error = strdup("Memory allocation failed for statement.");
+    return ERROR_MEMORY;
+  }
+  if (sqlite3_prepare_v2(conn->db, sql, -1, &statement->stmt, NULL) !=
+      SQLITE_OK) {
+    if (error)
+      *error = strdup(sqlite3_errmsg(conn->db));
+    statement_free(statement);
+    return ERROR_INVALID_ARG;
+  }
+  statement->hash = hash;
+  statement->in_use = true;
+
+  // Make room by finalizing the least recently used idle statement. If
+  // every cached statement is in use, this one is not cached.
+  if (conn->cached >= DB_STATEMENT_CACHE_SIZE) {
+    DbStatement *victim = conn->tail;
+    while (victim && victim->in_use)
+      victim = victim->prev;
+    if (victim) {
+      statement_unlink(conn, victim);
+      statement_free(victim);
+      conn->cached--;
+    }
+  }
+  if (conn->cached < DB_STATEMENT_CACHE_SIZE) {
+    statement->cached = true;
+    statement_push_front(conn, statement);
+    conn->cached++;
+  }
+  *out_statement = statement;
+  return OK;
+}
+
+void db_finish(DbStatement *statement) {
+  if (!statement)
+    return;
+  if (statement->stmt) {
+    sqlite3_reset(statement->stmt);
+    sqlite3_clear_bindings(statement->stmt);
+  }
+  statement->in_use = false;
+  if (!statement->cached)
+    statement_free(statement);
+}
+
+static Status bind_result(int rc) {
+  if (rc == SQLITE_OK)
+    return OK;
+  return rc == SQLITE_NOMEM ? ERROR_MEMORY : ERROR_INVALID_ARG;
+}
+
+Status db_bind_int(DbStatement *statement, int index, int64_t value) {
+  return bind_result(sqlite3_bind_int64(statement->stmt, index, value));
+}
+
+Status db_bind_double(DbStatement *statement, int index, double value) {
+  return bind_result(sqlite3_bind_double(statement->stmt, index, value));
+}
+
+Status db_bind_text(DbStatement *statement, int index, const char *text) {
+  if (!text)
+    return db_bind_null(statement, index);
+  return bind_result(sqlite3_bind_text(statement->stmt, index, text,
+                                                  -1, SQLITE_TRANSIENT));
+}
+
+Status db_bind_null(DbStatement *statement, int index) {
+  return bind_result(sqlite3_bind_null(statement->stmt, index));
+}
+
+Status db_bind_value(DbStatement *statement, int index, const Value *value) {
+  if (!value)
+    return db_bind_null(statement, index);
+  switch (value->type) {
+  case VALUE_NUMBER: {
+    double n = value->as.number;
+    if (n == floor(n) && fabs(n) < 9007199254740992.0)
+      return db_bind_int(statement, index, (int64_t)n);
+    return db_bind_double(statement, index, n);
+  }
+  case VALUE_BOOL:
+    return db_bind_int(statement, index, value->as.boolean ? 1 : 0);
+  case VALUE_STRING:
+    return bind_result(sqlite3_bind_text(statement->stmt, index,
+                                         value->as.string->chars,
+                                         (int)value->as.string->length,
+                                         SQLITE_TRANSIENT));
+  case VALUE_NULL:
+  case VALUE_UNDEFINED:
+    return db_bind_null(statement, index);
+  default:
+    return ERROR_INVALID_ARG;
+  }
+}
+
+DbStep db_step(DbStatement *statement, char **error) {
+  if (!statement->stmt) // The SQL held only whitespace or comments.
+    return DB_DONE;
+  int rc = sqlite3_step(statement->stmt);
+  if (rc == SQLITE_ROW)
+    return DB_ROW;
+  if (rc == SQLITE_DONE)
+    return DB_DONE;
+  if (error)
+    *error = strdup(sqlite3_errmsg(sqlite3_db_handle(statement->stmt)));
+  return DB_ERROR;
+}
+
+int db_column_count(DbStatement *statement) {
+  return sqlite3_column_count(statement->stmt);
+}
+
+const char *db_column_name(DbStatement *statement, int column) {
+  return sqlite3_column_name(statement->stmt, column);
+}
+
+bool db_column_is_null(DbStatement *statement, int column) {
+  return sqlite3_column_type(statement->stmt, column) == SQLITE_NULL;
+}
+
+int64_t db_column_int(DbStatement *statement, int column) {
+  return sqlite3_column_int64(statement->stmt, column);
+}
+
+double db_column_double(DbStatement *statement, int column) {
+  return sqlite3_column_double(statement->stmt, column);
+}
+
+const char *db_column_text(DbStatement *statement, int column) {
+  return (const char *)sqlite3_column_text(statement->stmt, column);
+}
+
+static bool only_whitespace(const char *text) {
+  while (*text && isspace((unsigned char)*text))
+    text++;
+  return *text == '\0';
+}
+
 Value *db_exec(Value *db_handle_val, const char *sql) {
-  if (!db_handle_val || db_handle_val->type != VALUE_POINTER ||
-      !db_handle_val->as.pointer) {
+  DbConnection *conn = connection_of(db_handle_val);
+  if (!conn) {
     return string_value("Invalid database handle");
   }
-  sqlite3 *db = (sqlite3 *)db_handle_val->as.pointer;
+
+  // A single statement runs from the cache; a script runs as before.
+  const char *semicolon = strchr(sql, ';');
+  if (!semicolon || only_whitespace(semicolon + 1)) {
+    DbStatement *statement = NULL;
+    char *error = NULL;
+    if (db_prepare(db_handle_val, sql, &statement, &error) != OK) {
+      Value *error_val = string_value(error ? error : "Prepare failed");
+      free(error);
+      return error_val;
+    }
+    DbStep step;
+    while ((step = db_step(statement, &error)) == DB_ROW)
+      ;
+    db_finish(statement);
+    if (step == DB_ERROR) {
+      Value *error_val = string_value(error ? error : "Step failed");
+      free(error);
+      return error_val;
+    }
+    return boolean(true);
+  }
+
   char *zErrMsg = 0;
-  int rc = sqlite3_exec(db, sql, 0, 0, &zErrMsg);
+  int rc = sqlite3_exec(conn->db, sql, 0, 0, &zErrMsg);
 
   if (rc != SQLITE_OK) {
     Value *error_val = string_value(zErrMsg);
@@ -52,72 +410,1045 @@ Value *db_exec(Value *db_handle_val, const char *sql) {
   return boolean(true);
 }
 
-Value *db_query(Value *db_handle_val, const char *sql) {
-  if (!db_handle_val || db_handle_val->type != VALUE_POINTER ||
-      !db_handle_val->as.pointer) {
-    return string_value("Invalid database handle");
+Value *db_row(DbStatement *statement) {
+  sqlite3_stmt *stmt = statement->stmt;
+  Value *row = object_value();
+  if (!row)
+    return NULL;
+
+  int col_count = sqlite3_column_count(stmt);
+  for (int i = 0; i < col_count; i++) {
+    const char *col_name = sqlite3_column_name(stmt, i);
+    Value *col_value;
+    int type = sqlite3_column_type(stmt, i);
+
+    switch (type) {
+    case SQLITE_INTEGER:
+      col_value = number((double)sqlite3_column_int64(stmt, i));
+      break;
+    case SQLITE_FLOAT:
+      col_value = number(sqlite3_column_double(stmt, i));
+      break;
+    case SQLITE_TEXT:
+      col_value = string_value((const char *)sqlite3_column_text(stmt, i));
+      break;
+    case SQLITE_NULL:
+    default:
+      col_value = null();
+      break;
+    }
+    if (!col_value) {
+      value_free(row);
+      return NULL;
+    }
+    row->as.object->set(row->as.object, col_name, col_value);
   }
-  sqlite3 *db = (sqlite3 *)db_handle_val->as.pointer;
-  sqlite3_stmt *stmt;
-  int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+  return row;
+}
 
-  if (rc != SQLITE_OK) {
-    return string_value(sqlite3_errmsg(db));
+Value *db_query(Value *db_handle_val, const char *sql) {
+  DbStatement *statement = NULL;
+  char *error = NULL;
+  if (db_prepare(db_handle_val, sql, &statement, &error) != OK) {
+    Value *error_val = string_value(error ? error : "Prepare failed");
+    free(error);
+    return error_val;
   }
 
   Value *results = array_value();
   if (!results) {
-    sqlite3_finalize(stmt);
+    db_finish(statement);
     return string_value("Memory allocation failed for results array.");
   }
 
-  int col_count = sqlite3_column_count(stmt);
-
-  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-    Value *row = object_value();
+  DbStep step;
+  while ((step = db_step(statement, &error)) == DB_ROW) {
+    Value *row = db_row(statement);
     if (!row) {
       value_free(results);
-      sqlite3_finalize(stmt);
+      db_finish(statement);
       return string_value("Memory allocation failed for row object.");
     }
+    results->as.array->push(results->as.array, row);
+  }
 
-    for (int i = 0; i < col_count; i++) {
-      const char *col_name = sqlite3_column_name(stmt, i);
-      Value *col_value;
-      int type = sqlite3_column_type(stmt, i);
+  if (step == DB_ERROR) {
+    Value *err_val = string_value(error ? error : "Step failed");
+    free(error);
+    value_free(results);
+    results = err_val;
+  }
+
+  db_finish(statement);
+  return results;
+}
+
+/**
+ * @brief Appends a double that reads back exactly, or null for infinities
+ * and NaN, which JSON cannot represent.
+ */
+static void format_double(char *buffer, size_t size, double value) {
+  snprintf(buffer, size, "%.15g", value);
+  if (strtod(buffer, NULL) != value)
+    snprintf(buffer, size, "%.17g", value);
+}
 
-      switch (type) {
+static void append_json_double(StringBuilder *sb, double value) {
+  if (!isfinite(value)) {
+    sb_append_str(sb, "null");
+    return;
+  }
+  char buffer[32];
+  format_double(buffer, sizeof(buffer), value);
+  sb_append_str(sb, buffer);
+}
+
+static void append_json_int(StringBuilder *sb, int64_t value) {
+  char buffer[24];
+  snprintf(buffer, sizeof(buffer), "%" PRId64, value);
+  sb_append_str(sb, buffer);
+}
+
+/**
+ * @brief Encodes every column's `"name":` once, back to back in `keys`;
+ * column `i`'s ends at `ends[i]`. A column whose name repeats later is left
+ * empty and skipped, since the last one wins in `db_row`.
+ */
+static bool encode_column_keys(const char *const *names, int columns,
+                               StringBuilder *keys, size_t *ends) {
+  for (int i = 0; i < columns; i++) {
+    bool repeated = false;
+    for (int j = i + 1; j < columns && !repeated; j++)
+      repeated = strcmp(names[i], names[j]) == 0;
+    if (!repeated) {
+      json_encode_string(names[i], keys);
+      sb_append_char(keys, ':');
+    }
+    ends[i] = keys->length;
+  }
+  return keys->buffer != NULL;
+}
+
+Status db_query_json(DbStatement *statement, StringBuilder *sb,
+                     char **error) {
+  sqlite3_stmt *stmt = statement->stmt;
+  int columns = sqlite3_column_count(stmt);
+  size_t slots = columns > 0 ? (size_t)columns : 1;
+  StringBuilder keys;
+  sb_init(&keys);
+  size_t *ends = malloc(sizeof(size_t) * slots);
+  const char **names = malloc(sizeof(char *) * slots);
+  bool ready = ends && names;
+  for (int i = 0; ready && i < columns; i++)
+    names[i] = sqlite3_column_name(stmt, i);
+  ready = ready && encode_column_keys(names, columns, &keys, ends);
+  free(names);
+  if (!ready) {
+    free(ends);
+    sb_free(&keys);
+    if (error)
+      *error = strdup("Memory allocation failed for column names.");
+    return ERROR_MEMORY;
+  }
+
+  size_t start = sb->length;
+  sb_append_char(sb, '[');
+  DbStep step;
+  bool first_row = true;
+  while ((step = db_step(statement, error)) == DB_ROW) {
+    sb_append_str(sb, first_row ? "{" : ",{");
+    first_row = false;
+    size_t key_start = 0;
+    bool first_column = true;
+    for (int i = 0; i < columns; i++) {
+      size_t key_end = ends[i];
+      if (key_end == key_start)
+        continue;
+      if (!first_column)
+        sb_append_char(sb, ',');
+      first_column = false;
+      sb_append_bytes(sb, keys.buffer + key_start, key_end - key_start);
+      key_start = key_end;
+
+      switch (sqlite3_column_type(stmt, i)) {
       case SQLITE_INTEGER:
-        col_value = number(sqlite3_column_int(stmt, i));
+        append_json_int(sb, sqlite3_column_int64(stmt, i));
         break;
       case SQLITE_FLOAT:
-        col_value = number(sqlite3_column_double(stmt, i));
+        append_json_double(sb, sqlite3_column_double(stmt, i));
         break;
       case SQLITE_TEXT:
-        col_value = string_value((const char *)sqlite3_column_text(stmt, i));
+        json_encode_string((const char *)sqlite3_column_text(stmt, i), sb);
         break;
-      case SQLITE_NULL:
       default:
-        col_value = null();
+        sb_append_str(sb, "null");
         break;
       }
-      if (!col_value) {
-        value_free(row);
-        value_free(results);
-        sqlite3_finalize(stmt);
-        return string_value("Memory allocation failed for column value.");
+    }
+    sb_append_char(sb, '}');
+  }
+  sb_append_char(sb, ']');
+  free(ends);
+  sb_free(&keys);
+
+  if (step == DB_ERROR) {
+    // Leave the builder as it was rather than holding half an array.
+    if (sb->buffer) {
+      sb->length = start;
+      sb->buffer[start] = '\0';
+    }
+    return ERROR_IO;
+  }
+  if (!sb->buffer) {
+    if (error)
+      *error = strdup("Memory allocation failed for JSON.");
+    return ERROR_MEMORY;
+  }
+  return OK;
+}
+
+static bool cell_is_null(const DbColumn *column, size_t row) {
+  return column->nulls[row / 8] & (1u << (row % 8));
+}
+
+static bool result_set_grow(DbResultSet *set) {
+  size_t capacity = set->row_capacity ? set->row_capacity * 2 : 64;
+  size_t old_bytes = (set->row_capacity + 7) / 8;
+  size_t bytes = (capacity + 7) / 8;
+  for (int i = 0; i < set->column_count; i++) {
+    DbColumn *column = &set->columns[i];
+    uint8_t *nulls = realloc(column->nulls, bytes);
+    if (!nulls)
+      return false;
+    memset(nulls + old_bytes, 0, bytes - old_bytes);
+    column->nulls = nulls;
+    if (column->ints || column->doubles) {
+      // Both are eight bytes wide; only one is ever set.
+      void *values = realloc(column->ints ? (void *)column->ints
+                                          : (void *)column->doubles,
+                             capacity * sizeof(int64_t));
+      if (!values)
+        return false;
+      if (column->ints)
+        column->ints = values;
+      else
+        column->doubles = values;
+    }
+    if (column->offsets) {
+      size_t *offsets =
+          realloc(column->offsets, (capacity + 1) * sizeof(size_t));
+      if (!offsets)
+        return false;
+      column->offsets = offsets;
+    }
+  }
+  set->row_capacity = capacity;
+  return true;
+}
+
+/**
+ * @brief Appends a cell and its terminating NUL to a text column.
+ */
+static bool column_append(DbColumn *column, size_t row, const void *bytes,
+                          size_t length) {
+  size_t needed = column->data_size + length + 1;
+  if (needed > column->data_capacity) {
+    size_t capacity = column->data_capacity ? column->data_capacity : 256;
+    while (capacity < needed)
+      capacity *= 2;
+    char *data = realloc(column->data, capacity);
+    if (!data)
+      return false;
+    column->data = data;
+    column->data_capacity = capacity;
+  }
+  if (length > 0)
+    memcpy(column->data + column->data_size, bytes, length);
+  column->data[needed - 1] = '\0';
+  column->offsets[row] = column->data_size;
+  column->data_size = needed;
+  column->offsets[row + 1] = needed;
+  return true;
+}
+
+/**
+ * @brief Rewrites the first `rows` cells of a column as text.
+ */
+static bool column_make_text(DbColumn *column, size_t rows, size_t capacity) {
+  DbColumn text = {.name = column->name,
+                   .type = DB_COLUMN_TEXT,
+                   .nulls = column->nulls};
+  text.offsets = malloc((capacity + 1) * sizeof(size_t));
+  if (!text.offsets)
+    return false;
+  text.offsets[0] = 0;
+  for (size_t row = 0; row < rows; row++) {
+    char buffer[32] = "";
+    if (cell_is_null(column, row))
+      ;
+    else if (column->type == DB_COLUMN_INT)
+      snprintf(buffer, sizeof(buffer), "%" PRId64, column->ints[row]);
+    else if (column->type == DB_COLUMN_DOUBLE)
+      format_double(buffer, sizeof(buffer), column->doubles[row]);
+    if (!column_append(&text, row, buffer, strlen(buffer))) {
+      free(text.offsets);
+      free(text.data);
+      return false;
+    }
+  }
+  free(column->ints ? (void *)column->ints : (void *)column->doubles);
+  *column = text;
+  return true;
+}
+
+/**
+ * @brief Stores one cell, settling or widening the column's type: integers
+ * widen to doubles, and numbers to text when text or a blob turns up.
+ */
+static bool column_store(DbResultSet *set, DbColumn *column,
+                         sqlite3_stmt *stmt, int index) {
+  size_t row = set->row_count;
+  int type = sqlite3_column_type(stmt, index);
+  if (type == SQLITE_NULL) {
+    column->nulls[row / 8] |= (uint8_t)(1u << (row % 8));
+    if (column->offsets)
+      return column_append(column, row, "", 0);
+    if (column->ints)
+      column->ints[row] = 0;
+    else if (column->doubles)
+      column->doubles[row] = 0;
+    return true;
+  }
+
+  bool textual = type == SQLITE_TEXT || type == SQLITE_BLOB;
+  if (column->type == DB_COLUMN_NULL && !textual) {
+    void *values = calloc(set->row_capacity, sizeof(int64_t));
+    if (!values)
+      return false;
+    if (type == SQLITE_INTEGER) {
+      column->ints = values;
+      column->type = DB_COLUMN_INT;
+    } else {
+      column->doubles = values;
+      column->type = DB_COLUMN_DOUBLE;
+    }
+  } else if (column->type == DB_COLUMN_INT && type == SQLITE_FLOAT) {
+    double *doubles = (double *)column->ints;
+    for (size_t i = 0; i < row; i++)
+      doubles[i] = (double)column->ints[i];
+    column->ints = NULL;
+    column->doubles = doubles;
+    column->type = DB_COLUMN_DOUBLE;
+  } else if (textual && column->type != DB_COLUMN_TEXT &&
+             column->type != DB_COLUMN_BLOB) {
+    bool blobs = column->type == DB_COLUMN_NULL && type == SQLITE_BLOB;
+    if (!column_make_text(column, row, set->row_capacity))
+      return false;
+    column->type = blobs ? DB_COLUMN_BLOB : DB_COLUMN_TEXT;
+  }
+
+  switch (column->type) {
+  case DB_COLUMN_INT:
+    column->ints[row] = sqlite3_column_int64(stmt, index);
+    return true;
+  case DB_COLUMN_DOUBLE:
+    column->doubles[row] = sqlite3_column_double(stmt, index);
+    return true;
+  default:
+    if (type != SQLITE_BLOB)
+      column->type = DB_COLUMN_TEXT;
+    const void *bytes = type == SQLITE_BLOB
+                            ? sqlite3_column_blob(stmt, index)
+                            : (const void *)sqlite3_column_text(stmt, index);
+    return column_append(column, row, bytes,
+                         (size_t)sqlite3_column_bytes(stmt, index));
+  }
+}
+
+Status db_result_set(DbStatement *statement, DbResultSet **out_set,
+                     char **error) {
+  *out_set = NULL;
+  sqlite3_stmt *stmt = statement->stmt;
+  int columns = sqlite3_column_count(stmt);
+  DbResultSet *set = calloc(1, sizeof(DbResultSet));
+  bool ready = set != NULL;
+  if (ready) {
+    set->columns = calloc(columns > 0 ? (size_t)columns : 1,
+                          sizeof(DbColumn));
+    ready = set->columns != NULL;
+  }
+  if (ready) {
+    set->column_count = columns;
+    for (int i = 0; i < columns && ready; i++)
+      ready = (set->columns[i].name =
+                   strdup(sqlite3_column_name(stmt, i))) != NULL;
+  }
+
+  DbStep step = DB_DONE;
+  while (ready && (step = db_step(statement, error)) == DB_ROW) {
+    if (set->row_count == set->row_capacity)
+      ready = result_set_grow(set);
+    for (int i = 0; i < columns && ready; i++)
+      ready = column_store(set, &set->columns[i], stmt, i);
+    if (ready)
+      set->row_count++;
+  }
+  if (!ready) {
+    db_result_set_free(set);
+    if (error)
+      *error = strdup("Memory allocation failed for result set.");
+    return ERROR_MEMORY;
+  }
+  if (step == DB_ERROR) {
+    db_result_set_free(set);
+    return ERROR_IO;
+  }
+  *out_set = set;
+  return OK;
+}
+
+void db_result_set_free(DbResultSet *set) {
+  if (!set)
+    return;
+  for (int i = 0; i < set->column_count; i++) {
+    DbColumn *column = &set->columns[i];
+    free(column->name);
+    free(column->ints ? (void *)column->ints : (void *)column->doubles);
+    free(column->offsets);
+    free(column->data);
+    free(column->nulls);
+  }
+  free(set->columns);
+  free(set);
+}
+
+bool db_result_set_is_null(const DbResultSet *set, int column, size_t row) {
+  return cell_is_null(&set->columns[column], row);
+}
+
+const char *db_result_set_text(const DbResultSet *set, int column, size_t row,
+                               size_t *length) {
+  const DbColumn *col = &set->columns[column];
+  if (!col->offsets) {
+    if (length)
+      *length = 0;
+    return NULL;
+  }
+  if (length)
+    *length = col->offsets[row + 1] - col->offsets[row] - 1;
+  return col->data + col->offsets[row];
+}
+
+Status db_result_set_json(const DbResultSet *set, StringBuilder *sb) {
+  int columns = set->column_count;
+  size_t slots = columns > 0 ? (size_t)columns : 1;
+  StringBuilder keys;
+  sb_init(&keys);
+  size_t *ends = malloc(sizeof(size_t) * slots);
+  const char **names = malloc(sizeof(char *) * slots);
+  bool ready = ends && names;
+  for (int i = 0; ready && i < columns; i++)
+    names[i] = set->columns[i].name;
+  ready = ready && encode_column_keys(names, columns, &keys, ends);
+  free(names);
+  if (!ready) {
+    free(ends);
+    sb_free(&keys);
+    return ERROR_MEMORY;
+  }
+
+  sb_append_char(sb, '[');
+  for (size_t row = 0; row < set->row_count; row++) {
+    sb_append_str(sb, row == 0 ? "{" : ",{");
+    size_t key_start = 0;
+    bool first_column = true;
+    for (int i = 0; i < columns; i++) {
+      const DbColumn *column = &set->columns[i];
+      size_t key_end = ends[i];
+      if (key_end == key_start)
+        continue;
+      if (!first_column)
+        sb_append_char(sb, ',');
+      first_column = false;
+      sb_append_bytes(sb, keys.buffer + key_start, key_end - key_start);
+      key_start = key_end;
+
+      if (cell_is_null(column, row)) {
+        sb_append_str(sb, "null");
+        continue;
+      }
+      switch (column->type) {
+      case DB_COLUMN_INT:
+        append_json_int(sb, column->ints[row]);
+        break;
+      case DB_COLUMN_DOUBLE:
+        append_json_double(sb, column->doubles[row]);
+        break;
+      case DB_COLUMN_TEXT:
+        json_encode_string(column->data + column->offsets[row], sb);
+        break;
+      default:
+        sb_append_str(sb, "null");
+        break;
       }
-      row->as.object->set(row->as.object, col_name, col_value);
     }
-    results->as.array->push(results->as.array, row);
+    sb_append_char(sb, '}');
   }
+  sb_append_char(sb, ']');
+  free(ends);
+  sb_free(&keys);
+  return sb->buffer ? OK : ERROR_MEMORY;
+}
 
-  if (rc != SQLITE_DONE) {
-    Value *err_val = string_value(sqlite3_errmsg(db));
-    value_free(results);
-    results = err_val;
+struct DbCursor {
+  DbStatement *statement;
+  Value *row;       // Built on the first row and updated in place after.
+  Value **cells;    // The value in `row` each column is written to, or NULL
+  size_t *capacity; // when a later column of the same name wins; and the
+  int columns;      // bytes allocated for it while it holds text.
+};
+
+DbCursor *db_cursor(DbStatement *statement) {
+  if (!statement)
+    return NULL;
+  DbCursor *cursor = calloc(1, sizeof(DbCursor));
+  if (!cursor) {
+    db_finish(statement);
+    return NULL;
   }
+  cursor->statement = statement;
+  return cursor;
+}
 
-  sqlite3_finalize(stmt);
-  return results;
+void db_cursor_free(DbCursor *cursor) {
+  if (!cursor)
+    return;
+  db_finish(cursor->statement);
+  Arena *previous = arena_enter(NULL);
+  value_free(cursor->row);
+  arena_leave(previous);
+  free(cursor->cells);
+  free(cursor->capacity);
+  free(cursor);
+}
+
+/**
+ * @brief Creates the row object and one cell per distinct column name.
+ */
+static bool cursor_build_row(DbCursor *cursor) {
+  sqlite3_stmt *stmt = cursor->statement->stmt;
+  int columns = sqlite3_column_count(stmt);
+  cursor->row = object_value();
+  cursor->cells = calloc(columns > 0 ? (size_t)columns : 1, sizeof(Value *));
+  cursor->capacity =
+      calloc(columns > 0 ? (size_t)columns : 1, sizeof(size_t));
+  if (!cursor->row || !cursor->cells || !cursor->capacity)
+    return false;
+  cursor->columns = columns;
+  Object *object = cursor->row->as.object;
+  for (int i = 0; i < columns; i++) {
+    const char *name = sqlite3_column_name(stmt, i);
+    Value *cell = object->get(object, name);
+    if (cell) {
+      // Like `db_row`, the last column of a repeated name wins.
+      for (int j = 0; j < i; j++)
+        if (cursor->cells[j] == cell)
+          cursor->cells[j] = NULL;
+    } else {
+      cell = null();
+      if (!cell || object->set(object, name, cell) != OK)
+        return false;
+    }
+    cursor->cells[i] = cell;
+  }
+  return true;
+}
+
+/**
+ * @brief Overwrites a cell with a column of the current row, reusing its
+ * text buffer when the new text fits.
+ */
+static void cursor_set_cell(DbCursor *cursor, int column) {
+  sqlite3_stmt *stmt = cursor->statement->stmt;
+  Value *cell = cursor->cells[column];
+  int type = sqlite3_column_type(stmt, column);
+  if (type == SQLITE_TEXT) {
+    const char *text = (const char *)sqlite3_column_text(stmt, column);
+    size_t length = (size_t)sqlite3_column_bytes(stmt, column);
+    if (cell->type != VALUE_STRING) {
+      cell->as.string = ALLOCATE_FOR(cell, String, 1);
+      cell->as.string->chars = NULL;
+      cell->type = VALUE_STRING;
+      cursor->capacity[column] = 0;
+    }
+    String *string = cell->as.string;
+    if (length + 1 > cursor->capacity[column]) {
+      string->chars = GROW_ARRAY_FOR(cell, char, string->chars,
+                                     cursor->capacity[column], length + 1);
+      cursor->capacity[column] = length + 1;
+    }
+    memcpy(string->chars, text, length);
+    string->chars[length] = '\0';
+    string->length = length;
+    return;
+  }
+
+  if (cell->type == VALUE_STRING) {
+    FREE_ARRAY(char, cell->as.string->chars, cursor->capacity[column]);
+    FREE(String, cell->as.string);
+    cursor->capacity[column] = 0;
+  }
+  switch (type) {
+  case SQLITE_INTEGER:
+    cell->type = VALUE_NUMBER;
+    cell->as.number = (double)sqlite3_column_int64(stmt, column);
+    break;
+  case SQLITE_FLOAT:
+    cell->type = VALUE_NUMBER;
+    cell->as.number = sqlite3_column_double(stmt, column);
+    break;
+  default:
+    cell->type = VALUE_NULL;
+    break;
+  }
+}
+
+DbStep db_cursor_next(DbCursor *cursor, const Value **out_row, char **error) {
+  *out_row = NULL;
+  DbStep step = db_step(cursor->statement, error);
+  if (step != DB_ROW)
+    return step;
+
+  // The row is reused for every step, so it must not grow the request's
+  // arena with the size of the result.
+  Arena *previous = arena_enter(NULL);
+  bool ready = cursor->row || cursor_build_row(cursor);
+  if (ready) {
+    for (int i = 0; i < cursor->columns; i++)
+      if (cursor->cells[i])
+        cursor_set_cell(cursor, i);
+  }
+  arena_leave(previous);
+  if (!ready) {
+    if (error)
+      *error = strdup("Memory allocation failed for row object.");
+    return DB_ERROR;
+  }
+  *out_row = cursor->row;
+  return DB_ROW;
+}
+
+DbPool *db_pool(const char *filename, const DbPoolOptions *options) {
+  DbPool *pool = calloc(1, sizeof(DbPool));
+  if (!pool)
+    return NULL;
+  pool->max = options && options->max_connections > 0
+                  ? options->max_connections
+                  : DB_POOL_DEFAULT_CONNECTIONS;
+  pool->busy_timeout_ms = options && options->busy_timeout_ms > 0
+                              ? options->busy_timeout_ms
+                              : DB_POOL_DEFAULT_BUSY_TIMEOUT_MS;
+  pool->filename = strdup(filename);
+  pool->init_sql =
+      options && options->init_sql ? strdup(options->init_sql) : NULL;
+  pool->single_writer = options && options->single_writer;
+  pool->idle = calloc((size_t)pool->max, sizeof(Value *));
+  if (!pool->filename || !pool->idle ||
+      (options && options->init_sql && !pool->init_sql)) {
+    free(pool->filename);
+    free(pool->init_sql);
+    free(pool->idle);
+    free(pool);
+    return NULL;
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->available, NULL);
+  return pool;
+}
+
+static void close_handle(Value *handle) {
+  DbConnection *conn = connection_of(handle);
+  if (conn) {
+    connection_close(conn);
+    free(conn);
+  }
+  value_free(handle);
+}
+
+static void writer_stop(DbWriter *writer);
+
+void db_pool_free(DbPool *pool) {
+  if (!pool)
+    return;
+  writer_stop(pool->writer);
+  for (int i = 0; i < pool->idle_count; i++)
+    close_handle(pool->idle[i]);
+  pthread_cond_destroy(&pool->available);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->filename);
+  free(pool->init_sql);
+  free(pool->idle);
+  free(pool);
+}
+
+/**
+ * @brief Opens and configures a new connection. The pool's lock is held, so
+ * the schema runs exactly once even when several connections open at once.
+ */
+static sqlite3 *open_connection(DbPool *pool, char **error) {
+  sqlite3 *db = NULL;
+  if (sqlite3_open(pool->filename, &db) != SQLITE_OK) {
+    if (error)
+      asprintf(error, "Failed to open database %s: %s", pool->filename,
+               db ? sqlite3_errmsg(db) : "out of memory");
+    sqlite3_close(db);
+    return NULL;
+  }
+  sqlite3_busy_timeout(db, pool->busy_timeout_ms);
+  // Readers in WAL mode neither block the writer nor wait for it.
+  if (pool->single_writer)
+    sqlite3_exec(db, "PRAGMA journal_mode=WAL;", NULL, NULL, NULL);
+  if (!pool->initialized && pool->init_sql) {
+    char *message = NULL;
+    if (sqlite3_exec(db, pool->init_sql, NULL, NULL, &message) != SQLITE_OK) {
+      if (error)
+        asprintf(error, "Failed to initialize database %s: %s",
+                 pool->filename, message ? message : sqlite3_errmsg(db));
+      sqlite3_free(message);
+      sqlite3_close(db);
+      return NULL;
+    }
+  }
+  pool->initialized = true;
+  return db;
+}
+
+Value *db_pool_acquire(DbPool *pool, char **error) {
+  pthread_mutex_lock(&pool->lock);
+  while (pool->idle_count == 0 && pool->open_count >= pool->max)
+    pthread_cond_wait(&pool->available, &pool->lock);
+  if (pool->idle_count > 0) {
+    Value *handle = pool->idle[--pool->idle_count];
+    pthread_mutex_unlock(&pool->lock);
+    return handle;
+  }
+
+  sqlite3 *db = open_connection(pool, error);
+  Value *handle = NULL;
+  if (db) {
+    handle = connection_handle(db);
+    if (!handle) {
+      sqlite3_close(db);
+      if (error)
+        *error = strdup("Memory allocation failed for database handle.");
+    }
+  }
+  if (handle) {
+    connection_of(handle)->pool = pool;
+    pool->open_count++;
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return handle;
+}
+
+void db_pool_release(DbPool *pool, Value *db_handle_val) {
+  if (!pool || !db_handle_val)
+    return;
+  DbConnection *conn = connection_of(db_handle_val);
+  if (conn && !sqlite3_get_autocommit(conn->db))
+    sqlite3_exec(conn->db, "ROLLBACK", NULL, NULL, NULL);
+
+  pthread_mutex_lock(&pool->lock);
+  if (conn) {
+    pool->idle[pool->idle_count++] = db_handle_val;
+  } else {
+    // Closed by its user; the slot can be reopened.
+    value_free(db_handle_val);
+    pool->open_count--;
+  }
+  pthread_cond_signal(&pool->available);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief Prepares, binds and runs one write on `handle`.
+ */
+static Status run_write(Value *handle, const char *sql, const Value *params,
+                        char **error) {
+  DbStatement *statement = NULL;
+  Status status = db_prepare(handle, sql, &statement, error);
+  if (status != OK)
+    return status;
+  size_t count =
+      params && params->type == VALUE_ARRAY ? params->as.array->count : 0;
+  for (size_t i = 0; i < count && status == OK; i++) {
+    status = db_bind_value(statement, (int)i + 1,
+                           params->as.array->elements[i]);
+    if (status != OK && error)
+      asprintf(error, "Cannot bind parameter %zu", i + 1);
+  }
+  if (status == OK) {
+    DbStep step;
+    while ((step = db_step(statement, error)) == DB_ROW)
+      ;
+    if (step == DB_ERROR)
+      status = ERROR_IO;
+  }
+  db_finish(statement);
+  return status;
+}
+
+/**
+ * @brief Fails the writes of a batch from `from` up to `to` that had
+ * succeeded, when the transaction that held them is lost.
+ */
+static void fail_writes(DbWrite *from, DbWrite *to, const char *message) {
+  for (DbWrite *write = from; write != to; write = write->next) {
+    if (write->status != OK)
+      continue;
+    write->status = ERROR_IO;
+    write->error = strdup(message);
+  }
+}
+
+/**
+ * @brief Runs a batch in one transaction. Each write gets a savepoint, so
+ * one that fails is rolled back alone and the rest still commit together.
+ */
+static void commit_batch(DbWriter *writer, DbWrite *batch) {
+  sqlite3 *db = connection_of(writer->handle)->db;
+  DbWrite *begun = batch; // The first write of the open transaction.
+  bool open = sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, NULL, NULL) ==
+              SQLITE_OK;
+  for (DbWrite *write = batch; write; write = write->next) {
+    if (open)
+      sqlite3_exec(db, "SAVEPOINT db_write;", NULL, NULL, NULL);
+    write->status = run_write(writer->handle, write->sql, write->params,
+                              &write->error);
+    if (!open)
+      continue;
+    if (write->status == OK) {
+      sqlite3_exec(db, "RELEASE db_write;", NULL, NULL, NULL);
+    } else if (!sqlite3_get_autocommit(db)) {
+      sqlite3_exec(db, "ROLLBACK TO db_write; RELEASE db_write;", NULL, NULL,
+                   NULL);
+    } else {
+      // Some errors roll back the whole transaction, and with it the writes
+      // before this one; the rest of the batch starts another.
+      fail_writes(begun, write, "Transaction rolled back");
+      begun = write->next;
+      open = sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, NULL, NULL) ==
+             SQLITE_OK;
+    }
+  }
+  if (open && sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL) != SQLITE_OK) {
+    fail_writes(begun, NULL, sqlite3_errmsg(db));
+    sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+  }
+}
+
+static void write_free(DbWrite *write) {
+  free(write->sql);
+  value_free(write->params);
+  free(write->error);
+  free(write);
+}
+
+static void *writer_main(void *arg) {
+  DbWriter *writer = arg;
+  pthread_mutex_lock(&writer->lock);
+  for (;;) {
+    while (!writer->head && !writer->stopping)
+      pthread_cond_wait(&writer->pending, &writer->lock);
+    if (!writer->head)
+      break;
+
+    // Everything queued while the last batch ran commits together.
+    DbWrite *batch = writer->head;
+    DbWrite *last = batch;
+    for (int count = 1; last->next && count < DB_WRITER_MAX_BATCH; count++)
+      last = last->next;
+    writer->head = last->next;
+    if (!writer->head)
+      writer->tail = NULL;
+    last->next = NULL;
+    pthread_mutex_unlock(&writer->lock);
+
+    commit_batch(writer, batch);
+
+    // A waiter may return as soon as its write is done, so each `next` is
+    // read first.
+    DbWrite *write = batch;
+    while (write) {
+      DbWrite *next = write->next;
+      if (write->owned) {
+        if (write->callback)
+          write->callback(write->status, write->error, write->user_data);
+        write_free(write);
+      } else {
+        pthread_mutex_lock(&writer->lock);
+        write->done = true;
+        pthread_mutex_unlock(&writer->lock);
+      }
+      write = next;
+    }
+    pthread_mutex_lock(&writer->lock);
+    pthread_cond_broadcast(&writer->completed);
+  }
+  pthread_mutex_unlock(&writer->lock);
+  return NULL;
+}
+
+/**
+ * @brief Opens the write connection and starts its thread. The pool's lock
+ * is held.
+ */
+static DbWriter *writer_start(DbPool *pool, char **error) {
+  DbWriter *writer = calloc(1, sizeof(DbWriter));
+  if (!writer) {
+    if (error)
+      *error = strdup("Memory allocation failed for database writer.");
+    return NULL;
+  }
+  sqlite3 *db = open_connection(pool, error);
+  if (!db) {
+    free(writer);
+    return NULL;
+  }
+  writer->handle = connection_handle(db);
+  if (!writer->handle) {
+    sqlite3_close(db);
+    free(writer);
+    if (error)
+      *error = strdup("Memory allocation failed for database handle.");
+    return NULL;
+  }
+  pthread_mutex_init(&writer->lock, NULL);
+  pthread_cond_init(&writer->pending, NULL);
+  pthread_cond_init(&writer->completed, NULL);
+  if (pthread_create(&writer->thread, NULL, writer_main, writer) != 0) {
+    if (error)
+      *error = strdup("Failed to start database writer thread.");
+    pthread_cond_destroy(&writer->completed);
+    pthread_cond_destroy(&writer->pending);
+    pthread_mutex_destroy(&writer->lock);
+    close_handle(writer->handle);
+    free(writer);
+    return NULL;
+  }
+  return writer;
+}
+
+/**
+ * @brief Commits whatever is still queued, then stops the thread and closes
+ * its connection.
+ */
+static void writer_stop(DbWriter *writer) {
+  if (!writer)
+    return;
+  pthread_mutex_lock(&writer->lock);
+  writer->stopping = true;
+  pthread_cond_signal(&writer->pending);
+  pthread_mutex_unlock(&writer->lock);
+  pthread_join(writer->thread, NULL);
+  pthread_cond_destroy(&writer->completed);
+  pthread_cond_destroy(&writer->pending);
+  pthread_mutex_destroy(&writer->lock);
+  close_handle(writer->handle);
+  free(writer);
+}
+
+static void writer_enqueue(DbWriter *writer, DbWrite *write) {
+  pthread_mutex_lock(&writer->lock);
+  if (writer->tail)
+    writer->tail->next = write;
+  else
+    writer->head = write;
+  writer->tail = write;
+  pthread_cond_signal(&writer->pending);
+  pthread_mutex_unlock(&writer->lock);
+}
+
+/**
+ * @brief Finds the writer a handle's writes go through, starting it on
+ * first use.
+ * @param[out] out_writer Set to the writer, or NULL if the handle writes on
+ * its own connection.
+ */
+static Status writer_of(Value *db_handle_val, const char *sql,
+                        DbWriter **out_writer, char **error) {
+  *out_writer = NULL;
+  DbConnection *conn = connection_of(db_handle_val);
+  if (!conn || !sql) {
+    if (error)
+      *error = strdup("Invalid database handle");
+    return ERROR_INVALID_ARG;
+  }
+  DbPool *pool = conn->pool;
+  if (!pool || !pool->single_writer)
+    return OK;
+  pthread_mutex_lock(&pool->lock);
+  if (!pool->writer)
+    pool->writer = writer_start(pool, error);
+  *out_writer = pool->writer;
+  pthread_mutex_unlock(&pool->lock);
+  return *out_writer ? OK : ERROR_IO;
+}
+
+Status db_write(Value *db_handle_val, const char *sql, const Value *params,
+                char **error) {
+  DbWriter *writer = NULL;
+  Status status = writer_of(db_handle_val, sql, &writer, error);
+  if (status != OK)
+    return status;
+  if (!writer)
+    return run_write(db_handle_val, sql, params, error);
+
+  // The caller blocks until the write is done, so it can be queued as is.
+  DbWrite write = {.sql = (char *)sql, .params = (Value *)params};
+  writer_enqueue(writer, &write);
+  pthread_mutex_lock(&writer->lock);
+  while (!write.done)
+    pthread_cond_wait(&writer->completed, &writer->lock);
+  pthread_mutex_unlock(&writer->lock);
+  if (error)
+    *error = write.error;
+  else
+    free(write.error);
+  return write.status;
+}
+
+void db_write_async(Value *db_handle_val, const char *sql,
+                    const Value *params, DbWriteCallback callback,
+                    void *user_data) {
+  char *error = NULL;
+  DbWriter *writer = NULL;
+  Status status = writer_of(db_handle_val, sql, &writer, &error);
+  DbWrite *write = NULL;
+  if (writer) {
+    // The write outlives the caller's request, and its arena.
+    Arena *previous = arena_enter(NULL);
+    write = calloc(1, sizeof(DbWrite));
+    if (write) {
+      write->owned = true;
+      write->callback = callback;
+      write->user_data = user_data;
+      write->sql = strdup(sql);
+      write->params = params ? value_clone(params) : NULL;
+    }
+    arena_leave(previous);
+    if (write && write->sql && (!params || write->params)) {
+      writer_enqueue(writer, write);
+      return;
+    }
+    status = ERROR_MEMORY;
+    error = strdup("Memory allocation failed for database write.");
+  } else if (status == OK) {
+    status = run_write(db_handle_val, sql, params, &error);
+  }
+  if (write)
+    write_free(write);
+  if (callback)
+    callback(status, error, user_data);
+  free(error);
 }
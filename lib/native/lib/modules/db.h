@@ -4,12 +4,141 @@
  *
  * This module provides a simplified wrapper around the sqlite3 library,
  * using the framework's `Value` system for data exchange.
+ *
+ * A `DbPool` keeps connections to one database file open across requests.
+ * Connections are opened on demand up to a limit, each configured once when
+ * it is opened, and the pool's schema SQL runs once, on the first.
+ * Checking out a connection when all of them are in use waits for one to be
+ * returned.
+ *
+ * Every connection keeps its most recently used prepared statements, keyed
+ * by SQL text, so running a hot query again skips parsing and planning.
+ * Values are passed with `db_bind_*` rather than formatted into the SQL:
+ * @code
+ *   DbStatement *stmt;
+ *   if (db_prepare(db, "SELECT name FROM users WHERE id = ?", &stmt,
+ *                  &error) == OK) {
+ *     db_bind_int(stmt, 1, id);
+ *     while (db_step(stmt, &error) == DB_ROW)
+ *       puts(db_column_text(stmt, 0));
+ *     db_finish(stmt);
+ *   }
+ * @endcode
+ *
+ * A pool made with `single_writer` also owns one write connection, run by a
+ * thread of its own. `db_write` on the pool's handles queues the statement
+ * for that thread, which commits everything queued while its last batch
+ * ran in a single transaction, so concurrent writers neither contend for
+ * SQLite's lock nor pay for a sync each. The pool's connections run in WAL
+ * mode, so reads carry on while a batch commits.
  */
 
 #ifndef DB_H
 #define DB_H
 
+#include "../core/error.h"
+#include "../core/string_builder.h"
 #include "../core/value.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief The prepared statements each connection keeps.
+ */
+#define DB_STATEMENT_CACHE_SIZE 32
+
+/**
+ * @brief The connections a pool opens when no limit is given.
+ */
+#define DB_POOL_DEFAULT_CONNECTIONS 8
+
+/**
+ * @brief How long a pooled connection retries a locked database before
+ * failing, when no timeout is given.
+ */
+#define DB_POOL_DEFAULT_BUSY_TIMEOUT_MS 5000
+
+/**
+ * @brief The most writes a pool's writer commits in one transaction.
+ */
+#define DB_WRITER_MAX_BATCH 64
+
+/**
+ * @struct DbPoolOptions
+ * @brief How a pool opens its connections. Zeroed fields take the defaults.
+ */
+typedef struct {
+  int max_connections;
+  int busy_timeout_ms;
+  const char *init_sql; ///< Schema SQL run once, on the first connection.
+  bool single_writer;   ///< Send `db_write` through one writer thread.
+} DbPoolOptions;
+
+/**
+ * @brief How a `DbColumn` stores its cells.
+ */
+typedef enum {
+  DB_COLUMN_NULL,   ///< Every cell is NULL, and nothing is stored.
+  DB_COLUMN_INT,    ///< In `ints`.
+  DB_COLUMN_DOUBLE, ///< In `doubles`.
+  DB_COLUMN_TEXT,   ///< In `data`, at `offsets`.
+  DB_COLUMN_BLOB    ///< As text, for a column that holds only blobs.
+} DbColumnType;
+
+/**
+ * @struct DbColumn
+ * @brief One column of a `DbResultSet`.
+ *
+ * Row `i` is NULL when bit `i % 8` of `nulls[i / 8]` is set. Its cell is
+ * then 0, or empty text. Text and blob cells lie end to end in `data`, each
+ * followed by a NUL byte: row `i` starts at `offsets[i]`, and its length is
+ * `offsets[i + 1] - offsets[i] - 1`.
+ */
+typedef struct {
+  char *name;
+  DbColumnType type;
+  int64_t *ints;
+  double *doubles;
+  size_t *offsets;
+  char *data;
+  size_t data_size;
+  size_t data_capacity;
+  uint8_t *nulls;
+} DbColumn;
+
+/**
+ * @struct DbResultSet
+ * @brief A query result stored by column, each in a few typed arrays
+ * rather than a `Value` per cell.
+ */
+typedef struct {
+  DbColumn *columns;
+  int column_count;
+  size_t row_count;
+  size_t row_capacity;
+} DbResultSet;
+
+typedef struct DbPool DbPool;
+typedef struct DbStatement DbStatement;
+typedef struct DbCursor DbCursor;
+
+/**
+ * @brief The outcome of `db_step`.
+ */
+typedef enum {
+  DB_ROW,  ///< A row is ready to be read with `db_column_*`.
+  DB_DONE, ///< The statement has finished.
+  DB_ERROR ///< The statement failed.
+} DbStep;
+
+/**
+ * @brief Called once a write queued with `db_write_async` has finished.
+ * @param status OK if the write was committed.
+ * @param error The error message on failure, valid only during the call.
+ * @param user_data The pointer given to `db_write_async`.
+ */
+typedef void (*DbWriteCallback)(Status status, const char *error,
+                                void *user_data);
 
 /**
  * @brief Opens a connection to an SQLite database file.
@@ -29,6 +158,99 @@ Value *db_open(const char *filename);
  */
 Value *db_close(Value *db_handle_val);
 
+/**
+ * @brief Returns the path of a handle's database file.
+ * @return The absolute path, an empty string for an in-memory or temporary
+ * database, or NULL for an invalid handle.
+ */
+const char *db_filename(Value *db_handle_val);
+
+/**
+ * @brief Prepares a statement, reusing the connection's cached copy of the
+ * same SQL when it is not already in use.
+ * @param db_handle_val A `Value` containing the database handle.
+ * @param sql A single SQL statement, with `?` or `?N` for parameters.
+ * @param[out] out_statement Set to the statement, to pass to `db_finish`.
+ * @param[out] error Set to a new error message on failure.
+ * @return OK, ERROR_INVALID_ARG for a bad handle or bad SQL, or
+ * ERROR_MEMORY.
+ */
+Status db_prepare(Value *db_handle_val, const char *sql,
+                  DbStatement **out_statement, char **error);
+
+/**
+ * @brief Resets a statement and clears its parameters, returning it to its
+ * connection's cache.
+ */
+void db_finish(DbStatement *statement);
+
+/**
+ * @brief Binds a parameter. Indexes start at 1; text is copied.
+ * @return OK, ERROR_INVALID_ARG for an index out of range, or ERROR_MEMORY.
+ */
+Status db_bind_int(DbStatement *statement, int index, int64_t value);
+Status db_bind_double(DbStatement *statement, int index, double value);
+Status db_bind_text(DbStatement *statement, int index, const char *text);
+Status db_bind_null(DbStatement *statement, int index);
+
+/**
+ * @brief Binds a `Value`: integral numbers as integers, booleans as 0 or 1,
+ * strings as text, and null or undefined as NULL.
+ * @return As the other binds, or ERROR_INVALID_ARG for other types.
+ */
+Status db_bind_value(DbStatement *statement, int index, const Value *value);
+
+/**
+ * @brief Advances a statement to its next row.
+ * @param[out] error Set to a new error message when DB_ERROR is returned.
+ */
+DbStep db_step(DbStatement *statement, char **error);
+
+/**
+ * @brief Reads the current row. Text stays valid until the next step.
+ */
+int db_column_count(DbStatement *statement);
+const char *db_column_name(DbStatement *statement, int column);
+bool db_column_is_null(DbStatement *statement, int column);
+int64_t db_column_int(DbStatement *statement, int column);
+double db_column_double(DbStatement *statement, int column);
+const char *db_column_text(DbStatement *statement, int column);
+
+/**
+ * @brief Builds an object `Value` from the current row, keyed by column
+ * name.
+ * @return The row, or NULL on allocation failure.
+ */
+Value *db_row(DbStatement *statement);
+
+/**
+ * @brief Wraps a prepared, bound statement to read its rows one at a time.
+ *
+ * Unlike `db_query`, a cursor holds one row however large the result is:
+ * the same object `Value` is updated in place by each `db_cursor_next`,
+ * reusing its text buffers, so a handler can stream a table into a chunked
+ * response in constant memory.
+ * @param statement The statement; the cursor finishes it when freed.
+ * @return A new cursor, or NULL on allocation failure, in which case the
+ * statement has been finished.
+ */
+DbCursor *db_cursor(DbStatement *statement);
+
+/**
+ * @brief Advances to the next row.
+ * @param cursor The cursor.
+ * @param[out] out_row Set to the row on DB_ROW: an object `Value` keyed by
+ * column name that belongs to the cursor and is overwritten by the next
+ * call. Clone it to keep it.
+ * @param[out] error Set to a new error message when DB_ERROR is returned.
+ */
+DbStep db_cursor_next(DbCursor *cursor, const Value **out_row, char **error);
+
+/**
+ * @brief Frees the cursor and finishes its statement.
+ */
+void db_cursor_free(DbCursor *cursor);
+
 /**
  * @brief Executes one or more SQL statements that do not return data.
  * @param db_handle_val A `Value` containing the database handle.
@@ -47,4 +269,124 @@ Value *db_exec(Value *db_handle_val, const char *sql);
  */
 Value *db_query(Value *db_handle_val, const char *sql);
 
+/**
+ * @brief Runs a prepared, bound statement to completion, appending its rows
+ * to `sb` as a JSON array of objects keyed by column name.
+ *
+ * The rows have the shape `db_query` returns, but are written straight from
+ * the statement: column names are escaped once, and no `Value` is built for
+ * any row or cell. Integers are written exactly, and blobs, like NULLs, as
+ * `null`.
+ * @param statement The statement; the caller still finishes it.
+ * @param sb The builder to append to.
+ * @param[out] error Set to a new error message on failure.
+ * @return OK, ERROR_IO if a step fails, in which case nothing is appended,
+ * or ERROR_MEMORY.
+ */
+Status db_query_json(DbStatement *statement, StringBuilder *sb, char **error);
+
+/**
+ * @brief Runs a prepared, bound statement to completion, storing its rows
+ * by column.
+ *
+ * A column's type is settled by the values it holds: integers are kept as
+ * 64-bit integers until a real turns up and they widen to doubles, and
+ * numbers become text once text or a blob turns up, so no cell loses
+ * precision to the column beside it.
+ * @param statement The statement; the caller still finishes it.
+ * @param[out] out_set Set to the result, to pass to `db_result_set_free`.
+ * @param[out] error Set to a new error message on failure.
+ * @return OK, ERROR_IO if a step fails, or ERROR_MEMORY.
+ */
+Status db_result_set(DbStatement *statement, DbResultSet **out_set,
+                     char **error);
+
+/**
+ * @brief Frees a result set.
+ */
+void db_result_set_free(DbResultSet *set);
+
+/**
+ * @brief Tells whether the cell at `row` of `column` is NULL.
+ */
+bool db_result_set_is_null(const DbResultSet *set, int column, size_t row);
+
+/**
+ * @brief Returns a text or blob cell, which is followed by a NUL byte.
+ * @param[out] length Set to the cell's length in bytes, if not NULL.
+ * @return The cell, or NULL if the column is not text or blob.
+ */
+const char *db_result_set_text(const DbResultSet *set, int column, size_t row,
+                               size_t *length);
+
+/**
+ * @brief Appends a result set to `sb` as a JSON array of row objects, in
+ * the shape `db_query_json` writes. Blob columns are written as `null`.
+ * @return OK, or ERROR_MEMORY.
+ */
+Status db_result_set_json(const DbResultSet *set, StringBuilder *sb);
+
+/**
+ * @brief Creates a pool for a database file. No connection is opened until
+ * the first checkout.
+ * @param filename The path to the database file.
+ * @param options How connections are opened, or NULL for the defaults.
+ * @return A new `DbPool`, or NULL on allocation failure.
+ */
+DbPool *db_pool(const char *filename, const DbPoolOptions *options);
+
+/**
+ * @brief Closes the pool's connections and frees it. Every connection must
+ * have been returned.
+ */
+void db_pool_free(DbPool *pool);
+
+/**
+ * @brief Checks out a connection, opening one if none is idle and the pool
+ * is below its limit, or waiting for one otherwise.
+ * @param pool The pool.
+ * @param[out] error Set to a new error message on failure.
+ * @return A handle like those from `db_open`, owned by the pool and valid
+ * until passed to `db_pool_release`, or NULL on failure. It must not be
+ * closed.
+ */
+Value *db_pool_acquire(DbPool *pool, char **error);
+
+/**
+ * @brief Returns a connection to the pool, rolling back any transaction the
+ * caller left open.
+ */
+void db_pool_release(DbPool *pool, Value *db_handle_val);
+
+/**
+ * @brief Runs one statement that changes data and waits until it is
+ * committed.
+ *
+ * On a handle from a `single_writer` pool, the statement is committed by
+ * the pool's writer with whatever else is queued, outside any transaction
+ * the caller has open on the handle; it fails alone if it fails. On any
+ * other handle it runs on the handle's own connection.
+ * @param db_handle_val A `Value` containing the database handle.
+ * @param sql A single SQL statement, with `?` or `?N` for parameters.
+ * @param params An array `Value` bound to the parameters in order, as by
+ * `db_bind_value`, or NULL.
+ * @param[out] error Set to a new error message on failure.
+ * @return OK, ERROR_INVALID_ARG for a bad handle, SQL or parameter, or
+ * ERROR_IO if the statement or its commit failed.
+ */
+Status db_write(Value *db_handle_val, const char *sql, const Value *params,
+                char **error);
+
+/**
+ * @brief Queues a statement like `db_write` without waiting for it.
+ *
+ * The SQL and parameters are copied. `callback`, which may be NULL, is
+ * called exactly once: on the writer thread after the batch holding the
+ * write commits, or before this returns if the handle has no writer or the
+ * write cannot be queued. It must not wait on the same pool's writer.
+ */
+void db_write_async(Value *db_handle_val, const char *sql,
+                    const Value *params, DbWriteCallback callback,
+                    void *user_data);
+
 #endif // DB_H
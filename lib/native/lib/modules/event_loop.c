@@ -0,0 +1,252 @@
+#include "event_loop.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+#ifdef __linux__
+
+struct EventLoop {
+  int epoll_fd;
+  struct epoll_event *ready;
+  int ready_capacity;
+};
+
+EventLoop *event_loop(void) {
+  EventLoop *loop = calloc(1, sizeof(EventLoop));
+  if (!loop)
+    return NULL;
+  loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (loop->epoll_fd < 0) {
+    perror("epoll_create1");
+    free(loop);
+    return NULL;
+  }
+  return loop;
+}
+
+void event_loop_free(EventLoop *loop) {
+  if (!loop)
+    return;
+  close(loop->epoll_fd);
+  free(loop->ready);
+  free(loop);
+}
+
+const char *event_loop_backend(const EventLoop *loop) {
+  (void)loop;
+  return "epoll";
+}
+
+Status event_loop_add(EventLoop *loop, int fd, int events, void *data) {
+  (void)events;
+  struct epoll_event ev = {0};
+  ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  ev.data.ptr = data;
+  if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    perror("epoll_ctl(ADD)");
+    return ERROR_IO;
+  }
+  return OK;
+}
+
+Status event_loop_modify(EventLoop *loop, int fd, int events, void *data) {
+  (void)loop;
+  (void)fd;
+  (void)events;
+  (void)data;
+  return OK;
+}
+
+Status event_loop_remove(EventLoop *loop, int fd) {
+  if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL) < 0)
+    return ERROR_IO;
+  return OK;
+}
+
+int event_loop_wait(EventLoop *loop, LoopEvent *events, int max_events,
+                    int timeout_ms) {
+  if (loop->ready_capacity < max_events) {
+    struct epoll_event *ready =
+        realloc(loop->ready, sizeof(struct epoll_event) * max_events);
+    if (!ready)
+      return -1;
+    loop->ready = ready;
+    loop->ready_capacity = max_events;
+  }
+
+  int count = epoll_wait(loop->epoll_fd, loop->ready, max_events, timeout_ms);
+  if (count < 0) {
+    if (errno == EINTR)
+      return 0;
+    perror("epoll_wait");
+    return -1;
+  }
+
+  for (int i = 0; i < count; i++) {
+    uint32_t flags = loop->ready[i].events;
+    events[i].data = loop->ready[i].data.ptr;
+    events[i].events = 0;
+    if (flags & EPOLLIN)
+      events[i].events |= EVENT_READABLE;
+    if (flags & EPOLLOUT)
+      events[i].events |= EVENT_WRITABLE;
+    if (flags & (EPOLLHUP | EPOLLERR | EPOLLRDHUP))
+      events[i].events |= EVENT_HANGUP | EVENT_READABLE;
+  }
+  return count;
+}
+
+#else
+
+struct EventLoop {
+  struct pollfd *fds;
+  void **data;
+  size_t count;
+  size_t capacity;
+  int *slot_of_fd;
+  size_t slot_capacity;
+};
+
+EventLoop *event_loop(void) {
+  EventLoop *loop = calloc(1, sizeof(EventLoop));
+  if (!loop)
+    return NULL;
+  loop->capacity = 16;
+  loop->fds = calloc(loop->capacity, sizeof(struct pollfd));
+  loop->data = calloc(loop->capacity, sizeof(void *));
+  if (!loop->fds || !loop->data) {
+    free(loop->fds);
+    free(loop->data);
+    free(loop);
+    return NULL;
+  }
+  return loop;
+}
+
+void event_loop_free(EventLoop *loop) {
+  if (!loop)
+    return;
+  free(loop->fds);
+  free(loop->data);
+  free(loop->slot_of_fd);
+  free(loop);
+}
+
+const char *event_loop_backend(const EventLoop *loop) {
+  (void)loop;
+  return "poll";
+}
+
+static short poll_events_for(int events) {
+  short mask = 0;
+  if (events & EVENT_READABLE)
+    mask |= POLLIN;
+  if (events & EVENT_WRITABLE)
+    mask |= POLLOUT;
+  return mask;
+}
+
+static int *slot_for_fd(EventLoop *loop, int fd) {
+  if ((size_t)fd >= loop->slot_capacity) {
+    size_t new_capacity = loop->slot_capacity ? loop->slot_capacity : 64;
+    while (new_capacity <= (size_t)fd)
+      new_capacity *= 2;
+    int *slots = realloc(loop->slot_of_fd, sizeof(int) * new_capacity);
+    if (!slots)
+      return NULL;
+    for (size_t i = loop->slot_capacity; i < new_capacity; i++)
+      slots[i] = -1;
+    loop->slot_of_fd = slots;
+    loop->slot_capacity = new_capacity;
+  }
+  return &loop->slot_of_fd[fd];
+}
+
+Status event_loop_add(EventLoop *loop, int fd, int events, void *data) {
+  int *slot = slot_for_fd(loop, fd);
+  if (!slot)
+    return ERROR_MEMORY;
+  if (loop->count == loop->capacity) {
+    size_t new_capacity = loop->capacity * 2;
+    struct pollfd *fds = realloc(loop->fds, sizeof(struct pollfd) * new_capacity);
+    if (!fds)
+      return ERROR_MEMORY;
+    loop->fds = fds;
+    void **data_slots = realloc(loop->data, sizeof(void *) * new_capacity);
+    if (!data_slots)
+      return ERROR_MEMORY;
+    loop->data = data_slots;
+    loop->capacity = new_capacity;
+  }
+  loop->fds[loop->count].fd = fd;
+  loop->fds[loop->count].events = poll_events_for(events);
+  loop->fds[loop->count].revents = 0;
+  loop->data[loop->count] = data;
+  *slot = (int)loop->count;
+  loop->count++;
+  return OK;
+}
+
+Status event_loop_modify(EventLoop *loop, int fd, int events, void *data) {
+  if ((size_t)fd >= loop->slot_capacity || loop->slot_of_fd[fd] < 0)
+    return ERROR_NOT_FOUND;
+  int index = loop->slot_of_fd[fd];
+  loop->fds[index].events = poll_events_for(events);
+  loop->data[index] = data;
+  return OK;
+}
+
+Status event_loop_remove(EventLoop *loop, int fd) {
+  if ((size_t)fd >= loop->slot_capacity || loop->slot_of_fd[fd] < 0)
+    return ERROR_NOT_FOUND;
+  int index = loop->slot_of_fd[fd];
+  size_t last = loop->count - 1;
+  if ((size_t)index != last) {
+    loop->fds[index] = loop->fds[last];
+    loop->data[index] = loop->data[last];
+    loop->slot_of_fd[loop->fds[index].fd] = index;
+  }
+  loop->slot_of_fd[fd] = -1;
+  loop->count--;
+  return OK;
+}
+
+int event_loop_wait(EventLoop *loop, LoopEvent *events, int max_events,
+                    int timeout_ms) {
+  int ready = poll(loop->fds, loop->count, timeout_ms);
+  if (ready < 0) {
+    if (errno == EINTR)
+      return 0;
+    perror("poll");
+    return -1;
+  }
+
+  int count = 0;
+  for (size_t i = 0; i < loop->count && count < max_events && ready > 0;
+       i++) {
+    short revents = loop->fds[i].revents;
+    if (!revents)
+      continue;
+    ready--;
+    events[count].data = loop->data[i];
+    events[count].events = 0;
+    if (revents & POLLIN)
+      events[count].events |= EVENT_READABLE;
+    if (revents & POLLOUT)
+      events[count].events |= EVENT_WRITABLE;
+    if (revents & (POLLHUP | POLLERR | POLLNVAL))
+      events[count].events |= EVENT_HANGUP | EVENT_READABLE;
+    count++;
+  }
+  return count;
+}
+
+#endif
@@ -0,0 +1,92 @@
+/**
+ * @file event_loop.h
+ * @brief Defines a small readiness-based event loop used by the HTTP server.
+ *
+ * On Linux the loop is backed by edge-triggered epoll, so the cost of a wait
+ * is proportional to the number of ready descriptors rather than the number
+ * of open connections. Other platforms fall back to a level-triggered
+ * `poll()` backend with the same interface.
+ */
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include "../core/error.h"
+
+/**
+ * @enum EventLoopFlags
+ * @brief Interest and readiness flags for a registered descriptor.
+ */
+typedef enum {
+  EVENT_READABLE = 1 << 0, ///< The descriptor has data to read.
+  EVENT_WRITABLE = 1 << 1, ///< The descriptor can accept more output.
+  EVENT_HANGUP = 1 << 2,   ///< The peer hung up or the descriptor errored.
+} EventLoopFlags;
+
+/**
+ * @struct LoopEvent
+ * @brief A single readiness notification returned by `event_loop_wait`.
+ */
+typedef struct {
+  void *data; ///< The pointer supplied when the descriptor was registered.
+  int events; ///< A mask of `EventLoopFlags`.
+} LoopEvent;
+
+typedef struct EventLoop EventLoop;
+
+/**
+ * @brief Creates a new event loop using the best backend for the platform.
+ * @return A new `EventLoop`, or NULL on failure. Free with `event_loop_free`.
+ */
+EventLoop *event_loop(void);
+
+/**
+ * @brief Closes the backend descriptor and frees the loop.
+ * @param loop The loop to free. Registered descriptors are not closed.
+ */
+void event_loop_free(EventLoop *loop);
+
+/**
+ * @brief Returns the name of the active backend ("epoll" or "poll").
+ */
+const char *event_loop_backend(const EventLoop *loop);
+
+/**
+ * @brief Registers a descriptor with the loop.
+ * @param loop The event loop.
+ * @param fd The descriptor to watch. It should be non-blocking.
+ * @param events The initial interest mask of `EventLoopFlags`.
+ * @param data An opaque pointer returned with every event for this `fd`.
+ * @return OK on success, or an error Status on failure.
+ */
+Status event_loop_add(EventLoop *loop, int fd, int events, void *data);
+
+/**
+ * @brief Changes the interest mask of a registered descriptor.
+ *
+ * The epoll backend registers descriptors for both directions in
+ * edge-triggered mode, so this is free there; the poll backend uses it to
+ * avoid spinning on writability.
+ * @return OK on success, or an error Status on failure.
+ */
+Status event_loop_modify(EventLoop *loop, int fd, int events, void *data);
+
+/**
+ * @brief Removes a descriptor from the loop. Must be called before `close`.
+ * @return OK on success, or an error Status on failure.
+ */
+Status event_loop_remove(EventLoop *loop, int fd);
+
+/**
+ * @brief Waits for descriptors to become ready.
+ * @param loop The event loop.
+ * @param[out] events An array that receives up to `max_events` events.
+ * @param max_events The capacity of the `events` array.
+ * @param timeout_ms The maximum time to block, or -1 to wait indefinitely.
+ * @return The number of events written, 0 on timeout or interruption, or -1
+ * on failure.
+ */
+int event_loop_wait(EventLoop *loop, LoopEvent *events, int max_events,
+                    int timeout_ms);
+
+#endif // EVENT_LOOP_H
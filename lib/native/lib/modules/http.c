@@ -1,122 +1,224 @@
+#define _GNU_SOURCE
 #include "http.h"
 #include "../core/object.h"
+#include "../core/scan.h"
 #include "../core/string.h"
 #include "../webs_api.h"
 #include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-Value *webs_http_parse_request(const char *raw_request, char **error) {
+#define HTTP_NAME_BUFFER 64
+
+static HttpSpan span_of(const char *buffer, const char *start,
+                        const char *end) {
+  return (HttpSpan){.offset = (size_t)(start - buffer),
+                    .len = (size_t)(end - start)};
+}
+
+static bool is_blank(char c) { return c == ' ' || c == '\t'; }
+
+/**
+ * @brief Scans the line starting at `p`. Sets `*eol` to its end, before any
+ * CR, and `*next` to the start of the following line, or to `end` if the line
+ * is not terminated.
+ * @return false if the line contains a control character.
+ */
+static bool next_line(const char *p, const char *end, const char **eol,
+                      const char **next, const char **colon) {
+  ScanLine line = scan_line(p, end);
+  *next = line.eol < end ? line.eol + 1 : end;
+  *eol = line.eol < end && line.eol > p && line.eol[-1] == '\r'
+             ? line.eol - 1
+             : line.eol;
+  *colon = line.colon;
+  return !line.invalid;
+}
+
+static size_t content_length(const HttpRequest *request) {
+  HttpSpan value;
+  if (!http_request_header(request, "content-length", &value))
+    return 0;
+  const char *p = http_span_data(request, value);
+  const char *end = p + value.len;
+  size_t length = 0;
+  while (p < end && isdigit((unsigned char)*p)) {
+    size_t digit = (size_t)(*p++ - '0');
+    length = length > (SIZE_MAX - digit) / 10 ? SIZE_MAX : length * 10 + digit;
+  }
+  return length;
+}
+
+Status http_request_parse(const char *raw_request, size_t length,
+                          HttpRequest *out_request, char **error) {
   *error = NULL;
   if (!raw_request) {
     *error = strdup("Request is null.");
-    return NULL;
+    return ERROR_INVALID_ARG;
   }
+  HttpRequest *req = out_request;
+  memset(req, 0, offsetof(HttpRequest, headers));
+  req->header_count = 0;
+  req->buffer = raw_request;
 
-  const char *start = raw_request;
-  while (*start && isspace((unsigned char)*start))
-    start++;
-  if (*start == '\0') {
+  const char *p = raw_request;
+  const char *end = raw_request + length;
+  while (p < end && isspace((unsigned char)*p))
+    p++;
+  if (p == end || *p == '\0') {
     *error = strdup("Request is empty or malformed");
-    return NULL;
-  }
-
-  const char *body_separator = "\r\n\r\n";
-  const char *body_start_ptr = strstr(start, body_separator);
-  size_t headers_len =
-      body_start_ptr ? (size_t)(body_start_ptr - start) : strlen(start);
-  char *headers_part = strndup(start, headers_len);
-  if (!headers_part) {
-    *error = strdup("Failed to allocate memory for headers.");
-    return NULL;
+    return ERROR_PARSE;
   }
 
-  Value *request_obj_val = object_value();
-  Object *request_obj = request_obj_val->as.object;
-  Value *headers_obj_val = object_value();
-  request_obj->set(request_obj, "headers", headers_obj_val);
-  Object *headers_obj = headers_obj_val->as.object;
-
-  char *line_saveptr = NULL;
-  char *line = strtok_r(headers_part, "\r\n", &line_saveptr);
-  if (!line) {
-    *error = strdup("Malformed request line: missing request line.");
-    goto cleanup;
+  const char *eol, *next, *colon;
+  if (!next_line(p, end, &eol, &next, &colon)) {
+    *error = strdup("Malformed request line: invalid character.");
+    return ERROR_PARSE;
   }
-
-  char *method = line;
-  char *path_full = strchr(method, ' ');
-  if (!path_full) {
+  const char *space = memchr(p, ' ', (size_t)(eol - p));
+  if (!space) {
     *error = strdup("Malformed request line: missing path.");
-    goto cleanup;
+    return ERROR_PARSE;
   }
-  *path_full++ = '\0';
-  char *version = strchr(path_full, ' ');
-  if (!version) {
+  req->method = span_of(raw_request, p, space);
+  const char *target = space + 1;
+  space = memchr(target, ' ', (size_t)(eol - target));
+  if (!space) {
     *error = strdup("Malformed request line: missing HTTP version.");
-    goto cleanup;
+    return ERROR_PARSE;
   }
-  *version++ = '\0';
-
-  char *query_string = strchr(path_full, '?');
-  if (query_string) {
-    *query_string++ = '\0';
-    request_obj->set(request_obj, "query", string_value(query_string));
+  req->version = span_of(raw_request, space + 1, eol);
+  const char *question = memchr(target, '?', (size_t)(space - target));
+  if (question) {
+    req->path = span_of(raw_request, target, question);
+    req->query = span_of(raw_request, question + 1, space);
   } else {
-    request_obj->set(request_obj, "query", string_value(""));
+    req->path = span_of(raw_request, target, space);
+    req->query = span_of(raw_request, space, space);
   }
 
-  request_obj->set(request_obj, "method", string_value(method));
-  request_obj->set(request_obj, "version", string_value(version));
-  request_obj->set(request_obj, "path", string_value(path_full));
-
-  long content_length = -1;
-  while ((line = strtok_r(NULL, "\r\n", &line_saveptr))) {
-    char *colon = strchr(line, ':');
-    if (colon) {
-      *colon = '\0';
-      char *key = line;
-      char *value_start = colon + 1;
-      while (*value_start && isspace((unsigned char)*value_start))
-        value_start++;
-      char *value_end = value_start + strlen(value_start) - 1;
-      while (value_end > value_start && isspace((unsigned char)*value_end))
-        *value_end-- = '\0';
-
-      char *lower_key = strdup(key);
-      for (int i = 0; lower_key[i]; i++) {
-        lower_key[i] = tolower(lower_key[i]);
-      }
-      headers_obj->set(headers_obj, lower_key, string_value(value_start));
-      if (strcasecmp(key, "Content-Length") == 0)
-        content_length = atol(value_start);
-      free(lower_key);
+  // The head ends at the first empty line; without one, every line is head.
+  bool terminated = false;
+  for (p = next; p < end; p = next) {
+    bool valid = next_line(p, end, &eol, &next, &colon);
+    if (eol == p) {
+      terminated = true;
+      p = next;
+      break;
     }
+    if (!valid) {
+      *error = strdup("Invalid character in header.");
+      return ERROR_PARSE;
+    }
+    if (!colon)
+      continue;
+    if (req->header_count == HTTP_MAX_HEADERS) {
+      *error = strdup("Too many headers.");
+      return ERROR_PARSE;
+    }
+    const char *value = colon + 1;
+    const char *value_end = eol;
+    while (value < value_end && is_blank(*value))
+      value++;
+    while (value_end > value && is_blank(value_end[-1]))
+      value_end--;
+    HttpHeader *header = &req->headers[req->header_count++];
+    header->name = span_of(raw_request, p, colon);
+    header->value = span_of(raw_request, value, value_end);
   }
 
-  if (body_start_ptr) {
-    const char *body_content_start = body_start_ptr + strlen(body_separator);
-    size_t actual_body_len = strlen(body_content_start);
-    if (content_length > 0 && actual_body_len > 0) {
-      size_t len_to_copy = actual_body_len < (size_t)content_length
-                               ? actual_body_len
-                               : (size_t)content_length;
-      char *body_str = strndup(body_content_start, len_to_copy);
-      request_obj->set(request_obj, "body", string_value(body_str));
-      free(body_str);
-    } else {
-      request_obj->set(request_obj, "body", string_value(""));
-    }
+  if (terminated) {
+    size_t available = (size_t)(end - p);
+    size_t body_len = content_length(req);
+    req->body = span_of(raw_request, p,
+                        p + (body_len < available ? body_len : available));
   } else {
-    request_obj->set(request_obj, "body", string_value(""));
+    req->body = span_of(raw_request, end, end);
+  }
+  return OK;
+}
+
+const char *http_span_data(const HttpRequest *request, HttpSpan span) {
+  return request->buffer + span.offset;
+}
+
+bool http_span_equals(const HttpRequest *request, HttpSpan span,
+                      const char *text) {
+  return strlen(text) == span.len &&
+         strncasecmp(http_span_data(request, span), text, span.len) == 0;
+}
+
+bool http_request_header(const HttpRequest *request, const char *name,
+                         HttpSpan *out_value) {
+  size_t name_len = strlen(name);
+  for (size_t i = 0; i < request->header_count; i++) {
+    const HttpHeader *header = &request->headers[i];
+    if (header->name.len == name_len &&
+        strncasecmp(http_span_data(request, header->name), name, name_len) ==
+            0) {
+      if (out_value)
+        *out_value = header->value;
+      return true;
+    }
+  }
+  return false;
+}
+
+static Value *span_value(const HttpRequest *request, HttpSpan span) {
+  return string_value_length(http_span_data(request, span), span.len);
+}
+
+Value *http_request_value(const HttpRequest *request) {
+  Value *request_obj_val = object_value();
+  if (!request_obj_val)
+    return NULL;
+  Object *request_obj = request_obj_val->as.object;
+  Value *headers_obj_val = object_value();
+  request_obj->set(request_obj, "headers", headers_obj_val);
+  Object *headers_obj = headers_obj_val->as.object;
+
+  char name[HTTP_NAME_BUFFER];
+  for (size_t i = 0; i < request->header_count; i++) {
+    const HttpHeader *header = &request->headers[i];
+    const char *src = http_span_data(request, header->name);
+    char *key = header->name.len < sizeof(name) ? name
+                                                : malloc(header->name.len + 1);
+    if (!key)
+      continue;
+    for (size_t j = 0; j < header->name.len; j++)
+      key[j] = (char)tolower((unsigned char)src[j]);
+    key[header->name.len] = '\0';
+    // Later duplicates replace earlier ones.
+    headers_obj->set(headers_obj, key, span_value(request, header->value));
+    if (key != name)
+      free(key);
   }
 
-  free(headers_part);
+  request_obj->set(request_obj, "query", span_value(request, request->query));
+  request_obj->set(request_obj, "method",
+                   span_value(request, request->method));
+  request_obj->set(request_obj, "version",
+                   span_value(request, request->version));
+  request_obj->set(request_obj, "path", span_value(request, request->path));
+  request_obj->set(request_obj, "body", span_value(request, request->body));
   return request_obj_val;
+}
+
+Value *webs_http_parse_request(const char *raw_request, char **error) {
+  return webs_http_parse_request_length(
+      raw_request, raw_request ? strlen(raw_request) : 0, error);
+}
 
-cleanup:
-  value_free(request_obj_val);
-  free(headers_part);
-  return NULL;
+Value *webs_http_parse_request_length(const char *raw_request, size_t length,
+                                      char **error) {
+  HttpRequest request;
+  if (http_request_parse(raw_request, length, &request, error) != OK)
+    return NULL;
+  Value *request_obj_val = http_request_value(&request);
+  if (!request_obj_val)
+    *error = strdup("Failed to allocate memory for request.");
+  return request_obj_val;
 }
@@ -4,6 +4,12 @@
  *
  * This module is responsible for parsing a raw HTTP request string into a
  * structured `Value` object.
+ *
+ * Parsing happens in two steps. `http_request_parse` records where the
+ * method, path, query, version, headers and body lie in the caller's buffer
+ * as spans, without allocating or copying. Handlers look headers up by name
+ * with `http_request_header`, and only pay for a `Value` tree when they ask
+ * for one with `http_request_value`.
  */
 
 #ifndef HTTP_H
@@ -11,6 +17,94 @@
 
 #include "../core/error.h"
 #include "../core/value.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief The most headers `http_request_parse` records for one request.
+ */
+#define HTTP_MAX_HEADERS 100
+
+/**
+ * @struct HttpSpan
+ * @brief A run of bytes in the buffer a request was parsed from.
+ */
+typedef struct {
+  size_t offset; ///< Where the run starts, from the start of the buffer.
+  size_t len;    ///< The number of bytes in the run.
+} HttpSpan;
+
+/**
+ * @struct HttpHeader
+ * @brief A header line split into its name and its trimmed value.
+ */
+typedef struct {
+  HttpSpan name;
+  HttpSpan value;
+} HttpHeader;
+
+/**
+ * @struct HttpRequest
+ * @brief A parsed request whose parts all point into the buffer it was
+ * parsed from, which must outlive it.
+ */
+typedef struct {
+  const char *buffer; ///< The bytes the spans refer to.
+  HttpSpan method;
+  HttpSpan path;    ///< The request target up to any `?`.
+  HttpSpan query;   ///< The text after `?`; empty if there is none.
+  HttpSpan version;
+  HttpSpan body;    ///< At most `Content-Length` bytes after the head.
+  HttpHeader headers[HTTP_MAX_HEADERS];
+  size_t header_count;
+} HttpRequest;
+
+/**
+ * @brief Parses the head of a raw HTTP request into spans.
+ *
+ * Nothing is allocated or copied on success. Lines may end in CRLF or a
+ * bare LF; header lines without a colon are skipped. Lines are scanned with
+ * the vector kernels in `scan.h`.
+ *
+ * @param raw_request The raw HTTP request bytes.
+ * @param length The number of bytes in `raw_request`.
+ * @param[out] out_request Receives the spans.
+ * @param[out] error Set to an error message on failure.
+ * @return `OK`, or `ERROR_PARSE` if the request line is malformed, a line of
+ * the head contains a control character, or the request has more than
+ * `HTTP_MAX_HEADERS` headers.
+ */
+Status http_request_parse(const char *raw_request, size_t length,
+                          HttpRequest *out_request, char **error);
+
+/**
+ * @brief Finds a header by name, ignoring case.
+ * @param request The parsed request.
+ * @param name The header name to look for.
+ * @param[out] out_value Receives the value of the first matching header.
+ * @return true if the header is present.
+ */
+bool http_request_header(const HttpRequest *request, const char *name,
+                         HttpSpan *out_value);
+
+/**
+ * @brief Returns the address of a span's first byte.
+ */
+const char *http_span_data(const HttpRequest *request, HttpSpan span);
+
+/**
+ * @brief Compares a span with a string, ignoring case.
+ */
+bool http_span_equals(const HttpRequest *request, HttpSpan span,
+                      const char *text);
+
+/**
+ * @brief Builds the `Value` form of a parsed request, as returned by
+ * `webs_http_parse_request`.
+ * @param request The parsed request.
+ * @return A new object `Value`, or NULL on allocation failure.
+ */
+Value *http_request_value(const HttpRequest *request);
 
 /**
  * @brief Parses a raw HTTP request string into a structured `Value`.
@@ -27,4 +121,20 @@
  */
 Value *webs_http_parse_request(const char *raw_request, char **error);
 
+/**
+ * @brief Parses a raw HTTP request of known length into a structured `Value`.
+ *
+ * Unlike `webs_http_parse_request`, the body may contain NUL bytes; it is
+ * taken from the bytes after the head, up to `Content-Length`. Handlers can
+ * get the length of their request from `server_request_length`.
+ *
+ * @param raw_request The raw HTTP request bytes.
+ * @param length The number of bytes in `raw_request`.
+ * @param[out] error Set to an error message on failure.
+ * @return A new object `Value` representing the parsed request, or NULL on
+ * parsing failure.
+ */
+Value *webs_http_parse_request_length(const char *raw_request, size_t length,
+                                      char **error);
+
 #endif // HTTP_H
@@ -0,0 +1,407 @@
+#include "io_ring.h"
+#include <errno.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+
+#include <linux/io_uring.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define RING_BUFFER_GROUP 0
+
+struct IoRing {
+  int fd;
+
+  // Submission queue, shared with the kernel. Entries up to `sq_local_tail`
+  // are filled in but only published when the ring is next entered.
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned sq_mask;
+  unsigned sq_entries;
+  unsigned sq_local_tail;
+  struct io_uring_sqe *sqes;
+
+  // Completion queue.
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned cq_mask;
+  struct io_uring_cqe *cqes;
+
+  void *ring_map;
+  size_t ring_map_len;
+  size_t sqes_len;
+
+  // Provided receive buffers and the ring that lends them to the kernel.
+  struct io_uring_buf_ring *buf_ring;
+  size_t buf_ring_len;
+  unsigned buf_mask;
+  char *buffers;
+  size_t buffer_size;
+};
+
+static int ring_enter(IoRing *ring, unsigned to_submit, unsigned min_complete,
+                      unsigned flags, void *arg, size_t arg_size) {
+  return (int)syscall(__NR_io_uring_enter, ring->fd, to_submit, min_complete,
+                      flags, arg, arg_size);
+}
+
+/**
+ * @brief Publishes the queued entries and hands them to the kernel. Entries
+ * the kernel could not take yet stay queued for the next call.
+ */
+static int ring_submit(IoRing *ring) {
+  unsigned to_submit =
+      ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+  __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+  if (to_submit == 0)
+    return 0;
+  return ring_enter(ring, to_submit, 0, 0, NULL, 0);
+}
+
+/**
+ * @brief Makes room for `count` entries, submitting the queue if it is full.
+ */
+static bool ring_reserve(IoRing *ring, unsigned count) {
+  unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+  if (ring->sq_local_tail - head + count <= ring->sq_entries)
+    return true;
+  if (ring_submit(ring) < 0 && errno != EBUSY && errno != EAGAIN)
+    return false;
+  head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+  return ring->sq_local_tail - head + count <= ring->sq_entries;
+}
+
+static struct io_uring_sqe *ring_sqe(IoRing *ring, int opcode, int fd,
+                                     uint64_t tag) {
+  if (!ring_reserve(ring, 1))
+    return NULL;
+  struct io_uring_sqe *sqe = &ring->sqes[ring->sq_local_tail & ring->sq_mask];
+  ring->sq_local_tail++;
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = (uint8_t)opcode;
+  sqe->fd = fd;
+  sqe->user_data = tag;
+  return sqe;
+}
+
+IoRing *io_ring(unsigned entries, unsigned buffer_count, size_t buffer_size) {
+  if (buffer_count == 0 || buffer_count > 32768 ||
+      (buffer_count & (buffer_count - 1)) != 0 || buffer_size == 0 ||
+      buffer_size > UINT32_MAX) {
+    errno = EINVAL;
+    return NULL;
+  }
+  IoRing *ring = calloc(1, sizeof(IoRing));
+  if (!ring)
+    return NULL;
+
+  // Completions are only reaped when the owning thread waits, so the kernel
+  // may defer completion work until then instead of interrupting it. These
+  // flags need Linux 6.1, which also brings multishot receive.
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN |
+                 IORING_SETUP_CQSIZE;
+  params.cq_entries = entries * 4;
+  ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+  if (ring->fd < 0) {
+    free(ring);
+    return NULL;
+  }
+  const unsigned required =
+      IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+  if ((params.features & required) != required) {
+    errno = ENOSYS;
+    goto fail;
+  }
+
+  size_t sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  size_t cq_len =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  ring->ring_map_len = sq_len > cq_len ? sq_len : cq_len;
+  ring->ring_map = mmap(NULL, ring->ring_map_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  if (ring->ring_map == MAP_FAILED) {
+    ring->ring_map = NULL;
+    goto fail;
+  }
+  ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED) {
+    ring->sqes = NULL;
+    goto fail;
+  }
+
+  char *base = ring->ring_map;
+  ring->sq_head = (unsigned *)(base + params.sq_off.head);
+  ring->sq_tail = (unsigned *)(base + params.sq_off.tail);
+  ring->sq_mask = *(unsigned *)(base + params.sq_off.ring_mask);
+  ring->sq_entries = params.sq_entries;
+  ring->sq_local_tail = *ring->sq_tail;
+  unsigned *array = (unsigned *)(base + params.sq_off.array);
+  for (unsigned i = 0; i < params.sq_entries; i++)
+    array[i] = i;
+  ring->cq_head = (unsigned *)(base + params.cq_off.head);
+  ring->cq_tail = (unsigned *)(base + params.cq_off.tail);
+  ring->cq_mask = *(unsigned *)(base + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(base + params.cq_off.cqes);
+
+  ring->buf_ring_len = buffer_count * sizeof(struct io_uring_buf);
+  ring->buf_ring = mmap(NULL, ring->buf_ring_len, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ring->buf_ring == MAP_FAILED) {
+    ring->buf_ring = NULL;
+    goto fail;
+  }
+  ring->buffers = malloc(buffer_count * buffer_size);
+  if (!ring->buffers)
+    goto fail;
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uint64_t)(uintptr_t)ring->buf_ring;
+  reg.ring_entries = buffer_count;
+  reg.bgid = RING_BUFFER_GROUP;
+  if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING,
+              &reg, 1) < 0)
+    goto fail;
+  ring->buf_mask = buffer_count - 1;
+  ring->buffer_size = buffer_size;
+  for (unsigned i = 0; i < buffer_count; i++)
+    io_ring_recycle(ring, (int)i);
+  return ring;
+
+fail:;
+  int saved = errno;
+  io_ring_free(ring);
+  errno = saved;
+  return NULL;
+}
+
+void io_ring_free(IoRing *ring) {
+  if (!ring)
+    return;
+  if (ring->fd >= 0)
+    close(ring->fd);
+  if (ring->sqes)
+    munmap(ring->sqes, ring->sqes_len);
+  if (ring->ring_map)
+    munmap(ring->ring_map, ring->ring_map_len);
+  if (ring->buf_ring)
+    munmap(ring->buf_ring, ring->buf_ring_len);
+  free(ring->buffers);
+  free(ring);
+}
+
+bool io_ring_accept(IoRing *ring, int fd, uint64_t tag) {
+  struct io_uring_sqe *sqe = ring_sqe(ring, IORING_OP_ACCEPT, fd, tag);
+  if (!sqe)
+    return false;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+  return true;
+}
+
+bool io_ring_recv(IoRing *ring, int fd, uint64_t tag) {
+  struct io_uring_sqe *sqe = ring_sqe(ring, IORING_OP_RECV, fd, tag);
+  if (!sqe)
+    return false;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = RING_BUFFER_GROUP;
+  return true;
+}
+
+bool io_ring_send(IoRing *ring, int fd, const void *data, size_t len,
+                  uint64_t tag, uint64_t close_tag) {
+  if (len > UINT32_MAX) {
+    errno = EINVAL;
+    return false;
+  }
+  // The send and its close must be queued back to back, or the link would
+  // attach the close to whatever is queued next.
+  if (!ring_reserve(ring, close_tag ? 2 : 1))
+    return false;
+  struct io_uring_sqe *sqe = ring_sqe(ring, IORING_OP_SEND, fd, tag);
+  sqe->addr = (uint64_t)(uintptr_t)data;
+  sqe->len = (uint32_t)len;
+  sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+  if (close_tag) {
+    sqe->flags = IOSQE_IO_LINK;
+    ring_sqe(ring, IORING_OP_CLOSE, fd, close_tag);
+  }
+  return true;
+}
+
+bool io_ring_poll(IoRing *ring, int fd, int events, bool multishot,
+                  uint64_t tag) {
+  struct io_uring_sqe *sqe = ring_sqe(ring, IORING_OP_POLL_ADD, fd, tag);
+  if (!sqe)
+    return false;
+  uint32_t mask = (uint32_t)events;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  mask = (mask << 16) | (mask >> 16);
+#endif
+  sqe->poll32_events = mask;
+  if (multishot)
+    sqe->len = IORING_POLL_ADD_MULTI;
+  return true;
+}
+
+bool io_ring_close(IoRing *ring, int fd, uint64_t tag) {
+  return ring_sqe(ring, IORING_OP_CLOSE, fd, tag) != NULL;
+}
+
+bool io_ring_cancel(IoRing *ring, uint64_t tag) {
+  struct io_uring_sqe *sqe = ring_sqe(ring, IORING_OP_ASYNC_CANCEL, -1, 0);
+  if (!sqe)
+    return false;
+  sqe->addr = tag;
+  return true;
+}
+
+int io_ring_wait(IoRing *ring, IoCompletion *completions, int max,
+                 int timeout_ms) {
+  unsigned to_submit =
+      ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+  __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+
+  // Completions may already be waiting, in which case only submit.
+  bool ready = *ring->cq_head != __atomic_load_n(ring->cq_tail,
+                                                 __ATOMIC_ACQUIRE);
+  struct __kernel_timespec ts = {
+      .tv_sec = timeout_ms / 1000,
+      .tv_nsec = (long long)(timeout_ms % 1000) * 1000000,
+  };
+  struct io_uring_getevents_arg arg;
+  memset(&arg, 0, sizeof(arg));
+  arg.sigmask_sz = _NSIG / 8;
+  arg.ts = timeout_ms >= 0 ? (uint64_t)(uintptr_t)&ts : 0;
+  unsigned min_complete = ready || timeout_ms == 0 ? 0 : 1;
+  if (ring_enter(ring, to_submit, min_complete,
+                 IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg,
+                 sizeof(arg)) < 0 &&
+      errno != ETIME && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+    return -1;
+
+  unsigned head = *ring->cq_head;
+  unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+  int count = 0;
+  while (head != tail && count < max) {
+    const struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+    head++;
+    if (cqe->user_data == 0)
+      continue;
+    IoCompletion *completion = &completions[count++];
+    completion->tag = cqe->user_data;
+    completion->result = cqe->res;
+    completion->more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+    completion->buffer = (cqe->flags & IORING_CQE_F_BUFFER)
+                             ? (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT)
+                             : -1;
+  }
+  __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+  return count;
+}
+
+char *io_ring_buffer(IoRing *ring, int buffer) {
+  return ring->buffers + (size_t)buffer * ring->buffer_size;
+}
+
+void io_ring_recycle(IoRing *ring, int buffer) {
+  // Only this thread moves the tail; the kernel consumes from the head.
+  uint16_t tail = ring->buf_ring->tail;
+  struct io_uring_buf *entry = &ring->buf_ring->bufs[tail & ring->buf_mask];
+  entry->addr = (uint64_t)(uintptr_t)io_ring_buffer(ring, buffer);
+  entry->len = (uint32_t)ring->buffer_size;
+  entry->bid = (uint16_t)buffer;
+  __atomic_store_n(&ring->buf_ring->tail, (uint16_t)(tail + 1),
+                   __ATOMIC_RELEASE);
+}
+
+#else
+
+IoRing *io_ring(unsigned entries, unsigned buffer_count, size_t buffer_size) {
+  (void)entries;
+  (void)buffer_count;
+  (void)buffer_size;
+  errno = ENOSYS;
+  return NULL;
+}
+
+void io_ring_free(IoRing *ring) { (void)ring; }
+
+bool io_ring_accept(IoRing *ring, int fd, uint64_t tag) {
+  (void)ring;
+  (void)fd;
+  (void)tag;
+  return false;
+}
+
+bool io_ring_recv(IoRing *ring, int fd, uint64_t tag) {
+  (void)ring;
+  (void)fd;
+  (void)tag;
+  return false;
+}
+
+bool io_ring_send(IoRing *ring, int fd, const void *data, size_t len,
+                  uint64_t tag, uint64_t close_tag) {
+  (void)ring;
+  (void)fd;
+  (void)data;
+  (void)len;
+  (void)tag;
+  (void)close_tag;
+  return false;
+}
+
+bool io_ring_poll(IoRing *ring, int fd, int events, bool multishot,
+                  uint64_t tag) {
+  (void)ring;
+  (void)fd;
+  (void)events;
+  (void)multishot;
+  (void)tag;
+  return false;
+}
+
+bool io_ring_close(IoRing *ring, int fd, uint64_t tag) {
+  (void)ring;
+  (void)fd;
+  (void)tag;
+  return false;
+}
+
+bool io_ring_cancel(IoRing *ring, uint64_t tag) {
+  (void)ring;
+  (void)tag;
+  return false;
+}
+
+int io_ring_wait(IoRing *ring, IoCompletion *completions, int max,
+                 int timeout_ms) {
+  (void)ring;
+  (void)completions;
+  (void)max;
+  (void)timeout_ms;
+  return -1;
+}
+
+char *io_ring_buffer(IoRing *ring, int buffer) {
+  (void)ring;
+  (void)buffer;
+  return NULL;
+}
+
+void io_ring_recycle(IoRing *ring, int buffer) {
+  (void)ring;
+  (void)buffer;
+}
+
+#endif
@@ -0,0 +1,121 @@
+/**
+ * @file io_ring.h
+ * @brief Defines a thin wrapper over Linux io_uring for the HTTP server's
+ * completion-based backend.
+ *
+ * The wrapper talks to the kernel directly through the `io_uring_setup`,
+ * `io_uring_enter` and `io_uring_register` system calls, so no library is
+ * needed. It offers only the operations the server uses: multishot accept,
+ * multishot receive into a ring of provided buffers, send (optionally linked
+ * to a close of the same socket), poll, close and cancellation.
+ *
+ * Operations are queued locally and handed to the kernel in one batch by the
+ * next `io_ring_wait`, which also collects their completions. Each operation
+ * carries a caller-chosen tag that comes back with its completion; tag 0 is
+ * reserved for operations whose completion is of no interest.
+ *
+ * The ring is meant to be used by a single thread, the one that created it.
+ * `io_ring` returns NULL on other platforms and on kernels older than 6.1,
+ * so callers can fall back to a readiness loop (see `event_loop.h`).
+ */
+
+#ifndef IO_RING_H
+#define IO_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct IoRing IoRing;
+
+/**
+ * @struct IoCompletion
+ * @brief The outcome of one operation, or one shot of a multishot one.
+ */
+typedef struct {
+  uint64_t tag; ///< The tag the operation was queued with.
+  int result;   ///< The operation's result, or a negated errno.
+  bool more;    ///< A multishot operation is still armed.
+  int buffer;   ///< The provided buffer holding received data, or -1.
+} IoCompletion;
+
+/**
+ * @brief Creates a ring together with its pool of receive buffers.
+ * @param entries The number of operations that can be queued at once.
+ * @param buffer_count The number of receive buffers; a power of two.
+ * @param buffer_size The size of each receive buffer, in bytes.
+ * @return A new `IoRing`, or NULL with `errno` set if io_uring is
+ * unavailable.
+ */
+IoRing *io_ring(unsigned entries, unsigned buffer_count, size_t buffer_size);
+
+/**
+ * @brief Tears the ring down. Operations still in flight are cancelled.
+ */
+void io_ring_free(IoRing *ring);
+
+/**
+ * @brief Accepts connections on a listening socket until cancelled or an
+ * error occurs. Each completion's result is a new non-blocking socket.
+ */
+bool io_ring_accept(IoRing *ring, int fd, uint64_t tag);
+
+/**
+ * @brief Receives from a socket until cancelled, EOF or an error. Each
+ * completion names the provided buffer the data landed in, which must be
+ * returned with `io_ring_recycle`.
+ */
+bool io_ring_recv(IoRing *ring, int fd, uint64_t tag);
+
+/**
+ * @brief Sends `len` bytes, retrying short writes in the kernel. The bytes
+ * must stay valid until the completion arrives.
+ * @param close_tag When non-zero, the socket is closed once the send
+ * succeeds, and the close completes with this tag. A failed send cancels the
+ * close (it completes with `-ECANCELED`).
+ */
+bool io_ring_send(IoRing *ring, int fd, const void *data, size_t len,
+                  uint64_t tag, uint64_t close_tag);
+
+/**
+ * @brief Waits for `events` (a `poll` mask) on a descriptor, once or, with
+ * `multishot`, every time the descriptor is woken.
+ */
+bool io_ring_poll(IoRing *ring, int fd, int events, bool multishot,
+                  uint64_t tag);
+
+/**
+ * @brief Closes a descriptor.
+ */
+bool io_ring_close(IoRing *ring, int fd, uint64_t tag);
+
+/**
+ * @brief Cancels the operation queued with `tag`, which then completes with
+ * `-ECANCELED` (unless it finishes first).
+ */
+bool io_ring_cancel(IoRing *ring, uint64_t tag);
+
+/**
+ * @brief Submits the queued operations and collects completions.
+ * @param ring The ring.
+ * @param[out] completions Receives up to `max` completions.
+ * @param max The capacity of `completions`.
+ * @param timeout_ms How long to block for the first completion, or -1 to
+ * wait indefinitely.
+ * @return The number of completions written, 0 on timeout or interruption,
+ * or -1 on failure.
+ */
+int io_ring_wait(IoRing *ring, IoCompletion *completions, int max,
+                 int timeout_ms);
+
+/**
+ * @brief Returns the memory of a provided buffer named by a completion.
+ */
+char *io_ring_buffer(IoRing *ring, int buffer);
+
+/**
+ * @brief Hands a provided buffer back to the kernel for further receives.
+ */
+void io_ring_recycle(IoRing *ring, int buffer);
+
+#endif // IO_RING_H
@@ -0,0 +1,186 @@
+#include "response.h"
+#include "server.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#define RESPONSE_INITIAL_HEAD 256
+
+static void head_append(Response *res, const char *data, size_t len) {
+  if (res->failed)
+    return;
+  if (res->head_len + len > res->head_capacity) {
+    size_t capacity =
+        res->head_capacity ? res->head_capacity : RESPONSE_INITIAL_HEAD;
+    while (capacity < res->head_len + len)
+      capacity *= 2;
+    char *grown = realloc(res->head, capacity);
+    if (!grown) {
+      res->failed = true;
+      return;
+    }
+    res->head = grown;
+    res->head_capacity = capacity;
+  }
+  memcpy(res->head + res->head_len, data, len);
+  res->head_len += len;
+}
+
+void response_init(Response *res, int client_fd, int status_code,
+                   const char *reason) {
+  memset(res, 0, sizeof(*res));
+  res->client_fd = client_fd;
+  res->status_code = status_code;
+  res->file_fd = -1;
+  if (!reason || strpbrk(reason, "\r\n"))
+    reason = "";
+  char status_line[128];
+  int len = snprintf(status_line, sizeof(status_line), "HTTP/1.1 %d %s\r\n",
+                     status_code, reason);
+  if (len >= (int)sizeof(status_line))
+    len = (int)sizeof(status_line) - 1;
+  head_append(res, status_line, (size_t)len);
+}
+
+void response_header(Response *res, const char *name, const char *value) {
+  // A line break would let the value start headers, or a body, of its own.
+  if (!*name || strpbrk(name, ":\r\n") || strpbrk(value, "\r\n"))
+    return;
+  if (strcasecmp(name, "content-length") == 0)
+    res->has_content_length = true;
+  head_append(res, name, strlen(name));
+  head_append(res, ": ", 2);
+  head_append(res, value, strlen(value));
+  head_append(res, "\r\n", 2);
+}
+
+void response_headerf(Response *res, const char *name, const char *format,
+                      ...) {
+  char value[512];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(value, sizeof(value), format, args);
+  va_end(args);
+  response_header(res, name, value);
+}
+
+static void body_append(Response *res, void *data, size_t len, bool owned) {
+  if (len == 0) {
+    if (owned)
+      free(data);
+    return;
+  }
+  if (res->body_count == res->body_capacity) {
+    int capacity = res->body_capacity ? res->body_capacity * 2 : 4;
+    struct iovec *body = realloc(res->body, sizeof(struct iovec) * capacity);
+    if (!body)
+      goto fail;
+    res->body = body;
+    bool *owned_flags = realloc(res->owned, sizeof(bool) * capacity);
+    if (!owned_flags)
+      goto fail;
+    res->owned = owned_flags;
+    res->body_capacity = capacity;
+  }
+  res->body[res->body_count].iov_base = data;
+  res->body[res->body_count].iov_len = len;
+  res->owned[res->body_count] = owned;
+  res->body_count++;
+  res->body_length += len;
+  return;
+
+fail:
+  res->failed = true;
+  if (owned)
+    free(data);
+}
+
+void response_body(Response *res, const void *data, size_t len) {
+  body_append(res, (void *)data, len, false);
+}
+
+void response_body_owned(Response *res, void *data, size_t len) {
+  body_append(res, data, len, true);
+}
+
+void response_file(Response *res, int file_fd, off_t offset, size_t length) {
+  if (res->file_fd >= 0)
+    close(res->file_fd);
+  res->file_fd = file_fd;
+  res->file_offset = offset;
+  res->file_length = length;
+}
+
+/**
+ * @brief Answers with a bare 500 in place of a response that could not be
+ * built, and closes its file.
+ */
+static void send_failure(Response *res) {
+  static const char failed[] = "HTTP/1.1 500 Internal Server Error\r\n"
+                               "Content-Length: 0\r\n"
+                               "Connection: close\r\n\r\n";
+  server_write(res->client_fd, failed, sizeof(failed) - 1);
+  if (res->file_fd >= 0)
+    close(res->file_fd);
+  res->file_fd = -1;
+  response_free(res);
+}
+
+void response_send(Response *res) {
+  if (res->failed) {
+    send_failure(res);
+    return;
+  }
+  int status = res->status_code;
+  bool bodiless = status < 200 || status == 204 || status == 304;
+  if (!res->has_content_length && !bodiless) {
+    char length[32];
+    snprintf(length, sizeof(length), "%zu",
+             res->body_length + res->file_length);
+    response_header(res, "Content-Length", length);
+  }
+  head_append(res, "\r\n", 2);
+
+  struct iovec stack_iov[8];
+  int count = res->body_count + 1;
+  struct iovec *iov =
+      count <= 8 ? stack_iov : malloc(sizeof(struct iovec) * count);
+  if (!iov) {
+    send_failure(res);
+    return;
+  }
+  iov[0].iov_base = res->head;
+  iov[0].iov_len = res->head_len;
+  if (res->body_count > 0)
+    memcpy(iov + 1, res->body, sizeof(struct iovec) * res->body_count);
+  if (res->file_fd >= 0)
+    server_writev_more(res->client_fd, iov, count);
+  else
+    server_writev(res->client_fd, iov, count);
+  if (iov != stack_iov)
+    free(iov);
+
+  if (res->file_fd >= 0) {
+    server_send_file(res->client_fd, res->file_fd, res->file_offset,
+                     res->file_length);
+    res->file_fd = -1;
+  }
+  response_free(res);
+}
+
+void response_free(Response *res) {
+  for (int i = 0; i < res->body_count; i++) {
+    if (res->owned[i])
+      free(res->body[i].iov_base);
+  }
+  if (res->file_fd >= 0)
+    close(res->file_fd);
+  free(res->head);
+  free(res->body);
+  free(res->owned);
+  memset(res, 0, sizeof(*res));
+  res->file_fd = -1;
+}
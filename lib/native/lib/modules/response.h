@@ -0,0 +1,115 @@
+/**
+ * @file response.h
+ * @brief Defines a scatter-gather builder for HTTP responses.
+ *
+ * A `Response` collects the status line and headers in one buffer and keeps
+ * body segments as separate iovecs, so a response assembled from several
+ * pieces (headers, a JSON body, a cached asset, a file) is handed to the
+ * server in a single `server_writev` without first being concatenated. A
+ * file segment, if any, is sent last with `server_send_file`.
+ *
+ * If the head or the segment list cannot grow, the response is marked
+ * failed and `response_send` answers 500 and closes the connection instead
+ * of sending a truncated response.
+ *
+ * Typical use:
+ * @code
+ *   Response res;
+ *   response_init(&res, client_fd, 200, "OK");
+ *   response_header(&res, "Content-Type", "application/json");
+ *   response_body_owned(&res, json, strlen(json));
+ *   response_send(&res);
+ * @endcode
+ */
+
+#ifndef RESPONSE_H
+#define RESPONSE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/**
+ * @struct Response
+ * @brief A response being assembled. Initialise with `response_init` and
+ * finish with `response_send` or `response_free`.
+ */
+typedef struct {
+  int client_fd;
+  int status_code;
+
+  char *head; // Status line and headers, without the final blank line.
+  size_t head_len;
+  size_t head_capacity;
+  bool has_content_length;
+
+  struct iovec *body; // Body segments in order.
+  bool *owned;        // Whether each segment is freed after sending.
+  int body_count;
+  int body_capacity;
+  size_t body_length;
+
+  int file_fd; // File segment sent after the body, or -1.
+  off_t file_offset;
+  size_t file_length;
+
+  bool failed; // An allocation failed; the response is replaced with a 500.
+} Response;
+
+/**
+ * @brief Starts a response with its status line.
+ * @param res The response to initialise.
+ * @param client_fd The client's socket file descriptor.
+ * @param status_code The HTTP status code.
+ * @param reason The reason phrase, e.g. "OK". One containing a line break
+ * is left out.
+ */
+void response_init(Response *res, int client_fd, int status_code,
+                   const char *reason);
+
+/**
+ * @brief Appends a header. A `Content-Length` header set here replaces the
+ * one `response_send` would compute. A header whose name is empty or holds
+ * a colon, or whose name or value holds CR or LF, is dropped, so a value
+ * taken from a request cannot split the response.
+ */
+void response_header(Response *res, const char *name, const char *value);
+
+/**
+ * @brief Appends a header whose value is built from a printf-style format.
+ */
+void response_headerf(Response *res, const char *name, const char *format,
+                      ...);
+
+/**
+ * @brief Appends a body segment that the caller keeps alive until the
+ * response is sent.
+ */
+void response_body(Response *res, const void *data, size_t len);
+
+/**
+ * @brief Appends a heap-allocated body segment that the response frees once
+ * it is sent.
+ */
+void response_body_owned(Response *res, void *data, size_t len);
+
+/**
+ * @brief Ends the body with a range of an open file, sent without copying.
+ * @param file_fd The file. Ownership passes to the response.
+ */
+void response_file(Response *res, int file_fd, off_t offset, size_t length);
+
+/**
+ * @brief Adds `Content-Length` if needed, writes the head and body segments
+ * with a single scatter-gather write, sends the file segment, and releases
+ * the response.
+ */
+void response_send(Response *res);
+
+/**
+ * @brief Releases a response without sending it.
+ */
+void response_free(Response *res);
+
+#endif // RESPONSE_H
@@ -1,29 +1,368 @@
+#define _GNU_SOURCE
 #include "server.h"
 #include "../webs_api.h"
+#include "connection.h"
+#include "event_loop.h"
+#include "io_ring.h"
+#include "timer_wheel.h"
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <netinet/in.h>
 #include <poll.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
-#define INITIAL_CLIENTS 10
-#define MAX_REQUEST_SIZE 8192
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#endif
+
+#define DEFAULT_MAX_HEADER_SIZE 8192
+#define DEFAULT_MAX_BODY_SIZE (1024 * 1024)
+// Input buffered beyond the head and body limits for a partial chunk line.
+#define CHUNK_LINE_SLACK 4096
+#define MAX_EVENTS 256
+#define OUTPUT_HIGH_WATER (256 * 1024)
+#define TIMER_TICK_MS 10
+#define DEFAULT_KEEP_ALIVE_TIMEOUT_MS 5000
+#define DEFAULT_HEADER_TIMEOUT_MS 10000
+#define DEFAULT_BODY_TIMEOUT_MS 30000
+#define DEFAULT_WRITE_TIMEOUT_MS 30000
+#define DEFAULT_KEEP_ALIVE_MAX_REQUESTS 1000
+#define DEFAULT_HANDLER_QUEUE_SIZE 1024
+#define RING_ENTRIES 256
+#define RING_BUFFERS 256
+#define RING_BUFFER_SIZE 8192
+// Largest single send handed to the ring; the rest follows when it is done.
+#define RING_SEND_MAX (1u << 30)
+#define RING_DRAIN_ATTEMPTS 100
+
+/**
+ * @struct ServerWorker
+ * @brief One accept shard: a listening socket, an event loop and the
+ * connections accepted through it.
+ */
+typedef struct ServerWorker {
+  Server *server;
+  RequestHandler handler;
+  int listen_fd;
+  EventLoop *loop;
+  IoRing *ring;       // Set when the worker runs on io_uring, not `loop`.
+  TimerWheel *timers; // Connection deadlines.
+  Connection *connections;
+  Connection *retired; // Closed, but still referenced by ring operations.
+  pthread_t thread;
+  int result;
+
+  // Handler pool completions. Pool threads push finished jobs onto
+  // `completed` and signal `notify_fds[1]`; the worker drains both.
+  int notify_fds[2];
+  pthread_mutex_t completed_lock;
+  struct HandlerJob *completed;
+} ServerWorker;
+
+/**
+ * @struct HandlerJob
+ * @brief A request handed to the handler pool and the response it produced.
+ * The pool thread only touches the request and output buffer; the connection
+ * itself stays owned by the worker's I/O thread.
+ */
+typedef struct HandlerJob {
+  ServerWorker *worker;
+  Connection *conn;
+  int fd;
+  bool keep_alive;
+  char *request; // Allocated from `arena`.
+  size_t request_length;
+  Arena *arena; // The connection's arena, lent to the pool thread.
+  char *out;
+  size_t out_len;
+  size_t out_capacity;
+  int file_fd; // File body sent after `file_at` bytes of `out`, or -1.
+  off_t file_offset;
+  size_t file_length;
+  size_t file_at;
+  struct HandlerJob *next;
+} HandlerJob;
 
 static int server_listen_method(Server *self, RequestHandler handler);
 static void server_stop_method(Server *self);
-static int setup_listen_socket(Server *self);
+
+// The connection whose request is being handled on this thread. Writes to its
+// descriptor are queued and flushed by the event loop instead of blocking.
+static _Thread_local Connection *active_connection = NULL;
+static _Thread_local Server *active_server = NULL;
+// The job being handled on this pool thread, which collects its output.
+static _Thread_local HandlerJob *active_job = NULL;
+static _Thread_local size_t active_request_length = 0;
+static _Thread_local Arena *active_arena = NULL;
+static _Thread_local ServerCapture *active_capture = NULL;
+
+/**
+ * @struct DirectResponse
+ * @brief A response on the readiness loop that may skip the output queue.
+ * If the handler writes its head and body in one `server_writev`, the server
+ * decides the `Connection` headers then and sends the response at once.
+ */
+typedef struct {
+  size_t start;    // The connection's `out_len` when the handler began.
+  bool keep_alive; // The request allows the connection to be reused.
+  bool sent;       // The head went out; `reuse` holds the decision.
+  bool reuse;
+} DirectResponse;
+
+static _Thread_local DirectResponse *active_direct = NULL;
+
+static bool send_direct(Connection *conn, const struct iovec *iov, int count);
+
+static int set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    perror("fcntl(O_NONBLOCK)");
+    return -1;
+  }
+  return 0;
+}
+
+void server_capture_begin(ServerCapture *capture, int client_fd) {
+  memset(capture, 0, sizeof(*capture));
+  capture->fd = client_fd;
+  capture->previous = active_capture;
+  active_capture = capture;
+}
+
+void server_capture_end(ServerCapture *capture) {
+  if (active_capture == capture)
+    active_capture = capture->previous;
+}
+
+static void capture_append(ServerCapture *capture, const void *data,
+                           size_t len) {
+  if (capture->len + len > capture->capacity) {
+    size_t capacity = capture->capacity ? capture->capacity : 4096;
+    while (capacity < capture->len + len)
+      capacity *= 2;
+    char *grown = realloc(capture->data, capacity);
+    if (!grown) {
+      capture->failed = true;
+      return;
+    }
+    capture->data = grown;
+    capture->capacity = capacity;
+  }
+  memcpy(capture->data + capture->len, data, len);
+  capture->len += len;
+}
+
+void server_write(int client_fd, const void *data, size_t len) {
+  if (!data || len == 0)
+    return;
+  if (active_capture && active_capture->fd == client_fd) {
+    capture_append(active_capture, data, len);
+    return;
+  }
+  if (active_connection && active_connection->fd == client_fd) {
+    connection_queue(active_connection, data, len);
+    return;
+  }
+  if (active_job && active_job->fd == client_fd) {
+    if (active_job->out_len + len > active_job->out_capacity) {
+      size_t capacity = active_job->out_capacity ? active_job->out_capacity
+                                                 : 4096;
+      while (capacity < active_job->out_len + len)
+        capacity *= 2;
+      char *grown = realloc(active_job->out, capacity);
+      if (!grown)
+        return;
+      active_job->out = grown;
+      active_job->out_capacity = capacity;
+    }
+    memcpy(active_job->out + active_job->out_len, data, len);
+    active_job->out_len += len;
+    return;
+  }
+
+  const char *p = data;
+  while (len > 0) {
+    ssize_t n = write(client_fd, p, len);
+    if (n > 0) {
+      p += n;
+      len -= (size_t)n;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      struct pollfd pfd = {.fd = client_fd, .events = POLLOUT};
+      poll(&pfd, 1, -1);
+    } else {
+      return;
+    }
+  }
+}
+
+/**
+ * @brief Writes segments in order; `more` says the response continues with
+ * a file, which the head should go out together with.
+ */
+static void write_segments(int client_fd, const struct iovec *iov, int count,
+                           bool more) {
+  bool captured = active_capture && active_capture->fd == client_fd;
+  if (!captured && !more && active_direct && active_connection &&
+      active_connection->fd == client_fd &&
+      send_direct(active_connection, iov, count))
+    return;
+  if (captured || (active_connection && active_connection->fd == client_fd) ||
+      (active_job && active_job->fd == client_fd)) {
+    // Queued output is contiguous, so the event loop sends all of it with
+    // one call once the handler returns.
+    for (int i = 0; i < count; i++)
+      server_write(client_fd, iov[i].iov_base, iov[i].iov_len);
+    return;
+  }
+
+  struct iovec pending[16];
+  while (count > 0) {
+    int batch = count < 16 ? count : 16;
+    memcpy(pending, iov, sizeof(struct iovec) * batch);
+    struct iovec *cursor = pending;
+    int remaining = batch;
+    while (remaining > 0) {
+      ssize_t n = writev(client_fd, cursor, remaining);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        struct pollfd pfd = {.fd = client_fd, .events = POLLOUT};
+        poll(&pfd, 1, -1);
+        continue;
+      }
+      if (n <= 0)
+        return;
+      // Skip the segments this write finished and trim the partial one.
+      size_t written = (size_t)n;
+      while (remaining > 0 && written >= cursor->iov_len) {
+        written -= cursor->iov_len;
+        cursor++;
+        remaining--;
+      }
+      if (remaining > 0) {
+        cursor->iov_base = (char *)cursor->iov_base + written;
+        cursor->iov_len -= written;
+      }
+    }
+    iov += batch;
+    count -= batch;
+  }
+}
+
+void server_writev(int client_fd, const struct iovec *iov, int count) {
+  write_segments(client_fd, iov, count, false);
+}
+
+void server_writev_more(int client_fd, const struct iovec *iov, int count) {
+  write_segments(client_fd, iov, count, true);
+}
 
 void server_write_response(int client_fd, const char *response) {
   if (response) {
-    write(client_fd, response, strlen(response));
+    server_write(client_fd, response, strlen(response));
   }
 }
 
+/**
+ * @brief Sends a file range by copying it through `server_write`. Used when
+ * the range cannot be attached to the connection for a zero-copy send.
+ */
+static void copy_file(int client_fd, int file_fd, off_t offset, size_t length) {
+  char chunk[65536];
+  while (length > 0) {
+    size_t want = length < sizeof(chunk) ? length : sizeof(chunk);
+    ssize_t n = pread(file_fd, chunk, want, offset);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    server_write(client_fd, chunk, (size_t)n);
+    offset += n;
+    length -= (size_t)n;
+  }
+  close(file_fd);
+}
+
+void server_send_file(int client_fd, int file_fd, off_t offset,
+                      size_t length) {
+  if (active_capture && active_capture->fd == client_fd) {
+    copy_file(client_fd, file_fd, offset, length);
+    return;
+  }
+  if (active_connection && active_connection->fd == client_fd) {
+    if (connection_attach_file(active_connection, file_fd, offset, length) !=
+        OK)
+      copy_file(client_fd, file_fd, offset, length);
+    return;
+  }
+  if (active_job && active_job->fd == client_fd) {
+    if (active_job->file_fd >= 0) {
+      copy_file(client_fd, file_fd, offset, length);
+      return;
+    }
+    active_job->file_fd = file_fd;
+    active_job->file_offset = offset;
+    active_job->file_length = length;
+    active_job->file_at = active_job->out_len;
+    return;
+  }
+
+#ifdef __linux__
+  while (length > 0) {
+    ssize_t n = sendfile(client_fd, file_fd, &offset, length);
+    if (n > 0) {
+      length -= (size_t)n;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      struct pollfd pfd = {.fd = client_fd, .events = POLLOUT};
+      poll(&pfd, 1, -1);
+    } else {
+      break;
+    }
+  }
+  if (length == 0) {
+    close(file_fd);
+    return;
+  }
+#endif
+  copy_file(client_fd, file_fd, offset, length);
+}
+
+Server *server_current(void) { return active_server; }
+
+size_t server_request_length(void) { return active_request_length; }
+
+Arena *server_request_arena(void) { return active_arena; }
+
+static Arena *connection_arena(Connection *conn) {
+  if (!conn->arena)
+    conn->arena = arena(0);
+  return conn->arena;
+}
+
+void server_stream_bodies(Server *server, const BodyStream *stream) {
+  if (!server)
+    return;
+  if (stream)
+    server->body_stream = *stream;
+  else
+    memset(&server->body_stream, 0, sizeof(server->body_stream));
+}
+
 Server *server(const char *host, int port) {
   Server *s = calloc(1, sizeof(Server));
   if (!s) {
@@ -39,39 +378,154 @@ Server *server(const char *host, int port) {
   }
   s->port = port;
   s->listen_fd = -1;
+  s->wake_fds[0] = s->wake_fds[1] = -1;
   s->running = false;
+  s->config.keep_alive_timeout_ms = DEFAULT_KEEP_ALIVE_TIMEOUT_MS;
+  s->config.keep_alive_max_requests = DEFAULT_KEEP_ALIVE_MAX_REQUESTS;
+  s->config.workers = 1;
+  s->config.handler_threads = 0;
+  s->config.handler_queue_size = DEFAULT_HANDLER_QUEUE_SIZE;
+  s->config.max_header_size = DEFAULT_MAX_HEADER_SIZE;
+  s->config.max_body_size = DEFAULT_MAX_BODY_SIZE;
+  s->config.header_timeout_ms = DEFAULT_HEADER_TIMEOUT_MS;
+  s->config.body_timeout_ms = DEFAULT_BODY_TIMEOUT_MS;
+  s->config.write_timeout_ms = DEFAULT_WRITE_TIMEOUT_MS;
   s->listen = server_listen_method;
   s->stop = server_stop_method;
 
   return s;
 }
 
+static bool config_backend(Value *options, bool *out_io_uring,
+                           char **error) {
+  Value *value = W->objectGetRef(options, "ioBackend");
+  if (!value)
+    return true;
+  const char *name = W->valueGetType(value) == VALUE_STRING
+                         ? W->valueAsString(value)
+                         : "";
+  if (strcmp(name, "io_uring") != 0 && strcmp(name, "epoll") != 0) {
+    asprintf(error,
+             "Server option 'ioBackend' must be \"io_uring\" or \"epoll\"");
+    return false;
+  }
+  *out_io_uring = strcmp(name, "io_uring") == 0;
+  return true;
+}
+
+static bool config_int(Value *options, const char *key, int min, int *out,
+                       char **error) {
+  Value *value = W->objectGetRef(options, key);
+  if (!value)
+    return true;
+  double number = W->valueAsNumber(value);
+  if (W->valueGetType(value) != VALUE_NUMBER || number < min ||
+      number > 2147483647.0) {
+    asprintf(error, "Server option '%s' must be a number >= %d", key, min);
+    return false;
+  }
+  *out = (int)number;
+  return true;
+}
+
+Status server_configure(Server *server, const char *options_json,
+                        char **error) {
+  if (!server || !options_json) {
+    asprintf(error, "Server and options are required");
+    return ERROR_INVALID_ARG;
+  }
+  if (server->running) {
+    asprintf(error, "Server options cannot change while it is listening");
+    return ERROR_INVALID_STATE;
+  }
+
+  Value *options = NULL;
+  char *parse_error = NULL;
+  Status status = W->json->parse(options_json, &options, &parse_error);
+  if (status != OK || W->valueGetType(options) != VALUE_OBJECT) {
+    asprintf(error, "Invalid server options: %s",
+             parse_error ? parse_error : "expected a JSON object");
+    if (parse_error)
+      W->freeString(parse_error);
+    if (options)
+      W->freeValue(options);
+    return ERROR_PARSE;
+  }
+
+  ServerConfig config = server->config;
+  bool valid =
+      config_int(options, "keepAliveTimeout", 0,
+                 &config.keep_alive_timeout_ms, error) &&
+      config_int(options, "keepAliveMaxRequests", 1,
+                 &config.keep_alive_max_requests, error) &&
+      config_int(options, "workers", 1, &config.workers, error) &&
+      config_int(options, "handlerThreads", 0, &config.handler_threads,
+                 error) &&
+      config_int(options, "handlerQueueSize", 1, &config.handler_queue_size,
+                 error) &&
+      config_int(options, "maxHeaderSize", 256, &config.max_header_size,
+                 error) &&
+      config_int(options, "maxBodySize", 0, &config.max_body_size, error) &&
+      config_int(options, "headerTimeout", 0, &config.header_timeout_ms,
+                 error) &&
+      config_int(options, "bodyTimeout", 0, &config.body_timeout_ms, error) &&
+      config_int(options, "writeTimeout", 0, &config.write_timeout_ms,
+                 error) &&
+      config_backend(options, &config.io_uring, error);
+  W->freeValue(options);
+  if (!valid)
+    return ERROR_INVALID_ARG;
+
+  server->config = config;
+  return OK;
+}
+
 static void server_stop_method(Server *self) {
   if (self) {
     self->running = false;
+    // Wake every worker so shutdown does not wait for a poll timeout. This is
+    // async-signal-safe, so stop may be called from a signal handler.
+    if (self->wake_fds[1] >= 0) {
+      ssize_t ignored = write(self->wake_fds[1], "x", 1);
+      (void)ignored;
+    }
   }
 }
 
+void server_stats(Server *server, ThreadPoolStats *out_stats) {
+  memset(out_stats, 0, sizeof(*out_stats));
+  if (server && server->handler_pool)
+    thread_pool_stats(server->handler_pool, out_stats);
+}
+
 void server_destroy(Server *server) {
   if (server) {
     if (server->listen_fd != -1) {
       close(server->listen_fd);
     }
+    thread_pool_free(server->handler_pool);
     free(server->host);
     free(server);
   }
 }
 
-static int setup_listen_socket(Server *self) {
-  self->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
-  if (self->listen_fd < 0) {
+static int open_listen_socket(Server *self, bool reuse_port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
     perror("socket");
     return -1;
   }
 
   int optval = 1;
-  setsockopt(self->listen_fd, SOL_SOCKET, SO_REUSEADDR, &optval,
-             sizeof(optval));
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+#ifdef SO_REUSEPORT
+  if (reuse_port &&
+      setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) < 0) {
+    perror("setsockopt(SO_REUSEPORT)");
+    close(fd);
+    return -1;
+  }
+#endif
 
   struct sockaddr_in server_addr;
   memset(&server_addr, 0, sizeof(server_addr));
@@ -79,216 +533,1210 @@ static int setup_listen_socket(Server *self) {
   server_addr.sin_port = htons(self->port);
   server_addr.sin_addr.s_addr = inet_addr(self->host);
 
-  if (bind(self->listen_fd, (struct sockaddr *)&server_addr,
-           sizeof(server_addr)) < 0) {
+  if (bind(fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
     perror("bind");
-    close(self->listen_fd);
+    close(fd);
     return -1;
   }
 
+  // Later shards must bind the port the kernel picked for the first one.
   if (self->port == 0) {
     socklen_t len = sizeof(server_addr);
-    if (getsockname(self->listen_fd, (struct sockaddr *)&server_addr, &len) ==
-        -1) {
+    if (getsockname(fd, (struct sockaddr *)&server_addr, &len) == -1) {
       perror("getsockname");
     } else {
       self->port = ntohs(server_addr.sin_port);
     }
   }
 
-  if (listen(self->listen_fd, SOMAXCONN) < 0) {
+  if (listen(fd, SOMAXCONN) < 0) {
     perror("listen");
-    close(self->listen_fd);
+    close(fd);
     return -1;
   }
-  return 0;
+  if (set_nonblocking(fd) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
 }
 
-static int server_listen_method(Server *self, RequestHandler handler) {
-  if (setup_listen_socket(self) != 0) {
-    return -1;
+static void end_stream(Server *self, Connection *conn, bool complete,
+                       bool keep_alive);
+
+// Ring operations are tagged with the address of their connection plus the
+// kind of operation. Operations on the worker's own descriptors use small
+// tags no connection address can produce.
+typedef enum { RING_RECV = 1, RING_SEND, RING_CLOSE, RING_POLL } RingOp;
+#define RING_OP_MASK 7
+enum { RING_ACCEPT = 1, RING_WAKE, RING_NOTIFY };
+
+static uint64_t ring_tag(Connection *conn, RingOp op) {
+  return (uint64_t)(uintptr_t)conn | op;
+}
+
+/**
+ * @brief Returns how much input a connection may buffer: a whole head and
+ * body, plus room for a partial chunk line.
+ */
+static size_t input_limit(const Server *self) {
+  return (size_t)self->config.max_header_size +
+         (size_t)self->config.max_body_size + CHUNK_LINE_SLACK;
+}
+
+/**
+ * @brief Frees a retired connection once no ring operation refers to it.
+ * The socket is closed through the ring as well, unless a close linked to
+ * the last send already did it.
+ */
+static void release_retired(ServerWorker *worker, Connection *conn) {
+  if (conn->ring_ops > 0)
+    return;
+  if (conn->prev)
+    conn->prev->next = conn->next;
+  else
+    worker->retired = conn->next;
+  if (conn->next)
+    conn->next->prev = conn->prev;
+  if (conn->fd >= 0 && io_ring_close(worker->ring, conn->fd, 0))
+    conn->fd = -1;
+  connection_free(conn);
+}
+
+/**
+ * @brief Closes a connection served by the ring. Its pending operations are
+ * cancelled, and it stays on the retired list until they complete.
+ */
+static void retire_connection(ServerWorker *worker, Connection *conn) {
+  conn->retired = true;
+  conn->state = CONN_CLOSING;
+  if (conn->recv_armed)
+    io_ring_cancel(worker->ring, ring_tag(conn, RING_RECV));
+  if (conn->send_armed)
+    io_ring_cancel(worker->ring, ring_tag(conn, RING_SEND));
+  if (conn->poll_armed)
+    io_ring_cancel(worker->ring, ring_tag(conn, RING_POLL));
+  conn->prev = NULL;
+  conn->next = worker->retired;
+  if (worker->retired)
+    worker->retired->prev = conn;
+  worker->retired = conn;
+  release_retired(worker, conn);
+}
+
+static void close_connection(ServerWorker *worker, Connection *conn) {
+  if (conn->body.streaming)
+    end_stream(worker->server, conn, false, false);
+  timer_cancel(worker->timers, &conn->timer);
+  if (conn->prev)
+    conn->prev->next = conn->next;
+  else
+    worker->connections = conn->next;
+  if (conn->next)
+    conn->next->prev = conn->prev;
+  if (worker->ring) {
+    retire_connection(worker, conn);
+    return;
   }
+  event_loop_remove(worker->loop, conn->fd);
+  connection_free(conn);
+}
 
-  nfds_t nfds = 1;
-  size_t poll_capacity = INITIAL_CLIENTS + 1;
-  struct pollfd *fds = calloc(poll_capacity, sizeof(struct pollfd));
-  if (!fds) {
-    perror("calloc for pollfd");
-    return -1;
+typedef enum {
+  DEADLINE_NONE,
+  DEADLINE_HEAD,  // Receiving a request head.
+  DEADLINE_BODY,  // Receiving a request body.
+  DEADLINE_IDLE,  // Waiting for the next request on a persistent connection.
+  DEADLINE_WRITE, // Waiting for the client to read a response.
+} Deadline;
+
+/**
+ * @brief Works out which deadline applies to a connection in its current
+ * state and when it falls. The head deadline runs from the first read of the
+ * head, so trickling bytes in does not extend it; the others run from the
+ * last socket activity.
+ */
+static Deadline connection_deadline(const ServerConfig *config,
+                                    Connection *conn, long long *deadline) {
+  Deadline kind;
+  int timeout_ms;
+  long long since = conn->last_active_ms;
+  if (conn->state == CONN_HANDLING) {
+    return DEADLINE_NONE;
+  } else if (connection_has_pending_output(conn)) {
+    kind = DEADLINE_WRITE;
+    timeout_ms = config->write_timeout_ms;
+  } else if (conn->body.active) {
+    kind = DEADLINE_BODY;
+    timeout_ms = config->body_timeout_ms;
+  } else if (conn->in_len == 0 && conn->requests_served > 0) {
+    kind = DEADLINE_IDLE;
+    timeout_ms = config->keep_alive_timeout_ms;
+  } else {
+    if (conn->head_started_ms == 0)
+      conn->head_started_ms = conn->last_active_ms;
+    kind = DEADLINE_HEAD;
+    timeout_ms = config->header_timeout_ms;
+    since = conn->head_started_ms;
   }
+  if (timeout_ms <= 0)
+    return DEADLINE_NONE;
+  *deadline = since + timeout_ms;
+  return kind;
+}
 
-  fds[0].fd = self->listen_fd;
-  fds[0].events = POLLIN;
-  self->running = true;
+/**
+ * @brief Arms the connection's timer for the phase it is in. A deadline that
+ * moves later leaves the timer where it is; it re-arms itself when it fires,
+ * so activity on a busy connection costs no wheel operations.
+ */
+static void schedule_deadline(ServerWorker *worker, Connection *conn) {
+  long long deadline;
+  if (connection_deadline(&worker->server->config, conn, &deadline) ==
+      DEADLINE_NONE) {
+    timer_cancel(worker->timers, &conn->timer);
+    return;
+  }
+  if (!conn->timer.armed || conn->timer.deadline_ms > deadline)
+    timer_arm(worker->timers, &conn->timer, deadline);
+}
 
-  printf("Listening on http://%s:%d\n", self->host, self->port);
-  fflush(stdout);
+/**
+ * @brief Sets the readiness events that wake a connection. On the ring this
+ * arms the connection's multishot receive while its buffer has room.
+ */
+static void watch_connection(ServerWorker *worker, Connection *conn,
+                             int events) {
+  if (!worker->ring) {
+    event_loop_modify(worker->loop, conn->fd, events, conn);
+    return;
+  }
+  if ((events & EVENT_READABLE) && !conn->recv_armed && !conn->read_closed &&
+      !conn->close_after_write && conn->in_len < input_limit(worker->server) &&
+      io_ring_recv(worker->ring, conn->fd, ring_tag(conn, RING_RECV))) {
+    conn->recv_armed = true;
+    conn->ring_ops++;
+  }
+}
 
-  while (self->running) {
-    int poll_count = poll(fds, nfds, 100);
-    if (poll_count < 0) {
+/**
+ * @brief Writes a connection's pending output. On the ring the bytes are
+ * lent to one asynchronous send, with the socket's close linked behind it
+ * when nothing else will be written. File bodies still go out through
+ * `connection_flush`, with a one-shot poll to wait for writability.
+ * @return As `connection_flush`; `IO_AGAIN` while a ring send is in flight.
+ */
+static IoResult flush_output(ServerWorker *worker, Connection *conn) {
+  if (!worker->ring)
+    return connection_flush(conn);
+  if (conn->ring_failed)
+    return IO_ERROR;
+  if (conn->send_armed || conn->poll_armed)
+    return IO_AGAIN;
+
+  const char *data;
+  size_t len = connection_begin_send(conn, &data);
+  if (len == 0) {
+    IoResult result = connection_flush(conn);
+    if (result == IO_AGAIN) {
+      if (!io_ring_poll(worker->ring, conn->fd, POLLOUT, false,
+                        ring_tag(conn, RING_POLL)))
+        return IO_ERROR;
+      conn->poll_armed = true;
+      conn->ring_ops++;
+    }
+    return result;
+  }
+
+  if (len > RING_SEND_MAX)
+    len = RING_SEND_MAX;
+  bool last = conn->close_after_write && len == connection_pending_output(conn);
+  if (!io_ring_send(worker->ring, conn->fd, data, len,
+                    ring_tag(conn, RING_SEND),
+                    last ? ring_tag(conn, RING_CLOSE) : 0))
+    return IO_ERROR;
+  conn->send_armed = true;
+  conn->ring_ops += last ? 2 : 1;
+  return IO_AGAIN;
+}
+
+/**
+ * @brief Starts serving a newly accepted socket.
+ */
+static void adopt_connection(ServerWorker *worker, int client_fd) {
+  Connection *conn = connection(client_fd);
+  if (!conn) {
+    close(client_fd);
+    return;
+  }
+  if (worker->ring) {
+    watch_connection(worker, conn, EVENT_READABLE);
+  } else if (event_loop_add(worker->loop, client_fd, EVENT_READABLE, conn) !=
+             OK) {
+    connection_free(conn);
+    return;
+  }
+  conn->next = worker->connections;
+  if (worker->connections)
+    worker->connections->prev = conn;
+  worker->connections = conn;
+  schedule_deadline(worker, conn);
+}
+
+static void accept_connections(ServerWorker *worker) {
+  for (;;) {
+    int client_fd = accept(worker->listen_fd, NULL, NULL);
+    if (client_fd < 0) {
       if (errno == EINTR)
         continue;
-      perror("poll");
-      break;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        perror("accept");
+      return;
     }
-    if (poll_count == 0)
+    if (set_nonblocking(client_fd) != 0) {
+      close(client_fd);
       continue;
+    }
+    adopt_connection(worker, client_fd);
+  }
+}
+
+static void queue_error_response(Connection *conn, const char *response) {
+  connection_queue(conn, response, strlen(response));
+  conn->close_after_write = true;
+}
+
+static bool header_has_token(const char *value, const char *value_end,
+                             const char *token) {
+  size_t token_len = strlen(token);
+  for (const char *p = value; p + token_len <= value_end; p++) {
+    if (strncasecmp(p, token, token_len) == 0)
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @struct ResponsePlan
+ * @brief What `plan_response` decided for a response head.
+ */
+typedef struct {
+  bool reuse;        // The connection may serve another request.
+  size_t insert_at;  // Where `header` goes: just past the status line.
+  char header[96];   // `Connection`/`Keep-Alive` headers to add.
+  int header_len;    // 0 when the handler chose `Connection` itself.
+} ResponsePlan;
+
+/**
+ * @brief Decides whether the connection survives the response whose head
+ * starts at `response`, and which `Connection`/`Keep-Alive` headers to add
+ * when the handler did not choose itself. A response can only be followed by
+ * another one if its length is self-delimiting.
+ * @param served The requests served on the connection, this one included.
+ * @return False if `response` does not start with a complete head.
+ */
+static bool plan_response(const Server *self, const char *response,
+                          size_t len, bool keep_alive, int served,
+                          ResponsePlan *plan) {
+  const char *head_end = len ? memmem(response, len, "\r\n\r\n", 4) : NULL;
+  const char *status_end = len ? memchr(response, '\r', len) : NULL;
+  if (!head_end || !status_end || status_end - response < 12)
+    return false;
 
-    if (fds[0].revents & POLLIN) {
-      int client_fd = accept(self->listen_fd, NULL, NULL);
-      if (client_fd >= 0) {
-        if (nfds == poll_capacity) {
-          poll_capacity *= 2;
-          struct pollfd *new_fds =
-              realloc(fds, poll_capacity * sizeof(struct pollfd));
-          if (!new_fds) {
-            perror("realloc for pollfd");
-            close(client_fd);
-          } else {
-            fds = new_fds;
-          }
-        }
-        if (nfds < poll_capacity) {
-          fds[nfds].fd = client_fd;
-          fds[nfds].events = POLLIN;
-          nfds++;
-        }
+  int status_code = atoi(response + 9);
+  bool delimited = status_code < 200 || status_code == 204 ||
+                   status_code == 304;
+  bool has_connection = false;
+  bool handler_close = false;
+
+  for (const char *line = status_end + 2; line < head_end;) {
+    const char *eol = memchr(line, '\r', (size_t)(head_end - line));
+    if (!eol)
+      eol = head_end;
+    const char *colon = memchr(line, ':', (size_t)(eol - line));
+    if (colon) {
+      size_t name_len = (size_t)(colon - line);
+      if (name_len == 14 && strncasecmp(line, "content-length", 14) == 0) {
+        delimited = true;
+      } else if (name_len == 17 &&
+                 strncasecmp(line, "transfer-encoding", 17) == 0) {
+        delimited |= header_has_token(colon + 1, eol, "chunked");
+      } else if (name_len == 10 && strncasecmp(line, "connection", 10) == 0) {
+        has_connection = true;
+        handler_close = header_has_token(colon + 1, eol, "close");
       }
     }
+    line = eol + 2;
+  }
 
-    for (nfds_t i = 1; i < nfds; i++) {
-      if (fds[i].revents & POLLIN) {
-        char *buffer = malloc(MAX_REQUEST_SIZE + 1);
-        if (!buffer) {
-          close(fds[i].fd);
-          fds[i] = fds[nfds - 1];
-          nfds--;
-          i--;
-          continue;
-        }
-
-        ssize_t bytes_read = read(fds[i].fd, buffer, MAX_REQUEST_SIZE);
-
-        if (bytes_read > 0) {
-          buffer[bytes_read] = '\0';
-          handler(fds[i].fd, buffer);
-        }
-
-        free(buffer);
-        close(fds[i].fd);
-        fds[i] = fds[nfds - 1];
-        nfds--;
-        i--;
-      }
+  const ServerConfig *config = &self->config;
+  plan->reuse = keep_alive && delimited && !handler_close &&
+                config->keep_alive_timeout_ms > 0 &&
+                served < config->keep_alive_max_requests;
+  plan->insert_at = (size_t)(status_end - response) + 2;
+  plan->header_len = 0;
+  if (!has_connection) {
+    if (plan->reuse) {
+      plan->header_len = snprintf(plan->header, sizeof(plan->header),
+                                  "Connection: keep-alive\r\n"
+                                  "Keep-Alive: timeout=%d, max=%d\r\n",
+                                  config->keep_alive_timeout_ms / 1000,
+                                  config->keep_alive_max_requests - served);
+    } else {
+      plan->header_len = snprintf(plan->header, sizeof(plan->header),
+                                  "Connection: close\r\n");
     }
   }
+  return true;
+}
+
+/**
+ * @brief Plans the response a handler just queued at `start` and adds the
+ * headers the plan calls for.
+ * @return Whether the connection survives the response.
+ */
+static bool finish_response(Server *self, Connection *conn, size_t start,
+                            bool keep_alive) {
+  ResponsePlan plan;
+  if (!plan_response(self, conn->out + start, conn->out_len - start,
+                     keep_alive, conn->requests_served, &plan))
+    return false;
+  connection_insert_output(conn, start + plan.insert_at, plan.header,
+                           (size_t)plan.header_len);
+  return plan.reuse;
+}
+
+/**
+ * @brief Sends output written on the readiness loop without queueing it
+ * first. The first write of a response must hold its whole head, which is
+ * planned here instead of after the handler returns; later writes go out
+ * directly while nothing is queued ahead of them. Output that could not be
+ * queued either closes the connection.
+ * @return False if the output must be queued instead.
+ */
+static bool send_direct(Connection *conn, const struct iovec *iov, int count) {
+  DirectResponse *direct = active_direct;
+  if (direct->sent) {
+    if (connection_sendv(conn, iov, count) != OK)
+      conn->state = CONN_CLOSING;
+    return true;
+  }
+  if (conn->out_len != direct->start || count < 1 || count > 16 ||
+      connection_has_pending_output(conn))
+    return false;
+
+  ResponsePlan plan;
+  if (!plan_response(active_server, iov[0].iov_base, iov[0].iov_len,
+                     direct->keep_alive, conn->requests_served + 1, &plan))
+    return false;
+  struct iovec segments[18];
+  segments[0] = (struct iovec){iov[0].iov_base, plan.insert_at};
+  segments[1] = (struct iovec){plan.header, (size_t)plan.header_len};
+  segments[2] = (struct iovec){(char *)iov[0].iov_base + plan.insert_at,
+                               iov[0].iov_len - plan.insert_at};
+  memcpy(segments + 3, iov + 1, sizeof(struct iovec) * (size_t)(count - 1));
+  direct->sent = true;
+  direct->reuse = plan.reuse;
+  if (connection_sendv(conn, segments, count + 2) != OK)
+    conn->state = CONN_CLOSING;
+  return true;
+}
 
-  for (nfds_t i = 1; i < nfds; i++) {
-    close(fds[i].fd);
+static void dispatch_request(Server *self, Connection *conn,
+                             const FramedRequest *request,
+                             RequestHandler handler, bool direct_send) {
+  char saved = conn->in[request->length];
+  conn->in[request->length] = '\0';
+  size_t response_start = conn->out_len;
+  DirectResponse direct = {.start = response_start,
+                           .keep_alive = request->keep_alive};
+
+  active_direct = direct_send ? &direct : NULL;
+  active_connection = conn;
+  active_server = self;
+  active_request_length = request->length;
+  active_arena = connection_arena(conn);
+  handler(conn->fd, conn->in);
+  active_direct = NULL;
+  active_connection = NULL;
+  active_server = NULL;
+  active_request_length = 0;
+  active_arena = NULL;
+  arena_reset(conn->arena);
+
+  conn->in[request->length] = saved;
+  connection_consume(conn, request->frame_length);
+  conn->head_started_ms = 0;
+  conn->requests_served++;
+  bool reuse = direct.sent ? direct.reuse
+                           : finish_response(self, conn, response_start,
+                                             request->keep_alive);
+  if (!reuse)
+    conn->close_after_write = true;
+}
+
+static void free_job(HandlerJob *job) {
+  if (job->file_fd >= 0)
+    close(job->file_fd);
+  free(job->out);
+  free(job);
+}
+
+static void notify_worker(ServerWorker *worker) {
+#ifdef __linux__
+  uint64_t one = 1;
+  ssize_t ignored = write(worker->notify_fds[1], &one, sizeof(one));
+#else
+  ssize_t ignored = write(worker->notify_fds[1], "x", 1);
+#endif
+  (void)ignored;
+}
+
+/**
+ * @brief Runs a queued request on a pool thread, then hands the response
+ * back to the worker that owns the connection.
+ */
+static void run_handler_job(void *arg) {
+  HandlerJob *job = arg;
+  ServerWorker *worker = job->worker;
+
+  active_job = job;
+  active_server = worker->server;
+  active_request_length = job->request_length;
+  active_arena = job->arena;
+  worker->handler(job->fd, job->request);
+  active_job = NULL;
+  active_server = NULL;
+  active_request_length = 0;
+  active_arena = NULL;
+
+  pthread_mutex_lock(&worker->completed_lock);
+  job->next = worker->completed;
+  worker->completed = job;
+  pthread_mutex_unlock(&worker->completed_lock);
+  notify_worker(worker);
+}
+
+/**
+ * @brief Hands the request at the head of the input buffer to the handler
+ * pool. The connection dispatches nothing else until the response is back,
+ * which keeps pipelined responses in order. A full queue is answered with
+ * 503 so load is shed instead of buffered.
+ */
+static void submit_request(ServerWorker *worker, Connection *conn,
+                           const FramedRequest *request) {
+  // The connection is idle until the job completes, so its arena can hold
+  // the request copy and everything the handler allocates.
+  HandlerJob *job = calloc(1, sizeof(HandlerJob));
+  Arena *arena = job ? connection_arena(conn) : NULL;
+  char *copy = arena ? arena_alloc(arena, request->length + 1) : NULL;
+  if (job) {
+    job->arena = arena;
+    job->file_fd = -1;
   }
-  free(fds);
-  close(self->listen_fd);
-  self->listen_fd = -1;
-  return 0;
+  if (copy) {
+    memcpy(copy, conn->in, request->length);
+    copy[request->length] = '\0';
+    job->worker = worker;
+    job->conn = conn;
+    job->fd = conn->fd;
+    job->keep_alive = request->keep_alive;
+    job->request = copy;
+    job->request_length = request->length;
+  }
+  connection_consume(conn, request->frame_length);
+  conn->head_started_ms = 0;
+
+  if (copy && thread_pool_submit(worker->server->handler_pool,
+                                 run_handler_job, job)) {
+    conn->state = CONN_HANDLING;
+    return;
+  }
+  if (job)
+    free_job(job);
+  arena_reset(arena);
+  queue_error_response(conn, "HTTP/1.1 503 Service Unavailable\r\n"
+                             "Content-Length: 0\r\n"
+                             "Retry-After: 1\r\n"
+                             "Connection: close\r\n\r\n");
 }
 
-static const char *get_mime_type(const char *path) {
-  const char *dot = strrchr(path, '.');
-  if (!dot || dot == path)
-    return "application/octet-stream";
-  if (strcmp(dot, ".html") == 0)
-    return "text/html";
-  if (strcmp(dot, ".css") == 0)
-    return "text/css";
-  if (strcmp(dot, ".js") == 0)
-    return "application/javascript";
-  return "application/octet-stream";
+/**
+ * @brief Queues the interim response a client sent `Expect: 100-continue`
+ * is waiting for before it uploads the body.
+ */
+static void send_continue(Connection *conn) {
+  if (!conn->body.expect_continue)
+    return;
+  conn->body.expect_continue = false;
+  static const char continue_response[] = "HTTP/1.1 100 Continue\r\n\r\n";
+  connection_queue(conn, continue_response, sizeof(continue_response) - 1);
 }
 
-int static_server_run(const char *host, int port, const char *public_dir) {
-  Server *s = server(host, port);
-  if (!s)
-    return 1;
+/**
+ * @brief Offers the body of the request whose head was just framed to the
+ * server's `BodyStream`. The head is consumed if the stream takes the body.
+ */
+static void begin_stream(Server *self, Connection *conn,
+                         const FramedRequest *request) {
+  char saved = conn->in[request->head_length];
+  conn->in[request->head_length] = '\0';
+  active_connection = conn;
+  active_server = self;
+  void *state = NULL;
+  bool streaming = self->body_stream.begin(conn->fd, conn->in, &state);
+  active_connection = NULL;
+  active_server = NULL;
+  conn->in[request->head_length] = saved;
+  conn->head_started_ms = 0;
 
-  if (setup_listen_socket(s) != 0) {
-    server_destroy(s);
-    return 1;
+  if (streaming) {
+    conn->body_state = state;
+    connection_begin_stream(conn);
   }
+}
 
-  printf("Listening on http://%s:%d\n", s->host, s->port);
-  fflush(stdout);
+/**
+ * @brief Finishes a streamed body: lets the stream write its response and
+ * decides whether the connection survives it. An unfinished body leaves the
+ * input out of sync, so the connection is closed after the response.
+ */
+static void end_stream(Server *self, Connection *conn, bool complete,
+                       bool keep_alive) {
+  void *state = conn->body_state;
+  conn->body_state = NULL;
+  memset(&conn->body, 0, sizeof(conn->body));
 
-  s->running = true;
-  while (s->running) {
-    int client_fd = accept(s->listen_fd, NULL, NULL);
-    if (client_fd < 0) {
-      if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+  size_t response_start = conn->out_len;
+  active_connection = conn;
+  active_server = self;
+  self->body_stream.end(conn->fd, state, complete);
+  active_connection = NULL;
+  active_server = NULL;
+
+  conn->requests_served++;
+  if (!finish_response(self, conn, response_start, complete && keep_alive))
+    conn->close_after_write = true;
+}
+
+/**
+ * @brief Passes the buffered part of a streamed body to the stream and
+ * consumes it. Returns true if any input was consumed.
+ */
+static bool stream_body(Server *self, Connection *conn) {
+  bool keep_alive = conn->body.keep_alive;
+  const char *data;
+  size_t len, consumed;
+  RequestFrame frame = connection_stream_body(conn, &data, &len, &consumed);
+
+  bool accepted = true;
+  if (len > 0) {
+    active_connection = conn;
+    active_server = self;
+    accepted = self->body_stream.data(conn->body_state, data, len);
+    active_connection = NULL;
+    active_server = NULL;
+  }
+  connection_consume(conn, consumed);
+
+  if (frame == FRAME_INCOMPLETE && accepted) {
+    send_continue(conn);
+    return consumed > 0;
+  }
+  if (frame == FRAME_COMPLETE && accepted) {
+    end_stream(self, conn, true, keep_alive);
+    return true;
+  }
+  size_t response_start = conn->out_len;
+  end_stream(self, conn, false, false);
+  if (conn->out_len == response_start) {
+    queue_error_response(conn, frame == FRAME_INVALID
+                                   ? "HTTP/1.1 400 Bad Request\r\n"
+                                     "Content-Length: 0\r\n"
+                                     "Connection: close\r\n\r\n"
+                                   : "HTTP/1.1 413 Payload Too Large\r\n"
+                                     "Content-Length: 0\r\n"
+                                     "Connection: close\r\n\r\n");
+  }
+  conn->close_after_write = true;
+  return true;
+}
+
+/**
+ * @brief Advances a connection's state machine after a readiness event: reads
+ * what is available, dispatches every complete (possibly pipelined) request
+ * in the buffer, and flushes the queued responses in order.
+ */
+static void service_connection(ServerWorker *worker, Connection *conn) {
+  Server *self = worker->server;
+  // Events for a connection whose request is on the pool are picked up when
+  // the response comes back.
+  if (conn->state == CONN_HANDLING)
+    return;
+
+  RequestLimits limits = {
+      .max_head = (size_t)self->config.max_header_size,
+      .max_body = (size_t)self->config.max_body_size,
+      .report_head = self->body_stream.begin != NULL,
+  };
+  size_t fill_limit = input_limit(self);
+
+  bool progressed = true;
+  while (progressed && conn->state != CONN_CLOSING) {
+    progressed = false;
+
+    // Readiness is edge-triggered, so a read cut short by the buffer limit
+    // must be resumed here once framing has made room. On the ring, input is
+    // appended as receives complete instead.
+    bool read_limited = false;
+    if (!worker->ring && !conn->close_after_write && !conn->read_closed) {
+      IoResult read_result = connection_fill(conn, fill_limit);
+      read_limited = read_result == IO_DONE;
+      if (read_result == IO_EOF)
+        conn->read_closed = true;
+      else if (read_result == IO_ERROR)
+        conn->state = CONN_CLOSING;
+    }
+
+    // A response with a file body is flushed before the next request runs,
+    // so every response gets its own zero-copy send.
+    while (conn->state != CONN_CLOSING && conn->state != CONN_HANDLING &&
+           !conn->close_after_write && !connection_has_file(conn) &&
+           connection_pending_output(conn) < OUTPUT_HIGH_WATER) {
+      if (conn->body.streaming) {
+        if (stream_body(self, conn))
+          progressed = true;
+        if (conn->body.streaming)
+          break;
         continue;
+      }
+      FramedRequest request;
+      RequestFrame frame = connection_frame_request(conn, &limits, &request);
+      if (frame == FRAME_HEAD) {
+        begin_stream(self, conn, &request);
+        progressed = true;
+        if (!conn->body.streaming)
+          send_continue(conn);
+      } else if (frame == FRAME_COMPLETE) {
+        if (self->handler_pool)
+          submit_request(worker, conn, &request);
+        else
+          dispatch_request(self, conn, &request, worker->handler,
+                           !worker->ring);
+        progressed = true;
+      } else if (frame == FRAME_TOO_LARGE) {
+        queue_error_response(conn, "HTTP/1.1 413 Payload Too Large\r\n"
+                                   "Content-Length: 0\r\n"
+                                   "Connection: close\r\n\r\n");
+      } else if (frame == FRAME_INVALID) {
+        queue_error_response(conn, "HTTP/1.1 400 Bad Request\r\n"
+                                   "Content-Length: 0\r\n"
+                                   "Connection: close\r\n\r\n");
+      } else {
+        send_continue(conn);
+        break;
+      }
+    }
+    if (conn->state == CONN_CLOSING)
+      break;
+    if (read_limited && conn->in_len < fill_limit)
+      progressed = true;
+    if (conn->state == CONN_HANDLING) {
+      // Send earlier pipelined responses while the handler runs; anything
+      // left over is flushed when the job completes.
+      if (connection_has_pending_output(conn))
+        flush_output(worker, conn);
+      timer_cancel(worker->timers, &conn->timer);
+      watch_connection(worker, conn, 0);
+      return;
+    }
+
+    if (connection_has_pending_output(conn)) {
+      conn->state = CONN_WRITING;
+      IoResult write_result = flush_output(worker, conn);
+      if (write_result == IO_AGAIN) {
+        schedule_deadline(worker, conn);
+        watch_connection(worker, conn, EVENT_READABLE | EVENT_WRITABLE);
+        return;
+      }
+      if (write_result == IO_ERROR) {
+        conn->state = CONN_CLOSING;
+        break;
+      }
+      conn->state = CONN_READING;
+      // Requests held back by the output high-water mark can run now.
+      if (conn->in_len > 0)
+        progressed = true;
+    }
+
+    if (conn->close_after_write || (conn->read_closed && !progressed))
+      conn->state = CONN_CLOSING;
+  }
+
+  if (conn->state == CONN_CLOSING) {
+    close_connection(worker, conn);
+    return;
+  }
+  schedule_deadline(worker, conn);
+  watch_connection(worker, conn, EVENT_READABLE);
+}
+
+/**
+ * @brief Writes the responses of finished pool jobs to their connections and
+ * resumes each connection's state machine.
+ */
+static void complete_jobs(ServerWorker *worker) {
+#ifdef __linux__
+  uint64_t count;
+  while (read(worker->notify_fds[0], &count, sizeof(count)) > 0)
+    ;
+#else
+  char drain[64];
+  while (read(worker->notify_fds[0], drain, sizeof(drain)) > 0)
+    ;
+#endif
+
+  pthread_mutex_lock(&worker->completed_lock);
+  HandlerJob *job = worker->completed;
+  worker->completed = NULL;
+  pthread_mutex_unlock(&worker->completed_lock);
+
+  while (job) {
+    HandlerJob *next = job->next;
+    Connection *conn = job->conn;
+    size_t response_start = conn->out_len;
+    if (job->file_fd >= 0) {
+      connection_queue(conn, job->out, job->file_at);
+      if (connection_attach_file(conn, job->file_fd, job->file_offset,
+                                 job->file_length) == OK)
+        job->file_fd = -1;
+      connection_queue(conn, job->out + job->file_at,
+                       job->out_len - job->file_at);
+    } else {
+      connection_queue(conn, job->out, job->out_len);
+    }
+    conn->requests_served++;
+    if (!finish_response(worker->server, conn, response_start,
+                         job->keep_alive))
+      conn->close_after_write = true;
+    conn->state = CONN_READING;
+    free_job(job);
+    arena_reset(conn->arena);
+    service_connection(worker, conn);
+    job = next;
+  }
+}
+
+/**
+ * @brief Enforces a connection's deadline when its timer fires. Deadlines
+ * that moved later since the timer was armed just re-arm it. A client that
+ * stalls mid-request is told why with 408, best effort, since it is not
+ * keeping up anyway: the response gets the write deadline and no more.
+ * Idle and unread connections are simply closed.
+ */
+static void expire_connection(Timer *timer, void *context) {
+  ServerWorker *worker = context;
+  Connection *conn =
+      (Connection *)((char *)timer - offsetof(Connection, timer));
+  long long deadline;
+  Deadline kind =
+      connection_deadline(&worker->server->config, conn, &deadline);
+  if (kind == DEADLINE_NONE)
+    return;
+  if (deadline > connection_now_ms()) {
+    timer_arm(worker->timers, timer, deadline);
+    return;
+  }
+  if (kind == DEADLINE_BODY || (kind == DEADLINE_HEAD && conn->in_len > 0)) {
+    queue_error_response(conn, "HTTP/1.1 408 Request Timeout\r\n"
+                               "Content-Length: 0\r\n"
+                               "Connection: close\r\n\r\n");
+    // On the ring it goes out like any last response, with the close linked
+    // behind its send; closing now would cancel the send.
+    if (worker->ring) {
+      service_connection(worker, conn);
+      return;
+    }
+    connection_flush(conn);
+  }
+  close_connection(worker, conn);
+}
+
+/**
+ * @brief Applies the completion of one operation on a worker's ring.
+ */
+static void ring_complete(ServerWorker *worker, const IoCompletion *done) {
+  IoRing *ring = worker->ring;
+  if (done->tag == RING_ACCEPT) {
+    if (done->result >= 0) {
+      if (worker->server->running)
+        adopt_connection(worker, done->result);
+      else
+        close(done->result);
+    } else if (done->result != -EAGAIN && done->result != -EINTR &&
+               done->result != -ECONNABORTED) {
+      errno = -done->result;
       perror("accept");
+    }
+    if (!done->more && done->result != -EBADF && done->result != -EINVAL)
+      io_ring_accept(ring, worker->listen_fd, RING_ACCEPT);
+    return;
+  }
+  if (done->tag == RING_WAKE)
+    return; // Woken by Server::stop; the loop condition handles it.
+  if (done->tag == RING_NOTIFY) {
+    complete_jobs(worker);
+    if (!done->more)
+      io_ring_poll(ring, worker->notify_fds[0], POLLIN, true, RING_NOTIFY);
+    return;
+  }
+
+  Connection *conn =
+      (Connection *)(uintptr_t)(done->tag & ~(uint64_t)RING_OP_MASK);
+  switch ((RingOp)(done->tag & RING_OP_MASK)) {
+  case RING_RECV:
+    if (done->buffer >= 0) {
+      if (done->result > 0 && !conn->retired &&
+          connection_receive(conn, io_ring_buffer(ring, done->buffer),
+                             (size_t)done->result) != OK)
+        conn->read_closed = true;
+      io_ring_recycle(ring, done->buffer);
+    }
+    if (!done->more) {
+      conn->recv_armed = false;
+      conn->ring_ops--;
+    }
+    if (conn->retired)
+      break;
+    // Running out of provided buffers or being cancelled at the input limit
+    // only disarms the receive; `watch_connection` re-arms it.
+    if (done->result == 0 || (done->result < 0 && done->result != -ENOBUFS &&
+                              done->result != -ECANCELED))
+      conn->read_closed = true;
+    else if (conn->recv_armed &&
+             conn->in_len >= input_limit(worker->server))
+      io_ring_cancel(ring, ring_tag(conn, RING_RECV));
+    service_connection(worker, conn);
+    return;
+  case RING_SEND:
+    conn->send_armed = false;
+    conn->ring_ops--;
+    if (done->result > 0)
+      connection_end_send(conn, (size_t)done->result);
+    if (conn->retired)
+      break;
+    if (done->result < 0)
+      conn->ring_failed = true;
+    service_connection(worker, conn);
+    return;
+  case RING_CLOSE:
+    conn->ring_ops--;
+    if (done->result == 0)
+      conn->fd = -1;
+    break;
+  case RING_POLL:
+    conn->poll_armed = false;
+    conn->ring_ops--;
+    if (conn->retired)
+      break;
+    service_connection(worker, conn);
+    return;
+  }
+  if (conn->retired)
+    release_retired(worker, conn);
+}
+
+/**
+ * @brief Moves a worker onto io_uring: creates the ring on the worker's own
+ * thread, which is the only one allowed to submit to it, and arms accept and
+ * the wake-ups. Returns false, and the worker keeps its readiness loop, if
+ * the kernel lacks support.
+ */
+static bool start_ring(ServerWorker *worker) {
+  Server *self = worker->server;
+  worker->ring = io_ring(RING_ENTRIES, RING_BUFFERS, RING_BUFFER_SIZE);
+  if (worker->ring &&
+      io_ring_accept(worker->ring, worker->listen_fd, RING_ACCEPT) &&
+      io_ring_poll(worker->ring, self->wake_fds[0], POLLIN, true, RING_WAKE) &&
+      (worker->notify_fds[0] < 0 ||
+       io_ring_poll(worker->ring, worker->notify_fds[0], POLLIN, true,
+                    RING_NOTIFY)))
+    return true;
+  fprintf(stderr, "io_uring unavailable (%s), using %s\n", strerror(errno),
+          event_loop_backend(worker->loop));
+  io_ring_free(worker->ring);
+  worker->ring = NULL;
+  return false;
+}
+
+/**
+ * @brief Closes every connection of a stopped worker. A handler still on the
+ * pool reads its request from, and allocates in, its connection's arena, so
+ * the pool is drained first; those responses are dropped.
+ */
+static void close_connections(ServerWorker *worker) {
+  if (worker->server->handler_pool)
+    thread_pool_wait_idle(worker->server->handler_pool);
+  while (worker->connections)
+    close_connection(worker, worker->connections);
+}
+
+/**
+ * @brief Runs a worker on its ring until the server is stopped. Socket
+ * operations are queued on the ring and submitted together with the wait for
+ * completions, so a request costs no system calls of its own.
+ */
+static void run_ring(ServerWorker *worker) {
+  Server *self = worker->server;
+  IoCompletion done[MAX_EVENTS];
+
+  while (self->running) {
+    int timeout_ms = timer_wheel_timeout(worker->timers, connection_now_ms());
+    int count = io_ring_wait(worker->ring, done, MAX_EVENTS, timeout_ms);
+    if (count < 0) {
+      worker->result = -1;
+      break;
+    }
+    for (int i = 0; i < count; i++)
+      ring_complete(worker, &done[i]);
+    timer_wheel_advance(worker->timers, connection_now_ms(),
+                        expire_connection, worker);
+  }
+
+  // Let the cancelled operations finish so their connections can be freed;
+  // whatever is left is freed with the ring.
+  close_connections(worker);
+  for (int i = 0; worker->retired && i < RING_DRAIN_ATTEMPTS; i++) {
+    int count = io_ring_wait(worker->ring, done, MAX_EVENTS, 10);
+    if (count < 0)
+      break;
+    for (int j = 0; j < count; j++)
+      ring_complete(worker, &done[j]);
+  }
+  io_ring_wait(worker->ring, done, MAX_EVENTS, 0);
+}
+
+/**
+ * @brief Runs one worker's event loop until the server is stopped. Each
+ * worker owns its listening socket, its loop and its connections, so workers
+ * share nothing but the `Server` configuration and the wake pipe.
+ */
+static void *run_worker(void *arg) {
+  ServerWorker *worker = arg;
+  Server *self = worker->server;
+  LoopEvent events[MAX_EVENTS];
+
+  if (self->config.io_uring && start_ring(worker)) {
+    run_ring(worker);
+    return NULL;
+  }
+
+  while (self->running) {
+    int timeout_ms = timer_wheel_timeout(worker->timers, connection_now_ms());
+    int count = event_loop_wait(worker->loop, events, MAX_EVENTS, timeout_ms);
+    if (count < 0) {
+      worker->result = -1;
       break;
     }
 
-    char buffer[MAX_REQUEST_SIZE];
-    ssize_t bytes_read = read(client_fd, buffer, sizeof(buffer) - 1);
-
-    if (bytes_read > 0) {
-      buffer[bytes_read] = '\0';
-
-      char *line_saveptr;
-      char *line = strtok_r(buffer, "\r\n", &line_saveptr);
-      if (line) {
-        char *method = line;
-        char *req_path = strchr(method, ' ');
-        if (req_path) {
-          *req_path = '\0';
-          req_path++;
-          char *version = strchr(req_path, ' ');
-          if (version)
-            *version = '\0';
-
-          if (strstr(req_path, "..")) {
-            const char *resp = "HTTP/1.1 400 Bad Request\r\n\r\nInvalid Path";
-            write(client_fd, resp, strlen(resp));
-          } else {
-            char file_path[1024];
-            const char *req_file =
-                (strcmp(req_path, "/") == 0) ? "/index.html" : req_path;
-            snprintf(file_path, sizeof(file_path), "%s%s", public_dir,
-                     req_file);
-
-            char *content = NULL;
-            char *read_error = NULL;
-            Status status = W->fs->readFile(file_path, &content, &read_error);
-
-            if (status == OK && content) {
-              const char *mime = get_mime_type(file_path);
-              char header[512];
-              int header_len = snprintf(
-                  header, sizeof(header),
-                  "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: "
-                  "%zu\r\nConnection: close\r\n\r\n",
-                  mime, strlen(content));
-              write(client_fd, header, header_len);
-              write(client_fd, content, strlen(content));
-              W->freeString(content);
-            } else {
-              const char *resp = "HTTP/1.1 404 Not Found\r\n\r\nNot Found";
-              write(client_fd, resp, strlen(resp));
-              if (content) {
-                W->freeString(content);
-              }
-              if (read_error) {
-                W->freeString(read_error);
-              }
-            }
-          }
-        }
+    for (int i = 0; i < count; i++) {
+      if (events[i].data == worker) {
+        accept_connections(worker);
+      } else if (events[i].data == &worker->completed) {
+        complete_jobs(worker);
+      } else if (events[i].data == self) {
+        continue; // Woken by Server::stop; the loop condition handles it.
+      } else {
+        service_connection(worker, events[i].data);
       }
     }
-    close(client_fd);
+
+    timer_wheel_advance(worker->timers, connection_now_ms(),
+                        expire_connection, worker);
   }
 
-  server_destroy(s);
+  close_connections(worker);
+  return NULL;
+}
+
+static void release_workers(Server *self, ServerWorker *workers, int count) {
+  // Jobs still on the pool point at their worker, so let them finish first.
+  if (self->handler_pool)
+    thread_pool_wait_idle(self->handler_pool);
+
+  for (int i = 0; i < count; i++) {
+    ServerWorker *worker = &workers[i];
+    if (worker->loop)
+      event_loop_free(worker->loop);
+    if (worker->timers)
+      timer_wheel_free(worker->timers);
+    if (worker->ring)
+      io_ring_free(worker->ring);
+    while (worker->retired) {
+      Connection *next = worker->retired->next;
+      connection_free(worker->retired);
+      worker->retired = next;
+    }
+    if (worker->listen_fd >= 0 && worker->listen_fd != self->listen_fd)
+      close(worker->listen_fd);
+    while (worker->completed) {
+      HandlerJob *next = worker->completed->next;
+      free_job(worker->completed);
+      worker->completed = next;
+    }
+    if (worker->notify_fds[0] >= 0)
+      close(worker->notify_fds[0]);
+    if (worker->notify_fds[1] >= 0 &&
+        worker->notify_fds[1] != worker->notify_fds[0])
+      close(worker->notify_fds[1]);
+    pthread_mutex_destroy(&worker->completed_lock);
+  }
+  free(workers);
+  if (self->listen_fd >= 0)
+    close(self->listen_fd);
+  self->listen_fd = -1;
+  for (int i = 0; i < 2; i++) {
+    if (self->wake_fds[i] >= 0)
+      close(self->wake_fds[i]);
+    self->wake_fds[i] = -1;
+  }
+}
+
+/**
+ * @brief Creates the handler pool on first listen, or recreates it when the
+ * configured thread count changed. The pool outlives `listen` so its
+ * counters stay readable through `server_stats`.
+ */
+static int prepare_handler_pool(Server *self) {
+  const ServerConfig *config = &self->config;
+  if (self->handler_pool) {
+    ThreadPoolStats stats;
+    thread_pool_stats(self->handler_pool, &stats);
+    if ((int)stats.threads == config->handler_threads &&
+        (int)stats.queue_capacity == config->handler_queue_size)
+      return 0;
+    thread_pool_free(self->handler_pool);
+    self->handler_pool = NULL;
+  }
+  if (config->handler_threads <= 0)
+    return 0;
+  self->handler_pool =
+      thread_pool(config->handler_threads, (size_t)config->handler_queue_size);
+  if (!self->handler_pool) {
+    fprintf(stderr, "Failed to start %d handler threads\n",
+            config->handler_threads);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Opens the descriptor pool threads use to wake the worker: an
+ * eventfd on Linux, a pipe elsewhere.
+ */
+static int open_notify_fds(ServerWorker *worker) {
+#ifdef __linux__
+  int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd < 0) {
+    perror("eventfd");
+    return -1;
+  }
+  worker->notify_fds[0] = worker->notify_fds[1] = fd;
+#else
+  if (pipe(worker->notify_fds) != 0) {
+    perror("pipe");
+    worker->notify_fds[0] = worker->notify_fds[1] = -1;
+    return -1;
+  }
+  set_nonblocking(worker->notify_fds[0]);
+  set_nonblocking(worker->notify_fds[1]);
+#endif
+  if (event_loop_add(worker->loop, worker->notify_fds[0], EVENT_READABLE,
+                     &worker->completed) != OK)
+    return -1;
   return 0;
 }
+
+static int server_listen_method(Server *self, RequestHandler handler) {
+  int worker_count = self->config.workers > 0 ? self->config.workers : 1;
+  ServerWorker *workers = calloc(worker_count, sizeof(ServerWorker));
+  if (!workers) {
+    perror("calloc for workers");
+    return -1;
+  }
+  for (int i = 0; i < worker_count; i++) {
+    workers[i].listen_fd = -1;
+    workers[i].notify_fds[0] = workers[i].notify_fds[1] = -1;
+    pthread_mutex_init(&workers[i].completed_lock, NULL);
+  }
+
+  if (pipe(self->wake_fds) != 0) {
+    perror("pipe");
+    self->wake_fds[0] = self->wake_fds[1] = -1;
+    release_workers(self, workers, worker_count);
+    return -1;
+  }
+  set_nonblocking(self->wake_fds[0]);
+  set_nonblocking(self->wake_fds[1]);
+
+  if (prepare_handler_pool(self) != 0) {
+    release_workers(self, workers, worker_count);
+    return -1;
+  }
+
+  // On Linux every worker binds its own SO_REUSEPORT socket and the kernel
+  // spreads incoming connections across them. Elsewhere the workers share a
+  // single listening socket.
+#ifdef __linux__
+  bool sharded = worker_count > 1;
+#else
+  bool sharded = false;
+#endif
+
+  for (int i = 0; i < worker_count; i++) {
+    ServerWorker *worker = &workers[i];
+    worker->server = self;
+    worker->handler = handler;
+    worker->listen_fd =
+        (i == 0 || sharded) ? open_listen_socket(self, sharded)
+                            : self->listen_fd;
+    if (i == 0)
+      self->listen_fd = worker->listen_fd;
+    worker->loop = event_loop();
+    worker->timers = timer_wheel(connection_now_ms(), TIMER_TICK_MS);
+    if (worker->listen_fd < 0 || !worker->loop || !worker->timers ||
+        event_loop_add(worker->loop, worker->listen_fd, EVENT_READABLE,
+                       worker) != OK ||
+        event_loop_add(worker->loop, self->wake_fds[0], EVENT_READABLE,
+                       self) != OK ||
+        (self->handler_pool && open_notify_fds(worker) != 0)) {
+      release_workers(self, workers, worker_count);
+      return -1;
+    }
+  }
+  self->running = true;
+
+  printf("Listening on http://%s:%d\n", self->host, self->port);
+  fflush(stdout);
+
+  int started = 1;
+  for (; started < worker_count; started++) {
+    if (pthread_create(&workers[started].thread, NULL, run_worker,
+                       &workers[started]) != 0) {
+      perror("pthread_create");
+      break;
+    }
+  }
+
+  run_worker(&workers[0]);
+  self->running = false;
+  int result = workers[0].result;
+  for (int i = 1; i < started; i++) {
+    pthread_join(workers[i].thread, NULL);
+    if (workers[i].result != 0)
+      result = workers[i].result;
+  }
+
+  release_workers(self, workers, worker_count);
+  return result;
+}
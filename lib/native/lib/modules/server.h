@@ -3,13 +3,46 @@
  * @brief Defines the core HTTP server implementation.
  *
  * This module provides the structures and functions needed to create, run,
- * and manage a simple, multi-client HTTP server.
+ * and manage a multi-client HTTP server. Connections are non-blocking and
+ * driven by an event loop (see `event_loop.h`), with each request framed from
+ * partial reads and each response flushed across partial writes.
+ *
+ * Connections are persistent (HTTP/1.1 keep-alive) whenever both the request
+ * and the handler's response allow it, and pipelined requests are served in
+ * order from the same read buffer. Each connection carries one deadline for
+ * the phase it is in (receiving a head, receiving a body, idling between
+ * requests, or waiting for the client to read), kept on a per-worker timer
+ * wheel (see `timer_wheel.h`). On Linux a worker may instead run on io_uring
+ * (see `io_ring.h` and the `ioBackend` option), which removes the per-request
+ * read, write and close system calls.
+ *
+ * A server may run several workers, each with its own event loop on its own
+ * thread. On Linux every worker accepts from a private `SO_REUSEPORT` socket
+ * so the kernel balances connections across cores without a shared accept
+ * lock; elsewhere the workers share one listening socket. Handlers must be
+ * thread-safe when more than one worker is configured.
+ *
+ * Handlers normally run on the worker's I/O thread. With `handlerThreads`
+ * configured they run on a shared thread pool instead: the request is queued,
+ * the connection waits without blocking its loop, and the pool signals the
+ * worker when the response is ready to be written.
+ *
+ * Request bodies may be sent with `Content-Length` or chunked transfer
+ * coding. Bodies up to `maxBodySize` are buffered and handed to the handler
+ * with the request, which is then always Content-Length delimited; larger
+ * uploads can be consumed piece by piece through a `BodyStream`.
  */
 
 #ifndef SERVER_H
 #define SERVER_H
 
+#include "../core/arena.h"
+#include "../core/error.h"
+#include "thread_pool.h"
 #include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 typedef struct Server Server;
 
@@ -20,6 +53,53 @@ typedef struct Server Server;
  */
 typedef void (*RequestHandler)(int client_fd, const char *request);
 
+/**
+ * @struct BodyStream
+ * @brief Callbacks that consume request bodies as they arrive instead of
+ * buffering them. They run on the worker's I/O thread, even when handler
+ * threads are configured, and may write the response with `server_write`.
+ */
+typedef struct BodyStream {
+  /**
+   * Called once the head of a request with a body has arrived. `head` is
+   * the NUL-terminated request line and headers. Return true (optionally
+   * setting `*state`) to stream the body, or false to buffer it and call the
+   * `RequestHandler` as usual.
+   */
+  bool (*begin)(int client_fd, const char *head, void **state);
+  /**
+   * Called with each piece of the decoded body. Return false to refuse the
+   * rest of it; `end` is then called with `complete` false.
+   */
+  bool (*data)(void *state, const char *data, size_t len);
+  /**
+   * Called once when the body has ended (`complete` true) or was cut short
+   * by a refusal, malformed framing or a closed connection. The response to
+   * the request is written here; `state` is not used again.
+   */
+  void (*end)(int client_fd, void *state, bool complete);
+} BodyStream;
+
+/**
+ * @struct ServerConfig
+ * @brief Tunable behaviour of a server, set through `server_configure`.
+ */
+typedef struct {
+  int keep_alive_timeout_ms;   ///< Idle time before a persistent connection
+                               ///< is closed. 0 disables keep-alive.
+  int keep_alive_max_requests; ///< Requests served on one connection before
+                               ///< it is closed.
+  int workers;                 ///< Event loop threads serving connections.
+  int handler_threads;    ///< Threads running handlers; 0 runs them inline.
+  int handler_queue_size; ///< Requests that may wait for a handler thread.
+  int max_header_size;    ///< Largest request line plus headers, in bytes.
+  int max_body_size;      ///< Largest buffered request body, in bytes.
+  int header_timeout_ms;  ///< Time allowed to receive a request head.
+  int body_timeout_ms;    ///< Longest pause while receiving a body.
+  int write_timeout_ms;   ///< Longest pause while a client reads a response.
+  bool io_uring;          ///< Run workers on io_uring where supported.
+} ServerConfig;
+
 /**
  * @struct Server
  * @brief Represents an instance of the HTTP server.
@@ -29,6 +109,11 @@ struct Server {
   int port;
   char *host;
   volatile bool running;
+  ServerConfig config;
+  void *context; // Opaque data for built-in handlers (e.g. the static root).
+  int wake_fds[2]; // Self-pipe that wakes every worker when stopped.
+  ThreadPool *handler_pool; // Created by listen when handler_threads > 0.
+  BodyStream body_stream;   // Set by server_stream_bodies; begin may be NULL.
   int (*listen)(Server *self, RequestHandler handler);
   void (*stop)(Server *self);
 };
@@ -41,6 +126,75 @@ struct Server {
  */
 Server *server(const char *host, int port);
 
+/**
+ * @brief Applies options to a server that is not yet listening.
+ *
+ * Recognised keys: `keepAliveTimeout` (milliseconds, 0 disables keep-alive),
+ * `keepAliveMaxRequests`, `workers` (number of event loop threads, default
+ * 1), `handlerThreads` (threads running the handler off the event loops,
+ * default 0), `handlerQueueSize` (requests that may wait for a handler
+ * thread before new ones are answered with 503), `maxHeaderSize` (bytes of
+ * request line and headers, default 8192) and `maxBodySize` (bytes of
+ * buffered body, default 1MB; larger requests are answered with 413).
+ *
+ * Slow clients are bounded by `headerTimeout` (milliseconds to deliver a
+ * whole request head, default 10000), `bodyTimeout` (longest pause between
+ * body reads, default 30000) and `writeTimeout` (longest pause while the
+ * client reads a response, default 30000); 0 disables a timeout. A client
+ * that misses a read deadline gets 408 and is disconnected.
+ *
+ * `ioBackend` selects how workers drive their sockets: "epoll" (the default;
+ * a readiness loop, `poll()` outside Linux) or "io_uring", which queues
+ * accepts, receives into shared buffers, sends and closes on a completion
+ * ring (Linux 6.1 or later). A worker whose kernel refuses io_uring logs it
+ * and falls back to the readiness loop.
+ * Unknown keys are ignored.
+ * @param server The server to configure.
+ * @param options_json A JSON object of options.
+ * @param[out] error Set to a new error message on failure.
+ * @return OK on success, or an error Status on failure.
+ */
+Status server_configure(Server *server, const char *options_json,
+                        char **error);
+
+/**
+ * @brief Routes request bodies through `stream` before they are buffered.
+ *
+ * For each request with a body, `stream->begin` decides whether to consume
+ * it incrementally. Streamed bodies are not subject to `maxBodySize`. Must be
+ * called before `listen`; pass NULL to buffer every body again.
+ * @param server The server.
+ * @param stream The callbacks, copied into the server.
+ */
+void server_stream_bodies(Server *server, const BodyStream *stream);
+
+/**
+ * @brief Returns the size of the request being handled on the calling
+ * thread, or 0 outside a handler. Unlike `strlen` on the request, this
+ * includes bodies that contain NUL bytes.
+ */
+size_t server_request_length(void);
+
+/**
+ * @brief Returns the arena for the request being handled on the calling
+ * thread, or NULL outside a handler.
+ *
+ * The arena belongs to the connection and is reset once the response has
+ * been queued, so nothing allocated from it may be kept past the handler.
+ * It is not made current automatically; see `arena_enter`.
+ */
+Arena *server_request_arena(void);
+
+/**
+ * @brief Reports the load on the server's handler thread pool.
+ *
+ * All counters are zero when handlers run inline on the event loops.
+ * @param server The server to inspect.
+ * @param[out] out_stats Receives the queue depth, wait-time and throughput
+ * counters.
+ */
+void server_stats(Server *server, ThreadPoolStats *out_stats);
+
 /**
  * @brief Frees all resources associated with a server instance.
  * @param server The server to destroy.
@@ -48,7 +202,96 @@ Server *server(const char *host, int port);
 void server_destroy(Server *server);
 
 /**
- * @brief Writes a complete HTTP response back to a client.
+ * @brief Writes raw bytes to a client.
+ *
+ * When called from a `RequestHandler` for the connection being served, the
+ * bytes are queued on that connection and flushed by the event loop as the
+ * socket becomes writable. For any other descriptor the write blocks until
+ * every byte is written.
+ * @param client_fd The client's socket file descriptor.
+ * @param data The bytes to send.
+ * @param len The number of bytes to send.
+ */
+void server_write(int client_fd, const void *data, size_t len);
+
+/**
+ * @brief Sends a range of an open file to a client without copying it
+ * through userspace.
+ *
+ * Like `server_write`, the range is queued when called from a handler and
+ * sent by the event loop with `sendfile` (or from an `mmap` of the file where
+ * `sendfile` is unavailable), after any bytes already written. For other
+ * descriptors it is sent before returning.
+ * @param client_fd The client's socket file descriptor.
+ * @param file_fd The file to send. Ownership passes to the server, which
+ * closes it once the range has been sent.
+ * @param offset The first byte of the range.
+ * @param length The number of bytes to send.
+ */
+void server_send_file(int client_fd, int file_fd, off_t offset,
+                      size_t length);
+
+/**
+ * @struct ServerCapture
+ * @brief Output a handler wrote to one descriptor, collected instead of sent.
+ */
+typedef struct ServerCapture {
+  int fd;
+  char *data; // Heap memory the caller frees after `server_capture_end`.
+  size_t len;
+  size_t capacity;
+  bool failed; // An allocation failed and `data` is incomplete.
+  struct ServerCapture *previous;
+} ServerCapture;
+
+/**
+ * @brief Diverts everything written to `client_fd` on the calling thread
+ * into `capture` until `server_capture_end`.
+ *
+ * `server_write`, `server_writev` and `server_send_file` all append to the
+ * capture; files are read into it rather than sent. Captures nest.
+ */
+void server_capture_begin(ServerCapture *capture, int client_fd);
+
+/**
+ * @brief Stops the capture started last on the calling thread.
+ */
+void server_capture_end(ServerCapture *capture);
+
+/**
+ * @brief Returns the server whose handler is running on the calling thread,
+ * or NULL outside a handler.
+ */
+Server *server_current(void);
+
+/**
+ * @brief Writes several buffers to a client in order, as `writev` would.
+ *
+ * On the readiness loop, a handler's first write of a response that holds
+ * its whole head is sent at once with `sendmsg`, and later ones while
+ * nothing is queued ahead of them; whatever the socket does not take is
+ * queued. Elsewhere inside a handler the segments are queued like
+ * `server_write`. For other descriptors they are written with `writev`,
+ * resuming after partial writes and waiting out `EAGAIN`. See `response.h`
+ * for a builder on top of this.
+ * @param client_fd The client's socket file descriptor.
+ * @param iov The buffers to send.
+ * @param count The number of buffers.
+ */
+void server_writev(int client_fd, const struct iovec *iov, int count);
+
+/**
+ * @brief Like `server_writev`, for the head of a response whose body
+ * continues with `server_send_file`. Inside a handler the head is always
+ * queued, so it leaves in one segment with the start of the file.
+ */
+void server_writev_more(int client_fd, const struct iovec *iov, int count);
+
+/**
+ * @brief Writes a complete HTTP response held in a C string back to a client.
+ *
+ * Kept for callers that already have the whole response as one string (such
+ * as the FFI); new code should build responses with `Response`.
  * @param client_fd The client's socket file descriptor.
  * @param response The full HTTP response string, including headers and body.
  */
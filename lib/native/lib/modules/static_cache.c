@@ -0,0 +1,233 @@
+#include "static_cache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define STATIC_CACHE_BUCKETS 256
+
+struct StaticCache {
+  pthread_mutex_t lock;
+  StaticAsset *buckets[STATIC_CACHE_BUCKETS];
+  StaticAsset *lru_head; // Most recently used.
+  StaticAsset *lru_tail; // Next to be evicted.
+  size_t bytes;
+  size_t max_bytes;
+  size_t max_entry_bytes;
+};
+
+static size_t hash_path(const char *path) {
+  size_t hash = 2166136261u;
+  for (const char *p = path; *p; p++) {
+    hash ^= (size_t)(unsigned char)*p;
+    hash *= 16777619;
+  }
+  return hash;
+}
+
+static uint64_t hash_content(const char *data, size_t size) {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= (unsigned char)data[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+void static_cache_http_date(time_t when, char *out, size_t out_size) {
+  struct tm tm;
+  gmtime_r(&when, &tm);
+  strftime(out, out_size, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+static bool asset_matches(const StaticAsset *asset, const struct stat *st) {
+  return asset->dev == st->st_dev && asset->ino == st->st_ino &&
+         asset->size == (size_t)st->st_size && asset->mtime == st->st_mtime &&
+         asset->mtime_nsec == STAT_MTIME_NSEC(st);
+}
+
+static void asset_free(StaticAsset *asset) {
+  free(asset->path);
+  free(asset->data);
+  free(asset);
+}
+
+static void lru_unlink(StaticCache *cache, StaticAsset *asset) {
+  if (asset->lru_prev)
+    asset->lru_prev->lru_next = asset->lru_next;
+  else
+    cache->lru_head = asset->lru_next;
+  if (asset->lru_next)
+    asset->lru_next->lru_prev = asset->lru_prev;
+  else
+    cache->lru_tail = asset->lru_prev;
+  asset->lru_prev = asset->lru_next = NULL;
+}
+
+static void lru_push_front(StaticCache *cache, StaticAsset *asset) {
+  asset->lru_prev = NULL;
+  asset->lru_next = cache->lru_head;
+  if (cache->lru_head)
+    cache->lru_head->lru_prev = asset;
+  cache->lru_head = asset;
+  if (!cache->lru_tail)
+    cache->lru_tail = asset;
+}
+
+/**
+ * @brief Removes an asset from the table and LRU list. It is freed now if
+ * unreferenced, otherwise by the last `static_cache_release`.
+ */
+static void evict(StaticCache *cache, StaticAsset *asset) {
+  StaticAsset **slot = &cache->buckets[hash_path(asset->path) %
+                                       STATIC_CACHE_BUCKETS];
+  while (*slot && *slot != asset)
+    slot = &(*slot)->hash_next;
+  if (*slot)
+    *slot = asset->hash_next;
+  lru_unlink(cache, asset);
+  cache->bytes -= asset->size;
+  asset->evicted = true;
+  if (asset->refs == 0)
+    asset_free(asset);
+}
+
+/**
+ * @brief Reads a file into a new asset. Returns NULL if the file changed
+ * between the caller's `stat` and the read, so a torn copy is never cached.
+ */
+static StaticAsset *load_asset(const char *path, const struct stat *st) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return NULL;
+
+  StaticAsset *asset = calloc(1, sizeof(StaticAsset));
+  char *data = malloc(st->st_size > 0 ? (size_t)st->st_size : 1);
+  char *path_copy = strdup(path);
+  if (!asset || !data || !path_copy) {
+    free(asset);
+    free(data);
+    free(path_copy);
+    close(fd);
+    return NULL;
+  }
+
+  size_t size = (size_t)st->st_size;
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = pread(fd, data + done, size - done, (off_t)done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    done += (size_t)n;
+  }
+  struct stat after;
+  bool stable = done == size && fstat(fd, &after) == 0 &&
+                after.st_size == st->st_size &&
+                after.st_mtime == st->st_mtime &&
+                STAT_MTIME_NSEC(&after) == STAT_MTIME_NSEC(st);
+  close(fd);
+  if (!stable) {
+    free(asset);
+    free(data);
+    free(path_copy);
+    return NULL;
+  }
+
+  asset->path = path_copy;
+  asset->data = data;
+  asset->size = size;
+  asset->dev = st->st_dev;
+  asset->ino = st->st_ino;
+  asset->mtime = st->st_mtime;
+  asset->mtime_nsec = STAT_MTIME_NSEC(st);
+  snprintf(asset->etag, sizeof(asset->etag), "\"%016llx\"",
+           (unsigned long long)hash_content(data, size));
+  static_cache_http_date(st->st_mtime, asset->last_modified,
+                         sizeof(asset->last_modified));
+  return asset;
+}
+
+StaticCache *static_cache(size_t max_bytes, size_t max_entry_bytes) {
+  StaticCache *cache = calloc(1, sizeof(StaticCache));
+  if (!cache)
+    return NULL;
+  pthread_mutex_init(&cache->lock, NULL);
+  cache->max_bytes = max_bytes;
+  cache->max_entry_bytes =
+      max_entry_bytes < max_bytes ? max_entry_bytes : max_bytes;
+  return cache;
+}
+
+void static_cache_free(StaticCache *cache) {
+  if (!cache)
+    return;
+  while (cache->lru_head)
+    evict(cache, cache->lru_head);
+  pthread_mutex_destroy(&cache->lock);
+  free(cache);
+}
+
+StaticAsset *static_cache_get(StaticCache *cache, const char *path,
+                              const struct stat *st) {
+  if ((size_t)st->st_size > cache->max_entry_bytes)
+    return NULL;
+
+  size_t bucket = hash_path(path) % STATIC_CACHE_BUCKETS;
+  pthread_mutex_lock(&cache->lock);
+  for (StaticAsset *asset = cache->buckets[bucket]; asset;
+       asset = asset->hash_next) {
+    if (strcmp(asset->path, path) != 0)
+      continue;
+    if (asset_matches(asset, st)) {
+      lru_unlink(cache, asset);
+      lru_push_front(cache, asset);
+      asset->refs++;
+      pthread_mutex_unlock(&cache->lock);
+      return asset;
+    }
+    evict(cache, asset);
+    break;
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  // Read outside the lock; a concurrent miss on the same path may load it
+  // twice, and the later insert replaces the earlier one.
+  StaticAsset *loaded = load_asset(path, st);
+  if (!loaded)
+    return NULL;
+
+  pthread_mutex_lock(&cache->lock);
+  for (StaticAsset *asset = cache->buckets[bucket]; asset;
+       asset = asset->hash_next) {
+    if (strcmp(asset->path, path) == 0) {
+      evict(cache, asset);
+      break;
+    }
+  }
+  while (cache->lru_tail && cache->bytes + loaded->size > cache->max_bytes)
+    evict(cache, cache->lru_tail);
+  loaded->hash_next = cache->buckets[bucket];
+  cache->buckets[bucket] = loaded;
+  lru_push_front(cache, loaded);
+  cache->bytes += loaded->size;
+  loaded->refs = 1;
+  pthread_mutex_unlock(&cache->lock);
+  return loaded;
+}
+
+void static_cache_release(StaticCache *cache, StaticAsset *asset) {
+  if (!asset)
+    return;
+  pthread_mutex_lock(&cache->lock);
+  bool free_now = --asset->refs == 0 && asset->evicted;
+  pthread_mutex_unlock(&cache->lock);
+  if (free_now)
+    asset_free(asset);
+}
@@ -0,0 +1,91 @@
+/**
+ * @file static_cache.h
+ * @brief Defines a bounded, thread-safe LRU cache of static file contents.
+ *
+ * The static file server keeps small, frequently requested assets (such as
+ * the bundler's `bundle.js` and `bundle.css`) in memory so that serving them
+ * costs a `stat` and a copy rather than an open and a read. Each entry is
+ * validated against the file's device, inode, size and modification time on
+ * every lookup, so edits on disk are picked up immediately. The strong ETag
+ * and Last-Modified values are computed once when an entry is loaded.
+ */
+
+#ifndef STATIC_CACHE_H
+#define STATIC_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// The nanosecond part of a `struct stat` modification time.
+#ifdef __APPLE__
+#define STAT_MTIME_NSEC(st) ((st)->st_mtimespec.tv_nsec)
+#else
+#define STAT_MTIME_NSEC(st) ((st)->st_mtim.tv_nsec)
+#endif
+
+/**
+ * @struct StaticAsset
+ * @brief A cached file. Returned by `static_cache_get` with a reference held;
+ * the fields are immutable until the reference is released.
+ */
+typedef struct StaticAsset {
+  char *path;
+  char *data;
+  size_t size;
+  dev_t dev;
+  ino_t ino;
+  time_t mtime;
+  long mtime_nsec;
+  char etag[24];          // Quoted content hash, e.g. "\"1f2e3d4c5b6a7980\"".
+  char last_modified[32]; // IMF-fixdate of the modification time.
+
+  int refs;
+  bool evicted;
+  struct StaticAsset *hash_next;
+  struct StaticAsset *lru_prev;
+  struct StaticAsset *lru_next;
+} StaticAsset;
+
+typedef struct StaticCache StaticCache;
+
+/**
+ * @brief Creates an empty cache.
+ * @param max_bytes The total size of file contents the cache may hold.
+ * @param max_entry_bytes Files larger than this are never cached.
+ * @return A new `StaticCache`, or NULL on allocation failure.
+ */
+StaticCache *static_cache(size_t max_bytes, size_t max_entry_bytes);
+
+/**
+ * @brief Frees the cache. Every asset must have been released.
+ */
+void static_cache_free(StaticCache *cache);
+
+/**
+ * @brief Returns the cached contents of `path`, loading them if they are
+ * missing or no longer match `st`.
+ * @param cache The cache.
+ * @param path The file path, used as the key.
+ * @param st The result of a fresh `stat` of `path`.
+ * @return A referenced asset to pass to `static_cache_release`, or NULL if
+ * the file is too large to cache or could not be read.
+ */
+StaticAsset *static_cache_get(StaticCache *cache, const char *path,
+                              const struct stat *st);
+
+/**
+ * @brief Drops a reference returned by `static_cache_get`.
+ */
+void static_cache_release(StaticCache *cache, StaticAsset *asset);
+
+/**
+ * @brief Formats `when` as an HTTP IMF-fixdate (RFC 9110).
+ * @param when The time to format.
+ * @param[out] out A buffer of at least 30 bytes.
+ * @param out_size The size of `out`.
+ */
+void static_cache_http_date(time_t when, char *out, size_t out_size);
+
+#endif // STATIC_CACHE_H
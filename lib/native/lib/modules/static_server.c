@@ -0,0 +1,569 @@
+#define _GNU_SOURCE
+#include "http.h"
+#include "response.h"
+#include "server.h"
+#include "static_cache.h"
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_PATH_SIZE 1024
+#define STATIC_CACHE_MAX_BYTES (64 * 1024 * 1024)
+#define STATIC_CACHE_MAX_ENTRY_BYTES (1024 * 1024)
+
+/**
+ * @struct StaticSite
+ * @brief The server context of `static_server_run`.
+ */
+typedef struct {
+  const char *public_dir;
+  StaticCache *cache;
+} StaticSite;
+
+typedef struct {
+  const char *extension;
+  const char *type;
+} MimeType;
+
+// Sorted by extension for binary search.
+static const MimeType mime_types[] = {
+    {"avif", "image/avif"},
+    {"bmp", "image/bmp"},
+    {"br", "application/x-brotli"},
+    {"css", "text/css; charset=utf-8"},
+    {"csv", "text/csv; charset=utf-8"},
+    {"gif", "image/gif"},
+    {"gz", "application/gzip"},
+    {"htm", "text/html; charset=utf-8"},
+    {"html", "text/html; charset=utf-8"},
+    {"ico", "image/x-icon"},
+    {"jpeg", "image/jpeg"},
+    {"jpg", "image/jpeg"},
+    {"js", "text/javascript; charset=utf-8"},
+    {"json", "application/json"},
+    {"map", "application/json"},
+    {"md", "text/markdown; charset=utf-8"},
+    {"mjs", "text/javascript; charset=utf-8"},
+    {"mp3", "audio/mpeg"},
+    {"mp4", "video/mp4"},
+    {"oga", "audio/ogg"},
+    {"ogg", "audio/ogg"},
+    {"ogv", "video/ogg"},
+    {"otf", "font/otf"},
+    {"pdf", "application/pdf"},
+    {"png", "image/png"},
+    {"svg", "image/svg+xml"},
+    {"tar", "application/x-tar"},
+    {"ttf", "font/ttf"},
+    {"txt", "text/plain; charset=utf-8"},
+    {"wasm", "application/wasm"},
+    {"wav", "audio/wav"},
+    {"webm", "video/webm"},
+    {"webmanifest", "application/manifest+json"},
+    {"webp", "image/webp"},
+    {"woff", "font/woff"},
+    {"woff2", "font/woff2"},
+    {"xml", "application/xml"},
+    {"zip", "application/zip"},
+};
+
+static const char *get_mime_type(const char *path) {
+  const char *dot = strrchr(path, '.');
+  const char *slash = strrchr(path, '/');
+  if (!dot || dot == path || (slash && dot < slash))
+    return "application/octet-stream";
+
+  const char *extension = dot + 1;
+  size_t low = 0;
+  size_t high = sizeof(mime_types) / sizeof(mime_types[0]);
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    int cmp = strcasecmp(extension, mime_types[mid].extension);
+    if (cmp == 0)
+      return mime_types[mid].type;
+    if (cmp < 0)
+      high = mid;
+    else
+      low = mid + 1;
+  }
+  return "application/octet-stream";
+}
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  c = (char)tolower((unsigned char)c);
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+/**
+ * @brief Percent-decodes the path of a request target in place, dropping any
+ * query string or fragment.
+ * @return false if the path is malformed or decodes to a NUL byte.
+ */
+static bool decode_path(char *path) {
+  char *out = path;
+  for (char *p = path; *p && *p != '?' && *p != '#'; p++) {
+    if (*p != '%') {
+      *out++ = *p;
+      continue;
+    }
+    int high = hex_value(p[1]);
+    int low = high >= 0 ? hex_value(p[2]) : -1;
+    if (low < 0 || (high == 0 && low == 0))
+      return false;
+    *out++ = (char)(high * 16 + low);
+    p += 2;
+  }
+  *out = '\0';
+  return true;
+}
+
+/**
+ * @brief Copies the value of request header `name` into `out`.
+ * @return true if the header is present.
+ */
+static bool request_header(const HttpRequest *request, const char *name,
+                           char *out, size_t out_size) {
+  HttpSpan value;
+  if (!http_request_header(request, name, &value))
+    return false;
+  size_t len = value.len < out_size ? value.len : out_size - 1;
+  memcpy(out, http_span_data(request, value), len);
+  out[len] = '\0';
+  return true;
+}
+
+typedef enum {
+  RANGE_NONE,          // Serve the whole file.
+  RANGE_SATISFIABLE,   // Serve `start`..`end` as 206 Partial Content.
+  RANGE_UNSATISFIABLE, // Answer 416 Range Not Satisfiable.
+} RangeResult;
+
+/**
+ * @brief Parses a single `bytes=` range against a file of `size` bytes.
+ * Malformed headers and multi-range requests are ignored, which the HTTP
+ * specification permits.
+ */
+static RangeResult parse_range(const char *value, off_t size, off_t *start,
+                               off_t *end) {
+  if (strncasecmp(value, "bytes=", 6) != 0 || strchr(value, ','))
+    return RANGE_NONE;
+  const char *p = value + 6;
+  char *rest;
+
+  if (*p == '-') {
+    if (!isdigit((unsigned char)p[1]))
+      return RANGE_NONE;
+    long long suffix = strtoll(p + 1, &rest, 10);
+    if (*rest)
+      return RANGE_NONE;
+    if (suffix == 0 || size == 0)
+      return RANGE_UNSATISFIABLE;
+    *start = suffix < size ? size - suffix : 0;
+    *end = size - 1;
+    return RANGE_SATISFIABLE;
+  }
+
+  if (!isdigit((unsigned char)*p))
+    return RANGE_NONE;
+  long long first = strtoll(p, &rest, 10);
+  if (*rest != '-')
+    return RANGE_NONE;
+  long long last = size - 1;
+  if (rest[1]) {
+    if (!isdigit((unsigned char)rest[1]))
+      return RANGE_NONE;
+    last = strtoll(rest + 1, &rest, 10);
+    if (*rest || last < first)
+      return RANGE_NONE;
+  }
+  if (first >= size)
+    return RANGE_UNSATISFIABLE;
+  *start = first;
+  *end = last < size ? last : size - 1;
+  return RANGE_SATISFIABLE;
+}
+
+/**
+ * @brief Resolves `path` to a regular file, mapping directories to their
+ * `index.html`.
+ * @return true if there is a file to serve; `st` describes it.
+ */
+static bool resolve_static_file(char *path, size_t path_size,
+                                struct stat *st) {
+  if (stat(path, st) != 0)
+    return false;
+  if (S_ISDIR(st->st_mode)) {
+    size_t len = strlen(path);
+    if (len + sizeof("/index.html") > path_size)
+      return false;
+    snprintf(path + len, path_size - len, "%sindex.html",
+             len > 0 && path[len - 1] == '/' ? "" : "/");
+    if (stat(path, st) != 0)
+      return false;
+  }
+  return S_ISREG(st->st_mode);
+}
+
+/**
+ * @brief Returns true if `If-None-Match` lists `etag` (or `*`), using the
+ * weak comparison the header calls for.
+ */
+static bool etag_list_matches(const char *list, const char *etag) {
+  size_t etag_len = strlen(etag);
+  const char *p = list;
+  while (*p) {
+    while (*p == ' ' || *p == '\t' || *p == ',')
+      p++;
+    if (*p == '*')
+      return true;
+    if (strncmp(p, "W/", 2) == 0)
+      p += 2;
+    const char *start = p;
+    while (*p && *p != ',')
+      p++;
+    const char *end = p;
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t'))
+      end--;
+    if ((size_t)(end - start) == etag_len &&
+        strncmp(start, etag, etag_len) == 0)
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Parses an IMF-fixdate such as `Sun, 06 Nov 1994 08:49:37 GMT`.
+ */
+static bool parse_http_date(const char *value, time_t *out) {
+  struct tm tm;
+  memset(&tm, 0, sizeof(tm));
+  const char *end = strptime(value, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  if (!end || *end != '\0')
+    return false;
+  *out = timegm(&tm);
+  return true;
+}
+
+/**
+ * @brief Evaluates the request's validators against the current
+ * representation. `If-None-Match` takes precedence over
+ * `If-Modified-Since`, as RFC 9110 requires.
+ */
+static bool not_modified(const HttpRequest *request, const char *etag,
+                         time_t mtime) {
+  char value[512];
+  if (request_header(request, "if-none-match", value, sizeof(value)))
+    return etag_list_matches(value, etag);
+  time_t since;
+  if (request_header(request, "if-modified-since", value, sizeof(value)))
+    return parse_http_date(value, &since) && mtime <= since;
+  return false;
+}
+
+/**
+ * @brief Returns true unless `If-Range` names something other than the
+ * current representation, in which case the whole file is sent instead of
+ * the range. An entity tag must match by strong comparison and a date must
+ * equal the modification time exactly, as RFC 9110 requires.
+ */
+static bool range_applies(const HttpRequest *request, const char *etag,
+                          time_t mtime) {
+  char value[512];
+  if (!request_header(request, "if-range", value, sizeof(value)))
+    return true;
+  if (value[0] == '"')
+    return strcmp(value, etag) == 0;
+  time_t date;
+  return parse_http_date(value, &date) && date == mtime;
+}
+
+/**
+ * @brief Returns true for fingerprinted names such as `bundle.3f9a2c1b.js`
+ * or `app-5d41402abc4b2a76.css`, whose contents never change.
+ */
+static bool is_hashed_name(const char *path) {
+  const char *name = strrchr(path, '/');
+  name = name ? name + 1 : path;
+  const char *extension = strrchr(name, '.');
+  for (const char *p = name; p < extension;) {
+    const char *start = p;
+    while (p < extension && isxdigit((unsigned char)*p))
+      p++;
+    if (p - start >= 8 && (*p == '.' || *p == '-') &&
+        (start == name || start[-1] == '.' || start[-1] == '-'))
+      return true;
+    while (p < extension && *p != '.' && *p != '-')
+      p++;
+    if (p < extension)
+      p++;
+  }
+  return false;
+}
+
+/**
+ * @brief Returns true if an `Accept-Encoding` value permits `coding`, either
+ * by name or through `*`, with a non-zero quality.
+ */
+static bool accepts_encoding(const char *header, const char *coding) {
+  size_t coding_len = strlen(coding);
+  bool wildcard = false;
+  const char *p = header;
+  while (*p) {
+    while (*p == ' ' || *p == '\t' || *p == ',')
+      p++;
+    const char *start = p;
+    while (*p && *p != ',' && *p != ';' && *p != ' ' && *p != '\t')
+      p++;
+    size_t len = (size_t)(p - start);
+    const char *end = strchr(p, ',');
+    if (!end)
+      end = p + strlen(p);
+    double quality = 1.0;
+    const char *q = strstr(p, "q=");
+    if (q && q < end)
+      quality = strtod(q + 2, NULL);
+    if (len == coding_len && strncasecmp(start, coding, len) == 0)
+      return quality > 0;
+    if (len == 1 && *start == '*')
+      wildcard = quality > 0;
+    p = end;
+  }
+  return wildcard;
+}
+
+/**
+ * @struct ContentCoding
+ * @brief The outcome of content negotiation for one file.
+ */
+typedef struct {
+  const char *encoding; // The chosen coding, or NULL for the plain file.
+  bool has_variants;    // Some sidecar exists, so responses vary.
+} ContentCoding;
+
+/**
+ * @brief Looks for up-to-date `.br` and `.gz` sidecars of `path` and picks
+ * the best one the request accepts. On a match, `variant_path` and `st`
+ * describe the sidecar.
+ */
+static ContentCoding negotiate_encoding(const HttpRequest *request,
+                                        const char *path,
+                                        struct stat *st, char *variant_path,
+                                        size_t variant_size) {
+  static const struct {
+    const char *coding;
+    const char *suffix;
+  } sidecars[] = {{"br", ".br"}, {"gzip", ".gz"}};
+
+  ContentCoding result = {NULL, false};
+  char accept[256];
+  bool has_accept =
+      request_header(request, "accept-encoding", accept, sizeof(accept));
+  for (size_t i = 0; i < sizeof(sidecars) / sizeof(sidecars[0]); i++) {
+    char candidate[MAX_PATH_SIZE];
+    struct stat candidate_st;
+    int len = snprintf(candidate, sizeof(candidate), "%s%s", path,
+                       sidecars[i].suffix);
+    // A sidecar older than its source is stale and ignored. Whole seconds
+    // would miss a source edited in the same second as its sidecar.
+    if (len >= (int)sizeof(candidate) || stat(candidate, &candidate_st) != 0 ||
+        !S_ISREG(candidate_st.st_mode) ||
+        candidate_st.st_mtime < st->st_mtime ||
+        (candidate_st.st_mtime == st->st_mtime &&
+         STAT_MTIME_NSEC(&candidate_st) < STAT_MTIME_NSEC(st)))
+      continue;
+    result.has_variants = true;
+    if (!result.encoding && has_accept &&
+        accepts_encoding(accept, sidecars[i].coding) &&
+        (size_t)len < variant_size) {
+      result.encoding = sidecars[i].coding;
+      memcpy(variant_path, candidate, (size_t)len + 1);
+      *st = candidate_st;
+    }
+  }
+  return result;
+}
+
+static void add_encoding_headers(Response *res, const ContentCoding *coding) {
+  if (!coding->has_variants)
+    return;
+  if (coding->encoding)
+    response_header(res, "Content-Encoding", coding->encoding);
+  response_header(res, "Vary", "Accept-Encoding");
+}
+
+static void static_file_handler(int client_fd, const char *raw_request) {
+  StaticSite *site = server_current()->context;
+  HttpRequest parsed;
+  const HttpRequest *request = &parsed;
+  char *error = NULL;
+  if (http_request_parse(raw_request, server_request_length(), &parsed,
+                         &error) != OK) {
+    free(error);
+    server_write_response(client_fd, "HTTP/1.1 400 Bad Request\r\n"
+                                     "Content-Length: 0\r\n\r\n");
+    return;
+  }
+
+  bool head = request->method.len == 4 &&
+              memcmp(http_span_data(request, request->method), "HEAD", 4) == 0;
+  if (!head &&
+      (request->method.len != 3 ||
+       memcmp(http_span_data(request, request->method), "GET", 3) != 0)) {
+    server_write_response(client_fd, "HTTP/1.1 405 Method Not Allowed\r\n"
+                                     "Allow: GET, HEAD\r\n"
+                                     "Content-Length: 0\r\n\r\n");
+    return;
+  }
+
+  // The query string plays no part in finding the file.
+  char req_path[MAX_PATH_SIZE];
+  if (request->path.len >= sizeof(req_path)) {
+    server_write_response(client_fd, "HTTP/1.1 414 URI Too Long\r\n"
+                                     "Content-Length: 0\r\n\r\n");
+    return;
+  }
+  memcpy(req_path, http_span_data(request, request->path), request->path.len);
+  req_path[request->path.len] = '\0';
+
+  if (!decode_path(req_path) || strstr(req_path, "..")) {
+    server_write_response(client_fd, "HTTP/1.1 400 Bad Request\r\n"
+                                     "Content-Length: 12\r\n\r\nInvalid Path");
+    return;
+  }
+
+  char file_path[MAX_PATH_SIZE];
+  const char *req_file = (strcmp(req_path, "/") == 0) ? "/index.html" : req_path;
+  snprintf(file_path, sizeof(file_path), "%s%s", site->public_dir, req_file);
+
+  struct stat st;
+  if (!resolve_static_file(file_path, sizeof(file_path), &st)) {
+    server_write_response(client_fd, "HTTP/1.1 404 Not Found\r\n"
+                                     "Content-Length: 9\r\n\r\nNot Found");
+    return;
+  }
+
+  const char *mime = get_mime_type(file_path);
+  const char *cache_control = is_hashed_name(file_path)
+                                  ? "public, max-age=31536000, immutable"
+                                  : "no-cache";
+
+  // Serve a precompressed sidecar when the client accepts its encoding.
+  // Every validator and range below then applies to the encoded bytes.
+  char variant_path[MAX_PATH_SIZE];
+  const char *serve_path = file_path;
+  ContentCoding coding = negotiate_encoding(request, file_path, &st,
+                                            variant_path, sizeof(variant_path));
+  if (coding.encoding)
+    serve_path = variant_path;
+
+  // Small files come from the cache with a content-hash ETag; larger ones
+  // are sent from disk and tagged from their metadata.
+  StaticAsset *asset = static_cache_get(site->cache, serve_path, &st);
+  char etag_buffer[64];
+  char date_buffer[32];
+  const char *etag = etag_buffer;
+  const char *last_modified = date_buffer;
+  if (asset) {
+    etag = asset->etag;
+    last_modified = asset->last_modified;
+  } else {
+    snprintf(etag_buffer, sizeof(etag_buffer), "\"%llx-%llx-%llx\"",
+             (unsigned long long)st.st_ino, (unsigned long long)st.st_size,
+             (unsigned long long)st.st_mtime);
+    static_cache_http_date(st.st_mtime, date_buffer, sizeof(date_buffer));
+  }
+
+  Response res;
+  if (not_modified(request, etag, st.st_mtime)) {
+    response_init(&res, client_fd, 304, "Not Modified");
+    add_encoding_headers(&res, &coding);
+    response_header(&res, "ETag", etag);
+    response_header(&res, "Last-Modified", last_modified);
+    response_header(&res, "Cache-Control", cache_control);
+    response_send(&res);
+    static_cache_release(site->cache, asset);
+    return;
+  }
+
+  off_t start = 0;
+  off_t end = st.st_size - 1;
+  char range[128];
+  RangeResult range_result = RANGE_NONE;
+  if (request_header(request, "range", range, sizeof(range)) &&
+      range_applies(request, etag, st.st_mtime))
+    range_result = parse_range(range, st.st_size, &start, &end);
+
+  if (range_result == RANGE_UNSATISFIABLE) {
+    response_init(&res, client_fd, 416, "Range Not Satisfiable");
+    response_headerf(&res, "Content-Range", "bytes */%lld",
+                     (long long)st.st_size);
+    response_send(&res);
+    static_cache_release(site->cache, asset);
+    return;
+  }
+
+  size_t length = st.st_size > 0 ? (size_t)(end - start + 1) : 0;
+  int file_fd = -1;
+  if (!asset && !head && length > 0) {
+    file_fd = open(serve_path, O_RDONLY | O_CLOEXEC);
+    if (file_fd < 0) {
+      server_write_response(client_fd, "HTTP/1.1 404 Not Found\r\n"
+                                       "Content-Length: 9\r\n\r\nNot Found");
+      return;
+    }
+  }
+  if (range_result == RANGE_SATISFIABLE) {
+    response_init(&res, client_fd, 206, "Partial Content");
+    response_headerf(&res, "Content-Range", "bytes %lld-%lld/%lld",
+                     (long long)start, (long long)end, (long long)st.st_size);
+  } else {
+    response_init(&res, client_fd, 200, "OK");
+  }
+  response_header(&res, "Content-Type", mime);
+  add_encoding_headers(&res, &coding);
+  response_header(&res, "Accept-Ranges", "bytes");
+  response_header(&res, "ETag", etag);
+  response_header(&res, "Last-Modified", last_modified);
+  response_header(&res, "Cache-Control", cache_control);
+  // HEAD advertises the length of the body it leaves out.
+  response_headerf(&res, "Content-Length", "%zu", length);
+
+  // The cached bytes are only borrowed, so the asset stays referenced
+  // until the response has been written or queued.
+  if (file_fd >= 0)
+    response_file(&res, file_fd, start, length);
+  else if (asset && !head)
+    response_body(&res, asset->data + start, length);
+  response_send(&res);
+  static_cache_release(site->cache, asset);
+}
+
+int static_server_run(const char *host, int port, const char *public_dir) {
+  Server *s = server(host, port);
+  if (!s)
+    return 1;
+
+  StaticSite site = {.public_dir = public_dir,
+                     .cache = static_cache(STATIC_CACHE_MAX_BYTES,
+                                           STATIC_CACHE_MAX_ENTRY_BYTES)};
+  if (!site.cache) {
+    server_destroy(s);
+    return 1;
+  }
+  s->context = &site;
+  int result = s->listen(s, static_file_handler);
+  server_destroy(s);
+  static_cache_free(site.cache);
+  return result == 0 ? 0 : 1;
+}
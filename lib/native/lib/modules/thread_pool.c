@@ -0,0 +1,152 @@
+#include "thread_pool.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct {
+  ThreadPoolTask task;
+  void *arg;
+  uint64_t enqueued_us;
+} QueuedTask;
+
+struct ThreadPool {
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t idle;
+  pthread_t *threads;
+  size_t thread_count;
+
+  // Ring buffer of pending tasks.
+  QueuedTask *queue;
+  size_t capacity;
+  size_t head;
+  size_t count;
+
+  bool shutting_down;
+  ThreadPoolStats stats;
+};
+
+static uint64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static void *pool_thread(void *arg) {
+  ThreadPool *pool = arg;
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (pool->count == 0 && !pool->shutting_down)
+      pthread_cond_wait(&pool->not_empty, &pool->lock);
+    if (pool->count == 0)
+      break;
+
+    QueuedTask next = pool->queue[pool->head];
+    pool->head = (pool->head + 1) % pool->capacity;
+    pool->count--;
+
+    uint64_t waited = now_us() - next.enqueued_us;
+    pool->stats.total_wait_us += waited;
+    if (waited > pool->stats.max_wait_us)
+      pool->stats.max_wait_us = waited;
+    pool->stats.active++;
+    pthread_mutex_unlock(&pool->lock);
+
+    next.task(next.arg);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stats.active--;
+    pool->stats.completed++;
+    if (pool->count == 0 && pool->stats.active == 0)
+      pthread_cond_broadcast(&pool->idle);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+ThreadPool *thread_pool(int threads, size_t queue_capacity) {
+  if (threads < 1 || queue_capacity < 1)
+    return NULL;
+  ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+  if (!pool)
+    return NULL;
+  pool->queue = calloc(queue_capacity, sizeof(QueuedTask));
+  pool->threads = calloc((size_t)threads, sizeof(pthread_t));
+  if (!pool->queue || !pool->threads) {
+    free(pool->queue);
+    free(pool->threads);
+    free(pool);
+    return NULL;
+  }
+  pool->capacity = queue_capacity;
+  pool->stats.queue_capacity = queue_capacity;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->not_empty, NULL);
+  pthread_cond_init(&pool->idle, NULL);
+
+  for (int i = 0; i < threads; i++) {
+    if (pthread_create(&pool->threads[i], NULL, pool_thread, pool) != 0) {
+      perror("pthread_create");
+      break;
+    }
+    pool->thread_count++;
+  }
+  pool->stats.threads = pool->thread_count;
+  if (pool->thread_count == 0) {
+    thread_pool_free(pool);
+    return NULL;
+  }
+  return pool;
+}
+
+bool thread_pool_submit(ThreadPool *pool, ThreadPoolTask task, void *arg) {
+  pthread_mutex_lock(&pool->lock);
+  if (pool->shutting_down || pool->count == pool->capacity) {
+    pool->stats.rejected++;
+    pthread_mutex_unlock(&pool->lock);
+    return false;
+  }
+  size_t tail = (pool->head + pool->count) % pool->capacity;
+  pool->queue[tail] = (QueuedTask){task, arg, now_us()};
+  pool->count++;
+  pool->stats.submitted++;
+  if (pool->count > pool->stats.max_queue_depth)
+    pool->stats.max_queue_depth = pool->count;
+  pthread_cond_signal(&pool->not_empty);
+  pthread_mutex_unlock(&pool->lock);
+  return true;
+}
+
+void thread_pool_stats(ThreadPool *pool, ThreadPoolStats *out) {
+  pthread_mutex_lock(&pool->lock);
+  *out = pool->stats;
+  out->queue_depth = pool->count;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void thread_pool_wait_idle(ThreadPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  while (pool->count > 0 || pool->stats.active > 0)
+    pthread_cond_wait(&pool->idle, &pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void thread_pool_free(ThreadPool *pool) {
+  if (!pool)
+    return;
+  pthread_mutex_lock(&pool->lock);
+  pool->shutting_down = true;
+  pthread_cond_broadcast(&pool->not_empty);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (size_t i = 0; i < pool->thread_count; i++)
+    pthread_join(pool->threads[i], NULL);
+
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->not_empty);
+  pthread_cond_destroy(&pool->idle);
+  free(pool->threads);
+  free(pool->queue);
+  free(pool);
+}
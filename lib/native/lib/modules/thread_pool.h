@@ -0,0 +1,77 @@
+/**
+ * @file thread_pool.h
+ * @brief Defines a fixed-size thread pool fed by a bounded work queue.
+ *
+ * The HTTP server uses the pool to run request handlers away from its I/O
+ * threads, so a slow handler delays only its own connection. The queue is
+ * bounded: once full, submissions are refused rather than buffered without
+ * limit, which lets the caller shed load.
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief A unit of work run on one of the pool's threads.
+ * @param arg The pointer passed to `thread_pool_submit`.
+ */
+typedef void (*ThreadPoolTask)(void *arg);
+
+/**
+ * @struct ThreadPoolStats
+ * @brief Counters describing the pool's load since it was created.
+ */
+typedef struct {
+  size_t threads;         ///< Number of worker threads.
+  size_t queue_capacity;  ///< Maximum number of queued tasks.
+  size_t queue_depth;     ///< Tasks currently waiting for a thread.
+  size_t max_queue_depth; ///< Highest queue depth observed.
+  size_t active;          ///< Tasks currently running.
+  uint64_t submitted;     ///< Tasks accepted into the queue.
+  uint64_t completed;     ///< Tasks that have finished running.
+  uint64_t rejected;      ///< Submissions refused because the queue was full.
+  uint64_t total_wait_us; ///< Sum of the time tasks spent queued.
+  uint64_t max_wait_us;   ///< Longest time a task spent queued.
+} ThreadPoolStats;
+
+typedef struct ThreadPool ThreadPool;
+
+/**
+ * @brief Creates a pool and starts its threads.
+ * @param threads The number of worker threads (at least 1).
+ * @param queue_capacity The maximum number of tasks waiting for a thread.
+ * @return A new `ThreadPool`, or NULL on failure.
+ */
+ThreadPool *thread_pool(int threads, size_t queue_capacity);
+
+/**
+ * @brief Queues a task to run on the next free thread.
+ * @param pool The thread pool.
+ * @param task The function to run.
+ * @param arg The argument passed to `task`.
+ * @return true if the task was queued, or false if the queue is full or the
+ * pool is shutting down. A refused task is never run.
+ */
+bool thread_pool_submit(ThreadPool *pool, ThreadPoolTask task, void *arg);
+
+/**
+ * @brief Copies the pool's counters into `out`.
+ */
+void thread_pool_stats(ThreadPool *pool, ThreadPoolStats *out);
+
+/**
+ * @brief Blocks until the queue is empty and no task is running.
+ */
+void thread_pool_wait_idle(ThreadPool *pool);
+
+/**
+ * @brief Runs every task still queued, joins the threads and frees the pool.
+ * @param pool The pool to free.
+ */
+void thread_pool_free(ThreadPool *pool);
+
+#endif // THREAD_POOL_H
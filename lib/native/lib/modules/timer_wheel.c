@@ -0,0 +1,152 @@
+#include "timer_wheel.h"
+#include <stdlib.h>
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_RANGE ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+struct TimerWheel {
+  long long origin_ms; // Time of tick 0.
+  int tick_ms;
+  uint64_t now; // Next tick to process; every earlier tick has fired.
+  size_t armed;
+  Timer *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+};
+
+TimerWheel *timer_wheel(long long now_ms, int tick_ms) {
+  TimerWheel *wheel = calloc(1, sizeof(TimerWheel));
+  if (!wheel)
+    return NULL;
+  wheel->origin_ms = now_ms;
+  wheel->tick_ms = tick_ms > 0 ? tick_ms : 1;
+  return wheel;
+}
+
+void timer_wheel_free(TimerWheel *wheel) { free(wheel); }
+
+static void link_timer(TimerWheel *wheel, Timer *timer) {
+  uint64_t delta = timer->expires - wheel->now;
+  int level = 0;
+  while (level < WHEEL_LEVELS - 1 &&
+         delta >= (uint64_t)1 << (WHEEL_BITS * (level + 1)))
+    level++;
+  Timer **slot =
+      &wheel->slots[level][(timer->expires >> (WHEEL_BITS * level)) &
+                           WHEEL_MASK];
+  timer->next = *slot;
+  if (*slot)
+    (*slot)->pprev = &timer->next;
+  timer->pprev = slot;
+  *slot = timer;
+}
+
+static void unlink_timer(Timer *timer) {
+  *timer->pprev = timer->next;
+  if (timer->next)
+    timer->next->pprev = timer->pprev;
+  timer->next = NULL;
+  timer->pprev = NULL;
+}
+
+void timer_arm(TimerWheel *wheel, Timer *timer, long long deadline_ms) {
+  if (timer->armed)
+    unlink_timer(timer);
+  else
+    wheel->armed++;
+  timer->armed = true;
+  timer->deadline_ms = deadline_ms;
+
+  // Round up so a timer never fires before its deadline.
+  long long offset = deadline_ms - wheel->origin_ms;
+  uint64_t tick =
+      offset <= 0 ? 0
+                  : (uint64_t)((offset + wheel->tick_ms - 1) / wheel->tick_ms);
+  if (tick < wheel->now)
+    tick = wheel->now;
+  if (tick - wheel->now >= WHEEL_RANGE)
+    tick = wheel->now + WHEEL_RANGE - 1;
+  timer->expires = tick;
+  link_timer(wheel, timer);
+}
+
+void timer_cancel(TimerWheel *wheel, Timer *timer) {
+  if (!timer->armed)
+    return;
+  unlink_timer(timer);
+  timer->armed = false;
+  wheel->armed--;
+}
+
+/**
+ * @brief Moves the timers of the higher-level slots that the current tick
+ * has just entered down to the levels below.
+ */
+static void cascade(TimerWheel *wheel) {
+  for (int level = 1; level < WHEEL_LEVELS; level++) {
+    int index = (int)((wheel->now >> (WHEEL_BITS * level)) & WHEEL_MASK);
+    Timer *timer = wheel->slots[level][index];
+    wheel->slots[level][index] = NULL;
+    while (timer) {
+      Timer *next = timer->next;
+      link_timer(wheel, timer);
+      timer = next;
+    }
+    if (index != 0)
+      break;
+  }
+}
+
+size_t timer_wheel_advance(TimerWheel *wheel, long long now_ms,
+                           TimerCallback callback, void *context) {
+  long long offset = now_ms - wheel->origin_ms;
+  if (offset < 0)
+    return 0;
+  uint64_t target = (uint64_t)(offset / wheel->tick_ms);
+  if (wheel->armed == 0) {
+    if (target >= wheel->now)
+      wheel->now = target + 1;
+    return 0;
+  }
+
+  size_t fired = 0;
+  while (wheel->now <= target) {
+    if ((wheel->now & WHEEL_MASK) == 0)
+      cascade(wheel);
+    // Detach the slot so timers the callbacks arm are never seen here; the
+    // detached list stays valid for `timer_cancel`.
+    Timer **slot = &wheel->slots[0][wheel->now & WHEEL_MASK];
+    Timer *due = *slot;
+    *slot = NULL;
+    if (due)
+      due->pprev = &due;
+    wheel->now++;
+    Timer *timer;
+    while ((timer = due)) {
+      unlink_timer(timer);
+      timer->armed = false;
+      wheel->armed--;
+      fired++;
+      callback(timer, context);
+    }
+    if (wheel->armed == 0 && wheel->now <= target)
+      wheel->now = target + 1;
+  }
+  return fired;
+}
+
+int timer_wheel_timeout(const TimerWheel *wheel, long long now_ms) {
+  if (wheel->armed == 0)
+    return -1;
+  // Stop at the first occupied slot, or at the next cascade, which may bring
+  // timers down to level 0.
+  uint64_t next = wheel->now;
+  while ((next & WHEEL_MASK) != 0 && !wheel->slots[0][next & WHEEL_MASK])
+    next++;
+  long long due_ms = wheel->origin_ms + (long long)next * wheel->tick_ms;
+  if (due_ms <= now_ms)
+    return 0;
+  long long wait = due_ms - now_ms;
+  return wait > 2147483647LL ? 2147483647 : (int)wait;
+}
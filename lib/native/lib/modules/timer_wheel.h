@@ -0,0 +1,87 @@
+/**
+ * @file timer_wheel.h
+ * @brief Defines a hierarchical timer wheel for connection deadlines.
+ *
+ * Timers are intrusive: the caller embeds a `Timer` in its own structure and
+ * recovers the structure in the expiry callback. Arming and cancelling are
+ * O(1) list operations. Time advances in fixed ticks; four levels of 64
+ * slots cover 2^24 ticks, and timers further out are cascaded down a level
+ * each time the level below wraps.
+ *
+ * Expiry is tick-granular and never early: a timer fires on the first
+ * advance at or after its deadline. Deadlines beyond the wheel's range are
+ * clamped to its end, so callers with very long deadlines should check the
+ * time in the callback and re-arm.
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @struct Timer
+ * @brief A timer embedded in the caller's structure. Zero-initialise before
+ * first use.
+ */
+typedef struct Timer {
+  struct Timer *next;
+  struct Timer **pprev;  // The pointer that points at this timer.
+  uint64_t expires;      // Tick at which the timer fires.
+  long long deadline_ms; // Deadline passed to `timer_arm`.
+  bool armed;
+} Timer;
+
+typedef struct TimerWheel TimerWheel;
+
+/**
+ * @brief Called for each expired timer. The timer is already disarmed, so
+ * the callback may re-arm it or free its owner.
+ */
+typedef void (*TimerCallback)(Timer *timer, void *context);
+
+/**
+ * @brief Creates an empty wheel.
+ * @param now_ms The current time on the caller's clock, in milliseconds.
+ * @param tick_ms The wheel's resolution, in milliseconds.
+ * @return A new `TimerWheel`, or NULL on allocation failure.
+ */
+TimerWheel *timer_wheel(long long now_ms, int tick_ms);
+
+/**
+ * @brief Frees the wheel. Armed timers are simply forgotten.
+ */
+void timer_wheel_free(TimerWheel *wheel);
+
+/**
+ * @brief Arms (or re-arms) a timer to fire at `deadline_ms`.
+ */
+void timer_arm(TimerWheel *wheel, Timer *timer, long long deadline_ms);
+
+/**
+ * @brief Disarms a timer. Does nothing if it is not armed.
+ */
+void timer_cancel(TimerWheel *wheel, Timer *timer);
+
+/**
+ * @brief Fires every timer whose deadline has passed.
+ * @param wheel The wheel.
+ * @param now_ms The current time.
+ * @param callback Called once per expired timer.
+ * @param context Passed to `callback`.
+ * @return The number of timers fired.
+ */
+size_t timer_wheel_advance(TimerWheel *wheel, long long now_ms,
+                           TimerCallback callback, void *context);
+
+/**
+ * @brief Returns how long an event loop may sleep before the wheel next
+ * needs advancing: 0 if a timer is due, -1 if no timers are armed. When
+ * only higher levels hold timers, this is the time of the next cascade,
+ * which may be earlier than the next expiry but is never later.
+ */
+int timer_wheel_timeout(const TimerWheel *wheel, long long now_ms);
+
+#endif // TIMER_WHEEL_H
@@ -16,10 +16,12 @@
 #include "webs_api.h"
 #include <ctype.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 // --- FFI Helper ---
@@ -262,6 +264,27 @@ int webs_string_compare(const char *s1, const char *s2) {
 Value *webs_regex_parse(const char *pattern, Status *status) {
   return W->regexParse(pattern, status);
 }
+bool webs_scan_set_kernel(int kernel) {
+  return scan_set_kernel((ScanKernel)kernel);
+}
+int webs_scan_kernel(void) { return (int)scan_kernel(); }
+
+// The scans report positions as offsets from `p`, with -1 for NULL.
+static int64_t scan_offset(const char *p, const char *found) {
+  return found ? (int64_t)(found - p) : -1;
+}
+void webs_scan_line(const char *p, size_t len, int64_t *offsets) {
+  ScanLine line = scan_line(p, p + len);
+  offsets[0] = scan_offset(p, line.eol);
+  offsets[1] = scan_offset(p, line.colon);
+  offsets[2] = scan_offset(p, line.invalid);
+}
+int64_t webs_scan_head_end(const char *p, size_t len) {
+  return scan_offset(p, scan_head_end(p, len));
+}
+int64_t webs_scan_either(const char *p, size_t len, int a, int b) {
+  return scan_offset(p, scan_either(p, p + len, (char)a, (char)b));
+}
 
 // --- Reactivity Wrappers ---
 Value *webs_ref(Value *initial_value) { return ref(initial_value); }
@@ -618,6 +641,13 @@ void webs_auth_delete_session(Value *db_handle_val, const char *session_id) {
   if (error)
     W->freeString(error);
 }
+bool webs_auth_sweep_sessions(Value *db_handle_val) {
+  char *error = NULL;
+  Status status = W->auth->sweepSessions(db_handle_val, &error);
+  if (error)
+    W->freeString(error);
+  return status == OK;
+}
 Value *webs_cookie_parse(const char *cookie_header) {
   return W->cookie->parse(cookie_header);
 }
@@ -669,15 +699,242 @@ Value *webs_db_query(Value *db_handle_val, const char *sql) {
   return results;
 }
 
+#define DB_TEST_MAX_WRITES 64
+
+typedef struct {
+  Value *reader;
+  const char *count_sql;
+  bool ok;
+  char *error;
+  Value *seen;
+} DbWriteTestRun;
+
+static void record_db_write(Status status, const char *error,
+                            void *user_data) {
+  DbWriteTestRun *run = user_data;
+  run->ok = status == OK;
+  run->error = error ? strdup(error) : NULL;
+  char *query_error = NULL;
+  W->db->query(run->reader, run->count_sql, &run->seen, &query_error);
+  if (query_error)
+    W->freeString(query_error);
+}
+
+/**
+ * @brief Queues each statement through a single-writer pool without waiting,
+ * then reports, in order, the status each callback got and what
+ * `count_sql` returned on another connection when it ran. Writes committed
+ * in one transaction see the same rows.
+ */
+char *webs_test_db_write_async(const char *filename,
+                               const char *statements_json,
+                               const char *count_sql) {
+  Status status;
+  Value *statements = webs_json_parse(statements_json, &status);
+  size_t count =
+      statements && W->valueGetType(statements) == VALUE_ARRAY
+          ? W->arrayCount(statements)
+          : 0;
+  if (count == 0 || count > DB_TEST_MAX_WRITES) {
+    if (statements)
+      W->freeValue(statements);
+    return create_json_error("TestError", "Invalid statements for db test.");
+  }
+
+  char *error = NULL;
+  Value *reader = NULL;
+  Value *handle = NULL;
+  DbPoolOptions options = {.single_writer = true};
+  DbPool *pool = W->db->pool(filename, &options);
+  if (!pool || W->db->open(filename, &reader, &error) != OK ||
+      W->db->acquire(pool, &handle, &error) != OK) {
+    char *err = create_json_error("TestError",
+                                  error ? error : "Failed to open database.");
+    if (error)
+      W->freeString(error);
+    if (reader) {
+      W->db->close(reader, NULL);
+      W->freeValue(reader);
+    }
+    W->db->poolFree(pool);
+    W->freeValue(statements);
+    return err;
+  }
+
+  DbWriteTestRun runs[DB_TEST_MAX_WRITES];
+  for (size_t i = 0; i < count; i++) {
+    runs[i] = (DbWriteTestRun){.reader = reader, .count_sql = count_sql};
+    const Value *sql = W->arrayGetRef(statements, i);
+    W->db->writeAsync(handle, W->valueAsString(sql), NULL, record_db_write,
+                      &runs[i]);
+  }
+  W->db->release(pool, handle);
+  // Freeing the pool commits what is still queued, so every callback has
+  // run by the time it returns.
+  W->db->poolFree(pool);
+
+  Value *results = W->array();
+  for (size_t i = 0; i < count; i++) {
+    W->arrayPush(results,
+                 W->objectOf("ok", W->boolean(runs[i].ok), "error",
+                             runs[i].error ? W->string(runs[i].error)
+                                           : W->null(),
+                             "seen", runs[i].seen ? runs[i].seen : W->null(),
+                             NULL));
+    free(runs[i].error);
+  }
+  char *json = W->json->encode(results);
+  W->freeValue(results);
+  W->freeValue(statements);
+  W->db->close(reader, NULL);
+  W->freeValue(reader);
+  return json;
+}
+
+#define DB_TEST_MAX_CONNECTIONS 8
+
+typedef struct {
+  DbPool *pool;
+  Value *handle;
+  struct timespec acquired_at;
+} DbPoolTestWaiter;
+
+static void *wait_for_connection(void *arg) {
+  DbPoolTestWaiter *waiter = arg;
+  W->db->acquire(waiter->pool, &waiter->handle, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &waiter->acquired_at);
+  return NULL;
+}
+
+static bool happened_before(const struct timespec *a,
+                            const struct timespec *b) {
+  return a->tv_sec < b->tv_sec ||
+         (a->tv_sec == b->tv_sec && a->tv_nsec <= b->tv_nsec);
+}
+
+/**
+ * @brief Checks out every connection a pool allows, then reports how many
+ * distinct ones it got, whether a released connection is handed out again,
+ * whether a checkout from another thread waited for a release while the pool
+ * was exhausted, and the connections' journal mode.
+ */
+char *webs_test_db_pool(const char *filename, const char *init_sql,
+                        int max_connections, bool single_writer) {
+  if (max_connections < 1 || max_connections > DB_TEST_MAX_CONNECTIONS)
+    return create_json_error("TestError", "Invalid connection limit.");
+  DbPoolOptions options = {.max_connections = max_connections,
+                           .init_sql = init_sql,
+                           .single_writer = single_writer};
+  DbPool *pool = W->db->pool(filename, &options);
+  if (!pool)
+    return create_json_error("TestError", "Failed to create pool.");
+
+  Value *handles[DB_TEST_MAX_CONNECTIONS] = {0};
+  char *error = NULL;
+  int distinct = 0;
+  for (int i = 0; i < max_connections; i++) {
+    if (W->db->acquire(pool, &handles[i], &error) != OK) {
+      char *err = create_json_error(
+          "TestError", error ? error : "Failed to acquire connection.");
+      if (error)
+        W->freeString(error);
+      for (int j = 0; j < i; j++)
+        W->db->release(pool, handles[j]);
+      W->db->poolFree(pool);
+      return err;
+    }
+    bool seen = false;
+    for (int j = 0; j < i; j++)
+      seen = seen || handles[j] == handles[i];
+    distinct += !seen;
+  }
+
+  Value *released = handles[0];
+  W->db->release(pool, released);
+  W->db->acquire(pool, &handles[0], NULL);
+  bool reused = handles[0] == released;
+
+  // The pool is exhausted again, so the waiter must not get a connection
+  // until the next release.
+  DbPoolTestWaiter waiter = {.pool = pool};
+  pthread_t thread;
+  bool waited = false;
+  if (pthread_create(&thread, NULL, wait_for_connection, &waiter) == 0) {
+    usleep(50 * 1000);
+    struct timespec released_at;
+    clock_gettime(CLOCK_MONOTONIC, &released_at);
+    released = handles[0];
+    W->db->release(pool, released);
+    pthread_join(thread, NULL);
+    handles[0] = waiter.handle;
+    waited = waiter.handle == released &&
+             happened_before(&released_at, &waiter.acquired_at);
+  }
+
+  Value *journal = NULL;
+  W->db->query(handles[0], "PRAGMA journal_mode;", &journal, &error);
+  if (error)
+    W->freeString(error);
+  const Value *row =
+      journal && W->arrayCount(journal) > 0 ? W->arrayGetRef(journal, 0)
+                                            : NULL;
+  const Value *mode = row ? W->objectGetRef(row, "journal_mode") : NULL;
+
+  Value *result = W->objectOf(
+      "connections", W->number(distinct), "reused", W->boolean(reused),
+      "waited", W->boolean(waited), "journalMode",
+      mode ? W->string(W->valueAsString(mode)) : W->null(), NULL);
+  if (journal)
+    W->freeValue(journal);
+  for (int i = 0; i < max_connections; i++)
+    W->db->release(pool, handles[i]);
+  W->db->poolFree(pool);
+  char *json = W->json->encode(result);
+  W->freeValue(result);
+  return json;
+}
+
 // --- Server ---
 Server *webs_server(const char *host, int port) {
   return W->server->start(host, port);
 }
+char *webs_server_configure(Server *server, const char *options_json) {
+  char *error = NULL;
+  Status status = W->server->configure(server, options_json, &error);
+  if (status != OK) {
+    char *json_err = create_json_error(
+        "ServerConfigError", error ? error : "Invalid server options");
+    if (error)
+      W->freeString(error);
+    return json_err;
+  }
+  return create_json_error("OK", "Server configured");
+}
 int webs_server_listen(Server *server, RequestHandler handler) {
   if (!server || !server->listen)
     return -1;
   return server->listen(server, handler);
 }
+char *webs_server_stats(Server *server) {
+  ThreadPoolStats stats;
+  W->server->stats(server, &stats);
+  Value *obj = W->objectOf(
+      "handlerThreads", W->number((double)stats.threads), "queueCapacity",
+      W->number((double)stats.queue_capacity), "queueDepth",
+      W->number((double)stats.queue_depth), "maxQueueDepth",
+      W->number((double)stats.max_queue_depth), "active",
+      W->number((double)stats.active), "submitted",
+      W->number((double)stats.submitted), "completed",
+      W->number((double)stats.completed), "rejected",
+      W->number((double)stats.rejected), "totalWaitUs",
+      W->number((double)stats.total_wait_us), "maxWaitUs",
+      W->number((double)stats.max_wait_us), NULL);
+  if (!obj)
+    return create_json_error("ServerError", "Failed to collect server stats");
+  char *json = W->json->encode(obj);
+  W->freeValue(obj);
+  return json;
+}
 void webs_server_stop(Server *server) {
   if (!server || !server->stop)
     return;
@@ -699,6 +956,77 @@ int webs_static_server(const char *host, int port, const char *public_dir) {
   return W->server->serveStatic(host, port, public_dir);
 }
 
+static pthread_mutex_t test_visits_lock = PTHREAD_MUTEX_INITIALIZER;
+static Value *test_visits = NULL; // Visits per path, kept across requests.
+
+/**
+ * @brief Counts a visit in an object that outlives every request. The count
+ * is built with no arena current, as long-lived values must be; the entry
+ * and key the object adds for it stay on the heap by themselves.
+ */
+static void count_visit(const char *path) {
+  pthread_mutex_lock(&test_visits_lock);
+  Arena *request_arena = W->arena->enter(NULL);
+  if (!test_visits)
+    test_visits = W->object();
+  const Value *seen = W->objectGetRef(test_visits, path);
+  Value *count = W->number(seen ? W->valueAsNumber(seen) + 1 : 1);
+  W->arena->leave(request_arena);
+  W->objectSet(test_visits, path, count);
+  pthread_mutex_unlock(&test_visits_lock);
+}
+
+/**
+ * @brief A request handler for server tests that, unlike a JS callback, may
+ * run on any worker or handler thread. It parses the request into values
+ * from the connection's arena and counts the visit to its path. `GET
+ * /visits` answers with the counts and `GET /sleep/<ms>` waits before it
+ * answers; other requests are answered with their path, or a POST with its
+ * body. Connection handling is left to the server.
+ */
+static void test_server_handler(int client_fd, const char *request) {
+  Arena *previous = W->arena->enter(W->server->requestArena());
+  Value *parsed = NULL;
+  char *error = NULL;
+  if (W->http->parseRequest(request, &parsed, &error) != OK) {
+    W->server->writeResponse(client_fd, "HTTP/1.1 400 Bad Request\r\n"
+                                        "Content-Length: 0\r\n\r\n");
+    free(error);
+    W->freeValue(parsed);
+    W->arena->leave(previous);
+    return;
+  }
+  const char *method =
+      W->valueAsString(W->objectGetRef(parsed, "method"));
+  const char *path = W->valueAsString(W->objectGetRef(parsed, "path"));
+  const char *body = path;
+  char *visits = NULL;
+  if (strcmp(method, "POST") == 0) {
+    body = W->valueAsString(W->objectGetRef(parsed, "body"));
+  } else if (strcmp(path, "/visits") == 0) {
+    pthread_mutex_lock(&test_visits_lock);
+    visits = test_visits ? W->json->encode(test_visits) : NULL;
+    pthread_mutex_unlock(&test_visits_lock);
+    body = visits ? visits : "{}";
+  }
+  if (!visits)
+    count_visit(path);
+  int delay_ms = 0;
+  if (sscanf(path, "/sleep/%d", &delay_ms) == 1 && delay_ms > 0)
+    usleep((useconds_t)delay_ms * 1000);
+  char *response = NULL;
+  if (asprintf(&response,
+               "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n\r\n%s",
+               strlen(body), body) >= 0) {
+    W->server->writeResponse(client_fd, response);
+    free(response);
+  }
+  free(visits);
+  W->freeValue(parsed);
+  W->arena->leave(previous);
+}
+RequestHandler webs_test_server_handler(void) { return test_server_handler; }
+
 // --- Router ---
 Value *webs_router_create(void) {
   Router *router = W->router->create();
@@ -740,6 +1068,80 @@ char *webs_test_run_router_logic(Value *router_obj_val,
   close(pipe_fds[0]);
   return strdup(buffer);
 }
+/**
+ * @brief Routes one raw request and returns what the router wrote.
+ */
+static char *route_raw_request(Router *router, const char *raw_request) {
+  HttpRequest request;
+  char *error = NULL;
+  if (W->http->parse(raw_request, strlen(raw_request), &request, &error) !=
+      OK) {
+    char *err = create_json_error("HTTPRequestParseError",
+                                  error ? error : "Unknown request parse error");
+    if (error)
+      W->freeString(error);
+    return err;
+  }
+  int pipe_fds[2];
+  if (pipe(pipe_fds) == -1)
+    return create_json_error("TestError", "Failed to create pipe.");
+  W->router->handleHttp(router, pipe_fds[1], &request);
+  close(pipe_fds[1]);
+  char buffer[4096] = {0};
+  read(pipe_fds[0], buffer, sizeof(buffer) - 1);
+  close(pipe_fds[0]);
+  return strdup(buffer);
+}
+char *webs_test_run_router_raw(Value *router_obj_val, const char *raw_request) {
+  if (!router_obj_val || !raw_request) {
+    return create_json_error("TestError", "Invalid arguments for router test.");
+  }
+  return route_raw_request((Router *)((Value *)router_obj_val)->as.pointer,
+                           raw_request);
+}
+
+#define ROUTER_TEST_MAX_THREADS 64
+
+typedef struct {
+  Router *router;
+  const char *raw_request;
+  char *response;
+} RouterTestRun;
+
+static void *run_router_test(void *arg) {
+  RouterTestRun *run = arg;
+  run->response = route_raw_request(run->router, run->raw_request);
+  return NULL;
+}
+
+char *webs_test_run_router_concurrent(Value *router_obj_val,
+                                      const char *raw_request, int count) {
+  if (!router_obj_val || !raw_request || count <= 0 ||
+      count > ROUTER_TEST_MAX_THREADS) {
+    return create_json_error("TestError", "Invalid arguments for router test.");
+  }
+  RouterTestRun runs[ROUTER_TEST_MAX_THREADS];
+  pthread_t threads[ROUTER_TEST_MAX_THREADS];
+  int started = 0;
+  for (; started < count; started++) {
+    runs[started] = (RouterTestRun){
+        .router = (Router *)((Value *)router_obj_val)->as.pointer,
+        .raw_request = raw_request};
+    if (pthread_create(&threads[started], NULL, run_router_test,
+                       &runs[started]) != 0)
+      break;
+  }
+  Value *responses = W->array();
+  for (int i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+    W->arrayPush(responses, W->string(runs[i].response ? runs[i].response
+                                                       : ""));
+    free(runs[i].response);
+  }
+  char *json = W->json->encode(responses);
+  W->freeValue(responses);
+  return json;
+}
 
 // --- Bundler ---
 Status webs_bundle(const char *entry_file, const char *output_dir,
@@ -18,6 +18,7 @@
 #include "core/object.h"
 #include "core/pointer.h"
 #include "core/regex.h"
+#include "core/scan.h"
 #include "core/string.h"
 #include "core/string_builder.h"
 #include "core/undefined.h"
@@ -88,6 +89,11 @@ char *webs_string_replace(const char *str, const char *search,
                           const char *replace);
 int webs_string_compare(const char *s1, const char *s2);
 Value *webs_regex_parse(const char *pattern, Status *status);
+bool webs_scan_set_kernel(int kernel);
+int webs_scan_kernel(void);
+void webs_scan_line(const char *p, size_t len, int64_t *offsets);
+int64_t webs_scan_head_end(const char *p, size_t len);
+int64_t webs_scan_either(const char *p, size_t len, int a, int b);
 
 // --- Reactivity API ---
 Value *webs_ref(Value *initial_value);
@@ -132,6 +138,7 @@ char *webs_auth_create_session(Value *db_handle_val, const char *username);
 Value *webs_auth_get_user_from_session(Value *db_handle_val,
                                        const char *session_id);
 void webs_auth_delete_session(Value *db_handle_val, const char *session_id);
+bool webs_auth_sweep_sessions(Value *db_handle_val);
 Value *webs_cookie_parse(const char *cookie_header);
 char *webs_cookie_serialize(const char *name, const char *value,
                             Value *options);
@@ -141,6 +148,11 @@ Value *webs_db_open(const char *filename);
 Value *webs_db_close(Value *db_handle_val);
 Value *webs_db_exec(Value *db_handle_val, const char *sql);
 Value *webs_db_query(Value *db_handle_val, const char *sql);
+char *webs_test_db_write_async(const char *filename,
+                               const char *statements_json,
+                               const char *count_sql);
+char *webs_test_db_pool(const char *filename, const char *init_sql,
+                        int max_connections, bool single_writer);
 
 // --- Framework & Tooling APIs ---
 Status webs_bundle(const char *entry_file, const char *output_dir,
@@ -170,7 +182,9 @@ char *webs_render_vdom(const char *template_string, const char *context_json);
 
 // --- Server APIs ---
 Server *webs_server(const char *host, int port);
+char *webs_server_configure(Server *server, const char *options_json);
 int webs_server_listen(Server *server, RequestHandler handler);
+char *webs_server_stats(Server *server);
 void webs_server_stop(Server *server);
 void webs_server_destroy(Server *server);
 void webs_server_write_response(int client_fd, const char *response);
@@ -179,12 +193,16 @@ void webs_http_stream_begin(int client_fd, int status_code,
 void webs_http_stream_write_chunk(int client_fd, const char *data, size_t len);
 void webs_http_stream_end(int client_fd);
 int webs_static_server(const char *host, int port, const char *public_dir);
+RequestHandler webs_test_server_handler(void);
 
 // --- Router API (for testing and future C-native server setup) ---
 Value *webs_router_create(void);
 void webs_router_free(Value *router_ptr_val);
 char *webs_test_run_router_logic(Value *router_ptr_val,
                                  const char *request_json);
+char *webs_test_run_router_raw(Value *router_ptr_val, const char *raw_request);
+char *webs_test_run_router_concurrent(Value *router_ptr_val,
+                                      const char *raw_request, int count);
 
 // --- Memory Management ---
 void webs_free_string(char *str);
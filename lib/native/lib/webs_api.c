@@ -229,6 +229,12 @@ static Status api_db_query(Value *db_handle_val, const char *sql,
   return OK;
 }
 
+static Status api_db_acquire(DbPool *pool, Value **out_db_handle,
+                             char **out_error) {
+  *out_db_handle = db_pool_acquire(pool, out_error);
+  return *out_db_handle ? OK : ERROR_IO;
+}
+
 static Status api_json_parse(const char *json_string, Value **out_value,
                              char **out_error) {
   Status status;
@@ -282,6 +288,13 @@ static Status api_http_parseRequest(const char *raw_request, Value **out_value,
   return (*out_error == NULL) ? OK : ERROR_PARSE;
 }
 
+static Status api_http_parseRequestLength(const char *raw_request,
+                                          size_t length, Value **out_value,
+                                          char **out_error) {
+  *out_value = webs_http_parse_request_length(raw_request, length, out_error);
+  return (*out_error == NULL) ? OK : ERROR_PARSE;
+}
+
 static Status api_http_fetch(const char *url, const char *options_json,
                              char **out_json_response, char **out_error) {
   *out_json_response = webs_fetch_sync(url, options_json, out_error);
@@ -375,8 +388,39 @@ static const WebsFsApi g_webs_fs_api = {
 };
 static const WebsDbApi g_webs_db_api = {.open = api_db_open,
                                         .close = api_db_close,
+                                        .filename = db_filename,
                                         .exec = api_db_exec,
-                                        .query = api_db_query};
+                                        .query = api_db_query,
+                                        .prepare = db_prepare,
+                                        .bindInt = db_bind_int,
+                                        .bindDouble = db_bind_double,
+                                        .bindText = db_bind_text,
+                                        .bindNull = db_bind_null,
+                                        .bindValue = db_bind_value,
+                                        .step = db_step,
+                                        .columnCount = db_column_count,
+                                        .columnName = db_column_name,
+                                        .columnIsNull = db_column_is_null,
+                                        .columnInt = db_column_int,
+                                        .columnDouble = db_column_double,
+                                        .columnText = db_column_text,
+                                        .row = db_row,
+                                        .queryJson = db_query_json,
+                                        .finish = db_finish,
+                                        .resultSet = db_result_set,
+                                        .resultIsNull = db_result_set_is_null,
+                                        .resultText = db_result_set_text,
+                                        .resultJson = db_result_set_json,
+                                        .resultFree = db_result_set_free,
+                                        .cursor = db_cursor,
+                                        .cursorNext = db_cursor_next,
+                                        .cursorFree = db_cursor_free,
+                                        .pool = db_pool,
+                                        .poolFree = db_pool_free,
+                                        .acquire = api_db_acquire,
+                                        .release = db_pool_release,
+                                        .write = db_write,
+                                        .writeAsync = db_write_async};
 static const WebsJsonApi g_webs_json_api = {.parse = api_json_parse,
                                             .encode = json_encode,
                                             .query = api_json_query,
@@ -385,13 +429,27 @@ static const WebsJsonApi g_webs_json_api = {.parse = api_json_parse,
 static const WebsUrlApi g_webs_url_api = {.decode = api_url_decode,
                                           .matchRoute = api_url_matchRoute};
 static const WebsHttpApi g_webs_http_api = {
-    .parseRequest = api_http_parseRequest, .fetch = api_http_fetch};
+    .parseRequest = api_http_parseRequest,
+    .parseRequestLength = api_http_parseRequestLength,
+    .parse = http_request_parse,
+    .header = http_request_header,
+    .requestValue = http_request_value,
+    .fetch = api_http_fetch};
 static const WebsServerApi g_webs_server_api = {
     .start = server,
+    .configure = server_configure,
     .listen = NULL,
+    .stats = server_stats,
+    .streamBodies = server_stream_bodies,
+    .requestLength = server_request_length,
+    .requestArena = server_request_arena,
     .stop = NULL,
     .destroy = server_destroy,
     .writeResponse = server_write_response,
+    .write = server_write,
+    .captureBegin = server_capture_begin,
+    .captureEnd = server_capture_end,
+    .sendFile = server_send_file,
     .serveStatic = static_server_run,
     .streamBegin = http_stream_begin,
     .streamWrite = http_stream_write_chunk,
@@ -402,25 +460,47 @@ static const WebsRouterApi g_webs_router_api = {
     .free = router_free,
     .addRoute = router_add_route,
     .addRouteWithMiddleware = router_add_route_with_middleware,
-    .handleRequest = router_handle_request};
+    .useDb = router_use_db,
+    .sweepSessions = router_sweep_sessions,
+    .cacheRoute = router_cache_route,
+    .handleRequest = router_handle_request,
+    .handleHttp = router_handle_http};
 static const WebsAuthApi g_webs_auth_api = {
     .hashPassword = auth_hash_password,
     .verifyPassword = auth_verify_password,
     .createSession = api_auth_createSession,
     .getUserFromSession = api_auth_getUserFromSession,
     .deleteSession = api_auth_deleteSession,
+    .sweepSessions = auth_sweep_sessions,
 };
 static const WebsCookieApi g_webs_cookie_api = {.parse = cookie_parse,
                                                 .serialize = cookie_serialize};
 static const WebsPathApi g_webs_path_api = {.resolve = path_resolve,
                                             .dirname = path_dirname};
+static const WebsArenaApi g_webs_arena_api = {.create = arena,
+                                              .free = arena_free,
+                                              .reset = arena_reset,
+                                              .alloc = arena_alloc,
+                                              .enter = arena_enter,
+                                              .leave = arena_leave,
+                                              .current = arena_current};
 static const WebsStringBuilderApi g_webs_string_builder_api = {
     .init = sb_init,
+    .initArena = sb_init_arena,
     .appendStr = sb_append_str,
+    .appendBytes = sb_append_bytes,
     .appendChar = sb_append_char,
     .appendHtmlEscaped = sb_append_html_escaped,
     .toString = sb_to_string,
     .free = sb_free};
+static const WebsResponseApi g_webs_response_api = {
+    .init = response_init,
+    .header = response_header,
+    .body = response_body,
+    .bodyOwned = response_body_owned,
+    .file = response_file,
+    .send = response_send,
+    .free = response_free};
 
 static const WebsApi g_webs_api = {
     .string = webs_string,
@@ -495,6 +575,8 @@ static const WebsApi g_webs_api = {
     .cookie = &g_webs_cookie_api,
     .path = &g_webs_path_api,
     .stringBuilder = &g_webs_string_builder_api,
+    .response = &g_webs_response_api,
+    .arena = &g_webs_arena_api,
 };
 
 const WebsApi *webs() { return &g_webs_api; }
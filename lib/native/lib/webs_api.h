@@ -1,18 +1,24 @@
 #ifndef WEBS_API_H
 #define WEBS_API_H
 
+#include "core/arena.h"
 #include "core/string_builder.h"
 #include "core/types.h"
 #include "framework/router.h"
+#include "modules/response.h"
+#include "modules/thread_pool.h"
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <sys/types.h>
 
 // Forward declarations to keep this header self-contained
 typedef struct Value Value;
 typedef struct VNode VNode;
 typedef struct Engine Engine;
 typedef struct Server Server;
+typedef struct ServerCapture ServerCapture;
+typedef struct BodyStream BodyStream;
 typedef struct ComponentInstance ComponentInstance;
 typedef struct Map Map;
 typedef void (*RequestHandler)(int client_fd, const char *request);
@@ -32,6 +38,8 @@ typedef struct WebsAuthApi WebsAuthApi;
 typedef struct WebsCookieApi WebsCookieApi;
 typedef struct WebsPathApi WebsPathApi;
 typedef struct WebsStringBuilderApi WebsStringBuilderApi;
+typedef struct WebsResponseApi WebsResponseApi;
+typedef struct WebsArenaApi WebsArenaApi;
 
 /**
  * @struct WebsApi
@@ -140,6 +148,8 @@ typedef struct {
   const WebsCookieApi *const cookie;
   const WebsPathApi *const path;
   const WebsStringBuilderApi *const stringBuilder;
+  const WebsResponseApi *const response;
+  const WebsArenaApi *const arena;
 } WebsApi;
 
 struct WebsConsoleApi {
@@ -166,9 +176,48 @@ struct WebsFsApi {
 struct WebsDbApi {
   Status (*open)(const char *filename, Value **out_db_handle, char **out_error);
   Status (*close)(Value *db_handle_val, char **out_error);
+  const char *(*filename)(Value *db_handle_val);
   Status (*exec)(Value *db_handle_val, const char *sql, char **out_error);
   Status (*query)(Value *db_handle_val, const char *sql,
                   Value **out_results_array, char **out_error);
+  Status (*prepare)(Value *db_handle_val, const char *sql,
+                    DbStatement **out_statement, char **out_error);
+  Status (*bindInt)(DbStatement *statement, int index, int64_t value);
+  Status (*bindDouble)(DbStatement *statement, int index, double value);
+  Status (*bindText)(DbStatement *statement, int index, const char *text);
+  Status (*bindNull)(DbStatement *statement, int index);
+  Status (*bindValue)(DbStatement *statement, int index, const Value *value);
+  DbStep (*step)(DbStatement *statement, char **out_error);
+  int (*columnCount)(DbStatement *statement);
+  const char *(*columnName)(DbStatement *statement, int column);
+  bool (*columnIsNull)(DbStatement *statement, int column);
+  int64_t (*columnInt)(DbStatement *statement, int column);
+  double (*columnDouble)(DbStatement *statement, int column);
+  const char *(*columnText)(DbStatement *statement, int column);
+  Value *(*row)(DbStatement *statement);
+  Status (*queryJson)(DbStatement *statement, StringBuilder *sb,
+                      char **out_error);
+  void (*finish)(DbStatement *statement);
+  Status (*resultSet)(DbStatement *statement, DbResultSet **out_set,
+                      char **out_error);
+  bool (*resultIsNull)(const DbResultSet *set, int column, size_t row);
+  const char *(*resultText)(const DbResultSet *set, int column, size_t row,
+                            size_t *out_length);
+  Status (*resultJson)(const DbResultSet *set, StringBuilder *sb);
+  void (*resultFree)(DbResultSet *set);
+  DbCursor *(*cursor)(DbStatement *statement);
+  DbStep (*cursorNext)(DbCursor *cursor, const Value **out_row,
+                       char **out_error);
+  void (*cursorFree)(DbCursor *cursor);
+  DbPool *(*pool)(const char *filename, const DbPoolOptions *options);
+  void (*poolFree)(DbPool *pool);
+  Status (*acquire)(DbPool *pool, Value **out_db_handle, char **out_error);
+  void (*release)(DbPool *pool, Value *db_handle_val);
+  Status (*write)(Value *db_handle_val, const char *sql, const Value *params,
+                  char **out_error);
+  void (*writeAsync)(Value *db_handle_val, const char *sql,
+                     const Value *params, DbWriteCallback callback,
+                     void *user_data);
 };
 
 struct WebsJsonApi {
@@ -188,16 +237,33 @@ struct WebsUrlApi {
 struct WebsHttpApi {
   Status (*parseRequest)(const char *raw_request, Value **out_value,
                          char **out_error);
+  Status (*parseRequestLength)(const char *raw_request, size_t length,
+                               Value **out_value, char **out_error);
+  Status (*parse)(const char *raw_request, size_t length,
+                  HttpRequest *out_request, char **out_error);
+  bool (*header)(const HttpRequest *request, const char *name,
+                 HttpSpan *out_value);
+  Value *(*requestValue)(const HttpRequest *request);
   Status (*fetch)(const char *url, const char *options_json,
                   char **out_json_response, char **out_error);
 };
 
 struct WebsServerApi {
   Server *(*start)(const char *host, int port);
+  Status (*configure)(Server *server, const char *options_json,
+                      char **out_error);
   int (*listen)(Server *server, RequestHandler handler);
+  void (*stats)(Server *server, ThreadPoolStats *out_stats);
+  void (*streamBodies)(Server *server, const BodyStream *stream);
+  size_t (*requestLength)(void);
+  Arena *(*requestArena)(void);
   void (*stop)(Server *server);
   void (*destroy)(Server *server);
   void (*writeResponse)(int client_fd, const char *response);
+  void (*write)(int client_fd, const void *data, size_t len);
+  void (*captureBegin)(ServerCapture *capture, int client_fd);
+  void (*captureEnd)(ServerCapture *capture);
+  void (*sendFile)(int client_fd, int file_fd, off_t offset, size_t length);
   int (*serveStatic)(const char *host, int port, const char *public_dir);
   void (*streamBegin)(int client_fd, int status_code, const char *content_type);
   void (*streamWrite)(int client_fd, const char *data, size_t len);
@@ -216,7 +282,13 @@ struct WebsRouterApi {
   void (*addRouteWithMiddleware)(Router *router, HttpMethod method,
                                  const char *path, MiddlewareFunc *middleware,
                                  int middleware_count, RouteHandler handler);
+  void (*useDb)(Router *router, DbPool *pool);
+  Status (*sweepSessions)(Router *router, int interval_ms, char **error);
+  Status (*cacheRoute)(Router *router, HttpMethod method, const char *path,
+                       const RouteCacheOptions *options, char **error);
   void (*handleRequest)(Router *router, int client_fd, Value *request);
+  void (*handleHttp)(Router *router, int client_fd,
+                     const HttpRequest *request);
 };
 
 struct WebsAuthApi {
@@ -228,6 +300,7 @@ struct WebsAuthApi {
                                Value **out_user, char **out_error);
   Status (*deleteSession)(Value *db_handle_val, const char *session_id,
                           char **out_error);
+  Status (*sweepSessions)(Value *db_handle_val, char **out_error);
 };
 
 struct WebsCookieApi {
@@ -240,15 +313,38 @@ struct WebsPathApi {
   char *(*dirname)(const char *path);
 };
 
+struct WebsArenaApi {
+  Arena *(*create)(size_t chunk_size);
+  void (*free)(Arena *arena);
+  void (*reset)(Arena *arena);
+  void *(*alloc)(Arena *arena, size_t size);
+  Arena *(*enter)(Arena *arena);
+  void (*leave)(Arena *previous);
+  Arena *(*current)(void);
+};
+
 struct WebsStringBuilderApi {
   void (*init)(StringBuilder *sb);
+  void (*initArena)(StringBuilder *sb, Arena *arena);
   void (*appendStr)(StringBuilder *sb, const char *str);
+  void (*appendBytes)(StringBuilder *sb, const char *data, size_t len);
   void (*appendChar)(StringBuilder *sb, char c);
   void (*appendHtmlEscaped)(StringBuilder *sb, const char *text);
   char *(*toString)(StringBuilder *sb);
   void (*free)(StringBuilder *sb);
 };
 
+struct WebsResponseApi {
+  void (*init)(Response *res, int client_fd, int status_code,
+               const char *reason);
+  void (*header)(Response *res, const char *name, const char *value);
+  void (*body)(Response *res, const void *data, size_t len);
+  void (*bodyOwned)(Response *res, void *data, size_t len);
+  void (*file)(Response *res, int file_fd, off_t offset, size_t length);
+  void (*send)(Response *res);
+  void (*free)(Response *res);
+};
+
 const WebsApi *webs();
 
 #define W webs()
@@ -0,0 +1,138 @@
+import { test, expect, describe, afterAll } from 'bun:test';
+import { symbols } from '../bindings.js';
+import { dlopen } from 'bun:ffi';
+import { resolve } from 'path';
+
+const libPath = resolve(import.meta.dir, '../.webs.dylib');
+const lib = dlopen(libPath, symbols);
+
+const {
+  webs_scan_set_kernel,
+  webs_scan_kernel,
+  webs_scan_line,
+  webs_scan_head_end,
+  webs_scan_either,
+} = lib.symbols;
+
+const SCAN_SCALAR = 0;
+const KERNELS = { sse2: 1, avx2: 2 };
+const SEMI = ';'.charCodeAt(0);
+const EQUALS = '='.charCodeAt(0);
+
+// Copies the input into a buffer one byte longer, so that even an empty
+// input has an address to scan from.
+function toBuffer(bytes) {
+  const buffer = Buffer.alloc(bytes.length + 1);
+  buffer.set(bytes);
+  return buffer;
+}
+
+function scanAll(bytes) {
+  const buffer = toBuffer(bytes);
+  const offsets = new BigInt64Array(3);
+  webs_scan_line(buffer, bytes.length, offsets);
+  return {
+    line: Array.from(offsets, Number),
+    headEnd: Number(webs_scan_head_end(buffer, bytes.length)),
+    either: Number(webs_scan_either(buffer, bytes.length, SEMI, EQUALS)),
+  };
+}
+
+function withTarget(length, offset, target) {
+  const bytes = Buffer.alloc(length, 'a');
+  bytes.set(target.slice(0, length - offset), offset);
+  return bytes;
+}
+
+// Every length up to a little over two AVX2 blocks, with each interesting
+// byte or sequence placed at every offset.
+function buildInputs() {
+  const targets = [
+    '\n', ':', '\r', '\r\n', '\r\n\r\n', '\r\n\r', '\t', ';', '=',
+    '\x00', '\x01', '\x1f', '\x7f', '\x80', '\xff',
+  ].map((target) => Buffer.from(target, 'latin1'));
+  const inputs = [];
+  for (let length = 0; length <= 70; length++) {
+    inputs.push(Buffer.alloc(length, 'a'));
+    for (let offset = 0; offset < length; offset++) {
+      for (const target of targets) {
+        inputs.push(withTarget(length, offset, target));
+      }
+    }
+  }
+  return inputs;
+}
+
+const defaultKernel = webs_scan_kernel();
+
+afterAll(() => {
+  webs_scan_set_kernel(defaultKernel);
+});
+
+describe('Webs C Core Scan', () => {
+  test('the scalar kernel finds lines, colons and control characters', () => {
+    webs_scan_set_kernel(SCAN_SCALAR);
+    expect(scanAll(Buffer.from('Host: x\r\n')).line).toEqual([8, 4, -1]);
+    expect(scanAll(Buffer.from('no newline')).line).toEqual([10, -1, -1]);
+    expect(scanAll(Buffer.from('a\x01b:\r\n')).line).toEqual([5, 3, 1]);
+    expect(scanAll(Buffer.from('a\x7f\n')).line).toEqual([2, -1, 1]);
+    expect(scanAll(Buffer.from('a\rb\n')).line).toEqual([3, -1, 1]);
+    expect(scanAll(Buffer.from('a\tb\n')).line).toEqual([3, -1, -1]);
+    expect(scanAll(Buffer.from('\n:\x01')).line).toEqual([0, -1, -1]);
+  });
+
+  test('the scalar kernel finds the end of the head', () => {
+    webs_scan_set_kernel(SCAN_SCALAR);
+    expect(scanAll(Buffer.from('GET / HTTP/1.1\r\n\r\n')).headEnd).toBe(14);
+    expect(scanAll(Buffer.from('GET / HTTP/1.1\r\n\r')).headEnd).toBe(-1);
+    expect(scanAll(Buffer.from('\n\n\r\n\r\n')).headEnd).toBe(2);
+    expect(scanAll(Buffer.from('')).headEnd).toBe(-1);
+  });
+
+  test('the scalar kernel finds either byte', () => {
+    webs_scan_set_kernel(SCAN_SCALAR);
+    expect(scanAll(Buffer.from('a=1; b=2')).either).toBe(1);
+    expect(scanAll(Buffer.from('flag; a=1')).either).toBe(4);
+    expect(scanAll(Buffer.from('none')).either).toBe(4);
+    expect(scanAll(Buffer.from('')).either).toBe(0);
+  });
+
+  for (const [name, kernel] of Object.entries(KERNELS)) {
+    test(`the ${name} kernel matches the scalar kernel`, () => {
+      if (!webs_scan_set_kernel(kernel)) {
+        console.log(`Skipping ${name}: not supported by this CPU.`);
+        return;
+      }
+      const inputs = buildInputs();
+      const results = inputs.map(scanAll);
+
+      webs_scan_set_kernel(SCAN_SCALAR);
+      const mismatches = [];
+      inputs.forEach((input, i) => {
+        const expected = scanAll(input);
+        if (JSON.stringify(results[i]) !== JSON.stringify(expected)) {
+          const text = input.toString('latin1');
+          mismatches.push({ input: text, actual: results[i], expected });
+        }
+      });
+      expect(mismatches.slice(0, 5)).toEqual([]);
+    });
+
+    test(`the ${name} kernel finds a head end straddling a block`, () => {
+      if (!webs_scan_set_kernel(kernel)) return;
+      const block = kernel === KERNELS.avx2 ? 32 : 16;
+      for (let split = 1; split < 4; split++) {
+        for (const blocks of [1, 2]) {
+          const offset = block * blocks - split;
+          const input = withTarget(
+            offset + 9,
+            offset,
+            Buffer.from('\r\n\r\n'),
+          );
+          expect(scanAll(input).headEnd).toBe(offset);
+        }
+      }
+      webs_scan_set_kernel(SCAN_SCALAR);
+    });
+  }
+});
@@ -132,4 +132,41 @@ describe('Webs C Bundler (Dependency Graph)', () => {
     expect(jsBundleContent).toInclude('components: { Button }');
     expect(jsBundleContent).toInclude('<h1>Hello from App</h1>');
   });
+
+  test('should write gzip sidecars next to the bundles', () => {
+    const lines = Array.from(
+      { length: 200 },
+      (_, i) => `console.log('line ${i}');`,
+    ).join('\n');
+    writeFileSync(resolve(TEST_INPUT_DIR, 'entry.js'), lines);
+
+    const entryFile = resolve(TEST_INPUT_DIR, 'entry.js');
+    expect(() => runBundler(entryFile, TEST_OUTPUT_DIR)).not.toThrow();
+
+    const jsBundlePath = resolve(TEST_OUTPUT_DIR, 'bundle.js');
+    const gzipPath = resolve(TEST_OUTPUT_DIR, 'bundle.js.gz');
+    expect(existsSync(gzipPath)).toBe(true);
+    const compressed = readFileSync(gzipPath);
+    expect(compressed.length).toBeLessThan(readFileSync(jsBundlePath).length);
+    expect(new TextDecoder().decode(Bun.gunzipSync(compressed))).toBe(
+      readFileSync(jsBundlePath, 'utf-8'),
+    );
+  });
+
+  test('should not leave a stale Brotli sidecar behind', () => {
+    writeFileSync(
+      resolve(TEST_INPUT_DIR, 'entry.js'),
+      "console.log('rebuilt');\n".repeat(100),
+    );
+    const brotliPath = resolve(TEST_OUTPUT_DIR, 'bundle.js.br');
+    writeFileSync(brotliPath, 'stale');
+
+    const entryFile = resolve(TEST_INPUT_DIR, 'entry.js');
+    expect(() => runBundler(entryFile, TEST_OUTPUT_DIR)).not.toThrow();
+
+    // Builds without Brotli remove it; builds with Brotli rewrite it.
+    if (existsSync(brotliPath)) {
+      expect(readFileSync(brotliPath, 'utf-8')).not.toBe('stale');
+    }
+  });
 });
@@ -11,6 +11,8 @@ const {
   webs_router_create,
   webs_router_free,
   webs_test_run_router_logic,
+  webs_test_run_router_raw,
+  webs_test_run_router_concurrent,
   webs_free_string,
 } = lib.symbols;
 
@@ -52,6 +54,35 @@ describe('Webs C Native Router', () => {
     }
   }
 
+  function runRawRequest(rawRequest) {
+    const responsePtr = webs_test_run_router_raw(
+      routerPtr,
+      Buffer.from(rawRequest + '\0'),
+    );
+    if (!responsePtr || responsePtr.ptr === 0) {
+      return '';
+    }
+
+    try {
+      return new CString(responsePtr).toString();
+    } finally {
+      webs_free_string(responsePtr);
+    }
+  }
+
+  function runConcurrentRequests(rawRequest, count) {
+    const responsePtr = webs_test_run_router_concurrent(
+      routerPtr,
+      Buffer.from(rawRequest + '\0'),
+      count,
+    );
+    try {
+      return JSON.parse(new CString(responsePtr).toString());
+    } finally {
+      webs_free_string(responsePtr);
+    }
+  }
+
   function getCookieFromResponse(rawResponse) {
     const match = rawResponse.match(/Set-Cookie: (session_id=[^;]+)/);
     return match ? match[1] : null;
@@ -93,6 +124,32 @@ describe('Webs C Native Router', () => {
     expect(response).toInclude('404 Not Found');
   });
 
+  test('should not match an empty route parameter', () => {
+    const request = { method: 'GET', path: '/users/' };
+    const response = runTestRequest(request);
+    expect(response).toInclude('404 Not Found');
+  });
+
+  test('should decode percent-escapes in route parameters', () => {
+    const request = { method: 'GET', path: '/users/a%20b' };
+    const response = runTestRequest(request);
+    expect(response).toInclude('User Handler Called for ID: a b');
+  });
+
+  test('should drop a header value that would split the response', () => {
+    const redirect = runTestRequest({ method: 'GET', path: '/redirect/home' });
+    expect(redirect).toStartWith('HTTP/1.1 302 Found');
+    expect(redirect).toInclude('Location: home\r\n');
+
+    const injected = runTestRequest({
+      method: 'GET',
+      path: '/redirect/x%0D%0ASet-Cookie:%20evil=1',
+    });
+    expect(injected).toStartWith('HTTP/1.1 302 Found');
+    expect(injected).not.toInclude('Location');
+    expect(injected).not.toInclude('Set-Cookie');
+  });
+
   test('should run middleware for an unauthenticated user', () => {
     const request = { method: 'GET', path: '/users/777' };
     const response = runTestRequest(request);
@@ -131,6 +188,73 @@ describe('Webs C Native Router', () => {
     );
   });
 
+  test('should bind quoted usernames instead of splicing them into SQL', () => {
+    const credentials = JSON.stringify({
+      username: "O'Brien'); DROP TABLE users; --",
+      password: 'password',
+    });
+    const registerResponse = runTestRequest({
+      method: 'POST',
+      path: '/register',
+      body: credentials,
+    });
+    expect(registerResponse).toInclude('201 Created');
+
+    const loginResponse = runTestRequest({
+      method: 'POST',
+      path: '/login',
+      body: credentials,
+    });
+    const sessionCookie = getCookieFromResponse(loginResponse);
+    expect(sessionCookie).not.toBeNull();
+
+    const response = runTestRequest({
+      method: 'GET',
+      path: '/users/1',
+      headers: { cookie: sessionCookie },
+    });
+    expect(response).toInclude(
+      "(Authenticated as O'Brien'); DROP TABLE users; --)",
+    );
+  });
+
+  test('should stream rows from a database cursor', () => {
+    runTestRequest({
+      method: 'POST',
+      path: '/register',
+      body: JSON.stringify({ username: 'Stream User', password: 'password' }),
+    });
+    const response = runTestRequest({ method: 'GET', path: '/usernames' });
+    expect(response).toInclude('Transfer-Encoding: chunked');
+    expect(response).toInclude('Stream User\r\n');
+    expect(response).toEndWith('0\r\n\r\n');
+  });
+
+  test('should serialize query rows straight to JSON', () => {
+    runTestRequest({
+      method: 'POST',
+      path: '/register',
+      body: JSON.stringify({ username: 'Json "User"', password: 'password' }),
+    });
+    const response = runTestRequest({ method: 'GET', path: '/users.json' });
+    expect(response).toInclude('Content-Type: application/json');
+    const rows = JSON.parse(response.slice(response.indexOf('\r\n\r\n') + 4));
+    const row = rows.find((r) => r.username === 'Json "User"');
+    expect(row).toBeDefined();
+    expect(Number.isInteger(row.id)).toBe(true);
+  });
+
+  test('should encode a columnar result set as JSON rows', () => {
+    const response = runTestRequest({ method: 'GET', path: '/users.columns' });
+    expect(response).toInclude('Content-Type: application/json');
+    const rows = JSON.parse(response.slice(response.indexOf('\r\n\r\n') + 4));
+    expect(rows.length).toBeGreaterThan(0);
+    for (const row of rows) {
+      expect(Number.isInteger(row.id)).toBe(true);
+      expect(row.half).toBe(row.username.length / 2);
+    }
+  });
+
   test('should not match if the method is different', () => {
     const request = { method: 'POST', path: '/' };
     const response = runTestRequest(request);
@@ -142,4 +266,71 @@ describe('Webs C Native Router', () => {
     const response = runTestRequest(request);
     expect(response).toInclude('User Handler Called for ID: abc-xyz');
   });
+
+  test('should route a raw request without a query string', () => {
+    const response = runRawRequest(
+      'GET /posts/2024/12?page=2 HTTP/1.1\r\nHost: localhost\r\n\r\n',
+    );
+    expect(response).toInclude('Posts for 12/2024');
+  });
+
+  test('should read the body of a raw request up to Content-Length', () => {
+    const response = runRawRequest(
+      'POST /data HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello world',
+    );
+    expect(response).toInclude('POST Handled: hello');
+    expect(response).not.toInclude('hello world');
+  });
+
+  test('should find raw request headers regardless of case', () => {
+    runTestRequest({
+      method: 'POST',
+      path: '/register',
+      body: JSON.stringify({ username: 'Raw User', password: 'password' }),
+    });
+    const loginResponse = runTestRequest({
+      method: 'POST',
+      path: '/login',
+      body: JSON.stringify({ username: 'Raw User', password: 'password' }),
+    });
+    const sessionCookie = getCookieFromResponse(loginResponse);
+    expect(sessionCookie).not.toBeNull();
+
+    const response = runRawRequest(
+      `GET /users/5 HTTP/1.1\r\nCOOKIE: ${sessionCookie}\r\n\r\n`,
+    );
+    expect(response).toInclude(
+      'User Handler Called for ID: 5 (Authenticated as Raw User)',
+    );
+  });
+
+  test('should replay a cached route until the query changes', () => {
+    const first = runTestRequest({ method: 'GET', path: '/cached' });
+    expect(first).toInclude('Cached Handler Call');
+    expect(runTestRequest({ method: 'GET', path: '/cached' })).toBe(first);
+    expect(
+      runRawRequest('GET /cached HTTP/1.1\r\nHost: localhost\r\n\r\n'),
+    ).toBe(first);
+
+    const other = runTestRequest({ method: 'GET', path: '/cached?page=2' });
+    expect(other).toInclude('Cached Handler Call');
+    expect(other).not.toBe(first);
+  });
+
+  test('should not queue requests behind an uncacheable response', () => {
+    const request = 'GET /cached/cookie HTTP/1.1\r\nHost: localhost\r\n\r\n';
+    const responses = runConcurrentRequests(request, 4);
+    expect(responses.length).toBe(4);
+    for (const response of responses) {
+      expect(response).toInclude('Set-Cookie: visited=1');
+    }
+    // Later requests bypass the cache instead of each filling it in turn.
+    const peaks = responses.map((r) => Number(r.match(/Peak (\d+)/)[1]));
+    expect(Math.max(...peaks)).toBeGreaterThan(1);
+  });
+
+  test('should return a 404 for an unknown raw method', () => {
+    const response = runRawRequest('BREW / HTTP/1.1\r\n\r\n');
+    expect(response).toInclude('404 Not Found');
+  });
 });
@@ -0,0 +1,41 @@
+import { symbols } from '../../bindings.js';
+import { dlopen } from 'bun:ffi';
+import { resolve } from 'path';
+
+// Serves with the library's own test handler, which unlike a JSCallback can
+// run on several workers or on handler threads. Takes server options as a
+// JSON argument, e.g. '{"handlerThreads":2}'.
+const libPath = resolve(import.meta.dir, '../../.webs.dylib');
+const lib = dlopen(libPath, symbols);
+
+const {
+  webs_server,
+  webs_server_configure,
+  webs_server_listen,
+  webs_server_destroy,
+  webs_set_log_level,
+  webs_test_server_handler,
+  webs_free_string,
+} = lib.symbols;
+
+webs_set_log_level(4);
+
+const serverPtr = webs_server(Buffer.from('127.0.0.1\0'), 0);
+
+if (!serverPtr) {
+  console.error('Failed to create server');
+  process.exit(1);
+}
+
+const options = process.argv[2];
+if (options) {
+  webs_free_string(
+    webs_server_configure(serverPtr, Buffer.from(options + '\0')),
+  );
+}
+
+try {
+  webs_server_listen(serverPtr, webs_test_server_handler());
+} finally {
+  webs_server_destroy(serverPtr);
+}
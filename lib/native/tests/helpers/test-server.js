@@ -8,6 +8,7 @@ const lib = dlopen(libPath, symbols);
 
 const {
   webs_server,
+  webs_server_configure,
   webs_server_listen,
   webs_server_stop,
   webs_server_destroy,
@@ -16,6 +17,7 @@ const {
   webs_http_stream_begin,
   webs_http_stream_write_chunk,
   webs_http_stream_end,
+  webs_free_string,
 } = lib.symbols;
 
 webs_set_log_level(4);
@@ -61,7 +63,9 @@ const handlerCallback = new JSCallback(
       return;
     }
 
-    if (method === 'GET' && path === '/') {
+    if (method === 'GET' && path === '/keep-alive') {
+      responseText = 'HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nkeep-alive';
+    } else if (method === 'GET' && path === '/') {
       responseText =
         'HTTP/1.1 200 OK\r\nContent-Length: 12\r\nConnection: close\r\n\r\nHello World!';
     } else if (method === 'GET' && path === '/json') {
@@ -120,6 +124,14 @@ if (!serverPtr) {
   process.exit(1);
 }
 
+// Optional server options as a JSON argument, e.g. '{"headerTimeout":1000}'.
+const options = process.argv[2];
+if (options) {
+  webs_free_string(
+    webs_server_configure(serverPtr, Buffer.from(options + '\0')),
+  );
+}
+
 let isShuttingDown = false;
 function gracefulShutdown() {
   if (isShuttingDown) return;
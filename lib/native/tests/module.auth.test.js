@@ -17,6 +17,13 @@ const lib = dlopen(libPath, symbols);
 const {
   webs_auth_hash_password,
   webs_auth_verify_password,
+  webs_auth_sweep_sessions,
+  webs_db_open,
+  webs_db_exec,
+  webs_db_query,
+  webs_db_close,
+  webs_json_encode,
+  webs_free_value,
   webs_free_string,
   webs_router_create,
   webs_router_free,
@@ -24,6 +31,7 @@ const {
 } = lib.symbols;
 
 const TEST_API_DB_PATH = resolve(import.meta.dir, '../api_test.db');
+const TEST_SWEEP_DB_PATH = resolve(import.meta.dir, './sweep_test.db');
 
 describe('Webs C Auth Module', () => {
   // ... password hashing and verification tests remain the same
@@ -69,6 +77,82 @@ describe('Webs C Auth Module', () => {
   });
 });
 
+describe('Webs C Session Sweep', () => {
+  let db_handle = null;
+
+  function query(sql) {
+    const resultPtr = webs_db_query(db_handle, Buffer.from(sql + '\0'));
+    const jsonPtr = webs_json_encode(resultPtr);
+    try {
+      return JSON.parse(new CString(jsonPtr).toString());
+    } finally {
+      webs_free_string(jsonPtr);
+      webs_free_value(resultPtr);
+    }
+  }
+
+  beforeAll(() => {
+    if (existsSync(TEST_SWEEP_DB_PATH)) {
+      unlinkSync(TEST_SWEEP_DB_PATH);
+    }
+    db_handle = webs_db_open(Buffer.from(TEST_SWEEP_DB_PATH + '\0'));
+    // The same schema the router's pool creates in its init SQL.
+    webs_free_value(
+      webs_db_exec(
+        db_handle,
+        Buffer.from(
+          'CREATE TABLE sessions (session_id TEXT PRIMARY KEY, ' +
+            'username TEXT, expires_at INTEGER); ' +
+            'CREATE INDEX sessions_expires_at ON sessions (expires_at);\0',
+        ),
+      ),
+    );
+  });
+
+  afterAll(() => {
+    if (db_handle) webs_free_value(webs_db_close(db_handle));
+    if (existsSync(TEST_SWEEP_DB_PATH)) {
+      unlinkSync(TEST_SWEEP_DB_PATH);
+    }
+  });
+
+  test('should delete expired sessions and keep live ones', () => {
+    const now = Math.floor(Date.now() / 1000);
+    const rows = [
+      ['expired-1', now - 3600],
+      ['expired-2', now - 1],
+      ['expired-3', 0],
+      ['live-1', now + 3600],
+      ['live-2', now + 86400],
+    ]
+      .map(([id, expiresAt]) => `('${id}', 'sweeper', ${expiresAt})`)
+      .join(', ');
+    webs_free_value(
+      webs_db_exec(
+        db_handle,
+        Buffer.from(`INSERT INTO sessions VALUES ${rows};\0`),
+      ),
+    );
+
+    expect(webs_auth_sweep_sessions(db_handle)).toBe(true);
+
+    expect(
+      query('SELECT session_id FROM sessions ORDER BY session_id;'),
+    ).toEqual([{ session_id: 'live-1' }, { session_id: 'live-2' }]);
+  });
+
+  test('should find expired sessions through the expires_at index', () => {
+    const plan = query(
+      'EXPLAIN QUERY PLAN SELECT 1 FROM sessions WHERE expires_at <= 0 ' +
+        'LIMIT 1;',
+    );
+    expect(plan.map((row) => row.detail).join('\n')).toInclude(
+      'USING COVERING INDEX sessions_expires_at',
+    );
+  });
+
+});
+
 describe('Webs C Auth API Handlers', () => {
   let routerPtr = null;
 
@@ -241,6 +325,36 @@ describe('Webs C Auth API Handlers', () => {
     );
   });
 
+  test('should forget a cached session on logout', () => {
+    runApiTestRequest({
+      method: 'POST',
+      path: '/register',
+      body: JSON.stringify({ username: 'cachetest', password: 'password' }),
+    });
+    const loginResponse = runApiTestRequest({
+      method: 'POST',
+      path: '/login',
+      body: JSON.stringify({ username: 'cachetest', password: 'password' }),
+    });
+    const cookie = loginResponse.headers['Set-Cookie'].split(';')[0];
+    for (let i = 0; i < 2; i++) {
+      const response = runApiTestRequest({
+        method: 'GET',
+        path: '/users/7',
+        headers: { cookie },
+      });
+      expect(response.body).toInclude('(Authenticated as cachetest)');
+    }
+
+    runApiTestRequest({ method: 'POST', path: '/logout', headers: { cookie } });
+    const response = runApiTestRequest({
+      method: 'GET',
+      path: '/users/7',
+      headers: { cookie },
+    });
+    expect(response.body).toInclude('(Unauthenticated)');
+  });
+
   test('should fail to log in with an incorrect password', () => {
     runApiTestRequest({
       method: 'POST',
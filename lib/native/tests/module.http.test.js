@@ -6,7 +6,13 @@ import { resolve } from 'path';
 const libPath = resolve(import.meta.dir, '../.webs.dylib');
 const lib = dlopen(libPath, symbols);
 
-const { webs_parse_http_request, webs_free_string } = lib.symbols;
+const {
+  webs_parse_http_request,
+  webs_cookie_parse,
+  webs_json_encode,
+  webs_free_value,
+  webs_free_string,
+} = lib.symbols;
 
 function parseHttpRequestWithC(requestString) {
   const requestBuffer = Buffer.from(requestString);
@@ -28,6 +34,20 @@ function parseHttpRequestWithC(requestString) {
   }
 }
 
+function parseCookiesWithC(cookieHeader) {
+  const cookiesPtr = webs_cookie_parse(Buffer.from(cookieHeader + '\0'));
+  try {
+    const jsonPtr = webs_json_encode(cookiesPtr);
+    try {
+      return JSON.parse(new CString(jsonPtr).toString());
+    } finally {
+      webs_free_string(jsonPtr);
+    }
+  } finally {
+    webs_free_value(cookiesPtr);
+  }
+}
+
 describe('Webs C HTTP Request Parser', () => {
   test('should parse a simple GET request', () => {
     const rawRequest =
@@ -135,4 +155,59 @@ describe('Webs C HTTP Request Parser', () => {
     const parsed = parseHttpRequestWithC(rawRequest);
     expect(parsed.headers['host']).toBe('example.com');
   });
+
+  test('should reject control characters in header values', () => {
+    for (const byte of ['\x01', '\x1f', '\x7f', '\r']) {
+      const rawRequest = `GET / HTTP/1.1\r\nX-Test: a${byte}b\r\n\r\n`;
+      expect(() => parseHttpRequestWithC(rawRequest)).toThrow(
+        'Invalid character in header.',
+      );
+    }
+  });
+
+  test('should reject control characters in the request line', () => {
+    const rawRequest = 'GET /\x1b[0m HTTP/1.1\r\nHost: example.com\r\n\r\n';
+    expect(() => parseHttpRequestWithC(rawRequest)).toThrow(
+      'Malformed request line: invalid character.',
+    );
+  });
+
+  test('should allow tabs and non-ASCII bytes in header values', () => {
+    const rawRequest =
+      'GET / HTTP/1.1\r\n' + 'X-Tab: a\tb\r\n' + 'X-Name: caf\u00e9\r\n\r\n';
+    const parsed = parseHttpRequestWithC(rawRequest);
+    expect(parsed.headers['x-tab']).toBe('a\tb');
+    expect(parsed.headers['x-name']).toBe('caf\u00e9');
+  });
+
+  test('should not check the body for control characters', () => {
+    const rawRequest =
+      'POST / HTTP/1.1\r\nContent-Length: 3\r\n\r\n\x01\x7fz';
+    expect(parseHttpRequestWithC(rawRequest).body).toBe('\x01\x7fz');
+  });
+});
+
+describe('Webs C Cookie Parser', () => {
+  test('should split pairs on semicolons and skip leading spaces', () => {
+    expect(parseCookiesWithC('a=1; b=2')).toEqual({ a: '1', b: '2' });
+    expect(parseCookiesWithC('  a=1;   b=2')).toEqual({ a: '1', b: '2' });
+  });
+
+  test('should keep everything after the first equals sign', () => {
+    expect(parseCookiesWithC('token=a=b==')).toEqual({ token: 'a=b==' });
+  });
+
+  test('should skip pairs without an equals sign', () => {
+    expect(parseCookiesWithC('flag; a=1')).toEqual({ a: '1' });
+    expect(parseCookiesWithC('a=1; flag')).toEqual({ a: '1' });
+  });
+
+  test('should skip empty pairs', () => {
+    expect(parseCookiesWithC(';; a=1;;b=2;')).toEqual({ a: '1', b: '2' });
+    expect(parseCookiesWithC('')).toEqual({});
+  });
+
+  test('should keep empty values', () => {
+    expect(parseCookiesWithC('a=;b=2')).toEqual({ a: '', b: '2' });
+  });
 });
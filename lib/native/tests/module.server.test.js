@@ -1,4 +1,8 @@
 import { describe, it, expect, beforeAll, afterAll } from 'bun:test';
+import { connect } from 'net';
+import { mkdtempSync, rmSync, writeFileSync } from 'fs';
+import { tmpdir } from 'os';
+import { join } from 'path';
 
 let serverProcess;
 let serverUrl;
@@ -37,6 +41,34 @@ async function readUntil(stream, condition) {
   });
 }
 
+function sendRaw(url, chunks, delay = 50) {
+  const { hostname, port } = new URL(url);
+  return new Promise((resolve, reject) => {
+    let data = '';
+    const socket = connect({ host: hostname, port: Number(port) }, () => {
+      chunks.forEach((chunk, i) => {
+        setTimeout(() => socket.write(chunk), i * delay);
+      });
+    });
+    socket.setEncoding('utf8');
+    socket.on('data', (chunk) => (data += chunk));
+    socket.on('end', () => resolve(data));
+    socket.on('error', reject);
+  });
+}
+
+async function startServer(args) {
+  const proc = Bun.spawn({
+    cmd: ['bun', 'run', ...args],
+    stdout: 'pipe',
+    stderr: 'pipe',
+  });
+  const stdout = await readUntil(proc.stdout, (text) =>
+    text.includes('Listening on'),
+  );
+  return { proc, url: stdout.match(/http:\/\/[^\s]+/)[0] };
+}
+
 describe('C HTTP Server End-to-End Tests', () => {
   beforeAll(async () => {
     const make = Bun.spawnSync(['make']);
@@ -129,4 +161,467 @@ describe('C HTTP Server End-to-End Tests', () => {
     const text = await response.text();
     expect(text).toBe('Not Found');
   });
+
+  it('should assemble a request delivered across partial writes', async () => {
+    const raw = await sendRaw(serverUrl, [
+      'POST /echo HTTP/1.1\r\nHost: localhost\r\nContent-Length: 10\r\n\r\n12345',
+      '67890',
+    ]);
+    expect(raw).toStartWith('HTTP/1.1 200 OK');
+    expect(raw).toEndWith('1234567890');
+  });
+
+  it('should accept request bodies larger than the head limit', async () => {
+    const payload = 'x'.repeat(100 * 1024);
+    const res = await fetch(`${serverUrl}/echo`, {
+      method: 'POST',
+      body: payload,
+    });
+    expect(res.status).toBe(200);
+    expect(await res.text()).toBe(payload);
+  });
+
+  it('should decode a chunked request body', async () => {
+    const raw = await sendRaw(serverUrl, [
+      'POST /echo HTTP/1.1\r\nHost: localhost\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhel',
+      'lo\r\n7;ext=1\r\n, world\r\n',
+      '0\r\nX-Trailer: ignored\r\n\r\n',
+    ]);
+    expect(raw).toStartWith('HTTP/1.1 200 OK');
+    expect(raw).toEndWith('hello, world');
+  });
+
+  it('should reject a body larger than the body limit', async () => {
+    const raw = await sendRaw(serverUrl, [
+      `POST /echo HTTP/1.1\r\nContent-Length: ${64 * 1024 * 1024}\r\n\r\n`,
+    ]);
+    expect(raw).toStartWith('HTTP/1.1 413');
+  });
+
+  it('should reject a request head larger than the request limit', async () => {
+    const raw = await sendRaw(serverUrl, [
+      `GET / HTTP/1.1\r\nX-Padding: ${'a'.repeat(9000)}\r\n\r\n`,
+    ]);
+    expect(raw).toStartWith('HTTP/1.1 413');
+  });
+
+  it('should serve pipelined requests on one keep-alive connection', async () => {
+    const request = 'GET /keep-alive HTTP/1.1\r\nHost: localhost\r\n\r\n';
+    const raw = await sendRaw(serverUrl, [
+      request +
+        request +
+        'GET /keep-alive HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n',
+    ]);
+    expect(raw.match(/HTTP\/1\.1 200 OK/g).length).toBe(3);
+    expect(raw.match(/Connection: keep-alive/g).length).toBe(2);
+    expect(raw).toInclude('Connection: close');
+  });
+
+  it('should close HTTP/1.0 connections without a keep-alive request', async () => {
+    const raw = await sendRaw(serverUrl, ['GET /keep-alive HTTP/1.0\r\n\r\n']);
+    expect(raw).toInclude('Connection: close');
+    expect(raw).toEndWith('keep-alive');
+  });
+});
+
+describe('C HTTP Server on io_uring', () => {
+  let ringProcess;
+  let ringUrl;
+
+  beforeAll(async () => {
+    // Kernels without io_uring fall back to epoll, so this runs everywhere.
+    ringProcess = Bun.spawn({
+      cmd: [
+        'bun',
+        'run',
+        'tests/helpers/test-server.js',
+        '{"ioBackend":"io_uring"}',
+      ],
+      stdout: 'pipe',
+      stderr: 'pipe',
+    });
+    const stdout = await readUntil(ringProcess.stdout, (text) =>
+      text.includes('Listening on'),
+    );
+    ringUrl = stdout.match(/http:\/\/[^\s]+/)[0];
+  });
+
+  afterAll(() => {
+    ringProcess.kill();
+  });
+
+  it('should echo request bodies', async () => {
+    const payload = 'x'.repeat(100 * 1024);
+    const res = await fetch(`${ringUrl}/echo`, {
+      method: 'POST',
+      body: payload,
+    });
+    expect(res.status).toBe(200);
+    expect(await res.text()).toBe(payload);
+  });
+
+  it('should serve pipelined requests and close when asked', async () => {
+    const request = 'GET /keep-alive HTTP/1.1\r\nHost: localhost\r\n\r\n';
+    const raw = await sendRaw(ringUrl, [
+      request +
+        request +
+        'GET /keep-alive HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n',
+    ]);
+    expect(raw.match(/HTTP\/1\.1 200 OK/g).length).toBe(3);
+    expect(raw).toInclude('Connection: close');
+  });
+
+  it('should assemble a chunked body delivered across writes', async () => {
+    const raw = await sendRaw(ringUrl, [
+      'POST /echo HTTP/1.1\r\nHost: localhost\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhel',
+      'lo\r\n0\r\n\r\n',
+    ]);
+    expect(raw).toStartWith('HTTP/1.1 200 OK');
+    expect(raw).toEndWith('hello');
+  });
+});
+
+describe('C HTTP Server on several workers', () => {
+  let server;
+
+  beforeAll(async () => {
+    server = await startServer([
+      'tests/helpers/native-server-runner.js',
+      '{"workers":4}',
+    ]);
+  });
+
+  afterAll(() => {
+    server.proc.kill();
+  });
+
+  it('should handle multiple concurrent requests', async () => {
+    const bodies = Array.from({ length: 20 }, (_, i) => `Request ${i}`);
+    const texts = await Promise.all(
+      bodies.map(async (body) => {
+        const response = await fetch(`${server.url}/echo`, {
+          method: 'POST',
+          body,
+        });
+        expect(response.status).toBe(200);
+        return response.text();
+      }),
+    );
+    expect(texts).toEqual(bodies);
+  });
+
+  it('should serve pipelined requests on one connection', async () => {
+    const raw = await sendRaw(server.url, [
+      'GET /first HTTP/1.1\r\n\r\n' +
+        'GET /second HTTP/1.1\r\n\r\n' +
+        'GET /third HTTP/1.1\r\nConnection: close\r\n\r\n',
+    ]);
+    expect(raw.match(/HTTP\/1\.1 200 OK/g).length).toBe(3);
+    expect(raw.match(/Connection: keep-alive/g).length).toBe(2);
+    expect(raw.indexOf('/first')).toBeLessThan(raw.indexOf('/second'));
+    expect(raw.indexOf('/second')).toBeLessThan(raw.indexOf('/third'));
+  });
+});
+
+describe('C HTTP Server with a handler pool', () => {
+  let server;
+
+  beforeAll(async () => {
+    server = await startServer([
+      'tests/helpers/native-server-runner.js',
+      '{"handlerThreads":2,"handlerQueueSize":1}',
+    ]);
+  });
+
+  afterAll(() => {
+    server.proc.kill();
+  });
+
+  it('should answer pipelined requests in order', async () => {
+    const raw = await sendRaw(server.url, [
+      'GET /sleep/100 HTTP/1.1\r\n\r\n' +
+        'GET /second HTTP/1.1\r\n\r\n' +
+        'GET /third HTTP/1.1\r\nConnection: close\r\n\r\n',
+    ]);
+    expect(raw.match(/HTTP\/1\.1 200 OK/g).length).toBe(3);
+    expect(raw.indexOf('/sleep/100')).toBeLessThan(raw.indexOf('/second'));
+    expect(raw.indexOf('/second')).toBeLessThan(raw.indexOf('/third'));
+  });
+
+  it('should shed requests beyond the queue with 503', async () => {
+    const request = 'GET /sleep/300 HTTP/1.1\r\nConnection: close\r\n\r\n';
+    const responses = await Promise.all(
+      Array.from({ length: 8 }, () => sendRaw(server.url, [request])),
+    );
+    const shed = responses.filter((raw) =>
+      raw.startsWith('HTTP/1.1 503 Service Unavailable'),
+    );
+    expect(shed.length).toBeGreaterThan(0);
+    expect(shed.length).toBeLessThan(responses.length);
+    for (const raw of shed) {
+      expect(raw).toInclude('Retry-After: 1');
+    }
+  });
+});
+
+for (const backend of ['epoll', 'io_uring']) {
+  describe(`C HTTP Server deadlines on ${backend}`, () => {
+    let server;
+
+    beforeAll(async () => {
+      server = await startServer([
+        'tests/helpers/test-server.js',
+        JSON.stringify({
+          headerTimeout: 200,
+          bodyTimeout: 200,
+          keepAliveTimeout: 200,
+          ioBackend: backend,
+        }),
+      ]);
+    });
+
+    afterAll(() => {
+      server.proc.kill();
+    });
+
+    it('should time out a head that trickles in', async () => {
+      // Each line lands before a per-read deadline would, but the head's
+      // deadline runs from its first byte.
+      const raw = await sendRaw(
+        server.url,
+        ['GET /keep-alive HTTP/1.1\r\n', 'X-Slow: 1\r\n', 'X-Slow: 2\r\n'],
+        150,
+      );
+      expect(raw).toStartWith('HTTP/1.1 408 Request Timeout');
+    });
+
+    it('should time out a body that stops partway', async () => {
+      const raw = await sendRaw(server.url, [
+        'POST /echo HTTP/1.1\r\nContent-Length: 10\r\n\r\n12345',
+      ]);
+      expect(raw).toStartWith('HTTP/1.1 408 Request Timeout');
+    });
+
+    it('should close an idle keep-alive connection', async () => {
+      const started = Date.now();
+      const raw = await sendRaw(server.url, [
+        'GET /keep-alive HTTP/1.1\r\n\r\n',
+      ]);
+      expect(raw).toInclude('Connection: keep-alive');
+      expect(raw).toEndWith('keep-alive');
+      expect(Date.now() - started).toBeLessThan(2000);
+    });
+  });
+}
+
+describe('C HTTP Server request arenas', () => {
+  // Forty requests of growing size on one connection, so each one reuses
+  // the arena the last one reset, then the heap counts they all updated.
+  async function visitAndCount(url) {
+    let requests = '';
+    for (let i = 0; i < 40; i++) {
+      requests += `GET /visit/${i}-${'x'.repeat(i * 97)} HTTP/1.1\r\n\r\n`;
+    }
+    const raw = await sendRaw(url, [
+      requests + 'GET /visits HTTP/1.1\r\nConnection: close\r\n\r\n',
+    ]);
+    expect(raw.match(/HTTP\/1\.1 200 OK/g).length).toBe(41);
+    for (let i = 0; i < 40; i++) {
+      expect(raw).toInclude(`/visit/${i}-`);
+    }
+    return JSON.parse(raw.slice(raw.lastIndexOf('\r\n\r\n') + 4));
+  }
+
+  for (const [mode, options] of [
+    ['inline', '{}'],
+    ['on the handler pool', '{"handlerThreads":2,"handlerQueueSize":64}'],
+  ]) {
+    it(`should keep heap values touched by requests run ${mode}`, async () => {
+      const { proc, url } = await startServer([
+        'tests/helpers/native-server-runner.js',
+        options,
+      ]);
+      try {
+        const visits = await visitAndCount(url);
+        const paths = Object.keys(visits).filter((path) =>
+          path.startsWith('/visit/'),
+        );
+        expect(paths.length).toBe(40);
+        expect(paths.every((path) => visits[path] === 1)).toBe(true);
+      } finally {
+        proc.kill();
+      }
+    });
+  }
+});
+
+describe('C Static File Server', () => {
+  let staticProcess;
+  let staticUrl;
+  let publicDir;
+  const binary = Uint8Array.from({ length: 70000 }, (_, i) => i % 256);
+
+  beforeAll(async () => {
+    publicDir = mkdtempSync(join(tmpdir(), 'webs-static-'));
+    writeFileSync(join(publicDir, 'index.html'), '<h1>Home</h1>');
+    writeFileSync(join(publicDir, 'data.bin'), binary);
+    writeFileSync(join(publicDir, 'app.css'), 'body{}');
+
+    staticProcess = Bun.spawn({
+      cmd: ['bun', 'run', 'tests/helpers/static-server-runner.js', publicDir],
+      stdout: 'pipe',
+      stderr: 'pipe',
+    });
+    const stdout = await readUntil(staticProcess.stdout, (text) =>
+      text.includes('Listening on'),
+    );
+    staticUrl = stdout.match(/http:\/\/[^\s]+/)[0];
+  });
+
+  afterAll(() => {
+    staticProcess.kill();
+    rmSync(publicDir, { recursive: true, force: true });
+  });
+
+  it('should serve index.html with an HTML content type', async () => {
+    const response = await fetch(`${staticUrl}/`);
+    expect(response.status).toBe(200);
+    expect(response.headers.get('Content-Type')).toContain('text/html');
+    expect(await response.text()).toBe('<h1>Home</h1>');
+  });
+
+  it('should serve binary files intact', async () => {
+    const response = await fetch(`${staticUrl}/data.bin`);
+    expect(response.headers.get('Content-Length')).toBe(String(binary.length));
+    const body = new Uint8Array(await response.arrayBuffer());
+    expect(body).toEqual(binary);
+  });
+
+  it('should answer byte range requests', async () => {
+    const response = await fetch(`${staticUrl}/data.bin`, {
+      headers: { Range: 'bytes=256-511' },
+    });
+    expect(response.status).toBe(206);
+    expect(response.headers.get('Content-Range')).toBe(
+      `bytes 256-511/${binary.length}`,
+    );
+    const body = new Uint8Array(await response.arrayBuffer());
+    expect(body).toEqual(binary.slice(256, 512));
+
+    const unsatisfiable = await fetch(`${staticUrl}/data.bin`, {
+      headers: { Range: 'bytes=999999-' },
+    });
+    expect(unsatisfiable.status).toBe(416);
+  });
+
+  it('should send the whole file when If-Range does not match', async () => {
+    const first = await fetch(`${staticUrl}/data.bin`);
+    await first.arrayBuffer();
+    const etag = first.headers.get('ETag');
+    const lastModified = first.headers.get('Last-Modified');
+    const rangeWith = (ifRange) =>
+      fetch(`${staticUrl}/data.bin`, {
+        headers: { Range: 'bytes=256-511', 'If-Range': ifRange },
+      });
+
+    for (const current of [etag, lastModified]) {
+      const partial = await rangeWith(current);
+      expect(partial.status).toBe(206);
+      expect(new Uint8Array(await partial.arrayBuffer())).toEqual(
+        binary.slice(256, 512),
+      );
+    }
+
+    // A weak tag never matches, and a date must be the exact one.
+    for (const stale of [
+      '"stale"',
+      `W/${etag}`,
+      'Mon, 01 Jan 2001 00:00:00 GMT',
+    ]) {
+      const full = await rangeWith(stale);
+      expect(full.status).toBe(200);
+      expect(full.headers.get('Content-Range')).toBeNull();
+      expect(new Uint8Array(await full.arrayBuffer())).toEqual(binary);
+    }
+  });
+
+  it('should revalidate with ETag and Last-Modified', async () => {
+    const first = await fetch(`${staticUrl}/app.css`);
+    const etag = first.headers.get('ETag');
+    const lastModified = first.headers.get('Last-Modified');
+    expect(etag).toMatch(/^"[0-9a-f]+"$/);
+    expect(first.headers.get('Cache-Control')).toBe('no-cache');
+
+    const byTag = await fetch(`${staticUrl}/app.css`, {
+      headers: { 'If-None-Match': etag },
+    });
+    expect(byTag.status).toBe(304);
+    expect(await byTag.text()).toBe('');
+
+    const byDate = await fetch(`${staticUrl}/app.css`, {
+      headers: { 'If-Modified-Since': lastModified },
+    });
+    expect(byDate.status).toBe(304);
+
+    writeFileSync(join(publicDir, 'app.css'), 'body{color:red}');
+    const changed = await fetch(`${staticUrl}/app.css`, {
+      headers: { 'If-None-Match': etag },
+    });
+    expect(changed.status).toBe(200);
+    expect(await changed.text()).toBe('body{color:red}');
+  });
+
+  it('should mark fingerprinted assets immutable', async () => {
+    writeFileSync(join(publicDir, 'bundle.3f9a2c1b.js'), 'x');
+    const response = await fetch(`${staticUrl}/bundle.3f9a2c1b.js`);
+    expect(response.headers.get('Cache-Control')).toContain('immutable');
+  });
+
+  it('should negotiate precompressed variants', async () => {
+    const css = 'body { margin: 0; }\n'.repeat(100);
+    writeFileSync(join(publicDir, 'site.css'), css);
+    writeFileSync(join(publicDir, 'site.css.gz'), Bun.gzipSync(css));
+
+    const gzipped = await sendRaw(staticUrl, [
+      'GET /site.css HTTP/1.1\r\nAccept-Encoding: gzip, br\r\n' +
+        'Connection: close\r\n\r\n',
+    ]);
+    expect(gzipped).toInclude('Content-Encoding: gzip');
+    expect(gzipped).toInclude('Vary: Accept-Encoding');
+
+    const plain = await sendRaw(staticUrl, [
+      'GET /site.css HTTP/1.1\r\nConnection: close\r\n\r\n',
+    ]);
+    expect(plain).not.toInclude('Content-Encoding');
+    expect(plain).toInclude('Vary: Accept-Encoding');
+    expect(plain).toEndWith(css);
+  });
+
+  it('should ignore a sidecar older than its source', async () => {
+    writeFileSync(join(publicDir, 'fresh.css'), 'old{}'.repeat(100));
+    writeFileSync(
+      join(publicDir, 'fresh.css.gz'),
+      Bun.gzipSync('old{}'.repeat(100)),
+    );
+    // Well inside the same second, but past the clock's granularity.
+    Bun.sleepSync(20);
+    const css = 'new{}'.repeat(100);
+    writeFileSync(join(publicDir, 'fresh.css'), css);
+
+    const raw = await sendRaw(staticUrl, [
+      'GET /fresh.css HTTP/1.1\r\nAccept-Encoding: gzip\r\n' +
+        'Connection: close\r\n\r\n',
+    ]);
+    expect(raw).not.toInclude('Content-Encoding');
+    expect(raw).toEndWith(css);
+  });
+
+  it('should reject path traversal and report missing files', async () => {
+    const traversal = await sendRaw(staticUrl, [
+      'GET /%2e%2e/secret HTTP/1.1\r\nConnection: close\r\n\r\n',
+    ]);
+    expect(traversal).toStartWith('HTTP/1.1 400');
+    const missing = await fetch(`${staticUrl}/missing.js`);
+    expect(missing.status).toBe(404);
+  });
 });
@@ -1,4 +1,11 @@
-import { test, expect, describe, beforeAll, afterAll } from 'bun:test';
+import {
+  test,
+  expect,
+  describe,
+  beforeAll,
+  afterAll,
+  beforeEach,
+} from 'bun:test';
 import { symbols } from '../bindings.js';
 import { dlopen, CString } from 'bun:ffi';
 import { resolve } from 'path';
@@ -15,9 +22,13 @@ const {
   webs_json_encode,
   webs_free_value,
   webs_free_string,
+  webs_test_db_write_async,
+  webs_test_db_pool,
 } = lib.symbols;
 
 const TEST_DB_PATH = resolve(import.meta.dir, './test.db');
+const WRITER_DB_PATH = resolve(import.meta.dir, './writer.db');
+const POOL_DB_PATH = resolve(import.meta.dir, './pool.db');
 
 function cValueToJs(valuePtr) {
   if (!valuePtr || valuePtr.ptr === 0) {
@@ -142,6 +153,14 @@ describe('Webs C SQLite Module', () => {
     expect(result).toEqual([{ i: 123, f: 45.67, t: 'test string', n: null }]);
   });
 
+  test('should read integers wider than 32 bits', () => {
+    const selectSql = Buffer.from(
+      'SELECT 3000000000 AS big, -3000000000 AS negative;\0',
+    );
+    const result = cValueToJs(webs_db_query(db_handle, selectSql));
+    expect(result).toEqual([{ big: 3000000000, negative: -3000000000 }]);
+  });
+
   test('should fail gracefully when operating on a closed handle', () => {
     const memDbPath = Buffer.from(':memory:\0');
     const mem_db_handle = webs_db_open(memDbPath);
@@ -196,3 +215,155 @@ describe('Webs C SQLite Module', () => {
     ]);
   });
 });
+
+describe('Webs C SQLite single writer', () => {
+  const removeDatabase = () => {
+    for (const suffix of ['', '-wal', '-shm']) {
+      if (existsSync(WRITER_DB_PATH + suffix)) {
+        unlinkSync(WRITER_DB_PATH + suffix);
+      }
+    }
+  };
+
+  // Queues the statements without waiting and reports, for each, what its
+  // callback got and how many rows were committed when it ran.
+  const writeAsync = (statements) => {
+    const resultPtr = webs_test_db_write_async(
+      Buffer.from(WRITER_DB_PATH + '\0'),
+      Buffer.from(JSON.stringify(statements) + '\0'),
+      Buffer.from('SELECT count(*) AS n FROM entries;\0'),
+    );
+    try {
+      return JSON.parse(new CString(resultPtr).toString()).map((write) => ({
+        ok: write.ok,
+        error: write.error,
+        seen: write.seen?.[0]?.n,
+      }));
+    } finally {
+      webs_free_string(resultPtr);
+    }
+  };
+
+  const insert = (value) => {
+    const literal = value === null ? 'NULL' : `'${value}'`;
+    return `INSERT INTO entries (v) VALUES (${literal})`;
+  };
+
+  beforeAll(() => {
+    removeDatabase();
+    const handle = webs_db_open(Buffer.from(WRITER_DB_PATH + '\0'));
+    cValueToJs(
+      webs_db_exec(
+        handle,
+        Buffer.from('CREATE TABLE entries (v TEXT NOT NULL UNIQUE);\0'),
+      ),
+    );
+    expect(cValueToJs(webs_db_close(handle))).toBe(true);
+  });
+
+  afterAll(removeDatabase);
+
+  test('should commit concurrent writes together', () => {
+    const writes = writeAsync(
+      Array.from({ length: 10 }, (_, i) => insert(`batch-${i}`)),
+    );
+    expect(writes.every((write) => write.ok)).toBe(true);
+    // One commit per write would have each callback see one more row.
+    expect(new Set(writes.map((write) => write.seen)).size).toBeLessThan(
+      writes.length,
+    );
+    expect(writes[writes.length - 1].seen).toBe(10);
+  });
+
+  test('should not roll back the batch for one failing write', () => {
+    const writes = writeAsync([
+      insert('kept-1'),
+      insert(null),
+      insert('kept-2'),
+    ]);
+    expect(writes.map((write) => write.ok)).toEqual([true, false, true]);
+    expect(writes[0].seen).toBe(writes[2].seen);
+
+    const handle = webs_db_open(Buffer.from(WRITER_DB_PATH + '\0'));
+    const rows = cValueToJs(
+      webs_db_query(
+        handle,
+        Buffer.from("SELECT v FROM entries WHERE v LIKE 'kept-%';\0"),
+      ),
+    );
+    cValueToJs(webs_db_close(handle));
+    expect(rows).toEqual([{ v: 'kept-1' }, { v: 'kept-2' }]);
+  });
+
+  test('should pass each write its own status', () => {
+    const writes = writeAsync([insert('status'), insert('status')]);
+    expect(writes[0]).toMatchObject({ ok: true, error: null });
+    expect(writes[1].ok).toBe(false);
+    expect(writes[1].error).toInclude('UNIQUE constraint failed');
+  });
+});
+
+describe('Webs C SQLite connection pool', () => {
+  const INIT_SQL =
+    'CREATE TABLE IF NOT EXISTS init_runs (n INTEGER); ' +
+    'INSERT INTO init_runs VALUES (1);';
+
+  const removeDatabase = () => {
+    for (const suffix of ['', '-wal', '-shm']) {
+      if (existsSync(POOL_DB_PATH + suffix)) {
+        unlinkSync(POOL_DB_PATH + suffix);
+      }
+    }
+  };
+
+  // Runs a pool through checkouts and releases on the C side; see
+  // webs_test_db_pool.
+  const runPool = (maxConnections, singleWriter) => {
+    const resultPtr = webs_test_db_pool(
+      Buffer.from(POOL_DB_PATH + '\0'),
+      Buffer.from(INIT_SQL + '\0'),
+      maxConnections,
+      singleWriter,
+    );
+    try {
+      return JSON.parse(new CString(resultPtr).toString());
+    } finally {
+      webs_free_string(resultPtr);
+    }
+  };
+
+  const countInitRuns = () => {
+    const handle = webs_db_open(Buffer.from(POOL_DB_PATH + '\0'));
+    const rows = cValueToJs(
+      webs_db_query(handle, Buffer.from('SELECT n FROM init_runs;\0')),
+    );
+    cValueToJs(webs_db_close(handle));
+    return rows.length;
+  };
+
+  beforeEach(removeDatabase);
+  afterAll(removeDatabase);
+
+  test('should run the init SQL once per pool', () => {
+    expect(runPool(4, false).connections).toBe(4);
+    expect(countInitRuns()).toBe(1);
+    runPool(2, false);
+    expect(countInitRuns()).toBe(2);
+  });
+
+  test('should hand a released connection out again', () => {
+    expect(runPool(3, false).reused).toBe(true);
+  });
+
+  test('should make a checkout wait while the pool is exhausted', () => {
+    for (const maxConnections of [1, 3]) {
+      expect(runPool(maxConnections, false).waited).toBe(true);
+    }
+  });
+
+  test('should use WAL only for a single-writer pool', () => {
+    expect(runPool(2, false).journalMode).toBe('delete');
+    removeDatabase();
+    expect(runPool(2, true).journalMode).toBe('wal');
+  });
+});